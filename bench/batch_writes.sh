@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# keys per second written or deleted through mset, mdel and mseize as the
+# number of keys per request grows, against set, del and seize one key at
+# a time.
+#
+# usage: bench/batch_writes.sh <build dir> [seconds] [connections]
+#
+# runs <build dir>/reveldb from a scratch directory holding a copy of
+# conf/ and drives it with rpc_load at 1, 10, 100 and 1000 keys per
+# request.
+
+set -e
+
+BUILD=${1:?usage: $0 <build dir> [seconds] [connections]}
+SECONDS_PER_RUN=${2:-5}
+CONNECTIONS=${3:-4}
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$(cd "$BUILD" && pwd)
+WORK=$(mktemp -d /tmp/reveldb-batch.XXXXXX)
+PORT=8087
+PID=
+
+trap 'kill $PID 2>/dev/null || true; rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/logs"
+cp -r "$SRC/conf" "$WORK/"
+sed -e "s|\"datadir\": *\"[^\"]*\"|\"datadir\": \"$WORK/data/\"|" \
+    -e "s|\"pidfile\": *\"[^\"]*\"|\"pidfile\": \"$WORK/reveldb.pid\"|" \
+    -e "s|\"https\": *true|\"https\": false|" \
+    "$SRC/conf/reveldb.json" > "$WORK/conf/reveldb.json"
+
+(cd "$WORK" && exec "$BUILD/reveldb" > "$WORK/reveldb.out" 2>&1) &
+PID=$!
+sleep 1
+
+"$BUILD/rpc_load" -p $PORT -m set -c 1 -d 1 -n 20000 -P > /dev/null
+
+for MODE in set del seize; do
+    "$BUILD/rpc_load" -p $PORT -m $MODE -c "$CONNECTIONS" \
+        -d "$SECONDS_PER_RUN" -n 20000
+done
+for KEYS in 10 100 1000; do
+    for MODE in mset mdel mseize; do
+        "$BUILD/rpc_load" -p $PORT -m $MODE -c "$CONNECTIONS" -k $KEYS \
+            -d "$SECONDS_PER_RUN" -n 20000
+    done
+done
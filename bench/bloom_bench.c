@@ -0,0 +1,250 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  bloom_bench.c
+ *
+ *    Description:  point lookups of missing and present keys on a compacted
+ *                  leveldb, with and without a bloom filter policy, opened
+ *                  the way xleveldb_instance_init() opens a database.
+ *
+ * =============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <leveldb/c.h>
+
+typedef struct bloom_config_s_ {
+    const char *dir;
+    unsigned long long keys;
+    unsigned long long lookups;
+    size_t cache_size;
+} bloom_config_t;
+
+typedef struct bloom_db_s_ {
+    leveldb_t *db;
+    leveldb_cache_t *cache;
+    leveldb_filterpolicy_t *filterpolicy;
+    leveldb_options_t *options;
+    leveldb_readoptions_t *roptions;
+    leveldb_writeoptions_t *woptions;
+} bloom_db_t;
+
+static unsigned long long
+_bloom_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+_bloom_check(char *err, const char *what)
+{
+    if (err == NULL) return 0;
+    fprintf(stderr, "failed to %s: %s.\n", what, err);
+    leveldb_free(err);
+    return -1;
+}
+
+/* bits is bloom_bits_per_key, 0 opens the database without filters. */
+static int
+_bloom_open(bloom_db_t *bdb, const bloom_config_t *config,
+        const char *name, unsigned int bits)
+{
+    char *err = NULL;
+
+    bdb->cache = leveldb_cache_create_lru(config->cache_size);
+    bdb->filterpolicy = (bits > 0) ?
+        leveldb_filterpolicy_create_bloom(bits) : NULL;
+    bdb->options = leveldb_options_create();
+    leveldb_options_set_create_if_missing(bdb->options, 1);
+    leveldb_options_set_cache(bdb->options, bdb->cache);
+    leveldb_options_set_compression(bdb->options, leveldb_no_compression);
+    if (bdb->filterpolicy != NULL) {
+        leveldb_options_set_filter_policy(bdb->options, bdb->filterpolicy);
+    }
+    bdb->roptions = leveldb_readoptions_create();
+    leveldb_readoptions_set_fill_cache(bdb->roptions, 1);
+    bdb->woptions = leveldb_writeoptions_create();
+    bdb->db = leveldb_open(bdb->options, name, &err);
+    return _bloom_check(err, "open the database");
+}
+
+static void
+_bloom_close(bloom_db_t *bdb)
+{
+    if (bdb->db != NULL) leveldb_close(bdb->db);
+    leveldb_writeoptions_destroy(bdb->woptions);
+    leveldb_readoptions_destroy(bdb->roptions);
+    leveldb_options_destroy(bdb->options);
+    if (bdb->filterpolicy != NULL) {
+        leveldb_filterpolicy_destroy(bdb->filterpolicy);
+    }
+    leveldb_cache_destroy(bdb->cache);
+}
+
+/* the even keys go in, the odd ones in between are the missing keys. */
+static int
+_bloom_fill(bloom_db_t *bdb, const bloom_config_t *config)
+{
+    leveldb_writebatch_t *batch = leveldb_writebatch_create();
+    char key[32];
+    char value[100];
+    char *err = NULL;
+    unsigned long long i = 0;
+    int len = 0;
+
+    memset(value, 'v', sizeof(value));
+    for (i = 0; i < config->keys; i++) {
+        len = snprintf(key, sizeof(key), "key%012llu", i * 2);
+        leveldb_writebatch_put(batch, key, len, value, sizeof(value));
+        if ((i + 1) % 1000 == 0 || i + 1 == config->keys) {
+            leveldb_write(bdb->db, bdb->woptions, batch, &err);
+            leveldb_writebatch_clear(batch);
+            if (_bloom_check(err, "write the keys") != 0) break;
+        }
+    }
+    leveldb_writebatch_destroy(batch);
+    if (err != NULL) return -1;
+    /* lookups go to the tables, not the memtable. */
+    leveldb_compact_range(bdb->db, NULL, 0, NULL, 0);
+    return 0;
+}
+
+/* nanoseconds per lookup of random keys, odd for missing ones. */
+static double
+_bloom_lookups(bloom_db_t *bdb, const bloom_config_t *config, int odd,
+        unsigned long long *found)
+{
+    unsigned long long seed = 0x9e3779b97f4a7c15ULL;
+    unsigned long long begin = _bloom_now();
+    unsigned long long i = 0;
+    char key[32];
+    char *value = NULL;
+    char *err = NULL;
+    size_t value_len = 0;
+    int len = 0;
+
+    *found = 0;
+    for (i = 0; i < config->lookups; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        len = snprintf(key, sizeof(key), "key%012llu",
+                (seed % config->keys) * 2 + (odd ? 1 : 0));
+        value = leveldb_get(bdb->db, bdb->roptions, key, len,
+                &value_len, &err);
+        if (_bloom_check(err, "look a key up") != 0) return -1;
+        if (value != NULL) {
+            (*found)++;
+            leveldb_free(value);
+        }
+    }
+    return (double)(_bloom_now() - begin) / config->lookups;
+}
+
+static int
+_bloom_run(const bloom_config_t *config, unsigned int bits)
+{
+    bloom_db_t bdb;
+    char name[1024];
+    char *err = NULL;
+    unsigned long long found = 0;
+    double missing = 0;
+    double present = 0;
+
+    snprintf(name, sizeof(name), "%s/bits-%u", config->dir, bits);
+    memset(&bdb, 0, sizeof(bdb));
+    if (_bloom_open(&bdb, config, name, bits) != 0
+            || _bloom_fill(&bdb, config) != 0) {
+        _bloom_close(&bdb);
+        return -1;
+    }
+    _bloom_close(&bdb);
+
+    /* reopened with a cold block cache. */
+    memset(&bdb, 0, sizeof(bdb));
+    if (_bloom_open(&bdb, config, name, bits) != 0) {
+        _bloom_close(&bdb);
+        return -1;
+    }
+    missing = _bloom_lookups(&bdb, config, 1, &found);
+    if (missing >= 0 && found != 0) {
+        fprintf(stderr, "found %llu keys that were never written.\n", found);
+        missing = -1;
+    }
+    if (missing >= 0) present = _bloom_lookups(&bdb, config, 0, &found);
+    if (present >= 0 && found != config->lookups) {
+        fprintf(stderr, "found %llu of %llu keys written.\n", found,
+                config->lookups);
+        present = -1;
+    }
+    _bloom_close(&bdb);
+    bdb.options = leveldb_options_create();
+    leveldb_destroy_db(bdb.options, name, &err);
+    leveldb_options_destroy(bdb.options);
+    if (err != NULL) leveldb_free(err);
+    if (missing < 0 || present < 0) return -1;
+
+    printf("bloom_bits_per_key=%-3u missing %8.1fns  present %8.1fns  "
+            "per lookup\n", bits, missing, present);
+    return 0;
+}
+
+static void
+_bloom_usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-d dir] [-n keys] [-l lookups] [-c cache bytes]\n"
+            "       [bits per key ...]\n"
+            "\n"
+            "  bits per key default to 0 (no filter) and 10.\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    bloom_config_t config;
+    unsigned int bits[] = { 0, 10 };
+    int opt = 0;
+    int i = 0;
+
+    config.dir = "/tmp";
+    config.keys = 1000000;
+    config.lookups = 200000;
+    config.cache_size = 8 * 1024 * 1024;
+
+    while ((opt = getopt(argc, argv, "d:n:l:c:h")) != -1) {
+        switch (opt) {
+            case 'd': config.dir = optarg; break;
+            case 'n': config.keys = strtoull(optarg, NULL, 10); break;
+            case 'l': config.lookups = strtoull(optarg, NULL, 10); break;
+            case 'c': config.cache_size = strtoull(optarg, NULL, 10); break;
+            default:
+                _bloom_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (config.keys == 0 || config.lookups == 0) {
+        _bloom_usage(argv[0]);
+        return 1;
+    }
+
+    printf("%llu keys, %llu lookups, %zu bytes of block cache\n",
+            config.keys, config.lookups, config.cache_size);
+    if (optind < argc) {
+        for (i = optind; i < argc; i++) {
+            if (_bloom_run(&config, atoi(argv[i])) != 0) return 1;
+        }
+    } else {
+        for (i = 0; i < (int)(sizeof(bits) / sizeof(bits[0])); i++) {
+            if (_bloom_run(&config, bits[i]) != 0) return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  regex_bench.c
+ *
+ *    Description:  value regex matching of the scans, engine=dfa against
+ *                  engine=gnu, over a corpus of json documents.
+ *
+ * =============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pattern.h"
+
+typedef struct regex_corpus_s_ {
+    char **values;
+    size_t *lens;
+    unsigned int count;
+} regex_corpus_t;
+
+/* the patterns the scans are timed with, unless given on the command
+ * line: a literal past a repetition, a class past one, a number past
+ * one, and an anchored prefix. */
+static const char *regex_patterns[] = {
+    ".*\"status\":\"error\"",
+    ".*s0000[0-9]",
+    ".*\"qty\":9",
+    "\\{\"id\":[0-9]+,\"user\":\"u7",
+    NULL
+};
+
+static unsigned long long
+_regex_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int
+_regex_rand(unsigned long long *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return (unsigned int)(*seed >> 32);
+}
+
+/* count json orders of about size bytes, one in 16 with an error status,
+ * their items naming skus and quantities at random. */
+static int
+_regex_corpus_init(regex_corpus_t *corpus, unsigned int count, size_t size)
+{
+    unsigned long long seed = 0x9e3779b97f4a7c15ULL;
+    unsigned int i = 0;
+    size_t len = 0;
+    char *value = NULL;
+
+    corpus->values = (char **)calloc(count, sizeof(char *));
+    corpus->lens = (size_t *)calloc(count, sizeof(size_t));
+    if (corpus->values == NULL || corpus->lens == NULL) return -1;
+    corpus->count = count;
+    for (i = 0; i < count; i++) {
+        if ((value = (char *)malloc(size + 128)) == NULL) return -1;
+        len = sprintf(value, "{\"id\":%u,\"user\":\"u%u\",\"items\":[", i,
+                _regex_rand(&seed) % 1000);
+        while (len < size) {
+            len += sprintf(value + len, "%s{\"sku\":\"s%05u\",\"qty\":%u}",
+                    (value[len - 1] == '[') ? "" : ",",
+                    _regex_rand(&seed) % 100000, _regex_rand(&seed) % 9);
+        }
+        len += sprintf(value + len, "],\"status\":\"%s\"}",
+                (_regex_rand(&seed) % 16 == 0) ? "error" : "ok");
+        corpus->values[i] = value;
+        corpus->lens[i] = len;
+    }
+    return 0;
+}
+
+static void
+_regex_corpus_free(regex_corpus_t *corpus)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < corpus->count; i++) free(corpus->values[i]);
+    free(corpus->values);
+    free(corpus->lens);
+}
+
+/* the gnu engine of the scans. */
+static int
+_regex_match_gnu(reveldb_pattern_t *pattern, const char *str, size_t len)
+{
+    return re_match(reveldb_pattern_buffer(pattern), str, len, 0, NULL) >= 0;
+}
+
+typedef int (*regex_match_t)(reveldb_pattern_t *pattern, const char *str,
+        size_t len);
+
+/* microseconds per value over rounds walks of the corpus. */
+static double
+_regex_time(reveldb_pattern_t *pattern, regex_match_t match,
+        const regex_corpus_t *corpus, unsigned int rounds,
+        unsigned int *matched)
+{
+    unsigned long long begin = _regex_now();
+    unsigned int round = 0;
+    unsigned int i = 0;
+
+    *matched = 0;
+    for (round = 0; round < rounds; round++) {
+        for (i = 0; i < corpus->count; i++) {
+            *matched += match(pattern, corpus->values[i], corpus->lens[i]);
+        }
+    }
+    *matched /= rounds;
+    return (double)(_regex_now() - begin) / 1000 / rounds / corpus->count;
+}
+
+static int
+_regex_run(const char *expr, const regex_corpus_t *corpus,
+        unsigned int rounds)
+{
+    reveldb_pattern_t *pattern = reveldb_pattern_acquire(NULL, expr);
+    unsigned int gnu_matched = 0;
+    unsigned int dfa_matched = 0;
+    unsigned int i = 0;
+    double gnu = 0;
+    double dfa = 0;
+
+    if (pattern == NULL) {
+        fprintf(stderr, "%s is not a valid regular expression.\n", expr);
+        return -1;
+    }
+    /* both engines have to give the same answer on every value. */
+    for (i = 0; i < corpus->count; i++) {
+        if (_regex_match_gnu(pattern, corpus->values[i], corpus->lens[i])
+                != reveldb_pattern_match(pattern, corpus->values[i],
+                    corpus->lens[i])) {
+            fprintf(stderr, "the engines disagree on %s for value %u.\n",
+                    expr, i);
+            reveldb_pattern_release(NULL, pattern);
+            return -1;
+        }
+    }
+    gnu = _regex_time(pattern, _regex_match_gnu, corpus, rounds,
+            &gnu_matched);
+    dfa = _regex_time(pattern, reveldb_pattern_match, corpus, rounds,
+            &dfa_matched);
+    printf("%-32s gnu %8.2fus  dfa %8.2fus  per value, %u matched\n",
+            expr, gnu, dfa, dfa_matched);
+    reveldb_pattern_release(NULL, pattern);
+    return 0;
+}
+
+static void
+_regex_usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-n values] [-s value size] [-r rounds] "
+            "[pattern ...]\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    regex_corpus_t corpus;
+    unsigned int count = 2000;
+    unsigned int rounds = 5;
+    size_t size = 4096;
+    int opt = 0;
+    int i = 0;
+    int failed = 0;
+
+    while ((opt = getopt(argc, argv, "n:s:r:h")) != -1) {
+        switch (opt) {
+            case 'n': count = atoi(optarg); break;
+            case 's': size = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            default:
+                _regex_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (count == 0 || rounds == 0) {
+        _regex_usage(argv[0]);
+        return 1;
+    }
+
+    /* the syntax the rpc server compiles scan patterns with. */
+    re_syntax_options = RE_SYNTAX_EGREP;
+    memset(&corpus, 0, sizeof(corpus));
+    if (_regex_corpus_init(&corpus, count, size) != 0) {
+        fprintf(stderr, "failed to malloc the corpus.\n");
+        return 1;
+    }
+    printf("%u values of about %zu bytes, %u rounds\n", count, size, rounds);
+    if (optind < argc) {
+        for (i = optind; i < argc; i++) {
+            failed |= _regex_run(argv[i], &corpus, rounds);
+        }
+    } else {
+        for (i = 0; regex_patterns[i] != NULL; i++) {
+            failed |= _regex_run(regex_patterns[i], &corpus, rounds);
+        }
+    }
+    _regex_corpus_free(&corpus);
+    return (failed != 0) ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# heap allocations per request made by the server.
+#
+# usage: bench/request_allocs.sh <build dir> [seconds] [mode ...]
+#
+# runs <build dir>/reveldb with libmalloc_count.so preloaded from a scratch
+# directory holding a copy of conf/, warms it up, then drives each mode
+# over one keep-alive connection with rpc_load and divides the number of
+# malloc/calloc/realloc calls made meanwhile by the number of requests.
+# Modes writing their keys back before each request (del, seize, mdel,
+# mseize) would count those writes too and are not meant for this.
+
+set -e
+
+BUILD=${1:?usage: $0 <build dir> [seconds] [mode ...]}
+SECONDS_PER_RUN=${2:-5}
+shift 2 2>/dev/null || shift $#
+MODES=${*:-void get set mset}
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$(cd "$BUILD" && pwd)
+WORK=$(mktemp -d /tmp/reveldb-allocs.XXXXXX)
+COUNTS="$WORK/malloc_count"
+PORT=8087
+PID=
+
+trap 'kill $PID 2>/dev/null || true; rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/logs"
+cp -r "$SRC/conf" "$WORK/"
+sed -e "s|\"datadir\": *\"[^\"]*\"|\"datadir\": \"$WORK/data/\"|" \
+    -e "s|\"pidfile\": *\"[^\"]*\"|\"pidfile\": \"$WORK/reveldb.pid\"|" \
+    -e "s|\"https\": *true|\"https\": false|" \
+    "$SRC/conf/reveldb.json" > "$WORK/conf/reveldb.json"
+
+(cd "$WORK" && MALLOC_COUNT_FILE="$COUNTS" \
+    LD_PRELOAD="$BUILD/libmalloc_count.so" \
+    exec "$BUILD/reveldb" > "$WORK/reveldb.out" 2>&1) &
+PID=$!
+sleep 1
+
+# the total of the three counters once the file has been rewritten.
+allocs() {
+    rm -f "$COUNTS"
+    kill -USR1 $PID
+    while [ ! -s "$COUNTS" ]; do sleep 0.1; done
+    awk '{ print $1 + $2 + $3 }' "$COUNTS"
+}
+
+# caches, arenas and connections warm up before anything is counted.
+"$BUILD/rpc_load" -p $PORT -m set -c 4 -d 1 -n 10000 -P > /dev/null
+
+for MODE in $MODES; do
+    BEFORE=$(allocs)
+    OUT=$("$BUILD/rpc_load" -p $PORT -m "$MODE" -c 1 -k 10 \
+        -d "$SECONDS_PER_RUN" -n 10000)
+    AFTER=$(allocs)
+    echo "$OUT" | awk -v allocs=$((AFTER - BEFORE)) '{
+        for (i = 1; i <= NF; i++) {
+            split($i, kv, "=");
+            if (kv[1] == "requests") requests = kv[2];
+        }
+        printf("mode=%-6s requests=%-8d allocations=%-10d per request=%.1f\n",
+            substr($1, 6), requests, allocs, allocs / requests);
+    }'
+done
@@ -0,0 +1,149 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  route_bench.c
+ *
+ *    Description:  path to callback lookup over the rpc routes, through the
+ *                  hash index against a walk of the callback list.
+ *
+ * =============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <event2/event.h>
+
+#include <reveldb/evhttpx/evhttpx.h>
+
+#define ROUTE_MAX_PATHS 1024
+#define ROUTE_MAX_PATH 256
+#define ROUTE_ROUNDS 200000
+
+static unsigned long long
+_route_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+_route_cb(evhttpx_request_t *req, void *arg)
+{
+    (void)req;
+    (void)arg;
+}
+
+/* the lookup every request paid for before the paths were indexed. */
+static evhttpx_callback_t *
+_route_find_linear(evhttpx_t *httpx, const char *path)
+{
+    evhttpx_callback_t *callback = NULL;
+
+    TAILQ_FOREACH(callback, httpx->callbacks, next) {
+        if (callback->type == evhttpx_callback_type_hash
+                && strcmp(callback->val.path, path) == 0) {
+            return callback;
+        }
+    }
+    return NULL;
+}
+
+/* the first string literal of every evhttpx_set_cb() call in file, in the
+ * order the server registers them. */
+static int
+_route_load(const char *file, char paths[][ROUTE_MAX_PATH], int max)
+{
+    FILE *fp = fopen(file, "r");
+    char line[1024];
+    char *begin = NULL;
+    char *end = NULL;
+    int n = 0;
+
+    if (fp == NULL) return -1;
+    while (n < max && fgets(line, sizeof(line), fp) != NULL) {
+        if ((begin = strstr(line, "evhttpx_set_cb(")) == NULL) continue;
+        if ((begin = strchr(begin, '"')) == NULL) continue;
+        if ((end = strchr(++begin, '"')) == NULL) continue;
+        if (end - begin >= ROUTE_MAX_PATH) continue;
+        memcpy(paths[n], begin, end - begin);
+        paths[n][end - begin] = '\0';
+        n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+typedef evhttpx_callback_t * (*route_find_t)(evhttpx_t *httpx,
+        const char *path);
+
+/* nanoseconds per lookup, each round looking up every path once. */
+static double
+_route_time(evhttpx_t *httpx, route_find_t find,
+        char paths[][ROUTE_MAX_PATH], int npaths, int *found)
+{
+    unsigned long long begin = _route_now();
+    int round = 0;
+    int i = 0;
+
+    *found = 0;
+    for (round = 0; round < ROUTE_ROUNDS; round++) {
+        for (i = 0; i < npaths; i++) {
+            if (find(httpx, paths[i]) != NULL) (*found)++;
+        }
+    }
+    return (double)(_route_now() - begin) / ROUTE_ROUNDS / npaths;
+}
+
+int main(int argc, char *argv[])
+{
+    static char paths[ROUTE_MAX_PATHS][ROUTE_MAX_PATH];
+    static char misses[][ROUTE_MAX_PATH] = {
+        "/", "/favicon.ico", "/rpc/", "/rpc/unknown", "/rest/get",
+    };
+    const char *file = (argc > 1) ? argv[1] : REVELDB_RPC_SOURCE;
+    struct event_base *base = event_base_new();
+    evhttpx_t *httpx = evhttpx_new(base, NULL);
+    int npaths = _route_load(file, paths, ROUTE_MAX_PATHS);
+    int nmisses = sizeof(misses) / sizeof(misses[0]);
+    int found = 0;
+    int i = 0;
+    double linear = 0;
+    double indexed = 0;
+
+    if (npaths <= 0) {
+        fprintf(stderr, "no evhttpx_set_cb() paths found in %s.\n", file);
+        return 1;
+    }
+    for (i = 0; i < npaths; i++) {
+        evhttpx_set_cb(httpx, paths[i], _route_cb, NULL);
+    }
+
+    /* the hash index is also what dispatches the requests, check that it
+     * agrees with the walk before timing anything. */
+    for (i = 0; i < npaths; i++) {
+        if (evhttpx_get_cb(httpx, paths[i])
+                != _route_find_linear(httpx, paths[i])) {
+            fprintf(stderr, "lookups disagree on %s.\n", paths[i]);
+            return 1;
+        }
+    }
+
+    printf("%d routes from %s, %d rounds\n", npaths, file, ROUTE_ROUNDS);
+    linear = _route_time(httpx, _route_find_linear, paths, npaths, &found);
+    indexed = _route_time(httpx, evhttpx_get_cb, paths, npaths, &found);
+    printf("hits:   linear %6.1fns  indexed %6.1fns  per lookup\n",
+            linear, indexed);
+    linear = _route_time(httpx, _route_find_linear, misses, nmisses, &found);
+    indexed = _route_time(httpx, evhttpx_get_cb, misses, nmisses, &found);
+    printf("misses: linear %6.1fns  indexed %6.1fns  per lookup\n",
+            linear, indexed);
+
+    evhttpx_free(httpx);
+    event_base_free(base);
+    return 0;
+}
@@ -0,0 +1,436 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  rpc_load.c
+ *
+ *    Description:  closed loop load generator for the rpc server, one
+ *                  keep-alive connection per thread.
+ *
+ * =============================================================================
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+typedef enum {
+    LOAD_VOID = 0, /* /rpc/void, the cost of the server alone. */
+    LOAD_GET,
+    LOAD_SET,
+    LOAD_DEL,
+    LOAD_SEIZE,
+    LOAD_MSET,
+    LOAD_MDEL,
+    LOAD_MSEIZE,
+} load_mode_t;
+
+static const char *load_modes[] = {
+    "void", "get", "set", "del", "seize", "mset", "mdel", "mseize", NULL
+};
+
+typedef struct load_config_s_ {
+    const char *host;
+    const char *port;
+    const char *db;
+    load_mode_t mode;
+    unsigned int connections;
+    unsigned int seconds;
+    unsigned int keys; /* per request of the m* modes. */
+    unsigned int space; /* keys are drawn from [0, space). */
+    unsigned int value_size;
+    int preload;
+} load_config_t;
+
+typedef struct load_thread_s_ {
+    pthread_t thread;
+    const load_config_t *config;
+    unsigned int id;
+    int fd;
+    unsigned long long requests;
+    unsigned long long keys;
+    unsigned long long failures; /* replies other than 200. */
+    unsigned long long busy; /* nanoseconds spent in timed requests. */
+    int error;
+    char *buf; /* requests and replies. */
+    size_t buf_size;
+    char *value;
+    uint64_t seed;
+} load_thread_t;
+
+static volatile int load_stop;
+
+static unsigned long long
+_load_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+_load_connect(const load_config_t *config)
+{
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    int fd = -1;
+    int one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(config->host, config->port, &hints, &res) != 0) return -1;
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd >= 0) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    freeaddrinfo(res);
+    return fd;
+}
+
+static int
+_load_send(int fd, const char *data, size_t len)
+{
+    ssize_t n = 0;
+
+    while (len > 0) {
+        n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* reads a whole reply, returns its status code or -1. */
+static int
+_load_recv(load_thread_t *t)
+{
+    size_t have = 0;
+    size_t need = 0;
+    char *end = NULL;
+    char *length = NULL;
+    ssize_t n = 0;
+
+    for (;;) {
+        if (have == t->buf_size - 1) {
+            t->buf_size *= 2;
+            t->buf = (char *)realloc(t->buf, t->buf_size);
+            if (t->buf == NULL) return -1;
+        }
+        n = read(t->fd, t->buf + have, t->buf_size - 1 - have);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        have += n;
+        t->buf[have] = '\0';
+        if (end == NULL) {
+            end = strstr(t->buf, "\r\n\r\n");
+            if (end == NULL) continue;
+            need = (size_t)(end - t->buf) + 4;
+            for (length = strstr(t->buf, "\r\n"); length != NULL
+                    && length < end; length = strstr(length + 2, "\r\n")) {
+                if (strncasecmp(length, "\r\nContent-Length:", 17) == 0) {
+                    need += strtoul(length + 17, NULL, 10);
+                    break;
+                }
+            }
+        }
+        if (have >= need) break;
+    }
+    /* one request at a time, nothing follows the reply. */
+    return atoi(t->buf + 9);
+}
+
+static uint64_t
+_load_rand(load_thread_t *t)
+{
+    t->seed ^= t->seed << 13;
+    t->seed ^= t->seed >> 7;
+    t->seed ^= t->seed << 17;
+    return t->seed;
+}
+
+/* appends {"keys":[...]} or {"keys":[...],"values":[...]} for the keys
+ * first to first + n - 1. */
+static size_t
+_load_body(load_thread_t *t, char *out, unsigned int first, unsigned int n,
+        int values)
+{
+    const load_config_t *config = t->config;
+    size_t len = 0;
+    unsigned int i = 0;
+
+    len += sprintf(out + len, "{\"keys\":[");
+    for (i = 0; i < n; i++) {
+        len += sprintf(out + len, "%s\"key%08u\"", (i > 0) ? "," : "",
+                (first + i) % config->space);
+    }
+    len += sprintf(out + len, "]");
+    if (values) {
+        len += sprintf(out + len, ",\"values\":[");
+        for (i = 0; i < n; i++) {
+            len += sprintf(out + len, "%s\"%s\"", (i > 0) ? "," : "",
+                    t->value);
+        }
+        len += sprintf(out + len, "]");
+    }
+    len += sprintf(out + len, "}\r\n");
+    return len;
+}
+
+/* builds the request for mode on the keys from first on. */
+static size_t
+_load_request(load_thread_t *t, load_mode_t mode, unsigned int first,
+        unsigned int n)
+{
+    const load_config_t *config = t->config;
+    char body_head[256];
+    char *body = NULL;
+    size_t body_len = 0;
+    size_t need = 512 + (size_t)n * (24 + config->value_size);
+    const char *db = (config->db != NULL) ? config->db : "";
+    const char *db_arg = (config->db != NULL) ? "&db=" : "";
+
+    if (need > t->buf_size) {
+        t->buf_size = need;
+        t->buf = (char *)realloc(t->buf, t->buf_size);
+        if (t->buf == NULL) return 0;
+    }
+
+    switch (mode) {
+        case LOAD_VOID:
+            return sprintf(t->buf, "GET /rpc/void HTTP/1.1\r\n"
+                    "Host: %s\r\n\r\n", config->host);
+        case LOAD_GET:
+        case LOAD_DEL:
+        case LOAD_SEIZE:
+            return sprintf(t->buf, "GET /rpc/%s?key=key%08u%s%s HTTP/1.1\r\n"
+                    "Host: %s\r\n\r\n", load_modes[mode], first, db_arg, db,
+                    config->host);
+        case LOAD_SET:
+            return sprintf(t->buf, "GET /rpc/set?key=key%08u&value=%s%s%s "
+                    "HTTP/1.1\r\nHost: %s\r\n\r\n", first, t->value,
+                    db_arg, db, config->host);
+        default:
+            break;
+    }
+
+    /* the head goes in front of the body once its length is known. */
+    body = t->buf + sizeof(body_head);
+    body_len = _load_body(t, body, first, n, mode == LOAD_MSET);
+    snprintf(body_head, sizeof(body_head), "POST /rpc/%s%s%s HTTP/1.1\r\n"
+            "Host: %s\r\nContent-Length: %zu\r\n\r\n", load_modes[mode],
+            (config->db != NULL) ? "?db=" : "", db, config->host, body_len);
+    memmove(t->buf + strlen(body_head), body, body_len);
+    memcpy(t->buf, body_head, strlen(body_head));
+    return strlen(body_head) + body_len;
+}
+
+static int
+_load_roundtrip(load_thread_t *t, load_mode_t mode, unsigned int first,
+        unsigned int n)
+{
+    size_t len = _load_request(t, mode, first, n);
+
+    if (len == 0 || _load_send(t->fd, t->buf, len) != 0) return -1;
+    return _load_recv(t);
+}
+
+static void *
+_load_run(void *arg)
+{
+    load_thread_t *t = (load_thread_t *)arg;
+    const load_config_t *config = t->config;
+    unsigned int n = 1;
+    unsigned int first = 0;
+    unsigned int range = 0;
+    unsigned long long begin = 0;
+    load_mode_t refill = LOAD_VOID;
+    int code = 0;
+
+    if (config->mode >= LOAD_MSET) n = config->keys;
+    if (config->mode == LOAD_DEL || config->mode == LOAD_SEIZE) {
+        refill = LOAD_SET;
+    } else if (config->mode == LOAD_MDEL || config->mode == LOAD_MSEIZE) {
+        refill = LOAD_MSET;
+    }
+    /* every connection keeps to its own share of the key space, so that
+     * none deletes the keys another one has just written back. */
+    range = config->space / config->connections;
+    range = (range > n) ? range - n + 1 : 1;
+
+    while (!load_stop) {
+        first = t->id * (config->space / config->connections)
+            + (unsigned int)(_load_rand(t) % range);
+        /* deletes are measured on keys that are there, written back
+         * untimed before each of them. */
+        if (refill != LOAD_VOID
+                && _load_roundtrip(t, refill, first, n) < 0) break;
+        begin = _load_now();
+        code = _load_roundtrip(t, config->mode, first, n);
+        if (code < 0) break;
+        t->busy += _load_now() - begin;
+        t->requests++;
+        t->keys += n;
+        if (code != 200) t->failures++;
+    }
+    if (!load_stop) t->error = 1;
+    return NULL;
+}
+
+/* writes every key of the space once, 1000 at a time. */
+static int
+_load_preload(load_thread_t *t)
+{
+    unsigned int first = 0;
+    unsigned int n = 0;
+
+    for (first = 0; first < t->config->space; first += n) {
+        n = t->config->space - first;
+        if (n > 1000) n = 1000;
+        if (_load_roundtrip(t, LOAD_MSET, first, n) != 200) return -1;
+    }
+    return 0;
+}
+
+static void
+_load_usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-H host] [-p port] [-c connections] [-d seconds]\n"
+            "       [-m void|get|set|del|seize|mset|mdel|mseize]\n"
+            "       [-k keys per request] [-n key space] [-s value size]\n"
+            "       [-D db] [-P]\n"
+            "\n"
+            "  -P writes every key of the space before the run.\n"
+            "  del, seize, mdel and mseize write their keys back, untimed,\n"
+            "  before each request.\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    load_config_t config;
+    load_thread_t *threads = NULL;
+    unsigned long long requests = 0;
+    unsigned long long keys = 0;
+    unsigned long long failures = 0;
+    unsigned long long busy = 0;
+    unsigned long long begin = 0;
+    double elapsed = 0;
+    unsigned int i = 0;
+    int opt = 0;
+    int errors = 0;
+
+    memset(&config, 0, sizeof(config));
+    config.host = "127.0.0.1";
+    config.port = "8087";
+    config.connections = 8;
+    config.seconds = 10;
+    config.keys = 10;
+    config.space = 100000;
+    config.value_size = 16;
+
+    while ((opt = getopt(argc, argv, "H:p:c:d:m:k:n:s:D:Ph")) != -1) {
+        switch (opt) {
+            case 'H': config.host = optarg; break;
+            case 'p': config.port = optarg; break;
+            case 'c': config.connections = atoi(optarg); break;
+            case 'd': config.seconds = atoi(optarg); break;
+            case 'k': config.keys = atoi(optarg); break;
+            case 'n': config.space = atoi(optarg); break;
+            case 's': config.value_size = atoi(optarg); break;
+            case 'D': config.db = optarg; break;
+            case 'P': config.preload = 1; break;
+            case 'm':
+                for (i = 0; load_modes[i] != NULL; i++) {
+                    if (strcmp(load_modes[i], optarg) == 0) break;
+                }
+                if (load_modes[i] == NULL) {
+                    _load_usage(argv[0]);
+                    return 1;
+                }
+                config.mode = (load_mode_t)i;
+                break;
+            default:
+                _load_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (config.connections == 0 || config.keys == 0 || config.space == 0) {
+        _load_usage(argv[0]);
+        return 1;
+    }
+
+    threads = (load_thread_t *)calloc(config.connections,
+            sizeof(load_thread_t));
+    for (i = 0; i < config.connections; i++) {
+        load_thread_t *t = &threads[i];
+        t->config = &config;
+        t->id = i;
+        t->seed = 0x9e3779b97f4a7c15ULL * (i + 1);
+        t->buf_size = 64 * 1024;
+        t->buf = (char *)malloc(t->buf_size);
+        t->value = (char *)malloc(config.value_size + 1);
+        memset(t->value, 'v', config.value_size);
+        t->value[config.value_size] = '\0';
+        t->fd = _load_connect(&config);
+        if (t->fd < 0) {
+            fprintf(stderr, "failed to connect to %s:%s.\n",
+                    config.host, config.port);
+            return 1;
+        }
+    }
+    if (config.preload && _load_preload(&threads[0]) != 0) {
+        fprintf(stderr, "failed to write the keys before the run.\n");
+        return 1;
+    }
+
+    begin = _load_now();
+    for (i = 0; i < config.connections; i++) {
+        pthread_create(&threads[i].thread, NULL, _load_run, &threads[i]);
+    }
+    sleep(config.seconds);
+    load_stop = 1;
+    for (i = 0; i < config.connections; i++) {
+        pthread_join(threads[i].thread, NULL);
+        requests += threads[i].requests;
+        keys += threads[i].keys;
+        failures += threads[i].failures;
+        busy += threads[i].busy;
+        errors += threads[i].error;
+        close(threads[i].fd);
+        free(threads[i].buf);
+        free(threads[i].value);
+    }
+    elapsed = (double)(_load_now() - begin) / 1e9;
+    free(threads);
+
+    /* the requests of the modes writing their keys back only take part
+     * of the time, the rates follow the time spent in them. */
+    if (busy > 0) elapsed = (double)busy / 1e9 / config.connections;
+    printf("mode=%s connections=%u keys/request=%u requests=%llu "
+            "non-200=%llu req/s=%.0f keys/s=%.0f mean=%.1fus\n",
+            load_modes[config.mode], config.connections,
+            (config.mode >= LOAD_MSET) ? config.keys : 1,
+            requests, failures, requests / elapsed, keys / elapsed,
+            (requests > 0) ? (double)busy / requests / 1000 : 0.0);
+    if (errors > 0) {
+        fprintf(stderr, "%d connections failed before the end.\n", errors);
+        return 1;
+    }
+    return 0;
+}
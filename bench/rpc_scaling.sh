@@ -0,0 +1,51 @@
+#!/bin/sh
+#
+# rpc throughput as the number of loop threads goes from 1 to N.
+#
+# usage: bench/rpc_scaling.sh <build dir> [max threads] [seconds] [mode]
+#
+# runs <build dir>/reveldb with "threads" set to 1, 2, 4, ... up to max
+# threads (the number of cores by default), each time from a scratch
+# directory holding a copy of conf/, and drives it with rpc_load, four
+# connections per thread.
+
+set -e
+
+BUILD=${1:?usage: $0 <build dir> [max threads] [seconds] [mode]}
+MAX=${2:-$(getconf _NPROCESSORS_ONLN)}
+SECONDS_PER_RUN=${3:-10}
+MODE=${4:-get}
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$(cd "$BUILD" && pwd)
+WORK=$(mktemp -d /tmp/reveldb-scaling.XXXXXX)
+PORT=8087
+PID=
+
+trap 'kill $PID 2>/dev/null || true; rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/logs"
+cp -r "$SRC/conf" "$WORK/"
+
+echo "mode=$MODE cores=$(getconf _NPROCESSORS_ONLN) seconds=$SECONDS_PER_RUN"
+
+THREADS=1
+while [ "$THREADS" -le "$MAX" ]; do
+    rm -rf "$WORK/data"
+    sed -e "s|\"threads\": *[0-9]*|\"threads\": $THREADS|" \
+        -e "s|\"datadir\": *\"[^\"]*\"|\"datadir\": \"$WORK/data/\"|" \
+        -e "s|\"pidfile\": *\"[^\"]*\"|\"pidfile\": \"$WORK/reveldb.pid\"|" \
+        -e "s|\"https\": *true|\"https\": false|" \
+        "$SRC/conf/reveldb.json" > "$WORK/conf/reveldb.json"
+    (cd "$WORK" && exec "$BUILD/reveldb" > "$WORK/reveldb.out" 2>&1) &
+    PID=$!
+    sleep 1
+
+    printf "threads=%-3d " "$THREADS"
+    "$BUILD/rpc_load" -p $PORT -m "$MODE" -c $((THREADS * 4)) \
+        -d "$SECONDS_PER_RUN" -n 10000 -P
+
+    kill $PID
+    wait $PID 2>/dev/null || true
+    PID=
+    THREADS=$((THREADS * 2))
+done
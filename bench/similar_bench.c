@@ -0,0 +1,311 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  similar_bench.c
+ *
+ *    Description:  edit distance of the similar scans, checked against a
+ *                  reference dynamic program on random strings, then timed
+ *                  against the full matrix the scans used to fill.
+ *
+ * =============================================================================
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "similar.h"
+
+#define SIMILAR_MAX_LEN 300
+
+static unsigned long long
+_similar_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int
+_similar_rand(unsigned long long *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return (unsigned int)(*seed >> 32);
+}
+
+static int
+_similar_eq(char a, char b)
+{
+    return tolower((unsigned char)a) == tolower((unsigned char)b);
+}
+
+static size_t
+_similar_min(size_t a, size_t b)
+{
+    return (a < b) ? a : b;
+}
+
+/* optimal string alignment over the whole matrix, the metric
+ * reveldb_similar_distance() is documented to compute. */
+static size_t
+_similar_reference(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    static size_t d[SIMILAR_MAX_LEN + 1][SIMILAR_MAX_LEN + 1];
+    size_t i = 0;
+    size_t j = 0;
+
+    for (i = 0; i <= a_len; i++) d[i][0] = i;
+    for (j = 0; j <= b_len; j++) d[0][j] = j;
+    for (i = 1; i <= a_len; i++) {
+        for (j = 1; j <= b_len; j++) {
+            d[i][j] = _similar_min(_similar_min(d[i - 1][j] + 1,
+                        d[i][j - 1] + 1),
+                    d[i - 1][j - 1] + !_similar_eq(a[i - 1], b[j - 1]));
+            if (i > 1 && j > 1 && _similar_eq(a[i - 1], b[j - 2])
+                    && _similar_eq(a[i - 2], b[j - 1])) {
+                d[i][j] = _similar_min(d[i][j], d[i - 2][j - 2] + 1);
+            }
+        }
+    }
+    return d[a_len][b_len];
+}
+
+/* the kernel the scans ran before reveldb_similar_distance(), a row
+ * allocated per string and the whole matrix filled whatever the limit,
+ * with its operands put right: it compared the key with itself. */
+static size_t
+_similar_old(const char *dst, size_t dst_len, const char *src, size_t src_len)
+{
+    size_t len1 = dst_len;
+    size_t len2 = src_len;
+    size_t *v = NULL;
+    size_t i = 0;
+    size_t j = 0;
+    size_t current = 0;
+    size_t next = 0;
+    size_t cost = 0;
+
+    while (len1 > 0 && len2 > 0 && _similar_eq(dst[0], src[0])) {
+        dst++, src++, len1--, len2--;
+    }
+    if (len1 == 0) return len2;
+    if (len2 == 0) return len1;
+
+    v = (size_t *)calloc(len2 + 1, sizeof(size_t));
+    for (j = 0; j < len2 + 1; j++) v[j] = j;
+    for (i = 0; i < len1; i++) {
+        current = i + 1;
+        for (j = 0; j < len2; j++) {
+            cost = !(_similar_eq(dst[i], src[j]) || (i && j
+                        && _similar_eq(dst[i - 1], src[j])
+                        && _similar_eq(dst[i], src[j - 1])));
+            next = _similar_min(_similar_min(v[j + 1] + 1, current + 1),
+                    v[j] + cost);
+            v[j] = current;
+            current = next;
+        }
+        v[len2] = next;
+    }
+    free(v);
+    return next;
+}
+
+/* len random letters, upper and lower case, out of a small alphabet so
+ * that strings share many of them. */
+static void
+_similar_random(unsigned long long *seed, char *str, size_t len,
+        unsigned int letters)
+{
+    size_t i = 0;
+
+    for (i = 0; i < len; i++) {
+        str[i] = "abcdefghijklmnopqrstuvwxyz"[_similar_rand(seed) % letters];
+        if (_similar_rand(seed) % 4 == 0) str[i] = toupper(str[i]);
+    }
+}
+
+/* a few random edits of src into dst, returns the length of dst. */
+static size_t
+_similar_mutate(unsigned long long *seed, const char *src, size_t len,
+        char *dst, unsigned int edits)
+{
+    size_t dst_len = len;
+    size_t at = 0;
+    char c = 0;
+
+    memcpy(dst, src, len);
+    while (edits-- > 0) {
+        at = (dst_len > 0) ? _similar_rand(seed) % dst_len : 0;
+        switch (_similar_rand(seed) % 4) {
+            case 0: /* insert */
+                if (dst_len == SIMILAR_MAX_LEN) break;
+                memmove(dst + at + 1, dst + at, dst_len - at);
+                dst[at] = 'a' + _similar_rand(seed) % 26;
+                dst_len++;
+                break;
+            case 1: /* delete */
+                if (dst_len == 0) break;
+                memmove(dst + at, dst + at + 1, dst_len - at - 1);
+                dst_len--;
+                break;
+            case 2: /* replace */
+                if (dst_len == 0) break;
+                dst[at] = 'a' + _similar_rand(seed) % 26;
+                break;
+            default: /* swap */
+                if (at + 1 >= dst_len) break;
+                c = dst[at];
+                dst[at] = dst[at + 1];
+                dst[at + 1] = c;
+                break;
+        }
+    }
+    return dst_len;
+}
+
+/* random pairs, near ones and unrelated ones, with random limits. */
+static int
+_similar_check(unsigned int cases)
+{
+    unsigned long long seed = 0x2545f4914f6cdd1dULL;
+    char a[SIMILAR_MAX_LEN];
+    char b[SIMILAR_MAX_LEN];
+    size_t a_len = 0;
+    size_t b_len = 0;
+    size_t max = 0;
+    size_t expect = 0;
+    size_t got = 0;
+    unsigned int n = 0;
+    reveldb_similar_t *similar = NULL;
+
+    for (n = 0; n < cases; n++) {
+        a_len = _similar_rand(&seed) % (SIMILAR_MAX_LEN + 1);
+        _similar_random(&seed, a, a_len, 2 + _similar_rand(&seed) % 25);
+        if (_similar_rand(&seed) % 2 == 0) {
+            b_len = _similar_mutate(&seed, a, a_len, b,
+                    _similar_rand(&seed) % 12);
+        } else {
+            b_len = _similar_rand(&seed) % (SIMILAR_MAX_LEN + 1);
+            _similar_random(&seed, b, b_len, 2 + _similar_rand(&seed) % 25);
+        }
+        max = _similar_rand(&seed) % (SIMILAR_MAX_LEN + 2);
+        if (_similar_rand(&seed) % 2 == 0) max %= 16;
+
+        /* the distance itself, or max + 1 once it is past max. */
+        expect = _similar_min(_similar_reference(b, b_len, a, a_len),
+                max + 1);
+        if ((similar = reveldb_similar_new(a, a_len)) == NULL) {
+            fprintf(stderr, "failed to malloc the similar query.\n");
+            return -1;
+        }
+        got = reveldb_similar_distance(similar, b, b_len, max);
+        reveldb_similar_free(similar);
+        if (got != expect) {
+            fprintf(stderr, "case %u: %zu edits, expected %zu, between "
+                    "\"%.*s\" and \"%.*s\" with max %zu.\n", n, got, expect,
+                    (int)a_len, a, (int)b_len, b, max);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* nanoseconds per string, count strings of len bytes measured against a
+ * query of the same length, one in 8 of them a near copy of it. */
+static int
+_similar_time(size_t len, size_t max, unsigned int count)
+{
+    unsigned long long seed = 0x9e3779b97f4a7c15ULL;
+    char query[SIMILAR_MAX_LEN];
+    char **texts = (char **)calloc(count, sizeof(char *));
+    size_t *lens = (size_t *)calloc(count, sizeof(size_t));
+    reveldb_similar_t *similar = NULL;
+    unsigned long long begin = 0;
+    double old = 0;
+    double now = 0;
+    unsigned int old_within = 0;
+    unsigned int now_within = 0;
+    unsigned int i = 0;
+
+    if (texts == NULL || lens == NULL) return -1;
+    _similar_random(&seed, query, len, 26);
+    for (i = 0; i < count; i++) {
+        if ((texts[i] = (char *)malloc(SIMILAR_MAX_LEN)) == NULL) return -1;
+        if (_similar_rand(&seed) % 8 == 0) {
+            lens[i] = _similar_mutate(&seed, query, len, texts[i],
+                    _similar_rand(&seed) % (max + 2));
+        } else {
+            lens[i] = len;
+            _similar_random(&seed, texts[i], len, 26);
+        }
+    }
+    if ((similar = reveldb_similar_new(query, len)) == NULL) return -1;
+
+    begin = _similar_now();
+    for (i = 0; i < count; i++) {
+        old_within += (_similar_old(texts[i], lens[i], query, len) <= max);
+    }
+    old = (double)(_similar_now() - begin) / count;
+    begin = _similar_now();
+    for (i = 0; i < count; i++) {
+        now_within += (reveldb_similar_distance(similar, texts[i], lens[i],
+                    max) <= max);
+    }
+    now = (double)(_similar_now() - begin) / count;
+
+    printf("%3zu bytes, max %2zu: full matrix %10.1fns  bounded %8.1fns  "
+            "per string, %u within max\n", len, max, old, now, now_within);
+    if (old_within != now_within) {
+        /* the old kernel let a swap cost nothing, it may count more. */
+        printf("    the full matrix kernel counted %u within max.\n",
+                old_within);
+    }
+    reveldb_similar_free(similar);
+    for (i = 0; i < count; i++) free(texts[i]);
+    free(texts);
+    free(lens);
+    return 0;
+}
+
+static void
+_similar_usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-c check cases] [-n strings]\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int cases = 300000;
+    unsigned int count = 100000;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "c:n:h")) != -1) {
+        switch (opt) {
+            case 'c': cases = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            default:
+                _similar_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (count == 0) {
+        _similar_usage(argv[0]);
+        return 1;
+    }
+
+    if (_similar_check(cases) != 0) return 1;
+    printf("%u random cases matched the reference\n", cases);
+    if (_similar_time(13, 2, count) != 0
+            || _similar_time(220, 10, count / 10) != 0
+            || _similar_time(220, 60, count / 10) != 0) {
+        fprintf(stderr, "failed to malloc the strings.\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  comparator.h
+ *
+ *    Description:  key orders a database can be created with.
+ *
+ * =============================================================================
+ */
+#ifndef _REVELDB_COMPARATOR_H_
+#define _REVELDB_COMPARATOR_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <leveldb/c.h>
+
+typedef enum {
+    /* leveldb's default, keys ordered byte by byte. */
+    XLEVELDB_COMPARATOR_BYTEWISE = 0,
+    /* the bytewise order turned upside down, so that forward scans visit
+     * keys from the largest one down. */
+    XLEVELDB_COMPARATOR_REVERSE_BYTEWISE,
+    /* keys made of decimal digits ordered by their value, the way the
+     * big-endian encoding of an unsigned 64 bit integer orders, numbers
+     * of any length included. other keys follow them, bytewise. */
+    XLEVELDB_COMPARATOR_UINT64,
+    /* keys made of decimal digits, after a '-' for negative ones, ordered
+     * by their signed value. other keys follow them, bytewise. */
+    XLEVELDB_COMPARATOR_INT64,
+} xleveldb_comparator_type_t;
+
+#define XLEVELDB_COMPARATORS 4
+
+/* the type named name, -1 if there is no such comparator. */
+extern int xleveldb_comparator_parse(const char *name);
+
+/* the name of type, as accepted by xleveldb_comparator_parse(). */
+extern const char * xleveldb_comparator_name(xleveldb_comparator_type_t type);
+
+/* < 0, 0 or > 0 as a orders before, along with or after b. */
+extern int xleveldb_comparator_compare(xleveldb_comparator_type_t type,
+        const char *a, size_t a_len, const char *b, size_t b_len);
+
+/* the leveldb comparator of type, NULL for the bytewise one which is
+ * leveldb's own. it has to outlive the databases opened with it. */
+extern leveldb_comparator_t * xleveldb_comparator_create(
+        xleveldb_comparator_type_t type);
+
+#endif // _REVELDB_COMPARATOR_H_
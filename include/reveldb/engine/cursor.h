@@ -0,0 +1,64 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  cursor.h
+ *
+ *    Description:  iterator over every shard of a database, merged in key
+ *                  order.
+ *
+ * =============================================================================
+ */
+#ifndef _REVELDB_CURSOR_H_
+#define _REVELDB_CURSOR_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <leveldb/c.h>
+
+#include <reveldb/engine/xleveldb.h>
+
+typedef struct xleveldb_cursor_s_ xleveldb_cursor_t;
+
+/* behaves like a leveldb iterator on the whole database: one iterator is
+ * opened on each shard and their entries are merged, so that a database
+ * that is not sharded is walked by a single leveldb iterator. the cursor
+ * starts out invalid, like a leveldb iterator does. */
+extern xleveldb_cursor_t * xleveldb_cursor_create(
+        xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions);
+
+/* opens n cursors which see the very same entries, so that they can walk
+ * parts of the database side by side. roptions has to be either the
+ * instance's own read options, in which case a snapshot of every shard
+ * is taken for them, or ones holding a snapshot. shards are snapshotted
+ * one after the other, a write to several of them may be seen on some
+ * only, as it may by a single cursor. returns -1 if they could not all
+ * be opened, none is then. */
+extern int xleveldb_cursor_create_many(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        xleveldb_cursor_t **cursors, unsigned int n);
+
+extern void xleveldb_cursor_destroy(xleveldb_cursor_t *cursor);
+
+extern unsigned char xleveldb_cursor_valid(const xleveldb_cursor_t *cursor);
+extern void xleveldb_cursor_seek_to_first(xleveldb_cursor_t *cursor);
+extern void xleveldb_cursor_seek_to_last(xleveldb_cursor_t *cursor);
+extern void xleveldb_cursor_seek(xleveldb_cursor_t *cursor,
+        const char *k, size_t klen);
+extern void xleveldb_cursor_next(xleveldb_cursor_t *cursor);
+extern void xleveldb_cursor_prev(xleveldb_cursor_t *cursor);
+extern const char * xleveldb_cursor_key(const xleveldb_cursor_t *cursor,
+        size_t *klen);
+extern const char * xleveldb_cursor_value(const xleveldb_cursor_t *cursor,
+        size_t *vlen);
+/* < 0, 0 or > 0 as key a comes before, along with or after key b when
+ * moving forward, in the order of the database. */
+extern int xleveldb_cursor_compare(const xleveldb_cursor_t *cursor,
+        const char *a, size_t a_len, const char *b, size_t b_len);
+
+/* the first error any of the shard iterators ran into. */
+extern void xleveldb_cursor_get_error(const xleveldb_cursor_t *cursor,
+        char **errptr);
+
+#endif // _REVELDB_CURSOR_H_
@@ -0,0 +1,61 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  vcache.h
+ *
+ *    Description:  sharded value cache in front of leveldb point lookups.
+ *
+ * =============================================================================
+ */
+#ifndef _REVELDB_VCACHE_H_
+#define _REVELDB_VCACHE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* number of independently locked shards, a power of two. */
+#define VCACHE_SHARDS 16
+
+typedef struct vcache_s_ vcache_t;
+typedef struct vcache_stats_s_ vcache_stats_t;
+
+struct vcache_stats_s_ {
+    uint64_t capacity; /* byte budget. */
+    uint64_t usage; /* bytes held by cached entries. */
+    uint64_t entries;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+/* a cache holding at most capacity bytes of keys and values, entries
+ * are evicted with the CLOCK algorithm. */
+extern vcache_t * vcache_new(uint64_t capacity);
+
+extern void vcache_free(vcache_t *cache);
+
+/* returns a malloc()ed copy of the value cached for key of owner, NULL
+ * on a miss. seq is set on a miss, it has to be handed to
+ * vcache_insert() along with the value read from leveldb. */
+extern char * vcache_lookup(vcache_t *cache, uint64_t owner,
+        const char *key, size_t key_len,
+        size_t *value_len, uint64_t *seq);
+
+/* caches a value read from leveldb after a miss, unless the shard was
+ * invalidated since the lookup that returned seq, in which case the
+ * value may already be stale. */
+extern void vcache_insert(vcache_t *cache, uint64_t owner,
+        const char *key, size_t key_len,
+        const char *value, size_t value_len, uint64_t seq);
+
+/* returns 1 if a value of key is cached, without copying it. */
+extern int vcache_contains(vcache_t *cache, uint64_t owner,
+        const char *key, size_t key_len);
+
+/* drops the value of key, to be called after the key was written. */
+extern void vcache_invalidate(vcache_t *cache, uint64_t owner,
+        const char *key, size_t key_len);
+
+extern void vcache_get_stats(vcache_t *cache, vcache_stats_t *stats);
+
+#endif // _REVELDB_VCACHE_H_
@@ -17,12 +17,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #include <leveldb/c.h>
 
+#include <reveldb/engine/comparator.h>
+#include <reveldb/engine/vcache.h>
 #include <reveldb/util/xconfig.h>
 
+/* shards a database may be partitioned across. */
+#define XLEVELDB_MAX_SHARDS 256
+
 typedef struct xleveldb_config_s_ xleveldb_config_t;
 typedef struct xleveldb_instance_s_ xleveldb_instance_t;
 
@@ -32,7 +38,8 @@ typedef struct xleveldb_instance_s_ xleveldb_instance_t;
  * */
 struct xleveldb_config_s_ {
     char *dbname; /** default database name.*/
-    unsigned int lru_cache_size; /** leveldb's lru cache size */
+    uint64_t lru_cache_size; /** bytes of the block cache shared by all databases. */
+    uint64_t value_cache_size; /** bytes of the value cache shared by all databases, 0 disables it. */
     bool create_if_missing; /** create database if it doesn't exist. */
     bool error_if_exist; /** open database throws an error if exist. */
     unsigned int write_buffer_size; /** leveldb's write buffer size */
@@ -40,6 +47,10 @@ struct xleveldb_config_s_ {
     unsigned int max_open_files; /** max open files */
     unsigned block_size; /** block size */
     unsigned int block_restart_interval; /*block restart interval */
+    unsigned int bloom_bits_per_key; /** bloom filter bits per key, 0 disables filters. */
+    unsigned int sorted_mget_threshold; /** mget of at least this many keys walks them with one iterator, 0 disables it. */
+    unsigned int shards; /** leveldb instances a new database is hash partitioned across, 0 or 1 means none. */
+    xleveldb_comparator_type_t comparator; /** order of the keys of a new database. */
     /** compression support, 0: no compression, 1: snappy compression.*/
     bool compression; 
     bool verify_checksums; /** set true to verify checksums when read. */
@@ -53,15 +64,37 @@ struct xleveldb_config_s_ {
 struct xleveldb_instance_s_ {
     /* leveldb instance. */
     leveldb_t *db;
-    leveldb_cache_t *cache;
-    leveldb_comparator_t *comparator;
-    leveldb_env_t *env;
+    leveldb_cache_t *cache; /* shared by all instances. */
+    leveldb_comparator_t *comparator; /* NULL if ordered bytewise. */
+    leveldb_env_t *env; /* shared by all instances. */
     leveldb_filterpolicy_t *filterpolicy;
     leveldb_logger_t *logger;
     leveldb_options_t *options;
     leveldb_readoptions_t *roptions;
     leveldb_writeoptions_t *woptions;
 
+    /* point lookups done through xleveldb_get(), how many of them found
+     * nothing, and how many were answered by the value cache. */
+    uint64_t reads;
+    uint64_t misses;
+    uint64_t hits;
+
+    /* value cache shared by all instances, NULL if disabled. entries
+     * are tagged with id, which no other instance ever gets. */
+    vcache_t *vcache;
+    uint64_t id;
+
+    /* a database created with more than one shard is hash partitioned
+     * across nshards instances opened under its directory as shard-k,
+     * and has no leveldb of its own, the xleveldb_ calls below route keys
+     * to their shards. one that is not sharded is its own only shard. */
+    unsigned int nshards;
+    xleveldb_instance_t **shards;
+
+    /* the order keys are kept in, the one the database was created with
+     * whatever the config says. */
+    xleveldb_comparator_type_t order;
+
     char *err;
 
     xleveldb_config_t *config;
@@ -74,8 +107,104 @@ extern xleveldb_instance_t * xleveldb_instance_init(xleveldb_config_t *config);
 
 extern void xleveldb_instance_fini(xleveldb_instance_t *instance);
 
-extern void xleveldb_instance_destroy(xleveldb_instance_t *instance);
+/* closes the instance and deletes its data, shards included. */
+extern void xleveldb_instance_destroy(xleveldb_instance_t *instance,
+        char **errptr);
+
+/* repairs the instance, shard by shard. */
+extern void xleveldb_instance_repair(xleveldb_instance_t *instance,
+        char **errptr);
+
+/* the shard holding key, instance itself if it is not sharded. */
+extern xleveldb_instance_t * xleveldb_shard(xleveldb_instance_t *instance,
+        const char *key, size_t keylen);
+
+/* the read options to use on shard for roptions given to the database
+ * it belongs to. */
+extern const leveldb_readoptions_t * xleveldb_shard_roptions(
+        xleveldb_instance_t *instance, xleveldb_instance_t *shard,
+        const leveldb_readoptions_t *roptions);
+
+/* copies the updates of batch to batches[k] of the shard they belong to,
+ * batches[k] is left NULL if shard k gets none. */
+extern void xleveldb_split_batch(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, leveldb_writebatch_t **batches);
+
+/* < 0, 0 or > 0 as key a orders before, along with or after key b in
+ * the instance. */
+extern int xleveldb_compare(xleveldb_instance_t *instance,
+        const char *a, size_t a_len, const char *b, size_t b_len);
 
 extern void xleveldb_reset_err(xleveldb_instance_t *instance);
 
+/* leveldb_get() on the instance, counting reads and misses. lookups
+ * with the instance's own read options go through the value cache,
+ * reads on a snapshot bypass it. */
+extern char * xleveldb_get(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        const char *key, size_t keylen,
+        size_t *vallen, char **errptr);
+
+/* returns 1 if key exists, 0 otherwise. the value cache is asked
+ * first, then an iterator is positioned on the key, which unlike
+ * leveldb_get() never copies the value out. */
+extern int xleveldb_exists(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        const char *key, size_t keylen);
+
+/* sets exists[i] for every keys[i], the keys are looked up in sorted
+ * order through a single iterator. */
+extern void xleveldb_mexists(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        size_t nkeys, const char **keys, const size_t *keylens,
+        bool *exists);
+
+/* sets values[i] to a malloc()ed copy of the value of keys[i], or NULL
+ * if it does not exist. keys missing from the value cache are looked up
+ * one by one, unless there are at least sorted_mget_threshold of them,
+ * then they are sorted and walked with a single iterator. values found
+ * before an error are returned too, every non NULL one has to be freed. */
+extern void xleveldb_mget(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        size_t nkeys, const char **keys, const size_t *keylens,
+        char **values, size_t *vallens, char **errptr);
+
+/* writes have to go through these so that the value cache never serves
+ * a value older than what leveldb holds. */
+extern void xleveldb_put(xleveldb_instance_t *instance,
+        const leveldb_writeoptions_t *woptions,
+        const char *key, size_t keylen,
+        const char *val, size_t vallen,
+        char **errptr);
+
+extern void xleveldb_delete(xleveldb_instance_t *instance,
+        const leveldb_writeoptions_t *woptions,
+        const char *key, size_t keylen,
+        char **errptr);
+
+extern void xleveldb_write(xleveldb_instance_t *instance,
+        const leveldb_writeoptions_t *woptions,
+        leveldb_writebatch_t *batch,
+        char **errptr);
+
+/* the property of every shard, summed up if it is a number, one after
+ * another otherwise. NULL if a shard does not know it. */
+extern char * xleveldb_property_value(xleveldb_instance_t *instance,
+        const char *propname);
+
+/* approximate bytes the keys in [start, limit) take up on disk. */
+extern uint64_t xleveldb_approximate_size(xleveldb_instance_t *instance,
+        const char *start, size_t start_len,
+        const char *limit, size_t limit_len);
+
+extern void xleveldb_compact_range(xleveldb_instance_t *instance,
+        const char *start, size_t start_len,
+        const char *limit, size_t limit_len);
+
+/* stats of the shared value cache, returns -1 if it is disabled. */
+extern int xleveldb_value_cache_stats(vcache_stats_t *stats);
+
+/* capacity of the shared block cache, 0 if no instance is open. */
+extern uint64_t xleveldb_cache_capacity(void);
+
 #endif // _REVELDB_XLEVELDB_H_
@@ -64,6 +64,7 @@ typedef struct evhttpx_hooks_s      evhttpx_hooks_t;
 typedef struct evhttpx_connection_s evhttpx_connection_t;
 typedef struct evhttpx_ssl_cfg_s    evhttpx_ssl_cfg_t;
 typedef struct evhttpx_alias_s      evhttpx_alias_t;
+typedef struct evhttpx_arena_s      evhttpx_arena_t;
 typedef uint16_t                  evhttpx_res;
 typedef uint8_t                   evhttpx_error_flags;
 
@@ -159,6 +160,8 @@ typedef void * (*evhttpx_ssl_scache_init)(evhttpx_t *);
 
 #define evhttpx_headers_iterator  evhttpx_kvs_iterator
 
+#define EVHTTPX_ARENA_CHUNK_SIZE  4096 /**< first chunk of every request arena */
+
 #define EVHTTPX_RES_ERROR         0
 #define EVHTTPX_RES_PAUSE         1
 #define EVHTTPX_RES_FATAL         2
@@ -249,6 +252,7 @@ struct evhttpx_s {
     int        bev_flags;      /**< bufferevent flags to use on bufferevent_*_socket_new() */
     uint64_t   max_body_size;
     uint64_t   max_keepalive_requests;
+    uint64_t   max_pipelined_requests;
 
 #ifndef DISABLE_SSL
     evhttpx_ssl_ctx_t * ssl_ctx; /**< if ssl enabled, this is the servers CTX */
@@ -263,10 +267,19 @@ struct evhttpx_s {
     pthread_mutex_t    * lock; /**< parent lock for add/del cbs in threads */
     evhttpx_thread_init_cb thread_init_cb;
     void               * thread_init_cbarg;
+
+    pthread_mutex_t      listeners_lock; /**< guards listeners, filled in by the threads */
+    TAILQ_HEAD(, evhttpx_reuseport_s) reuseports; /**< addrs every thread binds itself */
+    TAILQ_HEAD(, evhttpx_listener_s)  listeners;  /**< per-thread SO_REUSEPORT listeners */
 #endif
     evhttpx_callbacks_t * callbacks;
     evhttpx_defaults_t    defaults;
 
+    evhttpx_callback_t ** cb_table;      /**< open addressed index of the path callbacks */
+    unsigned int          cb_table_mask; /**< size of cb_table - 1 */
+    unsigned int          cb_table_used;
+    unsigned int          num_globs;     /**< glob callbacks, still matched in order */
+
     struct timeval recv_timeo;
     struct timeval send_timeo;
 
@@ -318,6 +331,7 @@ struct evhttpx_kv_s {
 
     char k_heaped; /**< set to 1 if the key can be free()'d */
     char v_heaped; /**< set to 1 if the val can be free()'d */
+    char in_arena; /**< set to 1 if the kv lives in a request arena */
 
     TAILQ_ENTRY(evhttpx_kv_s) next;
 };
@@ -373,6 +387,7 @@ struct evhttpx_path_s {
  */
 struct evhttpx_request_s {
     evhttpx_t            * httpx;         /**< the parent evhttpx_t structure */
+    evhttpx_arena_t      * arena;       /**< request scoped allocations, the request lives here too */
     evhttpx_connection_t * conn;        /**< the associated connection */
     evhttpx_hooks_t      * hooks;       /**< request specific hooks */
     evhttpx_uri_t        * uri;         /**< request URI information */
@@ -414,6 +429,10 @@ struct evhttpx_connection_s {
     uint64_t          max_body_size;
     uint64_t          body_bytes_read;
     uint64_t          num_requests;
+    evbuf_t         * batch_buf;     /**< replies to pipelined requests, written out once per read */
+    uint8_t           batching;      /**< set to 1 while the input buffer is being parsed */
+    uint8_t           pipeline_full; /**< set to 1 if parsing stopped at max_pipelined_requests */
+    uint64_t          num_inflight;  /**< requests answered since the output last drained */
 };
 
 struct evhttpx_hooks_s {
@@ -520,7 +539,9 @@ void evhttpx_set_post_accept_cb(evhttpx_t * httpx, evhttpx_post_accept_cb, void
 
 
 /**
- * @brief sets a callback to be executed on a specific path
+ * @brief sets a callback to be executed on a specific path. Paths are kept
+ *        in a hash index, so the lookup cost does not grow with the number
+ *        of callbacks, and an exact path always wins over a glob.
  *
  * @param httpx the initialized evhttpx_t
  * @param path the path to match
@@ -535,6 +556,8 @@ evhttpx_callback_t * evhttpx_set_cb(evhttpx_t * httpx, const char * path, evhttp
  * @brief sets a callback to to be executed on simple glob/wildcard patterns
  *        this is useful if the app does not care about what was matched, but
  *        just that it matched. This is technically faster than regex.
+ *        Globs are only tried, in the order they were set, if no exact
+ *        path matched.
  *
  * @param httpx
  * @param pattern wildcard pattern, the '*' can be set at either or both the front or end.
@@ -545,6 +568,18 @@ evhttpx_callback_t * evhttpx_set_cb(evhttpx_t * httpx, const char * path, evhttp
  */
 evhttpx_callback_t * evhttpx_set_glob_cb(evhttpx_t * httpx, const char * pattern, evhttpx_callback_cb cb, void * arg);
 
+/**
+ * @brief finds the callback a request for path would be routed to, the
+ *        same way the server does it: exact paths first, then globs in
+ *        the order they were set.
+ *
+ * @param httpx
+ * @param path
+ *
+ * @return the callback, or NULL if none matches.
+ */
+evhttpx_callback_t * evhttpx_get_cb(evhttpx_t * httpx, const char * path);
+
 /**
  * @brief sets a callback hook for either a connection or a path/regex .
  *
@@ -645,6 +680,36 @@ void evhttpx_unbind_socket(evhttpx_t * httpx);
  */
 int  evhttpx_bind_sockaddr(evhttpx_t * httpx, struct sockaddr *, size_t sin_len, int backlog);
 
+/**
+ * @brief have every worker thread bind its own SO_REUSEPORT listener on
+ *        addr:port instead of accepting on a single listener and deferring
+ *        connections to the threads; the kernel spreads incoming connections
+ *        across the listeners. Uses the same addr format as
+ *        evhttpx_bind_socket(), unix sockets are not supported.
+ *
+ *        Must be called before evhttpx_use_threads(), which binds the
+ *        sockets and fails if any of them cannot be bound.
+ *
+ * @param httpx
+ * @param addr
+ * @param port
+ * @param backlog backlog of each per-thread listener
+ *
+ * @return 0 on success, -1 on error or if SO_REUSEPORT is unavailable, in
+ *         which case the caller should fall back to evhttpx_bind_socket().
+ */
+int  evhttpx_bind_socket_reuseport(evhttpx_t * httpx, const char * addr, uint16_t port, int backlog);
+
+/**
+ * @brief forget every port registered with evhttpx_bind_socket_reuseport(),
+ *        so that they can be bound with evhttpx_bind_socket() instead.
+ *        Does nothing once evhttpx_use_threads() has succeeded.
+ *
+ * @param httpx
+ */
+void evhttpx_unbind_socket_reuseport(evhttpx_t * httpx);
+
+
 int  evhttpx_use_threads(evhttpx_t * httpx, evhttpx_thread_init_cb init_cb, int nthreads, void * arg);
 void evhttpx_send_reply(evhttpx_request_t * request, evhttpx_res code);
 void evhttpx_send_reply_start(evhttpx_request_t * request, evhttpx_res code);
@@ -898,6 +963,70 @@ void       evhttpx_request_resume(evhttpx_request_t * request);
  */
 evhttpx_connection_t * evhttpx_request_get_connection(evhttpx_request_t * request);
 
+/**
+ * @brief returns the arena everything belonging to the request is allocated
+ *        from, it is released in one go when the request is freed.
+ *
+ * @param request
+ *
+ * @return evhttpx_arena_t
+ */
+evhttpx_arena_t * evhttpx_request_get_arena(evhttpx_request_t * request);
+
+/**
+ * @brief creates a bump allocator whose first chunk is size bytes, later
+ *        chunks double in size up to 1MB.
+ *
+ * @param size
+ *
+ * @return evhttpx_arena_t * on success, NULL on error.
+ */
+evhttpx_arena_t * evhttpx_arena_new(size_t size);
+void            * evhttpx_arena_alloc(evhttpx_arena_t * arena, size_t size);
+void            * evhttpx_arena_calloc(evhttpx_arena_t * arena, size_t nmemb, size_t size);
+char            * evhttpx_arena_strndup(evhttpx_arena_t * arena, const char * s, size_t n);
+
+/**
+ * @brief returns 1 if ptr was allocated from arena, 0 otherwise
+ */
+int               evhttpx_arena_owns(evhttpx_arena_t * arena, const void * ptr);
+
+/**
+ * @brief free()'s ptr unless it was allocated from arena, for data which
+ *        may come from either.
+ */
+void              evhttpx_arena_release(evhttpx_arena_t * arena, void * ptr);
+
+/**
+ * @brief has cb(arg) called when arena is freed, for whatever a request
+ *        holds on to until it is done. Cleanups run newest first.
+ *
+ * @return 0 on success, -1 on error
+ */
+int               evhttpx_arena_add_cleanup(evhttpx_arena_t * arena, void (*cb)(void *), void * arg);
+void              evhttpx_arena_free(evhttpx_arena_t * arena);
+
+/**
+ * @brief sets the arena of the calling thread, evhttpx sets it to the
+ *        request arena while a request callback runs.
+ *
+ * @param arena the arena, or NULL for none
+ *
+ * @return the previous arena of the calling thread
+ */
+evhttpx_arena_t * evhttpx_arena_set_current(evhttpx_arena_t * arena);
+evhttpx_arena_t * evhttpx_arena_get_current(void);
+
+/**
+ * @brief malloc()/free() replacements which allocate from the arena of the
+ *        calling thread, or off the heap when there is none. Suitable for
+ *        allocator hooks such as cJSON_InitHooks(). Large allocations, and
+ *        every allocation once the arena is large, come off the heap as
+ *        well, so everything they return has to be freed.
+ */
+void            * evhttpx_arena_current_malloc(size_t size);
+void              evhttpx_arena_current_free(void * ptr);
+
 /**
  * @brief Sets the connections underlying bufferevent
  *
@@ -968,6 +1097,14 @@ evbev_t * evhttpx_connection_take_ownership(evhttpx_connection_t * connection);
  */
 void evhttpx_connection_free(evhttpx_connection_t * connection);
 
+/**
+ * @brief frees a request. a request fini hook returning EVHTTPX_RES_PAUSE
+ *        keeps the request alive when its connection is freed, the request
+ *        is then left without a connection and whoever kept it frees it
+ *        with this once done.
+ *
+ * @param request
+ */
 void evhttpx_request_free(evhttpx_request_t * request);
 
 
@@ -1006,6 +1143,17 @@ void evhttpx_request_set_max_body_size(evhttpx_request_t * request, uint64_t len
  */
 void evhttpx_set_max_keepalive_requests(evhttpx_t * httpx, uint64_t num);
 
+/**
+ * @brief sets a maximum number of pipelined requests a single connection
+ *        may have answered but not yet written out. Once reached, the rest
+ *        of the input is left alone until the output buffer drains.
+ *        0 (the default) means no limit.
+ *
+ * @param httpx
+ * @param num
+ */
+void evhttpx_set_max_pipelined_requests(evhttpx_t * httpx, uint64_t num);
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,14 +39,38 @@ struct reveldb_s_ {
 
     xleveldb_instance_t *instance;
 
+    /* the registry holds one reference and every lookup another, the
+     * database is closed once the last one is released. */
+    unsigned int refs;
+    /* set when destroyed, its files go along with the last reference. */
+    bool destroyed;
+
     struct rb_node node;
 };
 
 extern reveldb_t * reveldb_init(const char *dbname,
         reveldb_config_t *config);
+/* takes a reference on the database found, see reveldb_release_db(). */
 extern reveldb_t * reveldb_search_db(struct rb_root *root,
         const char *dbname);
+/* looks dbname up for req, the reference is released once req is freed. */
+extern reveldb_t * reveldb_request_db(struct rb_root *root,
+        evhttpx_request_t *req, const char *dbname);
+extern void reveldb_retain_db(reveldb_t *db);
+extern void reveldb_release_db(reveldb_t *db);
+/* the registry takes over the reference of reveldb_init() if it returns 1. */
 extern int reveldb_insert_db(struct rb_root *root, reveldb_t *db);
+/* unlinks db and drops the reference of the registry. */
+extern void reveldb_remove_db(struct rb_root *root, reveldb_t *db);
+/* unlinks db and releases the reference of the caller, its files are
+ * removed right away if that was the last one, errptr telling how it
+ * went, or else by whoever releases the last one. */
+extern void reveldb_destroy_db(struct rb_root *root, reveldb_t *db,
+        char **errptr);
 extern void reveldb_free_db(reveldb_t *db);
+/* calls cb on every database until it returns non-zero, databases can
+ * not be added or removed meanwhile. */
+extern int reveldb_foreach_db(struct rb_root *root,
+        int (*cb)(reveldb_t *db, void *arg), void *arg);
 
 #endif // _REVELDB_H_
@@ -20,6 +20,11 @@
 typedef struct reveldb_rpc_callbacks_s_ reveldb_rpc_callbacks_t;
 typedef struct reveldb_rpc_s_ reveldb_rpc_t;
 
+struct reveldb_executor_s_;
+struct reveldb_committer_s_;
+struct reveldb_compactor_s_;
+struct reveldb_pattern_cache_s_;
+
 struct reveldb_rpc_callbacks_s_ {
     /* only for server status test. */
     evhttpx_callback_t  *rpc_void_cb;
@@ -34,6 +39,8 @@ struct reveldb_rpc_callbacks_s_ {
     /* admin operations. */
     evhttpx_callback_t  *rpc_new_cb;
     evhttpx_callback_t  *rpc_compact_cb;
+    evhttpx_callback_t  *rpc_compact_status_cb;
+    evhttpx_callback_t  *rpc_compact_cancel_cb;
     evhttpx_callback_t  *rpc_size_cb;
     evhttpx_callback_t  *rpc_repair_cb;
     evhttpx_callback_t  *rpc_destroy_cb;
@@ -54,6 +61,7 @@ struct reveldb_rpc_callbacks_s_ {
     evhttpx_callback_t  *rpc_seize_cb;
     evhttpx_callback_t  *rpc_mseize_cb;
     evhttpx_callback_t  *rpc_range_cb;
+    evhttpx_callback_t  *rpc_prefix_cb;
     evhttpx_callback_t  *rpc_regex_cb;
     evhttpx_callback_t  *rpc_kregex_cb;
     evhttpx_callback_t  *rpc_vregex_cb;
@@ -103,6 +111,7 @@ struct reveldb_rpc_callbacks_s_ {
     evhttpx_callback_t  *rpc_sync_cb;
     evhttpx_callback_t  *rpc_check_cb;
     evhttpx_callback_t  *rpc_exists_cb;
+    evhttpx_callback_t  *rpc_mexists_cb;
     evhttpx_callback_t  *rpc_version_cb;
 };
 
@@ -118,6 +127,21 @@ struct reveldb_rpc_s_ {
 
     reveldb_rpc_callbacks_t *callbacks;
     reveldb_config_t *config;
+
+    /* runs the blocking storage handlers off the event loops. */
+    struct reveldb_executor_s_ *executor;
+
+    /* group commits the writes of every connection. */
+    struct reveldb_committer_s_ *committer;
+
+    /* runs the compactions in the background. */
+    struct reveldb_compactor_s_ *compactor;
+
+    /* compiled regex patterns, reused across requests. */
+    struct reveldb_pattern_cache_s_ *patterns;
+
+    /* walks the parts of the partitioned scans. */
+    struct reveldb_executor_s_ *scanner;
 };
 
 extern reveldb_rpc_t * reveldb_rpc_init(reveldb_config_t *config);
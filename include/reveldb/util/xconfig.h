@@ -16,6 +16,8 @@
 #ifndef _XCONFIG_H_
 #define _XCONFIG_H_
 
+#include <stdint.h>
+
 typedef struct reveldb_config_s_ reveldb_config_t;
 typedef struct reveldb_server_config_s_ reveldb_server_config_t;
 typedef struct reveldb_db_config_s_ reveldb_db_config_t;
@@ -35,6 +37,18 @@ struct reveldb_server_config_s_ {
     char *restports; /* REST protocol bind port, reveldb can listen on multiple ports. */
     bool https; /* https enabled. */
     unsigned int backlog; /* backlog of epoll. */
+    unsigned int threads; /* number of worker threads serving requests. */
+    bool reuseport; /* every worker thread binds its own SO_REUSEPORT listener. */
+    unsigned int storage_threads; /* threads running blocking storage jobs. */
+    unsigned int max_pipelined_requests; /* pipelined requests answered ahead of the socket, 0 means no limit. */
+    unsigned int stream_high_watermark; /* bytes of a streamed reply buffered ahead of the socket, 0 means 1MB. */
+    unsigned int group_commit_max_batch; /* writes merged into one leveldb batch, 0 means 256. */
+    unsigned int group_commit_max_wait; /* microseconds a batch waits for more writes to join. */
+    unsigned int commit_threads; /* commit threads, each one writing a share of the databases and shards, 0 means 1. */
+    uint64_t compaction_rate; /* bytes per second background compactions go at, 0 means no limit. */
+    uint64_t compaction_range_size; /* bytes compacted at once by background compactions, 0 means 64MB. */
+    unsigned int pattern_cache_size; /* compiled regex patterns kept for reuse, 0 means 256. */
+    unsigned int scan_threads; /* threads walking the parts of partitioned scans, 0 means none. */
     char *username; /* reveldb root username. */
     char *password; /* password. */
     char *datadir; /* data directory. */
@@ -43,7 +57,8 @@ struct reveldb_server_config_s_ {
 
 struct reveldb_db_config_s_ {
     char *dbname; /** default database name.*/
-    unsigned int lru_cache_size; /** leveldb's lru cache size */
+    uint64_t lru_cache_size; /** bytes of the block cache shared by all databases. */
+    uint64_t value_cache_size; /** bytes of the value cache shared by all databases, 0 disables it. */
     bool create_if_missing; /** create database if it doesn't exist. */
     bool error_if_exist; /** open database throws an error if exist. */
     unsigned int write_buffer_size; /** leveldb's write buffer size */
@@ -51,6 +66,10 @@ struct reveldb_db_config_s_ {
     unsigned int max_open_files; /** max open files */
     unsigned block_size; /** block size */
     unsigned int block_restart_interval; /*block restart interval */
+    unsigned int bloom_bits_per_key; /** bloom filter bits per key, 0 disables filters. */
+    unsigned int sorted_mget_threshold; /** mget of at least this many keys walks them with one iterator, 0 disables it. */
+    unsigned int shards; /** leveldb instances a new database is hash partitioned across, 0 or 1 means none. */
+    char *comparator; /** order of the keys of a new database, NULL means bytewise. */
     /** compression support, 0: no compression, 1: snappy compression.*/
     bool compression; 
     bool verify_checksums; /** set true to verify checksums when read. */
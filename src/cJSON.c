@@ -549,6 +549,7 @@ parse_array(cJSON * item, const char *value)
 			return 0;			/* memory fail */
 	}
 
+	item->child->prev = child;	/* the first item keeps the last one. */
 	if (*value == ']')
 		return value + 1;		/* end of array */
 	ep = value;
@@ -692,6 +693,7 @@ parse_object(cJSON * item, const char *value)
 			return 0;
 	}
 
+	item->child->prev = child;	/* the first item keeps the last one. */
 	if (*value == '}')
 		return value + 1;		/* end of array */
 	ep = value;
@@ -870,10 +872,11 @@ cJSON_AddItemToArray(cJSON * array, cJSON * item)
 		return;
 	if (!c) {
 		array->child = item;
+		item->prev = item;
+		item->next = 0;
 	} else {
-		while (c && c->next)
-			c = c->next;
-		suffix_object(c, item);
+		suffix_object(c->prev, item);
+		c->prev = item;
 	}
 }
 
@@ -922,12 +925,14 @@ cJSON_DetachItemFromArray(cJSON * array, int which)
 		c = c->next, which--;
 	if (!c)
 		return 0;
-	if (c->prev)
+	if (c != array->child)
 		c->prev->next = c->next;
 	if (c->next)
 		c->next->prev = c->prev;
 	if (c == array->child)
 		array->child = c->next;
+	else if (!c->next)
+		array->child->prev = c->prev;
 	c->prev = c->next = 0;
 	return c;
 }
@@ -968,13 +973,15 @@ cJSON_ReplaceItemInArray(cJSON * array, int which, cJSON * newitem)
 	if (!c)
 		return;
 	newitem->next = c->next;
-	newitem->prev = c->prev;
+	newitem->prev = (c->prev == c) ? newitem : c->prev;
 	if (newitem->next)
 		newitem->next->prev = newitem;
 	if (c == array->child)
 		array->child = newitem;
 	else
 		newitem->prev->next = newitem;
+	if (!newitem->next)
+		array->child->prev = newitem;
 	c->next = c->prev = 0;
 	cJSON_Delete(c);
 }
@@ -1107,6 +1114,8 @@ cJSON_CreateIntArray(int *numbers, int count)
 			suffix_object(p, n);
 		p = n;
 	}
+	if (a && a->child)
+		a->child->prev = n;
 	return a;
 }
 
@@ -1124,6 +1133,8 @@ cJSON_CreateFloatArray(float *numbers, int count)
 			suffix_object(p, n);
 		p = n;
 	}
+	if (a && a->child)
+		a->child->prev = n;
 	return a;
 }
 
@@ -1141,6 +1152,8 @@ cJSON_CreateDoubleArray(double *numbers, int count)
 			suffix_object(p, n);
 		p = n;
 	}
+	if (a && a->child)
+		a->child->prev = n;
 	return a;
 }
 
@@ -1158,5 +1171,7 @@ cJSON_CreateStringArray(const char **strings, int count)
 			suffix_object(p, n);
 		p = n;
 	}
+	if (a && a->child)
+		a->child->prev = n;
 	return a;
 }
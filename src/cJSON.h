@@ -59,6 +59,9 @@ extern "C" {
 typedef struct cJSON {
     /* next/prev allow you to walk array/object chains.
      * Alternatively, use GetArraySize/GetArrayItem/GetObjectItem
+     * The prev of the first item is the last one, so that items are
+     * appended without walking the chain, a walk backwards stops at
+     * the first item rather than at a NULL prev.
      * */
 	struct cJSON *next, *prev;
     
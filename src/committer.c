@@ -0,0 +1,714 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  committer.c
+ *
+ *    Description:  group commit of the writes issued by every connection
+ *                  and worker.
+ *
+ * =============================================================================
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "log.h"
+#include "committer.h"
+
+typedef struct reveldb_commit_s_ reveldb_commit_t;
+typedef struct reveldb_part_s_ reveldb_part_t;
+typedef struct reveldb_lane_s_ reveldb_lane_t;
+typedef struct reveldb_waiter_s_ reveldb_waiter_t;
+
+/* a writer thread and the writes queued to it. */
+struct reveldb_lane_s_ {
+    reveldb_committer_t *committer;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t queued; /* signalled whenever a write is queued. */
+    pthread_cond_t drained; /* signalled whenever the queue runs empty. */
+    reveldb_part_t *head;
+    reveldb_part_t *tail;
+    unsigned int pending; /* writes queued. */
+    int busy; /* set while the writer thread commits a group. */
+    int started;
+    int stop;
+};
+
+struct reveldb_committer_s_ {
+    unsigned int max_batch;
+    unsigned int max_wait; /* microseconds. */
+    leveldb_writeoptions_t *woptions_sync;
+    leveldb_writeoptions_t *woptions_async;
+    unsigned int nlanes;
+    reveldb_lane_t lanes[];
+};
+
+/* a thread waiting for a write, see reveldb_committer_write_wait(). */
+struct reveldb_waiter_s_ {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int done;
+};
+
+/* a write as asked for by a request. */
+struct reveldb_commit_s_ {
+    reveldb_t *db; /* referenced until the write is done. */
+    int sync;
+    unsigned int parts; /* parts not written yet. */
+    evhttpx_request_t *req; /* NULL if nobody waits for the write. */
+    struct event *done; /* made on the loop owning the connection of req,
+                           so that acknowledging the write cannot fail. */
+    int detached; /* set once the connection of req went away, req is then
+                     kept until the write is acknowledged. */
+    reveldb_committer_done_cb cb;
+    void *arg;
+    reveldb_waiter_t *waiter; /* set if a thread waits for the write, it
+                                 frees the write once done. */
+    char *err; /* the first error of any part. */
+};
+
+/* the part of a write going to one database, or one shard of it. */
+struct reveldb_part_s_ {
+    reveldb_part_t *next;
+    xleveldb_instance_t *instance;
+    leveldb_writebatch_t *batch; /* NULL if there is nothing to write. */
+    reveldb_committer_update_cb update; /* fills batch in once its turn
+                                           comes, if set. */
+    int merged; /* set once written along with its group. */
+    reveldb_commit_t *commit;
+};
+
+static void
+_committer_free_commit(reveldb_commit_t *commit)
+{
+    reveldb_release_db(commit->db);
+    if (commit->done != NULL) event_free(commit->done);
+    free(commit->err);
+    free(commit);
+}
+
+static void
+_committer_done(evutil_socket_t fd, short events, void *arg)
+{
+    reveldb_commit_t *commit = (reveldb_commit_t *)arg;
+    evhttpx_request_t *req = commit->req;
+    evhttpx_arena_t *prev = evhttpx_arena_set_current(
+            evhttpx_request_get_arena(req));
+
+    if (commit->detached) {
+        /* nobody is left to reply to, cb only releases arg. */
+        commit->req = NULL;
+        commit->cb(NULL, commit->err, commit->arg);
+        evhttpx_arena_set_current(prev);
+        evhttpx_request_free(req);
+        _committer_free_commit(commit);
+        return;
+    }
+    evhttpx_unset_hook(&req->hooks, evhttpx_hook_on_request_fini);
+    commit->cb(req, commit->err, commit->arg);
+    evhttpx_arena_set_current(prev);
+    evhttpx_request_resume(req);
+    _committer_free_commit(commit);
+}
+
+/* the connection of req is going away while its write is queued, the
+ * request is kept until the write is acknowledged. */
+static evhttpx_res
+_committer_abort(evhttpx_request_t *req, void *arg)
+{
+    reveldb_commit_t *commit = (reveldb_commit_t *)arg;
+
+    evhttpx_unset_hook(&req->hooks, evhttpx_hook_on_request_fini);
+    commit->detached = 1;
+    return EVHTTPX_RES_PAUSE;
+}
+
+/* has the loop owning the connection of req acknowledge commit, returns -1
+ * if there is no memory left to. */
+static int
+_committer_wait(reveldb_commit_t *commit, evhttpx_request_t *req,
+        reveldb_committer_done_cb cb, void *arg)
+{
+    commit->done = event_new(evhttpx_request_get_connection(req)->evbase,
+            -1, 0, _committer_done, commit);
+    if (commit->done == NULL) {
+        LOG_ERROR(("failed to create the event acknowledging a write."));
+        return -1;
+    }
+    if (evhttpx_set_hook(&req->hooks, evhttpx_hook_on_request_fini,
+                (evhttpx_hook)_committer_abort, commit) != 0) {
+        LOG_ERROR(("failed to hook the end of the request of a write."));
+        event_free(commit->done);
+        commit->done = NULL;
+        return -1;
+    }
+    commit->req = req;
+    commit->cb = cb;
+    commit->arg = arg;
+    return 0;
+}
+
+static void
+_committer_fail(reveldb_commit_t *commit, const char *err)
+{
+    char *copy = strdup(err);
+
+    /* parts are written by several threads, the first error wins. */
+    if (!__sync_bool_compare_and_swap(&commit->err, NULL, copy)) free(copy);
+}
+
+static void
+_committer_batch_put(void *state,
+        const char *key, size_t klen,
+        const char *val, size_t vlen)
+{
+    leveldb_writebatch_put((leveldb_writebatch_t *)state, key, klen, val, vlen);
+}
+
+static void
+_committer_batch_delete(void *state, const char *key, size_t klen)
+{
+    leveldb_writebatch_delete((leveldb_writebatch_t *)state, key, klen);
+}
+
+/* writes the parts of instance from from up to until in a single
+ * leveldb_write(). */
+static void
+_committer_flush(reveldb_committer_t *committer, xleveldb_instance_t *instance,
+        reveldb_part_t *from, reveldb_part_t *until)
+{
+    reveldb_part_t *part = NULL;
+    leveldb_writebatch_t *batch = NULL;
+    leveldb_writebatch_t *merged = NULL;
+    int sync = 0;
+    char *err = NULL;
+
+    for (part = from; part != until; part = part->next) {
+        if (part->instance != instance || part->batch == NULL) continue;
+        if (batch == NULL) {
+            batch = part->batch;
+        } else {
+            if (merged == NULL) {
+                merged = leveldb_writebatch_create();
+                leveldb_writebatch_iterate(batch, merged,
+                        _committer_batch_put, _committer_batch_delete);
+                batch = merged;
+            }
+            leveldb_writebatch_iterate(part->batch, merged,
+                    _committer_batch_put, _committer_batch_delete);
+        }
+        /* one sync covers everything in the batch. */
+        sync |= part->commit->sync;
+    }
+    if (batch == NULL) return;
+
+    xleveldb_write(instance,
+            sync ? committer->woptions_sync : committer->woptions_async,
+            batch, &err);
+    if (merged != NULL) leveldb_writebatch_destroy(merged);
+    if (err == NULL) return;
+
+    for (part = from; part != until; part = part->next) {
+        if (part->instance != instance || part->batch == NULL) continue;
+        _committer_fail(part->commit, err);
+    }
+    leveldb_free(err);
+}
+
+/* has update decide on the writes of part, with the arena of the request
+ * waiting for it. */
+static void
+_committer_update(reveldb_part_t *part)
+{
+    reveldb_commit_t *commit = part->commit;
+    evhttpx_arena_t *prev = evhttpx_arena_set_current(
+            evhttpx_request_get_arena(commit->req));
+
+    part->batch = leveldb_writebatch_create();
+    if (part->update(commit->db->instance, part->batch, commit->arg) == 0) {
+        leveldb_writebatch_destroy(part->batch);
+        part->batch = NULL;
+    }
+    evhttpx_arena_set_current(prev);
+}
+
+/* writes every part of the group belonging to the database of first, with
+ * a single leveldb_write() unless there are updates: they have to read
+ * whatever was queued before them, which is written first. */
+static void
+_committer_write_db(reveldb_committer_t *committer, reveldb_part_t *first)
+{
+    reveldb_part_t *part = NULL;
+    reveldb_part_t *from = first;
+
+    for (part = first; part != NULL; part = part->next) {
+        if (part->merged || part->instance != first->instance) continue;
+        part->merged = 1;
+        if (part->update == NULL) continue;
+        _committer_flush(committer, first->instance, from, part);
+        _committer_update(part);
+        from = part;
+    }
+    _committer_flush(committer, first->instance, from, NULL);
+}
+
+static void
+_committer_commit(reveldb_committer_t *committer, reveldb_part_t *group)
+{
+    reveldb_part_t *part = NULL;
+    reveldb_part_t *next = NULL;
+
+    /* writes to different databases go to leveldb separately. */
+    for (part = group; part != NULL; part = part->next) {
+        if (part->merged == 0) _committer_write_db(committer, part);
+    }
+
+    for (part = group; part != NULL; part = next) {
+        reveldb_commit_t *commit = part->commit;
+
+        next = part->next;
+        if (part->batch != NULL) leveldb_writebatch_destroy(part->batch);
+        free(part);
+        /* the last part written finishes the write. */
+        if (__sync_sub_and_fetch(&commit->parts, 1) > 0) continue;
+        if (commit->waiter != NULL) {
+            pthread_mutex_lock(&commit->waiter->lock);
+            commit->waiter->done = 1;
+            pthread_cond_signal(&commit->waiter->cond);
+            pthread_mutex_unlock(&commit->waiter->lock);
+            continue;
+        }
+        if (commit->req == NULL) {
+            if (commit->err != NULL) {
+                LOG_ERROR(("failed to commit a write: %s", commit->err));
+            }
+            _committer_free_commit(commit);
+            continue;
+        }
+        /* acknowledge it from the loop it belongs to. */
+        event_active(commit->done, EV_TIMEOUT, 0);
+    }
+}
+
+static void
+_committer_wait_for_more(reveldb_lane_t *lane)
+{
+    struct timeval now;
+    struct timespec deadline;
+    unsigned int max_wait = lane->committer->max_wait;
+
+    gettimeofday(&now, NULL);
+    deadline.tv_sec = now.tv_sec + max_wait / 1000000;
+    deadline.tv_nsec = (now.tv_usec + max_wait % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    while (lane->pending < lane->committer->max_batch && lane->stop == 0) {
+        if (pthread_cond_timedwait(&lane->queued, &lane->lock,
+                    &deadline) == ETIMEDOUT) break;
+    }
+}
+
+static void *
+_committer_run(void *arg)
+{
+    reveldb_lane_t *lane = (reveldb_lane_t *)arg;
+    reveldb_committer_t *committer = lane->committer;
+    reveldb_part_t *group = NULL;
+    reveldb_part_t *last = NULL;
+    unsigned int n = 0;
+
+    pthread_mutex_lock(&lane->lock);
+    for (;;) {
+        while (lane->head == NULL && lane->stop == 0) {
+            pthread_cond_wait(&lane->queued, &lane->lock);
+        }
+        if (lane->head == NULL) break;
+
+        /* writes queued while the last group was being written make up
+         * the next one, give more of them a chance to join if asked to. */
+        if (committer->max_wait > 0) _committer_wait_for_more(lane);
+
+        group = last = lane->head;
+        for (n = 1; n < committer->max_batch && last->next != NULL; n++) {
+            last = last->next;
+        }
+        lane->head = last->next;
+        if (lane->head == NULL) lane->tail = NULL;
+        lane->pending -= n;
+        last->next = NULL;
+        lane->busy = 1;
+        pthread_mutex_unlock(&lane->lock);
+
+        _committer_commit(committer, group);
+
+        pthread_mutex_lock(&lane->lock);
+        lane->busy = 0;
+        if (lane->head == NULL) {
+            pthread_cond_broadcast(&lane->drained);
+        }
+    }
+    pthread_mutex_unlock(&lane->lock);
+    return NULL;
+}
+
+reveldb_committer_t *
+reveldb_committer_init(unsigned int max_batch, unsigned int max_wait,
+        unsigned int nthreads)
+{
+    unsigned int i = 0;
+    unsigned int nlanes = (nthreads > 0) ? nthreads : 1;
+    reveldb_committer_t *committer = (reveldb_committer_t *)malloc(
+            sizeof(reveldb_committer_t) + sizeof(reveldb_lane_t) * nlanes);
+    if (committer == NULL) {
+        LOG_ERROR(("failed to malloc reveldb_committer_t."));
+        return NULL;
+    }
+    memset(committer, 0,
+            sizeof(reveldb_committer_t) + sizeof(reveldb_lane_t) * nlanes);
+
+    committer->max_batch = (max_batch > 0) ?
+        max_batch : REVELDB_COMMITTER_MAX_BATCH;
+    committer->max_wait = max_wait;
+    committer->woptions_sync = leveldb_writeoptions_create();
+    leveldb_writeoptions_set_sync(committer->woptions_sync, 1);
+    committer->woptions_async = leveldb_writeoptions_create();
+    leveldb_writeoptions_set_sync(committer->woptions_async, 0);
+    committer->nlanes = nlanes;
+
+    for (i = 0; i < nlanes; i++) {
+        reveldb_lane_t *lane = &committer->lanes[i];
+        lane->committer = committer;
+        pthread_mutex_init(&lane->lock, NULL);
+        pthread_cond_init(&lane->queued, NULL);
+        pthread_cond_init(&lane->drained, NULL);
+    }
+    for (i = 0; i < nlanes; i++) {
+        reveldb_lane_t *lane = &committer->lanes[i];
+        if (pthread_create(&lane->thread, NULL,
+                    _committer_run, lane) != 0) {
+            LOG_ERROR(("failed to start the commit threads, "
+                        "writing on the event loops."));
+            reveldb_committer_free(committer);
+            return NULL;
+        }
+        lane->started = 1;
+    }
+    return committer;
+}
+
+/* queues part to the thread owning its database or shard. */
+static void
+_committer_queue(reveldb_committer_t *committer, reveldb_part_t *part)
+{
+    reveldb_lane_t *lane =
+        &committer->lanes[part->instance->id % committer->nlanes];
+
+    pthread_mutex_lock(&lane->lock);
+    if (lane->tail != NULL) lane->tail->next = part;
+    else lane->head = part;
+    lane->tail = part;
+    lane->pending++;
+    pthread_cond_signal(&lane->queued);
+    pthread_mutex_unlock(&lane->lock);
+}
+
+static reveldb_part_t *
+_committer_part_new(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, reveldb_commit_t *commit)
+{
+    reveldb_part_t *part = (reveldb_part_t *)malloc(sizeof(reveldb_part_t));
+    if (part == NULL) {
+        LOG_ERROR(("failed to malloc reveldb_part_t."));
+        return NULL;
+    }
+    memset(part, 0, sizeof(reveldb_part_t));
+    part->instance = instance;
+    part->batch = batch;
+    part->commit = commit;
+    return part;
+}
+
+/* splits batch into the parts of commit, returns how many there are,
+ * or -1 if they could not be allocated. */
+static int
+_committer_split(xleveldb_instance_t *instance, leveldb_writebatch_t *batch,
+        reveldb_commit_t *commit, reveldb_part_t **parts)
+{
+    leveldb_writebatch_t **batches = NULL;
+    unsigned int k = 0;
+    int n = 0;
+
+    if (instance->nshards <= 1) {
+        parts[0] = _committer_part_new(instance, batch, commit);
+        return (parts[0] != NULL) ? 1 : -1;
+    }
+
+    batches = (leveldb_writebatch_t **)
+        malloc(sizeof(leveldb_writebatch_t *) * instance->nshards);
+    if (batches == NULL) return -1;
+    xleveldb_split_batch(instance, batch, batches);
+    for (k = 0; k < instance->nshards; k++) {
+        if (batches[k] == NULL) continue;
+        parts[n] = _committer_part_new(instance->shards[k],
+                batches[k], commit);
+        if (parts[n] == NULL) break;
+        n++;
+    }
+    if (k < instance->nshards) {
+        while (n > 0) free(parts[--n]);
+        for (k = 0; k < instance->nshards; k++) {
+            if (batches[k] != NULL) leveldb_writebatch_destroy(batches[k]);
+        }
+        free(batches);
+        return -1;
+    }
+    free(batches);
+    leveldb_writebatch_destroy(batch);
+    return n;
+}
+
+void
+reveldb_committer_write(reveldb_committer_t *committer,
+        evhttpx_request_t *req,
+        reveldb_t *db,
+        leveldb_writebatch_t *batch,
+        reveldb_durability_t durability,
+        reveldb_committer_done_cb cb, void *arg)
+{
+    xleveldb_instance_t *instance = db->instance;
+    reveldb_commit_t *commit = NULL;
+    reveldb_part_t **parts = NULL;
+    char *err = NULL;
+    int n = -1;
+    int i = 0;
+
+    assert(req != NULL);
+    assert(cb != NULL);
+
+    if (committer != NULL) {
+        commit = (reveldb_commit_t *)malloc(sizeof(reveldb_commit_t));
+        parts = (reveldb_part_t **)
+            malloc(sizeof(reveldb_part_t *) * instance->nshards);
+        if (commit == NULL || parts == NULL) {
+            LOG_ERROR(("failed to malloc reveldb_commit_t."));
+        } else {
+            memset(commit, 0, sizeof(reveldb_commit_t));
+            if (durability == REVELDB_DURABILITY_NONE
+                    || _committer_wait(commit, req, cb, arg) == 0) {
+                n = _committer_split(instance, batch, commit, parts);
+            }
+        }
+    }
+    if (n < 0) {
+        if (commit != NULL && commit->done != NULL) {
+            evhttpx_unset_hook(&req->hooks, evhttpx_hook_on_request_fini);
+            event_free(commit->done);
+        }
+        free(commit);
+        free(parts);
+        xleveldb_write(instance, instance->woptions, batch, &err);
+        leveldb_writebatch_destroy(batch);
+        cb(req, err, arg);
+        if (err != NULL) leveldb_free(err);
+        return;
+    }
+    if (n == 0) {
+        /* nothing to write. */
+        if (commit->done != NULL) {
+            evhttpx_unset_hook(&req->hooks, evhttpx_hook_on_request_fini);
+        }
+        _committer_free_commit(commit);
+        free(parts);
+        cb(req, NULL, arg);
+        return;
+    }
+
+    reveldb_retain_db(db);
+    commit->db = db;
+    commit->sync = (durability == REVELDB_DURABILITY_SYNC) ? 1 : 0;
+    /* set before any part is queued, a thread may finish one right away. */
+    commit->parts = n;
+    if (durability != REVELDB_DURABILITY_NONE) {
+        /* stop reading from the connection until the write is done. */
+        evhttpx_request_pause(req);
+    }
+
+    for (i = 0; i < n; i++) _committer_queue(committer, parts[i]);
+    free(parts);
+
+    if (durability == REVELDB_DURABILITY_NONE) cb(req, NULL, arg);
+}
+
+void
+reveldb_committer_update(reveldb_committer_t *committer,
+        evhttpx_request_t *req,
+        reveldb_t *db,
+        const char *key, size_t key_len,
+        reveldb_committer_update_cb update,
+        reveldb_durability_t durability,
+        reveldb_committer_done_cb cb, void *arg)
+{
+    xleveldb_instance_t *instance = db->instance;
+    leveldb_writebatch_t *batch = NULL;
+    reveldb_commit_t *commit = NULL;
+    reveldb_part_t *part = NULL;
+    char *err = NULL;
+
+    assert(req != NULL);
+    assert(update != NULL);
+    assert(cb != NULL);
+
+    if (committer != NULL) {
+        commit = (reveldb_commit_t *)malloc(sizeof(reveldb_commit_t));
+        if (commit == NULL) {
+            LOG_ERROR(("failed to malloc reveldb_commit_t."));
+        } else {
+            memset(commit, 0, sizeof(reveldb_commit_t));
+            if (_committer_wait(commit, req, cb, arg) == 0) {
+                part = _committer_part_new(
+                        xleveldb_shard(instance, key, key_len), NULL, commit);
+            }
+        }
+    }
+    if (part == NULL) {
+        if (commit != NULL && commit->done != NULL) {
+            evhttpx_unset_hook(&req->hooks, evhttpx_hook_on_request_fini);
+            event_free(commit->done);
+        }
+        free(commit);
+        batch = leveldb_writebatch_create();
+        if (update(instance, batch, arg) != 0) {
+            xleveldb_write(instance, instance->woptions, batch, &err);
+        }
+        leveldb_writebatch_destroy(batch);
+        cb(req, err, arg);
+        if (err != NULL) leveldb_free(err);
+        return;
+    }
+
+    reveldb_retain_db(db);
+    commit->db = db;
+    commit->sync = (durability == REVELDB_DURABILITY_SYNC) ? 1 : 0;
+    commit->parts = 1;
+    /* what to reply depends on what update reads, so the request waits
+     * for it whatever the durability asked for. */
+    part->update = update;
+    evhttpx_request_pause(req);
+
+    _committer_queue(committer, part);
+}
+
+int
+reveldb_committer_write_wait(reveldb_committer_t *committer,
+        reveldb_t *db,
+        leveldb_writebatch_t *batch,
+        reveldb_durability_t durability,
+        char **errptr)
+{
+    xleveldb_instance_t *instance = db->instance;
+    reveldb_commit_t *commit = NULL;
+    reveldb_part_t **parts = NULL;
+    reveldb_waiter_t waiter;
+    int n = -1;
+    int i = 0;
+
+    *errptr = NULL;
+    if (committer != NULL) {
+        commit = (reveldb_commit_t *)malloc(sizeof(reveldb_commit_t));
+        parts = (reveldb_part_t **)
+            malloc(sizeof(reveldb_part_t *) * instance->nshards);
+        if (commit == NULL || parts == NULL) {
+            LOG_ERROR(("failed to malloc reveldb_commit_t."));
+        } else {
+            memset(commit, 0, sizeof(reveldb_commit_t));
+            n = _committer_split(instance, batch, commit, parts);
+        }
+    }
+    if (n < 0) {
+        free(commit);
+        free(parts);
+        xleveldb_write(instance, instance->woptions, batch, errptr);
+        leveldb_writebatch_destroy(batch);
+        return (*errptr == NULL) ? 0 : -1;
+    }
+    if (n == 0) {
+        /* nothing to write. */
+        free(commit);
+        free(parts);
+        return 0;
+    }
+
+    pthread_mutex_init(&waiter.lock, NULL);
+    pthread_cond_init(&waiter.cond, NULL);
+    waiter.done = 0;
+    reveldb_retain_db(db);
+    commit->db = db;
+    commit->sync = (durability == REVELDB_DURABILITY_SYNC) ? 1 : 0;
+    commit->parts = n;
+    commit->waiter = &waiter;
+
+    for (i = 0; i < n; i++) _committer_queue(committer, parts[i]);
+    free(parts);
+
+    pthread_mutex_lock(&waiter.lock);
+    while (waiter.done == 0) pthread_cond_wait(&waiter.cond, &waiter.lock);
+    pthread_mutex_unlock(&waiter.lock);
+    pthread_cond_destroy(&waiter.cond);
+    pthread_mutex_destroy(&waiter.lock);
+
+    *errptr = commit->err;
+    commit->err = NULL;
+    _committer_free_commit(commit);
+    return (*errptr == NULL) ? 0 : -1;
+}
+
+void
+reveldb_committer_drain(reveldb_committer_t *committer)
+{
+    unsigned int i = 0;
+
+    if (committer == NULL) return;
+    for (i = 0; i < committer->nlanes; i++) {
+        reveldb_lane_t *lane = &committer->lanes[i];
+        pthread_mutex_lock(&lane->lock);
+        while (lane->head != NULL || lane->busy) {
+            pthread_cond_wait(&lane->drained, &lane->lock);
+        }
+        pthread_mutex_unlock(&lane->lock);
+    }
+}
+
+void
+reveldb_committer_free(reveldb_committer_t *committer)
+{
+    unsigned int i = 0;
+
+    if (committer == NULL) return;
+    for (i = 0; i < committer->nlanes; i++) {
+        reveldb_lane_t *lane = &committer->lanes[i];
+        pthread_mutex_lock(&lane->lock);
+        lane->stop = 1;
+        pthread_cond_signal(&lane->queued);
+        pthread_mutex_unlock(&lane->lock);
+    }
+    for (i = 0; i < committer->nlanes; i++) {
+        reveldb_lane_t *lane = &committer->lanes[i];
+        /* whatever is still queued gets written first. */
+        if (lane->started) pthread_join(lane->thread, NULL);
+        pthread_mutex_destroy(&lane->lock);
+        pthread_cond_destroy(&lane->queued);
+        pthread_cond_destroy(&lane->drained);
+    }
+    leveldb_writeoptions_destroy(committer->woptions_sync);
+    leveldb_writeoptions_destroy(committer->woptions_async);
+    free(committer);
+}
@@ -0,0 +1,90 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  committer.h
+ *
+ *    Description:  group commit of the writes issued by every connection
+ *                  and worker.
+ *
+ * =============================================================================
+ */
+#ifndef _REVELDB_COMMITTER_H_
+#define _REVELDB_COMMITTER_H_
+
+#include <reveldb/reveldb.h>
+#include <reveldb/evhttpx/evhttpx.h>
+#include <reveldb/engine/xleveldb.h>
+
+typedef struct reveldb_committer_s_ reveldb_committer_t;
+
+/* writes merged into one batch, unless set otherwise. */
+#define REVELDB_COMMITTER_MAX_BATCH 256
+
+typedef enum {
+    REVELDB_DURABILITY_NONE = 0, /* acknowledged once queued. */
+    REVELDB_DURABILITY_ASYNC, /* acknowledged once written, not synced. */
+    REVELDB_DURABILITY_SYNC, /* acknowledged once synced to disk. */
+} reveldb_durability_t;
+
+/* runs on the loop owning the connection of req once the write is done,
+ * err is NULL on success. req is NULL if its connection went away
+ * meanwhile, cb is then only left to release arg, with the arena of the
+ * request as the current one. */
+typedef void (*reveldb_committer_done_cb)(evhttpx_request_t *req,
+        const char *err, void *arg);
+
+/* nthreads writer threads, each one owning the databases and shards
+ * whose id it is handed, merge up to max_batch queued writes into one
+ * leveldb_write() per database, waiting up to max_wait microseconds for
+ * more writes to join a batch that is not full yet. */
+extern reveldb_committer_t * reveldb_committer_init(unsigned int max_batch,
+        unsigned int max_wait, unsigned int nthreads);
+
+/* queues batch, which the committer takes over, and calls cb once it is as
+ * durable as asked for. req is paused meanwhile, except for
+ * REVELDB_DURABILITY_NONE where cb is called right away. the batch of a
+ * sharded database is split up and written by the owner of each shard,
+ * cb is called once all of them are done. db is referenced until then. */
+extern void reveldb_committer_write(reveldb_committer_t *committer,
+        evhttpx_request_t *req,
+        reveldb_t *db,
+        leveldb_writebatch_t *batch,
+        reveldb_durability_t durability,
+        reveldb_committer_done_cb cb, void *arg);
+
+/* reads what a write depends on and puts it into batch, returns 0 if there
+ * is nothing to write. instance is the whole database. */
+typedef int (*reveldb_committer_update_cb)(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, void *arg);
+
+/* a read-modify-write of key: update runs on the writer thread owning
+ * the shard of key, once every write queued to it before has been
+ * written, and whatever it puts into batch is written before any write
+ * queued after it, so that no other write to key comes in between. The
+ * arena of req is the current one while update runs. req is paused until
+ * cb is called, once the writes are as durable as asked for. update may
+ * only write key. */
+extern void reveldb_committer_update(reveldb_committer_t *committer,
+        evhttpx_request_t *req,
+        reveldb_t *db,
+        const char *key, size_t key_len,
+        reveldb_committer_update_cb update,
+        reveldb_durability_t durability,
+        reveldb_committer_done_cb cb, void *arg);
+
+/* writes batch, which the committer takes over, the way
+ * reveldb_committer_write() does, but waits for it on the calling thread,
+ * which may be neither a loop nor a commit thread. Returns 0 on success,
+ * -1 with *errptr set, to be released with leveldb_free(), otherwise. */
+extern int reveldb_committer_write_wait(reveldb_committer_t *committer,
+        reveldb_t *db,
+        leveldb_writebatch_t *batch,
+        reveldb_durability_t durability,
+        char **errptr);
+
+/* waits until every write queued so far has been written. */
+extern void reveldb_committer_drain(reveldb_committer_t *committer);
+
+extern void reveldb_committer_free(reveldb_committer_t *committer);
+
+#endif /* _REVELDB_COMMITTER_H_ */
@@ -0,0 +1,554 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  compactor.c
+ *
+ *    Description:  background range compaction, split up into sub-ranges
+ *                  and throttled.
+ *
+ * =============================================================================
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "log.h"
+#include "compactor.h"
+
+typedef struct reveldb_cjob_s_ reveldb_cjob_t;
+typedef struct reveldb_crange_s_ reveldb_crange_t;
+
+/* a sub-range of a job, compacted by one leveldb_compact_range(). */
+struct reveldb_crange_s_ {
+    leveldb_t *db; /* the database or shard holding it. */
+    char *start; /* NULL means from the first key. */
+    size_t start_len;
+    char *limit; /* NULL means up to the last key. */
+    size_t limit_len;
+    uint64_t size;
+};
+
+struct reveldb_cjob_s_ {
+    reveldb_cjob_t *next;
+    reveldb_t *db; /* referenced until finished. */
+    xleveldb_instance_t *instance; /* NULL once finished. */
+    char *start;
+    size_t start_len;
+    char *limit;
+    size_t limit_len;
+    reveldb_crange_t *ranges;
+    unsigned int nranges;
+    int cancel;
+    reveldb_compaction_t stats; /* guarded by the lock of the compactor. */
+};
+
+struct reveldb_compactor_s_ {
+    uint64_t rate;
+    uint64_t range_size;
+    leveldb_readoptions_t *roptions;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup; /* signalled on a new job, a cancel or a stop. */
+    reveldb_cjob_t *head; /* every job, in submission order. */
+    reveldb_cjob_t *tail;
+    unsigned int finished;
+    int started;
+    int stop;
+};
+
+static char *
+_compactor_strndup(const char *str, size_t len)
+{
+    char *dup = (char *)malloc(len + 1);
+    if (dup == NULL) return NULL;
+    memcpy(dup, str, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+static void
+_compactor_free_ranges(reveldb_cjob_t *job)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < job->nranges; i++) {
+        free(job->ranges[i].start);
+        free(job->ranges[i].limit);
+    }
+    free(job->ranges);
+    job->ranges = NULL;
+    job->nranges = 0;
+}
+
+static void
+_compactor_free_job(reveldb_cjob_t *job)
+{
+    _compactor_free_ranges(job);
+    reveldb_release_db(job->db);
+    free((char *)job->stats.id);
+    free((char *)job->stats.dbname);
+    free(job->start);
+    free(job->limit);
+    free(job);
+}
+
+static int
+_compactor_add_range(reveldb_cjob_t *job, unsigned int *capacity,
+        leveldb_t *db, const char *start, size_t start_len,
+        const char *limit, size_t limit_len, uint64_t size)
+{
+    reveldb_crange_t *range = NULL;
+
+    if (job->nranges == *capacity) {
+        unsigned int n = (*capacity > 0) ? *capacity * 2 : 16;
+        range = (reveldb_crange_t *)
+            realloc(job->ranges, n * sizeof(reveldb_crange_t));
+        if (range == NULL) return -1;
+        job->ranges = range;
+        *capacity = n;
+    }
+    range = &job->ranges[job->nranges];
+    memset(range, 0, sizeof(reveldb_crange_t));
+    range->db = db;
+    range->size = size;
+    if (start != NULL) {
+        range->start = _compactor_strndup(start, start_len);
+        range->start_len = start_len;
+        if (range->start == NULL) return -1;
+    }
+    if (limit != NULL) {
+        range->limit = _compactor_strndup(limit, limit_len);
+        range->limit_len = limit_len;
+        if (range->limit == NULL) {
+            free(range->start);
+            return -1;
+        }
+    }
+    job->nranges++;
+    return 0;
+}
+
+/* splits the part of the job held by shard at the byte following the prefix
+ * its lowest and highest keys share, that is into at most 256 pieces of
+ * ascending keys, and merges neighbouring pieces until they weigh about
+ * range_size bytes according to leveldb_approximate_sizes(). */
+static int
+_compactor_plan_db(reveldb_compactor_t *compactor, reveldb_cjob_t *job,
+        xleveldb_instance_t *shard, unsigned int *capacity, uint64_t *bytes)
+{
+    leveldb_t *db = shard->db;
+    leveldb_iterator_t *iter = NULL;
+    const char *key = NULL;
+    char *lo = NULL, *hi = NULL, *bounds = NULL;
+    size_t lo_len = 0, hi_len = 0, prefix = 0, len = 0;
+    const char *starts[257], *limits[257];
+    size_t start_lens[257], limit_lens[257];
+    uint64_t sizes[257];
+    int c = 0, first = 0, last = -1;
+    unsigned int n = 0, i = 0, group = 0;
+    uint64_t size = 0;
+    int ret = -1;
+
+    /* the range is narrowed down to the keys it actually holds. */
+    iter = leveldb_create_iterator(db, compactor->roptions);
+    if (job->start != NULL) leveldb_iter_seek(iter, job->start, job->start_len);
+    else leveldb_iter_seek_to_first(iter);
+    if (!leveldb_iter_valid(iter)) {
+        /* no live key, though deleted ones may still be waiting for a
+         * compaction to drop them. */
+        leveldb_iter_destroy(iter);
+        return _compactor_add_range(job, capacity, db,
+                job->start, job->start_len, job->limit, job->limit_len, 0);
+    }
+    key = leveldb_iter_key(iter, &lo_len);
+    lo = _compactor_strndup(key, lo_len);
+    if (job->limit != NULL) {
+        hi = _compactor_strndup(job->limit, job->limit_len);
+        hi_len = job->limit_len;
+    } else {
+        leveldb_iter_seek_to_last(iter);
+        key = leveldb_iter_key(iter, &hi_len);
+        hi = _compactor_strndup(key, hi_len);
+    }
+    leveldb_iter_destroy(iter);
+    if (lo == NULL || hi == NULL) goto out;
+
+    if (xleveldb_compare(shard, lo, lo_len, hi, hi_len) > 0) {
+        /* no live key up to limit. */
+        ret = _compactor_add_range(job, capacity, db,
+                job->start, job->start_len, job->limit, job->limit_len, 0);
+        goto out;
+    }
+    while (prefix < lo_len && prefix < hi_len && lo[prefix] == hi[prefix]) {
+        prefix++;
+    }
+    /* splitting by bytes only follows the bytewise order, the range is
+     * compacted in one go otherwise. */
+    if (prefix < hi_len && shard->order == XLEVELDB_COMPARATOR_BYTEWISE) {
+        /* every prefix + c with first <= c <= last lies within (lo, hi]. */
+        first = (prefix < lo_len) ? (unsigned char)lo[prefix] + 1 : 0;
+        last = (unsigned char)hi[prefix];
+        /* a piece running from hi to hi would be of no use. */
+        if (hi_len == prefix + 1) last--;
+    }
+    len = prefix + 1;
+    if (first <= last) {
+        bounds = (char *)malloc((last - first + 1) * len);
+        if (bounds == NULL) goto out;
+    }
+
+    starts[0] = lo;
+    start_lens[0] = lo_len;
+    for (c = first; c <= last; c++) {
+        char *bound = bounds + (c - first) * len;
+        memcpy(bound, hi, prefix);
+        bound[prefix] = (char)c;
+        limits[n] = bound;
+        limit_lens[n] = len;
+        n++;
+        starts[n] = bound;
+        start_lens[n] = len;
+    }
+    limits[n] = hi;
+    limit_lens[n] = hi_len;
+    n++;
+    leveldb_approximate_sizes(db, n, starts, start_lens,
+            limits, limit_lens, sizes);
+
+    for (i = 0; i < n; i++) {
+        size += sizes[i];
+        if (size < compactor->range_size && i + 1 < n) continue;
+        /* the outer bounds are the ones of the job, so that deleted keys
+         * around the live ones, and keys written since, are covered. */
+        if (_compactor_add_range(job, capacity, db,
+                    (group == 0) ? job->start : starts[group],
+                    (group == 0) ? job->start_len : start_lens[group],
+                    (i + 1 == n && job->limit == NULL) ? NULL : limits[i],
+                    limit_lens[i], size) != 0) goto out;
+        *bytes += size;
+        size = 0;
+        group = i + 1;
+    }
+    ret = 0;
+
+out:
+    free(bounds);
+    free(lo);
+    free(hi);
+    return ret;
+}
+
+static int
+_compactor_plan(reveldb_compactor_t *compactor, reveldb_cjob_t *job,
+        uint64_t *bytes)
+{
+    unsigned int capacity = 0;
+    unsigned int k = 0;
+
+    for (k = 0; k < job->instance->nshards; k++) {
+        if (_compactor_plan_db(compactor, job,
+                    job->instance->shards[k], &capacity, bytes) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* holds the thread back until rate allows for size more bytes, elapsed
+ * microseconds after the last sub-range was started. lock is held. */
+static void
+_compactor_throttle(reveldb_compactor_t *compactor, reveldb_cjob_t *job,
+        uint64_t size, uint64_t elapsed)
+{
+    struct timeval now;
+    struct timespec deadline;
+    uint64_t wait = 0;
+
+    if (job->stats.rate == 0) return;
+    wait = (uint64_t)((double)size * 1000000 / job->stats.rate);
+    if (wait <= elapsed) return;
+    wait -= elapsed;
+
+    gettimeofday(&now, NULL);
+    deadline.tv_sec = now.tv_sec + wait / 1000000;
+    deadline.tv_nsec = (now.tv_usec + wait % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    while (job->cancel == 0 && compactor->stop == 0) {
+        if (pthread_cond_timedwait(&compactor->wakeup, &compactor->lock,
+                    &deadline) == ETIMEDOUT) break;
+    }
+}
+
+/* runs job, called and returning with the lock held. */
+static void
+_compactor_run_job(reveldb_compactor_t *compactor, reveldb_cjob_t *job)
+{
+    struct timeval begin, end;
+    uint64_t bytes = 0;
+    unsigned int i = 0;
+
+    pthread_mutex_unlock(&compactor->lock);
+    if (_compactor_plan(compactor, job, &bytes) != 0) {
+        LOG_ERROR(("failed to split up compaction %s, "
+                    "compacting the whole range at once.", job->stats.id));
+        _compactor_free_ranges(job);
+        bytes = 0;
+        xleveldb_compact_range(job->instance, job->start, job->start_len,
+                job->limit, job->limit_len);
+    }
+    pthread_mutex_lock(&compactor->lock);
+    job->stats.ranges = job->nranges;
+    job->stats.bytes = bytes;
+
+    /* cancelling takes effect between sub-ranges. */
+    for (i = 0; i < job->nranges; i++) {
+        reveldb_crange_t *range = &job->ranges[i];
+        if (job->cancel || compactor->stop) break;
+        pthread_mutex_unlock(&compactor->lock);
+
+        gettimeofday(&begin, NULL);
+        leveldb_compact_range(range->db, range->start, range->start_len,
+                range->limit, range->limit_len);
+        gettimeofday(&end, NULL);
+
+        pthread_mutex_lock(&compactor->lock);
+        job->stats.ranges_done++;
+        job->stats.bytes_done += range->size;
+        if (i + 1 < job->nranges) {
+            _compactor_throttle(compactor, job, range->size,
+                    (end.tv_sec - begin.tv_sec) * 1000000ULL
+                    + end.tv_usec - begin.tv_usec);
+        }
+    }
+}
+
+/* drops the oldest finished jobs beyond REVELDB_COMPACTOR_HISTORY. */
+static void
+_compactor_trim(reveldb_compactor_t *compactor)
+{
+    reveldb_cjob_t **link = &compactor->head;
+    reveldb_cjob_t *prev = NULL;
+
+    while (compactor->finished > REVELDB_COMPACTOR_HISTORY && *link != NULL) {
+        reveldb_cjob_t *job = *link;
+        if (job->stats.state < REVELDB_COMPACTION_DONE) {
+            prev = job;
+            link = &job->next;
+            continue;
+        }
+        *link = job->next;
+        if (compactor->tail == job) compactor->tail = prev;
+        compactor->finished--;
+        _compactor_free_job(job);
+    }
+}
+
+static void
+_compactor_finish(reveldb_compactor_t *compactor, reveldb_cjob_t *job,
+        reveldb_compaction_state_t state)
+{
+    job->stats.state = state;
+    job->stats.finished = time(NULL);
+    job->instance = NULL;
+    reveldb_release_db(job->db);
+    job->db = NULL;
+    _compactor_free_ranges(job);
+    compactor->finished++;
+}
+
+static void *
+_compactor_run(void *arg)
+{
+    reveldb_compactor_t *compactor = (reveldb_compactor_t *)arg;
+    reveldb_cjob_t *job = NULL;
+
+    pthread_mutex_lock(&compactor->lock);
+    for (;;) {
+        for (job = compactor->head; job != NULL; job = job->next) {
+            if (job->stats.state == REVELDB_COMPACTION_QUEUED) break;
+        }
+        if (compactor->stop) break;
+        if (job == NULL) {
+            pthread_cond_wait(&compactor->wakeup, &compactor->lock);
+            continue;
+        }
+
+        job->stats.state = REVELDB_COMPACTION_RUNNING;
+        job->stats.started = time(NULL);
+        _compactor_run_job(compactor, job);
+        _compactor_finish(compactor, job, (job->cancel || compactor->stop) ?
+                REVELDB_COMPACTION_CANCELLED : REVELDB_COMPACTION_DONE);
+        _compactor_trim(compactor);
+    }
+    pthread_mutex_unlock(&compactor->lock);
+    return NULL;
+}
+
+reveldb_compactor_t *
+reveldb_compactor_init(uint64_t rate, uint64_t range_size)
+{
+    reveldb_compactor_t *compactor = (reveldb_compactor_t *)
+        malloc(sizeof(reveldb_compactor_t));
+    if (compactor == NULL) {
+        LOG_ERROR(("failed to malloc reveldb_compactor_t."));
+        return NULL;
+    }
+    memset(compactor, 0, sizeof(reveldb_compactor_t));
+
+    compactor->rate = rate;
+    compactor->range_size = (range_size > 0) ?
+        range_size : REVELDB_COMPACTOR_RANGE_SIZE;
+    /* looking for the bounds of a range must not churn the block cache. */
+    compactor->roptions = leveldb_readoptions_create();
+    leveldb_readoptions_set_fill_cache(compactor->roptions, 0);
+    pthread_mutex_init(&compactor->lock, NULL);
+    pthread_cond_init(&compactor->wakeup, NULL);
+
+    if (pthread_create(&compactor->thread, NULL,
+                _compactor_run, compactor) != 0) {
+        LOG_ERROR(("failed to start the compaction thread."));
+        reveldb_compactor_free(compactor);
+        return NULL;
+    }
+    compactor->started = 1;
+    return compactor;
+}
+
+int
+reveldb_compactor_submit(reveldb_compactor_t *compactor,
+        const char *id, reveldb_t *db,
+        const char *start, size_t start_len,
+        const char *limit, size_t limit_len,
+        uint64_t rate)
+{
+    reveldb_cjob_t *job = (reveldb_cjob_t *)malloc(sizeof(reveldb_cjob_t));
+    if (job == NULL) return -1;
+    memset(job, 0, sizeof(reveldb_cjob_t));
+
+    reveldb_retain_db(db);
+    job->db = db;
+    job->instance = db->instance;
+    job->stats.id = _compactor_strndup(id, strlen(id));
+    job->stats.dbname = _compactor_strndup(db->dbname, strlen(db->dbname));
+    job->stats.state = REVELDB_COMPACTION_QUEUED;
+    job->stats.rate = (rate > 0) ? rate : compactor->rate;
+    job->stats.submitted = time(NULL);
+    if (start != NULL) {
+        job->start = _compactor_strndup(start, start_len);
+        job->start_len = start_len;
+    }
+    if (limit != NULL) {
+        job->limit = _compactor_strndup(limit, limit_len);
+        job->limit_len = limit_len;
+    }
+    if (job->stats.id == NULL || job->stats.dbname == NULL
+            || (start != NULL && job->start == NULL)
+            || (limit != NULL && job->limit == NULL)) {
+        _compactor_free_job(job);
+        return -1;
+    }
+
+    pthread_mutex_lock(&compactor->lock);
+    if (compactor->tail != NULL) compactor->tail->next = job;
+    else compactor->head = job;
+    compactor->tail = job;
+    pthread_cond_broadcast(&compactor->wakeup);
+    pthread_mutex_unlock(&compactor->lock);
+    return 0;
+}
+
+int
+reveldb_compactor_cancel(reveldb_compactor_t *compactor, const char *id)
+{
+    reveldb_cjob_t *job = NULL;
+    int ret = -1;
+
+    pthread_mutex_lock(&compactor->lock);
+    for (job = compactor->head; job != NULL; job = job->next) {
+        if (strcmp(job->stats.id, id) == 0) break;
+    }
+    if (job == NULL) ret = -1;
+    else if (job->stats.state >= REVELDB_COMPACTION_DONE) ret = 1;
+    else {
+        if (job->stats.state == REVELDB_COMPACTION_QUEUED) {
+            _compactor_finish(compactor, job, REVELDB_COMPACTION_CANCELLED);
+            _compactor_trim(compactor);
+        } else {
+            job->cancel = 1;
+            pthread_cond_broadcast(&compactor->wakeup);
+        }
+        ret = 0;
+    }
+    pthread_mutex_unlock(&compactor->lock);
+    return ret;
+}
+
+unsigned int
+reveldb_compactor_foreach(reveldb_compactor_t *compactor,
+        const char *id, reveldb_compactor_cb cb, void *arg)
+{
+    reveldb_cjob_t *job = NULL;
+    unsigned int n = 0;
+
+    pthread_mutex_lock(&compactor->lock);
+    for (job = compactor->head; job != NULL; job = job->next) {
+        if (id != NULL && strcmp(job->stats.id, id) != 0) continue;
+        cb(&job->stats, arg);
+        n++;
+    }
+    pthread_mutex_unlock(&compactor->lock);
+    return n;
+}
+
+void
+reveldb_compactor_forget(reveldb_compactor_t *compactor, reveldb_t *db)
+{
+    reveldb_cjob_t *job = NULL;
+
+    if (compactor == NULL) return;
+    pthread_mutex_lock(&compactor->lock);
+    for (job = compactor->head; job != NULL; job = job->next) {
+        if (job->db != db) continue;
+        if (job->stats.state == REVELDB_COMPACTION_QUEUED) {
+            _compactor_finish(compactor, job, REVELDB_COMPACTION_CANCELLED);
+        } else job->cancel = 1;
+    }
+    /* a running job stops after its current sub-range, it holds db until
+     * then. */
+    pthread_cond_broadcast(&compactor->wakeup);
+    _compactor_trim(compactor);
+    pthread_mutex_unlock(&compactor->lock);
+}
+
+void
+reveldb_compactor_free(reveldb_compactor_t *compactor)
+{
+    reveldb_cjob_t *job = NULL;
+
+    if (compactor == NULL) return;
+    pthread_mutex_lock(&compactor->lock);
+    compactor->stop = 1;
+    pthread_cond_broadcast(&compactor->wakeup);
+    pthread_mutex_unlock(&compactor->lock);
+    /* a running job stops after its current sub-range. */
+    if (compactor->started) pthread_join(compactor->thread, NULL);
+
+    while (compactor->head != NULL) {
+        job = compactor->head;
+        compactor->head = job->next;
+        _compactor_free_job(job);
+    }
+    pthread_mutex_destroy(&compactor->lock);
+    pthread_cond_destroy(&compactor->wakeup);
+    leveldb_readoptions_destroy(compactor->roptions);
+    free(compactor);
+}
@@ -0,0 +1,89 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  compactor.h
+ *
+ *    Description:  background range compaction, split up into sub-ranges
+ *                  and throttled.
+ *
+ * =============================================================================
+ */
+#ifndef _REVELDB_COMPACTOR_H_
+#define _REVELDB_COMPACTOR_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <reveldb/reveldb.h>
+#include <reveldb/engine/xleveldb.h>
+
+typedef struct reveldb_compactor_s_ reveldb_compactor_t;
+typedef struct reveldb_compaction_s_ reveldb_compaction_t;
+
+/* bytes compacted by one leveldb_compact_range(), unless set otherwise. */
+#define REVELDB_COMPACTOR_RANGE_SIZE (64 * 1048576ULL)
+
+/* finished jobs kept around for their status. */
+#define REVELDB_COMPACTOR_HISTORY 64
+
+typedef enum {
+    REVELDB_COMPACTION_QUEUED = 0,
+    REVELDB_COMPACTION_RUNNING,
+    REVELDB_COMPACTION_DONE,
+    REVELDB_COMPACTION_CANCELLED,
+} reveldb_compaction_state_t;
+
+/* progress of a job, as handed to reveldb_compactor_foreach(). */
+struct reveldb_compaction_s_ {
+    const char *id;
+    const char *dbname;
+    reveldb_compaction_state_t state;
+    unsigned int ranges; /* sub-ranges, known once the job runs. */
+    unsigned int ranges_done;
+    uint64_t bytes; /* approximate size of the whole range. */
+    uint64_t bytes_done;
+    uint64_t rate; /* bytes per second, 0 means not throttled. */
+    time_t submitted;
+    time_t started;
+    time_t finished;
+};
+
+typedef void (*reveldb_compactor_cb)(const reveldb_compaction_t *job,
+        void *arg);
+
+/* a dedicated thread compacting the queued jobs one after another, each
+ * one split up into sub-ranges of about range_size bytes, going no faster
+ * than rate bytes per second unless a job asks otherwise. */
+extern reveldb_compactor_t * reveldb_compactor_init(uint64_t rate,
+        uint64_t range_size);
+
+/* queues the compaction of [start, limit] of db, either bound being NULL
+ * means the range is open on that side. the job holds a reference on db
+ * until it is finished. id names the job, rate overrides the default of
+ * the compactor when it is not 0. returns -1 if the job could not be
+ * queued. */
+extern int reveldb_compactor_submit(reveldb_compactor_t *compactor,
+        const char *id, reveldb_t *db,
+        const char *start, size_t start_len,
+        const char *limit, size_t limit_len,
+        uint64_t rate);
+
+/* cancels a job, a running one stops before its next sub-range. returns
+ * 0 on success, 1 if the job is already finished, -1 if there is no such
+ * job. */
+extern int reveldb_compactor_cancel(reveldb_compactor_t *compactor,
+        const char *id);
+
+/* calls cb on the job named id, or on every job if id is NULL, and
+ * returns the number of jobs visited. */
+extern unsigned int reveldb_compactor_foreach(reveldb_compactor_t *compactor,
+        const char *id, reveldb_compactor_cb cb, void *arg);
+
+/* cancels the jobs of db without waiting for the running one, which
+ * stops after its current sub-range and releases db then. */
+extern void reveldb_compactor_forget(reveldb_compactor_t *compactor,
+        reveldb_t *db);
+
+extern void reveldb_compactor_free(reveldb_compactor_t *compactor);
+
+#endif /* _REVELDB_COMPACTOR_H_ */
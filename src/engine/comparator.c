@@ -0,0 +1,177 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  comparator.c
+ *
+ *    Description:  key orders a database can be created with.
+ *
+ * =============================================================================
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <reveldb/engine/comparator.h>
+
+typedef struct xleveldb_comparator_s_ {
+    xleveldb_comparator_type_t type;
+    const char *name; /* as given to /rpc/new and kept in the database. */
+    const char *leveldb_name; /* leveldb refuses to open with another. */
+} xleveldb_comparator_t;
+
+static const xleveldb_comparator_t _xleveldb_comparators[] = {
+    {XLEVELDB_COMPARATOR_BYTEWISE,
+        "bytewise", "leveldb.BytewiseComparator"},
+    {XLEVELDB_COMPARATOR_REVERSE_BYTEWISE,
+        "reverse-bytewise", "reveldb.ReverseBytewiseComparator"},
+    {XLEVELDB_COMPARATOR_UINT64,
+        "uint64", "reveldb.Uint64Comparator"},
+    {XLEVELDB_COMPARATOR_INT64,
+        "int64", "reveldb.Int64Comparator"},
+};
+
+static int
+_comparator_bytewise(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    int r = memcmp(a, b, (a_len < b_len) ? a_len : b_len);
+    if (r != 0) return r;
+    if (a_len < b_len) return -1;
+    if (a_len > b_len) return 1;
+    return 0;
+}
+
+static int
+_comparator_is_number(const char *a, size_t a_len)
+{
+    size_t i = 0;
+
+    if (a_len == 0) return 0;
+    for (i = 0; i < a_len; i++) {
+        if (a[i] < '0' || a[i] > '9') return 0;
+    }
+    return 1;
+}
+
+/* orders two strings of digits by value, then by their leading zeros so
+ * that "7" and "007" remain different keys. */
+static int
+_comparator_magnitude(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    size_t a_zeros = 0, b_zeros = 0;
+    int r = 0;
+
+    while (a_zeros + 1 < a_len && a[a_zeros] == '0') a_zeros++;
+    while (b_zeros + 1 < b_len && b[b_zeros] == '0') b_zeros++;
+    if (a_len - a_zeros != b_len - b_zeros) {
+        return (a_len - a_zeros < b_len - b_zeros) ? -1 : 1;
+    }
+    r = memcmp(a + a_zeros, b + b_zeros, a_len - a_zeros);
+    if (r != 0) return r;
+    return (a_zeros > b_zeros) - (a_zeros < b_zeros);
+}
+
+static int
+_comparator_uint64(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    int a_number = _comparator_is_number(a, a_len);
+    int b_number = _comparator_is_number(b, b_len);
+
+    if (a_number && b_number) return _comparator_magnitude(a, a_len, b, b_len);
+    if (a_number != b_number) return a_number ? -1 : 1;
+    return _comparator_bytewise(a, a_len, b, b_len);
+}
+
+/* 0 for a negative number, 1 for any other number, 2 if it is none. */
+static int
+_comparator_sign_class(const char *a, size_t a_len)
+{
+    if (a_len > 1 && a[0] == '-' && _comparator_is_number(a + 1, a_len - 1)) {
+        return 0;
+    }
+    return _comparator_is_number(a, a_len) ? 1 : 2;
+}
+
+static int
+_comparator_int64(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    int a_class = _comparator_sign_class(a, a_len);
+    int b_class = _comparator_sign_class(b, b_len);
+
+    if (a_class != b_class) return (a_class < b_class) ? -1 : 1;
+    switch (a_class) {
+        case 0:
+            /* the larger the magnitude, the smaller the number. */
+            return _comparator_magnitude(b + 1, b_len - 1, a + 1, a_len - 1);
+        case 1:
+            return _comparator_magnitude(a, a_len, b, b_len);
+        default:
+            return _comparator_bytewise(a, a_len, b, b_len);
+    }
+}
+
+int
+xleveldb_comparator_parse(const char *name)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < XLEVELDB_COMPARATORS; i++) {
+        if (strcmp(name, _xleveldb_comparators[i].name) == 0) {
+            return _xleveldb_comparators[i].type;
+        }
+    }
+    return -1;
+}
+
+const char *
+xleveldb_comparator_name(xleveldb_comparator_type_t type)
+{
+    assert(type < XLEVELDB_COMPARATORS);
+    return _xleveldb_comparators[type].name;
+}
+
+int
+xleveldb_comparator_compare(xleveldb_comparator_type_t type,
+        const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    switch (type) {
+        case XLEVELDB_COMPARATOR_REVERSE_BYTEWISE:
+            return _comparator_bytewise(b, b_len, a, a_len);
+        case XLEVELDB_COMPARATOR_UINT64:
+            return _comparator_uint64(a, a_len, b, b_len);
+        case XLEVELDB_COMPARATOR_INT64:
+            return _comparator_int64(a, a_len, b, b_len);
+        default:
+            return _comparator_bytewise(a, a_len, b, b_len);
+    }
+}
+
+static int
+_comparator_compare(void *state, const char *a, size_t a_len,
+        const char *b, size_t b_len)
+{
+    const xleveldb_comparator_t *comparator =
+        (const xleveldb_comparator_t *)state;
+    return xleveldb_comparator_compare(comparator->type, a, a_len, b, b_len);
+}
+
+static const char *
+_comparator_name(void *state)
+{
+    return ((const xleveldb_comparator_t *)state)->leveldb_name;
+}
+
+static void
+_comparator_destructor(void *state)
+{}
+
+leveldb_comparator_t *
+xleveldb_comparator_create(xleveldb_comparator_type_t type)
+{
+    if (type == XLEVELDB_COMPARATOR_BYTEWISE) return NULL;
+    assert(type < XLEVELDB_COMPARATORS);
+    return leveldb_comparator_create(
+            (void *)&_xleveldb_comparators[type],
+            _comparator_destructor, _comparator_compare, _comparator_name);
+}
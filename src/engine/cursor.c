@@ -0,0 +1,283 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  cursor.c
+ *
+ *    Description:  iterator over every shard of a database, merged in key
+ *                  order.
+ *
+ * =============================================================================
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <reveldb/engine/cursor.h>
+
+struct xleveldb_cursor_s_ {
+    unsigned int n;
+    /* the shard iterator the cursor is on, -1 if it is not valid. */
+    int current;
+    /* set while moving forward, every other iterator is then on the
+     * first entry after the current key, otherwise on the last one
+     * before it. */
+    int forward;
+    xleveldb_comparator_type_t order; /* the shards are kept in. */
+    leveldb_iterator_t *iters[];
+};
+
+int
+xleveldb_cursor_compare(const xleveldb_cursor_t *cursor,
+        const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    return xleveldb_comparator_compare(cursor->order, a, a_len, b, b_len);
+}
+
+/* points current at the iterator on the smallest key, or the largest
+ * one if smallest is 0. */
+static void
+_cursor_find(xleveldb_cursor_t *cursor, int smallest)
+{
+    unsigned int i = 0;
+    const char *best = NULL;
+    size_t best_len = 0;
+
+    if (cursor->n == 1) {
+        cursor->current = leveldb_iter_valid(cursor->iters[0]) ? 0 : -1;
+        return;
+    }
+
+    cursor->current = -1;
+    for (i = 0; i < cursor->n; i++) {
+        const char *key = NULL;
+        size_t key_len = 0;
+        int r = 0;
+
+        if (!leveldb_iter_valid(cursor->iters[i])) continue;
+        key = leveldb_iter_key(cursor->iters[i], &key_len);
+        if (best != NULL) {
+            r = xleveldb_cursor_compare(cursor, key, key_len, best, best_len);
+            if (smallest ? (r >= 0) : (r <= 0)) continue;
+        }
+        best = key;
+        best_len = key_len;
+        cursor->current = i;
+    }
+}
+
+/* opens the iterator of shard i with roptions[i]. */
+static xleveldb_cursor_t *
+_cursor_create(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t **roptions)
+{
+    unsigned int i = 0;
+    xleveldb_cursor_t *cursor = (xleveldb_cursor_t *)malloc(
+            sizeof(xleveldb_cursor_t)
+            + sizeof(leveldb_iterator_t *) * instance->nshards);
+    if (cursor == NULL) return NULL;
+
+    cursor->n = instance->nshards;
+    cursor->current = -1;
+    cursor->forward = 1;
+    cursor->order = instance->order;
+    for (i = 0; i < cursor->n; i++) {
+        cursor->iters[i] = leveldb_create_iterator(instance->shards[i]->db,
+                roptions[i]);
+    }
+    return cursor;
+}
+
+xleveldb_cursor_t *
+xleveldb_cursor_create(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions)
+{
+    unsigned int i = 0;
+    const leveldb_readoptions_t *shard_roptions[XLEVELDB_MAX_SHARDS];
+
+    for (i = 0; i < instance->nshards; i++) {
+        shard_roptions[i] = xleveldb_shard_roptions(instance,
+                instance->shards[i], roptions);
+    }
+    return _cursor_create(instance, shard_roptions);
+}
+
+int
+xleveldb_cursor_create_many(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        xleveldb_cursor_t **cursors, unsigned int n)
+{
+    unsigned int i = 0;
+    const leveldb_snapshot_t *snapshots[XLEVELDB_MAX_SHARDS];
+    leveldb_readoptions_t *pinned[XLEVELDB_MAX_SHARDS];
+    const leveldb_readoptions_t *shard_roptions[XLEVELDB_MAX_SHARDS];
+    int r = 0;
+
+    /* the instance's own read options pin nothing, a snapshot of each
+     * shard is held while the cursors are opened. the iterators pin the
+     * sequence they read at, so they outlive it. */
+    for (i = 0; i < instance->nshards; i++) {
+        xleveldb_instance_t *shard = instance->shards[i];
+        if (roptions != instance->roptions) {
+            shard_roptions[i] = roptions;
+            continue;
+        }
+        snapshots[i] = leveldb_create_snapshot(shard->db);
+        pinned[i] = leveldb_readoptions_create();
+        leveldb_readoptions_set_verify_checksums(pinned[i],
+                instance->config->verify_checksums);
+        leveldb_readoptions_set_fill_cache(pinned[i],
+                instance->config->fill_cache);
+        leveldb_readoptions_set_snapshot(pinned[i], snapshots[i]);
+        shard_roptions[i] = pinned[i];
+    }
+
+    for (i = 0; i < n; i++) {
+        cursors[i] = _cursor_create(instance, shard_roptions);
+        if (cursors[i] == NULL) r = -1;
+    }
+
+    for (i = 0; i < instance->nshards && roptions == instance->roptions; i++) {
+        leveldb_readoptions_destroy(pinned[i]);
+        leveldb_release_snapshot(instance->shards[i]->db, snapshots[i]);
+    }
+    if (r == 0) return 0;
+    for (i = 0; i < n; i++) xleveldb_cursor_destroy(cursors[i]);
+    return -1;
+}
+
+void
+xleveldb_cursor_destroy(xleveldb_cursor_t *cursor)
+{
+    unsigned int i = 0;
+
+    if (cursor == NULL) return;
+    for (i = 0; i < cursor->n; i++) leveldb_iter_destroy(cursor->iters[i]);
+    free(cursor);
+}
+
+unsigned char
+xleveldb_cursor_valid(const xleveldb_cursor_t *cursor)
+{
+    return (cursor->current >= 0) ? 1 : 0;
+}
+
+void
+xleveldb_cursor_seek_to_first(xleveldb_cursor_t *cursor)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < cursor->n; i++) {
+        leveldb_iter_seek_to_first(cursor->iters[i]);
+    }
+    cursor->forward = 1;
+    _cursor_find(cursor, 1);
+}
+
+void
+xleveldb_cursor_seek_to_last(xleveldb_cursor_t *cursor)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < cursor->n; i++) {
+        leveldb_iter_seek_to_last(cursor->iters[i]);
+    }
+    cursor->forward = 0;
+    _cursor_find(cursor, 0);
+}
+
+void
+xleveldb_cursor_seek(xleveldb_cursor_t *cursor, const char *k, size_t klen)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < cursor->n; i++) {
+        leveldb_iter_seek(cursor->iters[i], k, klen);
+    }
+    cursor->forward = 1;
+    _cursor_find(cursor, 1);
+}
+
+void
+xleveldb_cursor_next(xleveldb_cursor_t *cursor)
+{
+    unsigned int i = 0;
+    leveldb_iterator_t *current = NULL;
+    const char *key = NULL;
+    size_t key_len = 0;
+
+    assert(cursor->current >= 0);
+    current = cursor->iters[cursor->current];
+    if (!cursor->forward) {
+        /* the others are behind the current key, move them past it. */
+        key = leveldb_iter_key(current, &key_len);
+        for (i = 0; i < cursor->n; i++) {
+            leveldb_iterator_t *iter = cursor->iters[i];
+            const char *found = NULL;
+            size_t found_len = 0;
+
+            if (iter == current) continue;
+            leveldb_iter_seek(iter, key, key_len);
+            if (!leveldb_iter_valid(iter)) continue;
+            found = leveldb_iter_key(iter, &found_len);
+            if (xleveldb_cursor_compare(cursor, found, found_len, key, key_len) == 0) {
+                leveldb_iter_next(iter);
+            }
+        }
+        cursor->forward = 1;
+    }
+    leveldb_iter_next(current);
+    _cursor_find(cursor, 1);
+}
+
+void
+xleveldb_cursor_prev(xleveldb_cursor_t *cursor)
+{
+    unsigned int i = 0;
+    leveldb_iterator_t *current = NULL;
+    const char *key = NULL;
+    size_t key_len = 0;
+
+    assert(cursor->current >= 0);
+    current = cursor->iters[cursor->current];
+    if (cursor->forward) {
+        /* the others are past the current key, move them before it. */
+        key = leveldb_iter_key(current, &key_len);
+        for (i = 0; i < cursor->n; i++) {
+            leveldb_iterator_t *iter = cursor->iters[i];
+
+            if (iter == current) continue;
+            leveldb_iter_seek(iter, key, key_len);
+            if (leveldb_iter_valid(iter)) leveldb_iter_prev(iter);
+            else leveldb_iter_seek_to_last(iter);
+        }
+        cursor->forward = 0;
+    }
+    leveldb_iter_prev(current);
+    _cursor_find(cursor, 0);
+}
+
+const char *
+xleveldb_cursor_key(const xleveldb_cursor_t *cursor, size_t *klen)
+{
+    assert(cursor->current >= 0);
+    return leveldb_iter_key(cursor->iters[cursor->current], klen);
+}
+
+const char *
+xleveldb_cursor_value(const xleveldb_cursor_t *cursor, size_t *vlen)
+{
+    assert(cursor->current >= 0);
+    return leveldb_iter_value(cursor->iters[cursor->current], vlen);
+}
+
+void
+xleveldb_cursor_get_error(const xleveldb_cursor_t *cursor, char **errptr)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < cursor->n && *errptr == NULL; i++) {
+        leveldb_iter_get_error(cursor->iters[i], errptr);
+    }
+}
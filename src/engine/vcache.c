@@ -0,0 +1,328 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  vcache.c
+ *
+ *    Description:  sharded value cache in front of leveldb point lookups.
+ *
+ * =============================================================================
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <reveldb/engine/vcache.h>
+
+#define VCACHE_MIN_BUCKETS 256
+
+typedef struct vcache_entry_s_ vcache_entry_t;
+typedef struct vcache_shard_s_ vcache_shard_t;
+
+struct vcache_entry_s_ {
+    vcache_entry_t *next; /* hash chain. */
+    uint64_t owner;
+    uint64_t hash;
+    size_t key_len;
+    size_t value_len;
+    size_t slot; /* position on the clock. */
+    int referenced; /* set on a hit, cleared as the hand passes by. */
+    char data[]; /* key followed by value. */
+};
+
+struct vcache_shard_s_ {
+    pthread_mutex_t lock;
+    vcache_entry_t **buckets;
+    size_t nbuckets;
+    vcache_entry_t **clock; /* every entry, in insertion order. */
+    size_t nentries;
+    size_t clock_size;
+    size_t hand;
+    uint64_t capacity;
+    uint64_t usage;
+    /* bumped by every invalidation, see vcache_insert(). */
+    uint64_t seq;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+struct vcache_s_ {
+    uint64_t capacity;
+    vcache_shard_t shards[VCACHE_SHARDS];
+};
+
+/* FNV-1a over the owner and the key. */
+static uint64_t
+_vcache_hash(uint64_t owner, const char *key, size_t key_len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i = 0;
+
+    for (i = 0; i < sizeof(owner); i++) {
+        hash ^= (owner >> (i * 8)) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+    for (i = 0; i < key_len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static size_t
+_vcache_charge(vcache_entry_t *entry)
+{
+    return sizeof(vcache_entry_t) + entry->key_len + entry->value_len;
+}
+
+static vcache_shard_t *
+_vcache_shard(vcache_t *cache, uint64_t hash)
+{
+    /* the low bits pick the bucket, the high ones the shard. */
+    return &cache->shards[(hash >> 56) & (VCACHE_SHARDS - 1)];
+}
+
+static vcache_entry_t **
+_vcache_find(vcache_shard_t *shard, uint64_t hash, uint64_t owner,
+        const char *key, size_t key_len)
+{
+    vcache_entry_t **entry = &shard->buckets[hash & (shard->nbuckets - 1)];
+
+    while (*entry != NULL) {
+        if ((*entry)->hash == hash && (*entry)->owner == owner
+                && (*entry)->key_len == key_len
+                && memcmp((*entry)->data, key, key_len) == 0) break;
+        entry = &(*entry)->next;
+    }
+    return entry;
+}
+
+/* unlinks the entry *link points to and frees it. */
+static void
+_vcache_remove(vcache_shard_t *shard, vcache_entry_t **link)
+{
+    vcache_entry_t *entry = *link;
+
+    *link = entry->next;
+    /* the last entry on the clock takes over the slot. */
+    shard->clock[entry->slot] = shard->clock[--shard->nentries];
+    shard->clock[entry->slot]->slot = entry->slot;
+    if (shard->hand >= shard->nentries) shard->hand = 0;
+    shard->usage -= _vcache_charge(entry);
+    free(entry);
+}
+
+static void
+_vcache_evict(vcache_shard_t *shard)
+{
+    while (shard->nentries > 0) {
+        vcache_entry_t *entry = shard->clock[shard->hand];
+        if (entry->referenced) {
+            entry->referenced = 0;
+            shard->hand = (shard->hand + 1) % shard->nentries;
+            continue;
+        }
+        _vcache_remove(shard, _vcache_find(shard, entry->hash,
+                    entry->owner, entry->data, entry->key_len));
+        return;
+    }
+}
+
+static void
+_vcache_grow(vcache_shard_t *shard)
+{
+    size_t nbuckets = shard->nbuckets * 2;
+    size_t i = 0;
+    vcache_entry_t **buckets = (vcache_entry_t **)
+        calloc(nbuckets, sizeof(vcache_entry_t *));
+
+    if (buckets == NULL) return;
+    for (i = 0; i < shard->nentries; i++) {
+        vcache_entry_t *entry = shard->clock[i];
+        entry->next = buckets[entry->hash & (nbuckets - 1)];
+        buckets[entry->hash & (nbuckets - 1)] = entry;
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->nbuckets = nbuckets;
+}
+
+vcache_t *
+vcache_new(uint64_t capacity)
+{
+    unsigned int i = 0;
+    vcache_t *cache = (vcache_t *)malloc(sizeof(vcache_t));
+    if (cache == NULL) return NULL;
+    memset(cache, 0, sizeof(vcache_t));
+
+    cache->capacity = capacity;
+    for (i = 0; i < VCACHE_SHARDS; i++) {
+        vcache_shard_t *shard = &cache->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->capacity = capacity / VCACHE_SHARDS;
+        shard->nbuckets = VCACHE_MIN_BUCKETS;
+        shard->buckets = (vcache_entry_t **)
+            calloc(shard->nbuckets, sizeof(vcache_entry_t *));
+        if (shard->buckets == NULL) {
+            cache->shards[i].nbuckets = 0;
+            vcache_free(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+void
+vcache_free(vcache_t *cache)
+{
+    unsigned int i = 0;
+    size_t j = 0;
+
+    if (cache == NULL) return;
+    for (i = 0; i < VCACHE_SHARDS; i++) {
+        vcache_shard_t *shard = &cache->shards[i];
+        if (shard->nbuckets == 0) break;
+        for (j = 0; j < shard->nentries; j++) free(shard->clock[j]);
+        free(shard->clock);
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(cache);
+}
+
+char *
+vcache_lookup(vcache_t *cache, uint64_t owner,
+        const char *key, size_t key_len,
+        size_t *value_len, uint64_t *seq)
+{
+    uint64_t hash = _vcache_hash(owner, key, key_len);
+    vcache_shard_t *shard = _vcache_shard(cache, hash);
+    vcache_entry_t *entry = NULL;
+    char *value = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+    entry = *_vcache_find(shard, hash, owner, key, key_len);
+    if (entry == NULL) {
+        shard->misses++;
+        *seq = shard->seq;
+        pthread_mutex_unlock(&shard->lock);
+        return NULL;
+    }
+    entry->referenced = 1;
+    shard->hits++;
+    /* leveldb_get() never returns NULL for a value that exists. */
+    value = (char *)malloc(entry->value_len > 0 ? entry->value_len : 1);
+    if (value != NULL) {
+        memcpy(value, entry->data + entry->key_len, entry->value_len);
+        *value_len = entry->value_len;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return value;
+}
+
+int
+vcache_contains(vcache_t *cache, uint64_t owner,
+        const char *key, size_t key_len)
+{
+    uint64_t hash = _vcache_hash(owner, key, key_len);
+    vcache_shard_t *shard = _vcache_shard(cache, hash);
+    vcache_entry_t *entry = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+    entry = *_vcache_find(shard, hash, owner, key, key_len);
+    if (entry != NULL) entry->referenced = 1;
+    pthread_mutex_unlock(&shard->lock);
+    return (entry != NULL) ? 1 : 0;
+}
+
+void
+vcache_insert(vcache_t *cache, uint64_t owner,
+        const char *key, size_t key_len,
+        const char *value, size_t value_len, uint64_t seq)
+{
+    uint64_t hash = _vcache_hash(owner, key, key_len);
+    vcache_shard_t *shard = _vcache_shard(cache, hash);
+    vcache_entry_t **link = NULL;
+    vcache_entry_t *entry = NULL;
+    size_t charge = sizeof(vcache_entry_t) + key_len + value_len;
+
+    /* one entry must not flush a large part of its shard. */
+    if (charge > shard->capacity / 8) return;
+
+    entry = (vcache_entry_t *)malloc(charge);
+    if (entry == NULL) return;
+    entry->owner = owner;
+    entry->hash = hash;
+    entry->key_len = key_len;
+    entry->value_len = value_len;
+    entry->referenced = 0;
+    memcpy(entry->data, key, key_len);
+    memcpy(entry->data + key_len, value, value_len);
+
+    pthread_mutex_lock(&shard->lock);
+    /* a write may have landed between the miss and now. */
+    if (shard->seq != seq) goto skip;
+    link = _vcache_find(shard, hash, owner, key, key_len);
+    if (*link != NULL) goto skip;
+
+    if (shard->nentries == shard->clock_size) {
+        size_t clock_size = (shard->clock_size > 0) ?
+            shard->clock_size * 2 : VCACHE_MIN_BUCKETS;
+        vcache_entry_t **clock = (vcache_entry_t **)
+            realloc(shard->clock, clock_size * sizeof(vcache_entry_t *));
+        if (clock == NULL) goto skip;
+        shard->clock = clock;
+        shard->clock_size = clock_size;
+    }
+    while (shard->usage + charge > shard->capacity) _vcache_evict(shard);
+
+    if (shard->nentries >= shard->nbuckets) _vcache_grow(shard);
+
+    entry->slot = shard->nentries;
+    shard->clock[shard->nentries++] = entry;
+    shard->usage += charge;
+    link = &shard->buckets[hash & (shard->nbuckets - 1)];
+    entry->next = *link;
+    *link = entry;
+    pthread_mutex_unlock(&shard->lock);
+    return;
+
+skip:
+    pthread_mutex_unlock(&shard->lock);
+    free(entry);
+}
+
+void
+vcache_invalidate(vcache_t *cache, uint64_t owner,
+        const char *key, size_t key_len)
+{
+    uint64_t hash = _vcache_hash(owner, key, key_len);
+    vcache_shard_t *shard = _vcache_shard(cache, hash);
+    vcache_entry_t **link = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+    shard->seq++;
+    link = _vcache_find(shard, hash, owner, key, key_len);
+    if (*link != NULL) _vcache_remove(shard, link);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void
+vcache_get_stats(vcache_t *cache, vcache_stats_t *stats)
+{
+    unsigned int i = 0;
+
+    memset(stats, 0, sizeof(vcache_stats_t));
+    stats->capacity = cache->capacity;
+    for (i = 0; i < VCACHE_SHARDS; i++) {
+        vcache_shard_t *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        stats->usage += shard->usage;
+        stats->entries += shard->nentries;
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
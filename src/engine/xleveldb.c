@@ -14,13 +14,93 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <reveldb/engine/xleveldb.h>
 #include <reveldb/util/xconfig.h>
 
+/* every instance uses the same block cache and env, so the cache budget
+ * holds for the whole process however many databases are open. they are
+ * created along with the first instance and go away with the last one. */
+static pthread_mutex_t _xleveldb_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static leveldb_cache_t *_xleveldb_shared_cache = NULL;
+static leveldb_env_t *_xleveldb_shared_env = NULL;
+static vcache_t *_xleveldb_shared_vcache = NULL;
+static uint64_t _xleveldb_shared_capacity = 0;
+static unsigned int _xleveldb_shared_refs = 0;
+static uint64_t _xleveldb_next_id = 0;
+
+static void
+_xleveldb_shared_acquire(xleveldb_instance_t *instance,
+        xleveldb_config_t *config)
+{
+    pthread_mutex_lock(&_xleveldb_shared_lock);
+    if (_xleveldb_shared_refs++ == 0) {
+        _xleveldb_shared_capacity = config->lru_cache_size;
+        _xleveldb_shared_cache =
+            leveldb_cache_create_lru((size_t)config->lru_cache_size);
+        _xleveldb_shared_env = leveldb_create_default_env();
+        if (config->value_cache_size > 0) {
+            _xleveldb_shared_vcache = vcache_new(config->value_cache_size);
+        }
+    }
+    instance->cache = _xleveldb_shared_cache;
+    instance->env = _xleveldb_shared_env;
+    instance->vcache = _xleveldb_shared_vcache;
+    instance->id = ++_xleveldb_next_id;
+    pthread_mutex_unlock(&_xleveldb_shared_lock);
+}
+
+static void
+_xleveldb_shared_release(xleveldb_instance_t *instance)
+{
+    pthread_mutex_lock(&_xleveldb_shared_lock);
+    instance->cache = NULL;
+    instance->env = NULL;
+    instance->vcache = NULL;
+    if (--_xleveldb_shared_refs == 0) {
+        leveldb_cache_destroy(_xleveldb_shared_cache);
+        leveldb_env_destroy(_xleveldb_shared_env);
+        vcache_free(_xleveldb_shared_vcache);
+        _xleveldb_shared_cache = NULL;
+        _xleveldb_shared_env = NULL;
+        _xleveldb_shared_vcache = NULL;
+        _xleveldb_shared_capacity = 0;
+    }
+    pthread_mutex_unlock(&_xleveldb_shared_lock);
+}
+
+uint64_t
+xleveldb_cache_capacity(void)
+{
+    uint64_t capacity = 0;
+
+    pthread_mutex_lock(&_xleveldb_shared_lock);
+    capacity = _xleveldb_shared_capacity;
+    pthread_mutex_unlock(&_xleveldb_shared_lock);
+    return capacity;
+}
+
+int
+xleveldb_value_cache_stats(vcache_stats_t *stats)
+{
+    int res = -1;
+
+    pthread_mutex_lock(&_xleveldb_shared_lock);
+    if (_xleveldb_shared_vcache != NULL) {
+        vcache_get_stats(_xleveldb_shared_vcache, stats);
+        res = 0;
+    }
+    pthread_mutex_unlock(&_xleveldb_shared_lock);
+    return res;
+}
+
 xleveldb_config_t *
 xleveldb_config_init(const char* dbname,
         reveldb_db_config_t *db_config)
@@ -37,6 +117,7 @@ xleveldb_config_init(const char* dbname,
     strncpy(config->dbname, dbname, dbname_len);
 
     config->lru_cache_size = db_config->lru_cache_size;
+    config->value_cache_size = db_config->value_cache_size;
     config->create_if_missing = db_config->create_if_missing;
     config->error_if_exist = db_config->error_if_exist;
     config->write_buffer_size = db_config->write_buffer_size;
@@ -44,6 +125,13 @@ xleveldb_config_init(const char* dbname,
     config->max_open_files = db_config->max_open_files;
     config->block_size = db_config->block_size;
     config->block_restart_interval = db_config->block_restart_interval;
+    config->bloom_bits_per_key = db_config->bloom_bits_per_key;
+    config->sorted_mget_threshold = db_config->sorted_mget_threshold;
+    config->shards = db_config->shards;
+    config->comparator = (db_config->comparator != NULL
+            && xleveldb_comparator_parse(db_config->comparator) > 0) ?
+        xleveldb_comparator_parse(db_config->comparator) :
+        XLEVELDB_COMPARATOR_BYTEWISE;
     config->compression = db_config->compression;
     config->verify_checksums = db_config->verify_checksums;
     config->fill_cache = db_config->fill_cache;
@@ -52,16 +140,153 @@ xleveldb_config_init(const char* dbname,
     return config;
 }
 
+/* the number of shards of a database is kept in this file in its
+ * directory, so that it is opened the same way whatever the config
+ * says by then. */
+#define XLEVELDB_SHARDS_FILE "SHARDS"
+
+static char *
+_xleveldb_path(const char *dir, const char *name)
+{
+    size_t len = strlen(dir) + strlen(name) + 2;
+    char *path = (char *)malloc(len);
+
+    assert(path != NULL);
+    snprintf(path, len, "%s/%s", dir, name);
+    return path;
+}
+
+/* shards dbname was created with, 0 if it is not sharded. */
+static unsigned int
+_xleveldb_shards_read(const char *dbname)
+{
+    char *path = _xleveldb_path(dbname, XLEVELDB_SHARDS_FILE);
+    FILE *file = fopen(path, "r");
+    unsigned int nshards = 0;
+
+    free(path);
+    if (file == NULL) return 0;
+    if (fscanf(file, "%u", &nshards) != 1) nshards = 0;
+    fclose(file);
+    return (nshards > 1 && nshards <= XLEVELDB_MAX_SHARDS) ? nshards : 0;
+}
+
+/* how many shards to open dbname with. a database that already exists
+ * unsharded stays that way. */
+static unsigned int
+_xleveldb_shards_count(xleveldb_config_t *config)
+{
+    unsigned int nshards = _xleveldb_shards_read(config->dbname);
+    char *path = NULL;
+    FILE *file = NULL;
+
+    if (nshards > 0 || config->shards <= 1
+            || config->shards > XLEVELDB_MAX_SHARDS) return nshards;
+
+    path = _xleveldb_path(config->dbname, "CURRENT");
+    if (access(path, F_OK) == 0 || !config->create_if_missing) {
+        free(path);
+        return 0;
+    }
+    free(path);
+
+    if (mkdir(config->dbname, 0755) != 0 && errno != EEXIST) return 0;
+    path = _xleveldb_path(config->dbname, XLEVELDB_SHARDS_FILE);
+    file = fopen(path, "w");
+    free(path);
+    if (file == NULL) return 0;
+    fprintf(file, "%u\n", config->shards);
+    if (fclose(file) != 0) return 0;
+    return config->shards;
+}
+
+/* likewise for the comparator, leveldb refuses to open a database with
+ * another one than it was created with. a database without the file is
+ * ordered bytewise. */
+#define XLEVELDB_COMPARATOR_FILE "COMPARATOR"
+
+/* the order to open dbname with. the one asked for by config is recorded
+ * if the database does not exist yet, one that does keeps its own. */
+static xleveldb_comparator_type_t
+_xleveldb_comparator_type(xleveldb_config_t *config)
+{
+    char *path = _xleveldb_path(config->dbname, XLEVELDB_COMPARATOR_FILE);
+    FILE *file = fopen(path, "r");
+    char name[32];
+    int type = -1;
+
+    if (file != NULL) {
+        if (fscanf(file, "%31s", name) == 1) {
+            type = xleveldb_comparator_parse(name);
+        }
+        fclose(file);
+        free(path);
+        /* leveldb refuses to open it if that is not the right one. */
+        return (type >= 0) ? (xleveldb_comparator_type_t)type :
+            XLEVELDB_COMPARATOR_BYTEWISE;
+    }
+    free(path);
+
+    if (config->comparator == XLEVELDB_COMPARATOR_BYTEWISE
+            || !config->create_if_missing) return XLEVELDB_COMPARATOR_BYTEWISE;
+    path = _xleveldb_path(config->dbname, "CURRENT");
+    if (access(path, F_OK) == 0 || _xleveldb_shards_read(config->dbname) > 0) {
+        free(path);
+        return XLEVELDB_COMPARATOR_BYTEWISE;
+    }
+    free(path);
+
+    if (mkdir(config->dbname, 0755) != 0 && errno != EEXIST) {
+        return XLEVELDB_COMPARATOR_BYTEWISE;
+    }
+    path = _xleveldb_path(config->dbname, XLEVELDB_COMPARATOR_FILE);
+    file = fopen(path, "w");
+    free(path);
+    if (file == NULL) return XLEVELDB_COMPARATOR_BYTEWISE;
+    fprintf(file, "%s\n", xleveldb_comparator_name(config->comparator));
+    if (fclose(file) != 0) return XLEVELDB_COMPARATOR_BYTEWISE;
+    return config->comparator;
+}
+
+static void
+_xleveldb_shards_open(xleveldb_instance_t *instance,
+        xleveldb_config_t *config, unsigned int nshards)
+{
+    unsigned int k = 0;
+    char name[32];
+
+    instance->shards = (xleveldb_instance_t **)
+        malloc(sizeof(xleveldb_instance_t *) * nshards);
+    assert(instance->shards != NULL);
+    for (k = 0; k < nshards; k++) {
+        xleveldb_config_t *shard_config = (xleveldb_config_t *)
+            malloc(sizeof(xleveldb_config_t));
+        assert(shard_config != NULL);
+        memcpy(shard_config, config, sizeof(xleveldb_config_t));
+        snprintf(name, sizeof(name), "shard-%u", k);
+        shard_config->dbname = _xleveldb_path(config->dbname, name);
+        shard_config->shards = 0;
+        shard_config->comparator = instance->order;
+        instance->shards[k] = xleveldb_instance_init(shard_config);
+    }
+    instance->nshards = nshards;
+}
+
 xleveldb_instance_t *
 xleveldb_instance_init(xleveldb_config_t *config)
 {
+    unsigned int nshards = 0;
     xleveldb_instance_t *instance = (xleveldb_instance_t *)
         malloc(sizeof(xleveldb_instance_t));
     
     instance->comparator = NULL;
-    instance->env = leveldb_create_default_env();
-    instance->cache = leveldb_cache_create_lru(config->lru_cache_size);
-    instance->filterpolicy = NULL;
+    instance->reads = 0;
+    instance->misses = 0;
+    instance->hits = 0;
+    _xleveldb_shared_acquire(instance, config);
+    /* lets point lookups of missing keys skip the data blocks. */
+    instance->filterpolicy = (config->bloom_bits_per_key > 0) ?
+        leveldb_filterpolicy_create_bloom(config->bloom_bits_per_key) : NULL;
     instance->logger = NULL;
 
     instance->options = leveldb_options_create();
@@ -76,6 +301,9 @@ xleveldb_instance_init(xleveldb_config_t *config)
     leveldb_options_set_block_size(instance->options, config->block_size);
     leveldb_options_set_block_restart_interval(instance->options, config->block_restart_interval);
     leveldb_options_set_compression(instance->options, config->compression);
+    if (instance->filterpolicy != NULL) {
+        leveldb_options_set_filter_policy(instance->options, instance->filterpolicy);
+    }
     
     instance->roptions = leveldb_readoptions_create();
     leveldb_readoptions_set_verify_checksums(instance->roptions, config->verify_checksums);
@@ -84,29 +312,67 @@ xleveldb_instance_init(xleveldb_config_t *config)
     instance->woptions = leveldb_writeoptions_create();
     leveldb_writeoptions_set_sync(instance->woptions, config->sync);
     
-    instance->db = leveldb_open(instance->options, config->dbname, &(instance->err));
+    instance->db = NULL;
+    instance->err = NULL;
     instance->config = config;
+    instance->order = _xleveldb_comparator_type(config);
+    nshards = _xleveldb_shards_count(config);
+    if (nshards > 1) {
+        _xleveldb_shards_open(instance, config, nshards);
+        return instance;
+    }
+
+    instance->comparator = xleveldb_comparator_create(instance->order);
+    if (instance->comparator != NULL) {
+        leveldb_options_set_comparator(instance->options, instance->comparator);
+    }
+
+    instance->db = leveldb_open(instance->options, config->dbname, &(instance->err));
     instance->err = NULL;
+    instance->nshards = 1;
+    instance->shards = (xleveldb_instance_t **)
+        malloc(sizeof(xleveldb_instance_t *));
+    assert(instance->shards != NULL);
+    instance->shards[0] = instance;
 
     return instance;
 }
 
+/* closes the shards of a sharded instance along with their configs. */
+static void
+_xleveldb_shards_close(xleveldb_instance_t *instance)
+{
+    unsigned int k = 0;
+
+    if (instance->nshards <= 1) return;
+    for (k = 0; k < instance->nshards; k++) {
+        xleveldb_config_t *shard_config = instance->shards[k]->config;
+        xleveldb_instance_fini(instance->shards[k]);
+        free(shard_config->dbname);
+        free(shard_config);
+    }
+    instance->nshards = 0;
+}
+
 void
 xleveldb_instance_fini(xleveldb_instance_t *instance)
 {
     assert(instance != NULL);
 
+    /* the db uses the comparator, cache and filter policy until closed. */
+    _xleveldb_shards_close(instance);
+    free(instance->shards);
+    instance->shards = NULL;
+    if (instance->db != NULL) {
+        leveldb_close(instance->db);
+        instance->db = NULL;
+    }
     if (instance->comparator != NULL) {
         leveldb_comparator_destroy(instance->comparator);
         instance->comparator = NULL;
     }
-    if (instance->env != NULL) {
-        leveldb_env_destroy(instance->env);
-        instance->env = NULL;
-    }
     if (instance->cache != NULL) {
-        leveldb_cache_destroy(instance->cache);
-        instance->cache = NULL;
+        _xleveldb_shared_release(instance);
     }
     if (instance->filterpolicy != NULL) {
         leveldb_filterpolicy_destroy(instance->filterpolicy);
@@ -124,22 +390,215 @@ xleveldb_instance_fini(xleveldb_instance_t *instance)
         leveldb_writeoptions_destroy(instance->woptions);
         instance->woptions = NULL;
     }
-    if (instance->db != NULL) {
-        leveldb_close(instance->db);
-        instance->db = NULL;
-    }
 
     free(instance);
 }
 
 void
-xleveldb_instance_destroy(xleveldb_instance_t *instance)
+xleveldb_instance_destroy(xleveldb_instance_t *instance, char **errptr)
 {
+    unsigned int k = 0;
+    char *path = NULL;
+
     assert(instance != NULL);
 
-    leveldb_destroy_db(instance->options,
-            instance->config->dbname,
-            &(instance->err));
+    if (instance->nshards <= 1) {
+        if (instance->db != NULL) {
+            leveldb_close(instance->db);
+            instance->db = NULL;
+        }
+        /* leveldb leaves the files it does not know of alone. */
+        path = _xleveldb_path(instance->config->dbname,
+                XLEVELDB_COMPARATOR_FILE);
+        unlink(path);
+        free(path);
+        leveldb_destroy_db(instance->options,
+                instance->config->dbname, errptr);
+        return;
+    }
+
+    for (k = 0; k < instance->nshards && *errptr == NULL; k++) {
+        xleveldb_instance_destroy(instance->shards[k], errptr);
+    }
+    if (*errptr != NULL) return;
+    path = _xleveldb_path(instance->config->dbname, XLEVELDB_SHARDS_FILE);
+    unlink(path);
+    free(path);
+    path = _xleveldb_path(instance->config->dbname, XLEVELDB_COMPARATOR_FILE);
+    unlink(path);
+    free(path);
+    rmdir(instance->config->dbname);
+}
+
+void
+xleveldb_instance_repair(xleveldb_instance_t *instance, char **errptr)
+{
+    unsigned int k = 0;
+
+    assert(instance != NULL);
+
+    for (k = 0; k < instance->nshards && *errptr == NULL; k++) {
+        leveldb_repair_db(instance->shards[k]->options,
+                instance->shards[k]->config->dbname, errptr);
+    }
+}
+
+/* FNV-1a, so that a key always lands on the same shard. */
+static unsigned int
+_xleveldb_shard_of(xleveldb_instance_t *instance,
+        const char *key, size_t keylen)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i = 0;
+
+    for (i = 0; i < keylen; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    /* FNV mixes poorly on short keys that share a prefix, spread it out
+     * with the finalizer of MurmurHash3. */
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return (unsigned int)(hash % instance->nshards);
+}
+
+xleveldb_instance_t *
+xleveldb_shard(xleveldb_instance_t *instance, const char *key, size_t keylen)
+{
+    if (instance->nshards <= 1) return instance;
+    return instance->shards[_xleveldb_shard_of(instance, key, keylen)];
+}
+
+const leveldb_readoptions_t *
+xleveldb_shard_roptions(xleveldb_instance_t *instance,
+        xleveldb_instance_t *shard,
+        const leveldb_readoptions_t *roptions)
+{
+    /* the value cache is only asked on the shard's own read options. */
+    return (roptions == instance->roptions) ? shard->roptions : roptions;
+}
+
+typedef struct xleveldb_split_s_ {
+    xleveldb_instance_t *instance;
+    leveldb_writebatch_t **batches;
+} xleveldb_split_t;
+
+static leveldb_writebatch_t *
+_xleveldb_split_batch_of(xleveldb_split_t *split,
+        const char *key, size_t klen)
+{
+    unsigned int k = _xleveldb_shard_of(split->instance, key, klen);
+
+    if (split->batches[k] == NULL) {
+        split->batches[k] = leveldb_writebatch_create();
+    }
+    return split->batches[k];
+}
+
+static void
+_xleveldb_split_put(void *arg, const char *key, size_t klen,
+        const char *val, size_t vlen)
+{
+    xleveldb_split_t *split = (xleveldb_split_t *)arg;
+    leveldb_writebatch_put(_xleveldb_split_batch_of(split, key, klen),
+            key, klen, val, vlen);
+}
+
+static void
+_xleveldb_split_delete(void *arg, const char *key, size_t klen)
+{
+    xleveldb_split_t *split = (xleveldb_split_t *)arg;
+    leveldb_writebatch_delete(_xleveldb_split_batch_of(split, key, klen),
+            key, klen);
+}
+
+void
+xleveldb_split_batch(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, leveldb_writebatch_t **batches)
+{
+    xleveldb_split_t split;
+
+    split.instance = instance;
+    split.batches = batches;
+    memset(batches, 0, sizeof(leveldb_writebatch_t *) * instance->nshards);
+    leveldb_writebatch_iterate(batch, &split,
+            _xleveldb_split_put, _xleveldb_split_delete);
+}
+
+char *
+xleveldb_property_value(xleveldb_instance_t *instance, const char *propname)
+{
+    unsigned int k = 0;
+    size_t len = 0;
+    size_t size = 0;
+    char *value = NULL;
+    char *values = NULL;
+    char *end = NULL;
+    uint64_t sum = 0;
+    bool numeric = true;
+
+    if (instance->nshards <= 1) {
+        return leveldb_property_value(instance->db, propname);
+    }
+
+    for (k = 0; k < instance->nshards; k++) {
+        value = leveldb_property_value(instance->shards[k]->db, propname);
+        if (value == NULL) {
+            free(values);
+            return NULL;
+        }
+        if (numeric) {
+            sum += strtoull(value, &end, 10);
+            numeric = (end != value && *end == '\0');
+        }
+        size = len + strlen(value) + 32;
+        values = (char *)realloc(values, size);
+        assert(values != NULL);
+        len += snprintf(values + len, size - len,
+                "shard-%u:\n%s\n", k, value);
+        free(value);
+    }
+
+    if (numeric) {
+        /* large enough for any uint64_t. */
+        values = (char *)realloc(values, 24);
+        assert(values != NULL);
+        snprintf(values, 24, "%llu", (unsigned long long)sum);
+    }
+    return values;
+}
+
+uint64_t
+xleveldb_approximate_size(xleveldb_instance_t *instance,
+        const char *start, size_t start_len,
+        const char *limit, size_t limit_len)
+{
+    unsigned int k = 0;
+    uint64_t size = 0;
+    uint64_t total = 0;
+
+    for (k = 0; k < instance->nshards; k++) {
+        leveldb_approximate_sizes(instance->shards[k]->db, 1,
+                &start, &start_len, &limit, &limit_len, &size);
+        total += size;
+    }
+    return total;
+}
+
+void
+xleveldb_compact_range(xleveldb_instance_t *instance,
+        const char *start, size_t start_len,
+        const char *limit, size_t limit_len)
+{
+    unsigned int k = 0;
+
+    for (k = 0; k < instance->nshards; k++) {
+        leveldb_compact_range(instance->shards[k]->db,
+                start, start_len, limit, limit_len);
+    }
 }
 
 void
@@ -152,3 +611,497 @@ xleveldb_reset_err(xleveldb_instance_t *instance)
     }
 }
 
+char *
+xleveldb_get(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        const char *key, size_t keylen,
+        size_t *vallen, char **errptr)
+{
+    char *value = NULL;
+    uint64_t seq = 0;
+    /* a snapshot may see older values than the cache holds. */
+    bool cached = (instance->vcache != NULL)
+        && (roptions == instance->roptions);
+
+    if (instance->nshards > 1) {
+        xleveldb_instance_t *shard = xleveldb_shard(instance, key, keylen);
+        return xleveldb_get(shard,
+                xleveldb_shard_roptions(instance, shard, roptions),
+                key, keylen, vallen, errptr);
+    }
+
+    __sync_fetch_and_add(&instance->reads, 1);
+    if (cached) {
+        value = vcache_lookup(instance->vcache, instance->id,
+                key, keylen, vallen, &seq);
+        if (value != NULL) {
+            __sync_fetch_and_add(&instance->hits, 1);
+            return value;
+        }
+    }
+
+    value = leveldb_get(instance->db, roptions,
+            key, keylen, vallen, errptr);
+    if (value == NULL) {
+        __sync_fetch_and_add(&instance->misses, 1);
+    } else if (cached) {
+        vcache_insert(instance->vcache, instance->id,
+                key, keylen, value, *vallen, seq);
+    }
+    return value;
+}
+
+/* is the iterator on exactly key ? */
+static int
+_xleveldb_iter_on(leveldb_iterator_t *iter, const char *key, size_t keylen)
+{
+    const char *found = NULL;
+    size_t found_len = 0;
+
+    if (!leveldb_iter_valid(iter)) return 0;
+    found = leveldb_iter_key(iter, &found_len);
+    return (found_len == keylen) && (memcmp(found, key, keylen) == 0);
+}
+
+static int
+_xleveldb_cached(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        const char *key, size_t keylen)
+{
+    return (instance->vcache != NULL) && (roptions == instance->roptions)
+        && vcache_contains(instance->vcache, instance->id, key, keylen);
+}
+
+int
+xleveldb_exists(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        const char *key, size_t keylen)
+{
+    leveldb_iterator_t *iter = NULL;
+    int found = 0;
+
+    if (instance->nshards > 1) {
+        xleveldb_instance_t *shard = xleveldb_shard(instance, key, keylen);
+        return xleveldb_exists(shard,
+                xleveldb_shard_roptions(instance, shard, roptions),
+                key, keylen);
+    }
+
+    if (_xleveldb_cached(instance, roptions, key, keylen)) return 1;
+
+    iter = leveldb_create_iterator(instance->db, roptions);
+    leveldb_iter_seek(iter, key, keylen);
+    found = _xleveldb_iter_on(iter, key, keylen);
+    leveldb_iter_destroy(iter);
+    return found;
+}
+
+typedef struct xleveldb_key_s_ {
+    const char *key;
+    size_t keylen;
+    size_t idx;
+    uint64_t seq; /* of the value cache miss, see vcache_insert(). */
+    xleveldb_comparator_type_t order; /* of the instance, for qsort(). */
+} xleveldb_key_t;
+
+static int
+_xleveldb_key_compare(const void *a, const void *b)
+{
+    const xleveldb_key_t *ka = (const xleveldb_key_t *)a;
+    const xleveldb_key_t *kb = (const xleveldb_key_t *)b;
+
+    return xleveldb_comparator_compare(ka->order,
+            ka->key, ka->keylen, kb->key, kb->keylen);
+}
+
+int
+xleveldb_compare(xleveldb_instance_t *instance,
+        const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    return xleveldb_comparator_compare(instance->order, a, a_len, b, b_len);
+}
+
+/* the keys of a multi-key call on a sharded instance, grouped by shard. */
+typedef struct xleveldb_groups_s_ {
+    size_t *count; /* keys of each shard. */
+    size_t *start; /* where the keys of each shard begin. */
+    const char **keys;
+    size_t *keylens;
+    size_t *idx; /* of each key in the call. */
+} xleveldb_groups_t;
+
+static void
+_xleveldb_groups_init(xleveldb_groups_t *groups,
+        xleveldb_instance_t *instance,
+        size_t nkeys, const char **keys, const size_t *keylens)
+{
+    unsigned int nshards = instance->nshards;
+    unsigned int *owner = NULL;
+    size_t *next = NULL;
+    size_t i = 0;
+    unsigned int k = 0;
+
+    groups->count = (size_t *)calloc(nshards, sizeof(size_t));
+    groups->start = (size_t *)calloc(nshards, sizeof(size_t));
+    groups->keys = (const char **)malloc(sizeof(char *) * (nkeys + 1));
+    groups->keylens = (size_t *)malloc(sizeof(size_t) * (nkeys + 1));
+    groups->idx = (size_t *)malloc(sizeof(size_t) * (nkeys + 1));
+    owner = (unsigned int *)malloc(sizeof(unsigned int) * (nkeys + 1));
+    next = (size_t *)calloc(nshards, sizeof(size_t));
+    assert(groups->count != NULL && groups->start != NULL
+            && groups->keys != NULL && groups->keylens != NULL
+            && groups->idx != NULL && owner != NULL && next != NULL);
+
+    for (i = 0; i < nkeys; i++) {
+        owner[i] = _xleveldb_shard_of(instance, keys[i], keylens[i]);
+        groups->count[owner[i]]++;
+    }
+    for (k = 1; k < nshards; k++) {
+        groups->start[k] = groups->start[k - 1] + groups->count[k - 1];
+    }
+    for (i = 0; i < nkeys; i++) {
+        size_t j = groups->start[owner[i]] + next[owner[i]]++;
+        groups->keys[j] = keys[i];
+        groups->keylens[j] = keylens[i];
+        groups->idx[j] = i;
+    }
+    free(owner);
+    free(next);
+}
+
+static void
+_xleveldb_groups_free(xleveldb_groups_t *groups)
+{
+    free(groups->count);
+    free(groups->start);
+    free(groups->keys);
+    free(groups->keylens);
+    free(groups->idx);
+}
+
+static void
+_xleveldb_mexists_sharded(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        size_t nkeys, const char **keys, const size_t *keylens,
+        bool *exists)
+{
+    xleveldb_groups_t groups;
+    bool *found = (bool *)malloc(sizeof(bool) * (nkeys + 1));
+    unsigned int k = 0;
+    size_t i = 0;
+
+    assert(found != NULL);
+    _xleveldb_groups_init(&groups, instance, nkeys, keys, keylens);
+    for (k = 0; k < instance->nshards; k++) {
+        size_t start = groups.start[k];
+        xleveldb_instance_t *shard = instance->shards[k];
+
+        if (groups.count[k] == 0) continue;
+        xleveldb_mexists(shard,
+                xleveldb_shard_roptions(instance, shard, roptions),
+                groups.count[k], groups.keys + start,
+                groups.keylens + start, found + start);
+    }
+    for (i = 0; i < nkeys; i++) exists[groups.idx[i]] = found[i];
+    _xleveldb_groups_free(&groups);
+    free(found);
+}
+
+void
+xleveldb_mexists(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        size_t nkeys, const char **keys, const size_t *keylens,
+        bool *exists)
+{
+    leveldb_iterator_t *iter = NULL;
+    xleveldb_key_t *sorted = NULL;
+    size_t nsorted = 0;
+    size_t i = 0;
+
+    if (instance->nshards > 1) {
+        _xleveldb_mexists_sharded(instance, roptions,
+                nkeys, keys, keylens, exists);
+        return;
+    }
+
+    sorted = (xleveldb_key_t *)malloc(sizeof(xleveldb_key_t) * (nkeys + 1));
+    assert(sorted != NULL);
+    for (i = 0; i < nkeys; i++) {
+        exists[i] = _xleveldb_cached(instance, roptions, keys[i], keylens[i]);
+        if (exists[i]) continue;
+        sorted[nsorted].key = keys[i];
+        sorted[nsorted].keylen = keylens[i];
+        sorted[nsorted].order = instance->order;
+        sorted[nsorted].idx = i;
+        nsorted++;
+    }
+
+    if (nsorted > 0) {
+        /* seeking in key order keeps walking the same blocks forward. */
+        qsort(sorted, nsorted, sizeof(xleveldb_key_t), _xleveldb_key_compare);
+        iter = leveldb_create_iterator(instance->db, roptions);
+        for (i = 0; i < nsorted; i++) {
+            leveldb_iter_seek(iter, sorted[i].key, sorted[i].keylen);
+            exists[sorted[i].idx] =
+                _xleveldb_iter_on(iter, sorted[i].key, sorted[i].keylen);
+        }
+        leveldb_iter_destroy(iter);
+    }
+    free(sorted);
+}
+
+/* entries stepped over with next() before seeking instead. */
+#define XLEVELDB_MGET_MAX_NEXT 4
+
+/* moves iter forward to the first entry not below key, stepping when
+ * that entry is close and seeking otherwise. */
+static void
+_xleveldb_iter_advance(xleveldb_instance_t *instance,
+        leveldb_iterator_t *iter, const char *key, size_t keylen)
+{
+    xleveldb_key_t target;
+    xleveldb_key_t found;
+    int steps = 0;
+
+    target.key = key;
+    target.keylen = keylen;
+    target.order = found.order = instance->order;
+    for (steps = 0; ; steps++) {
+        /* past the last entry, so is key. */
+        if (!leveldb_iter_valid(iter)) return;
+        found.key = leveldb_iter_key(iter, &found.keylen);
+        if (_xleveldb_key_compare(&found, &target) >= 0) return;
+        if (steps == XLEVELDB_MGET_MAX_NEXT) break;
+        leveldb_iter_next(iter);
+    }
+    leveldb_iter_seek(iter, key, keylen);
+}
+
+/* copies the values of the sorted keys out of a single iterator. */
+static void
+_xleveldb_mget_sorted(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        xleveldb_key_t *sorted, size_t nsorted,
+        char **values, size_t *vallens, char **errptr)
+{
+    leveldb_iterator_t *iter = NULL;
+    const char *value = NULL;
+    size_t vallen = 0;
+    size_t i = 0;
+
+    qsort(sorted, nsorted, sizeof(xleveldb_key_t), _xleveldb_key_compare);
+    iter = leveldb_create_iterator(instance->db, roptions);
+    for (i = 0; i < nsorted; i++) {
+        xleveldb_key_t *key = &sorted[i];
+        size_t idx = key->idx;
+
+        if (i > 0 && _xleveldb_key_compare(&sorted[i - 1], key) == 0) {
+            /* asked for more than once. */
+            size_t prev = sorted[i - 1].idx;
+            if (values[prev] == NULL) continue;
+            values[idx] = (char *)malloc(vallens[prev] > 0 ? vallens[prev] : 1);
+            assert(values[idx] != NULL);
+            memcpy(values[idx], values[prev], vallens[prev]);
+            vallens[idx] = vallens[prev];
+            continue;
+        }
+
+        if (i == 0) leveldb_iter_seek(iter, key->key, key->keylen);
+        else _xleveldb_iter_advance(instance, iter, key->key, key->keylen);
+        if (!_xleveldb_iter_on(iter, key->key, key->keylen)) continue;
+
+        value = leveldb_iter_value(iter, &vallen);
+        values[idx] = (char *)malloc(vallen > 0 ? vallen : 1);
+        assert(values[idx] != NULL);
+        memcpy(values[idx], value, vallen);
+        vallens[idx] = vallen;
+    }
+    leveldb_iter_get_error(iter, errptr);
+    leveldb_iter_destroy(iter);
+}
+
+static void
+_xleveldb_mget_sharded(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        size_t nkeys, const char **keys, const size_t *keylens,
+        char **values, size_t *vallens, char **errptr)
+{
+    xleveldb_groups_t groups;
+    char **found = (char **)calloc(nkeys + 1, sizeof(char *));
+    size_t *found_lens = (size_t *)calloc(nkeys + 1, sizeof(size_t));
+    unsigned int k = 0;
+    size_t i = 0;
+
+    assert(found != NULL && found_lens != NULL);
+    _xleveldb_groups_init(&groups, instance, nkeys, keys, keylens);
+    for (k = 0; k < instance->nshards && *errptr == NULL; k++) {
+        size_t start = groups.start[k];
+        xleveldb_instance_t *shard = instance->shards[k];
+
+        if (groups.count[k] == 0) continue;
+        xleveldb_mget(shard,
+                xleveldb_shard_roptions(instance, shard, roptions),
+                groups.count[k], groups.keys + start,
+                groups.keylens + start,
+                found + start, found_lens + start, errptr);
+    }
+    for (i = 0; i < nkeys; i++) {
+        values[groups.idx[i]] = found[i];
+        vallens[groups.idx[i]] = found_lens[i];
+    }
+    _xleveldb_groups_free(&groups);
+    free(found);
+    free(found_lens);
+}
+
+void
+xleveldb_mget(xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions,
+        size_t nkeys, const char **keys, const size_t *keylens,
+        char **values, size_t *vallens, char **errptr)
+{
+    xleveldb_key_t *sorted = NULL;
+    size_t nsorted = 0;
+    size_t i = 0;
+    unsigned int threshold = instance->config->sorted_mget_threshold;
+    /* a snapshot may see older values than the cache holds. */
+    bool cached = (instance->vcache != NULL)
+        && (roptions == instance->roptions);
+
+    if (instance->nshards > 1) {
+        _xleveldb_mget_sharded(instance, roptions,
+                nkeys, keys, keylens, values, vallens, errptr);
+        return;
+    }
+
+    sorted = (xleveldb_key_t *)malloc(sizeof(xleveldb_key_t) * (nkeys + 1));
+    assert(sorted != NULL);
+    __sync_fetch_and_add(&instance->reads, nkeys);
+    for (i = 0; i < nkeys; i++) {
+        values[i] = NULL;
+        vallens[i] = 0;
+        if (cached) {
+            values[i] = vcache_lookup(instance->vcache, instance->id,
+                    keys[i], keylens[i], &vallens[i], &sorted[nsorted].seq);
+            if (values[i] != NULL) {
+                __sync_fetch_and_add(&instance->hits, 1);
+                continue;
+            }
+        }
+        sorted[nsorted].key = keys[i];
+        sorted[nsorted].keylen = keylens[i];
+        sorted[nsorted].order = instance->order;
+        sorted[nsorted].idx = i;
+        nsorted++;
+    }
+
+    if (threshold > 0 && nsorted >= threshold) {
+        _xleveldb_mget_sorted(instance, roptions,
+                sorted, nsorted, values, vallens, errptr);
+    } else {
+        for (i = 0; i < nsorted && *errptr == NULL; i++) {
+            values[sorted[i].idx] = leveldb_get(instance->db, roptions,
+                    sorted[i].key, sorted[i].keylen,
+                    &vallens[sorted[i].idx], errptr);
+        }
+    }
+
+    for (i = 0; i < nsorted; i++) {
+        size_t idx = sorted[i].idx;
+        if (values[idx] == NULL) {
+            __sync_fetch_and_add(&instance->misses, 1);
+        } else if (cached) {
+            vcache_insert(instance->vcache, instance->id,
+                    sorted[i].key, sorted[i].keylen,
+                    values[idx], vallens[idx], sorted[i].seq);
+        }
+    }
+    free(sorted);
+}
+
+void
+xleveldb_put(xleveldb_instance_t *instance,
+        const leveldb_writeoptions_t *woptions,
+        const char *key, size_t keylen,
+        const char *val, size_t vallen,
+        char **errptr)
+{
+    if (instance->nshards > 1) {
+        xleveldb_put(xleveldb_shard(instance, key, keylen), woptions,
+                key, keylen, val, vallen, errptr);
+        return;
+    }
+
+    leveldb_put(instance->db, woptions, key, keylen, val, vallen, errptr);
+    /* after the write, see vcache_insert(). */
+    if (instance->vcache != NULL) {
+        vcache_invalidate(instance->vcache, instance->id, key, keylen);
+    }
+}
+
+void
+xleveldb_delete(xleveldb_instance_t *instance,
+        const leveldb_writeoptions_t *woptions,
+        const char *key, size_t keylen,
+        char **errptr)
+{
+    if (instance->nshards > 1) {
+        xleveldb_delete(xleveldb_shard(instance, key, keylen), woptions,
+                key, keylen, errptr);
+        return;
+    }
+
+    leveldb_delete(instance->db, woptions, key, keylen, errptr);
+    if (instance->vcache != NULL) {
+        vcache_invalidate(instance->vcache, instance->id, key, keylen);
+    }
+}
+
+static void
+_xleveldb_batch_put(void *arg, const char *key, size_t klen,
+        const char *val, size_t vlen)
+{
+    xleveldb_instance_t *instance = (xleveldb_instance_t *)arg;
+    vcache_invalidate(instance->vcache, instance->id, key, klen);
+}
+
+static void
+_xleveldb_batch_delete(void *arg, const char *key, size_t klen)
+{
+    xleveldb_instance_t *instance = (xleveldb_instance_t *)arg;
+    vcache_invalidate(instance->vcache, instance->id, key, klen);
+}
+
+void
+xleveldb_write(xleveldb_instance_t *instance,
+        const leveldb_writeoptions_t *woptions,
+        leveldb_writebatch_t *batch,
+        char **errptr)
+{
+    leveldb_writebatch_t **batches = NULL;
+    unsigned int k = 0;
+
+    if (instance->nshards > 1) {
+        /* atomic on each shard, not across them. */
+        batches = (leveldb_writebatch_t **)
+            malloc(sizeof(leveldb_writebatch_t *) * instance->nshards);
+        assert(batches != NULL);
+        xleveldb_split_batch(instance, batch, batches);
+        for (k = 0; k < instance->nshards; k++) {
+            if (batches[k] == NULL) continue;
+            if (*errptr == NULL) {
+                xleveldb_write(instance->shards[k], woptions,
+                        batches[k], errptr);
+            }
+            leveldb_writebatch_destroy(batches[k]);
+        }
+        free(batches);
+        return;
+    }
+
+    leveldb_write(instance->db, woptions, batch, errptr);
+    if (instance->vcache != NULL) {
+        leveldb_writebatch_iterate(batch, instance,
+                _xleveldb_batch_put, _xleveldb_batch_delete);
+    }
+}
@@ -34,14 +34,14 @@ static int _evhttpx_request_parser_chunks_fini(http_parser_t * p);
 static int _evhttpx_request_parser_headers_start(http_parser_t * p);
 
 static void _evhttpx_connection_readcb(evbev_t * bev, void * arg);
+static void _evhttpx_connection_flush(evhttpx_connection_t * c);
 
 static evhttpx_connection_t * _evhttpx_connection_new(evhttpx_t * httpx, int sock);
 
-static evhttpx_uri_t * _evhttpx_uri_new(void);
-static void _evhttpx_uri_free(evhttpx_uri_t * uri);
+static evhttpx_uri_t * _evhttpx_uri_new(evhttpx_arena_t * arena);
+static evhttpx_path_t * _evhttpx_path_new(evhttpx_arena_t * arena, const char * data, size_t len);
 
-static evhttpx_path_t * _evhttpx_path_new(const char * data, size_t len);
-static void _evhttpx_path_free(evhttpx_path_t * path);
+static evhttpx_query_t * _evhttpx_parse_query(evhttpx_arena_t * arena, const char * query, size_t len);
 
 #define HOOK_AVAIL(var, hook_name) (var->hooks && var->hooks->hook_name)
 #define HOOK_FUNC(var, hook_name) (var->hooks->hook_name)
@@ -592,41 +592,454 @@ _evhttpx_glob_match(const char * pattern, const char * string)
     return 0;
 } /* _evhttpx_glob_match */
 
+/**
+ * @brief adds a path callback to the hash index of an evhttpx_t, growing the
+ *        table so that it is never more than half full. The first callback
+ *        set for a path keeps it.
+ *
+ * @param httpx
+ * @param callback
+ *
+ * @return 0 on success, -1 on error
+ */
+static int
+_evhttpx_callback_index(evhttpx_t * httpx, evhttpx_callback_t * callback)
+{
+    evhttpx_callback_t ** table;
+    evhttpx_callback_t  * cur;
+    unsigned int          mask;
+    unsigned int          i;
+
+    if ((httpx->cb_table_used + 1) * 2 > httpx->cb_table_mask + 1 || httpx->cb_table == NULL) {
+        mask = httpx->cb_table ? (httpx->cb_table_mask << 1) | 1 : 63;
+
+        if (!(table = calloc(mask + 1, sizeof(evhttpx_callback_t *)))) {
+            return -1;
+        }
+
+        if (httpx->cb_table != NULL) {
+            for (i = 0; i <= httpx->cb_table_mask; i++) {
+                unsigned int j;
+
+                if ((cur = httpx->cb_table[i]) == NULL) {
+                    continue;
+                }
+
+                for (j = cur->hash & mask; table[j] != NULL; j = (j + 1) & mask) {
+                    ;
+                }
+
+                table[j] = cur;
+            }
+
+            free(httpx->cb_table);
+        }
+
+        httpx->cb_table      = table;
+        httpx->cb_table_mask = mask;
+    }
+
+    for (i = callback->hash & httpx->cb_table_mask;
+         (cur = httpx->cb_table[i]) != NULL;
+         i = (i + 1) & httpx->cb_table_mask) {
+        if (cur->hash == callback->hash && strcmp(cur->val.path, callback->val.path) == 0) {
+            return 0;
+        }
+    }
+
+    httpx->cb_table[i] = callback;
+    httpx->cb_table_used++;
+
+    return 0;
+} /* _evhttpx_callback_index */
+
 static evhttpx_callback_t *
-_evhttpx_callback_find(evhttpx_callbacks_t * cbs,
+_evhttpx_callback_find(evhttpx_t         * httpx,
                      const char        * path,
                      unsigned int      * start_offset,
                      unsigned int      * end_offset)
 {
     evhttpx_callback_t * callback;
+    unsigned int         hash;
+    unsigned int         i;
 
-    if (cbs == NULL) {
+    if (httpx->callbacks == NULL) {
         return NULL;
     }
 
-    TAILQ_FOREACH(callback, cbs, next) {
-        switch (callback->type) {
-            case evhttpx_callback_type_hash:
-                if (strcmp(callback->val.path, path) == 0) {
-                    *start_offset = 0;
-                    *end_offset   = (unsigned int)strlen(path);
-                    return callback;
-                }
-                break;
-            case evhttpx_callback_type_glob:
-                if (_evhttpx_glob_match(callback->val.glob, path) == 1) {
-                    *start_offset = 0;
-                    *end_offset   = (unsigned int)strlen(path);
-                    return callback;
-                }
-            default:
-                break;
-        } /* switch */
+    /* exact paths first, one probe sequence in the index */
+    if (httpx->cb_table != NULL) {
+        hash = _evhttpx_quick_hash(path);
+
+        for (i = hash & httpx->cb_table_mask;
+             (callback = httpx->cb_table[i]) != NULL;
+             i = (i + 1) & httpx->cb_table_mask) {
+            if (callback->hash == hash && strcmp(callback->val.path, path) == 0) {
+                *start_offset = 0;
+                *end_offset   = (unsigned int)strlen(path);
+                return callback;
+            }
+        }
+    }
+
+    if (httpx->num_globs == 0) {
+        return NULL;
+    }
+
+    TAILQ_FOREACH(callback, httpx->callbacks, next) {
+        if (callback->type != evhttpx_callback_type_glob) {
+            continue;
+        }
+
+        if (_evhttpx_glob_match(callback->val.glob, path) == 1) {
+            *start_offset = 0;
+            *end_offset   = (unsigned int)strlen(path);
+            return callback;
+        }
     }
 
     return NULL;
 }         /* _evhttpx_callback_find */
 
+/*
+ * request arenas: everything a request allocates while it is parsed and
+ * served is bumped out of a short list of chunks and handed back with a
+ * single evhttpx_arena_free() once the request is done.
+ */
+
+#define EVHTTPX_ARENA_ALIGN         (2 * sizeof(void *))
+#define EVHTTPX_ARENA_MAX_CHUNK     (1024 * 1024)
+#define EVHTTPX_ARENA_LARGE         EVHTTPX_ARENA_CHUNK_SIZE /**< hook allocations this big go to the heap */
+#define EVHTTPX_ARENA_HOOKS_MAX     (256 * 1024) /**< and all of them once the arena is this big */
+#define _evhttpx_arena_align(size)  (((size) + EVHTTPX_ARENA_ALIGN - 1) & ~(EVHTTPX_ARENA_ALIGN - 1))
+
+struct evhttpx_arena_chunk_s {
+    struct evhttpx_arena_chunk_s * next;
+    char                         * data; /**< first usable byte of the chunk */
+    size_t                         size; /**< usable bytes starting at data */
+};
+
+struct evhttpx_arena_cleanup_s {
+    struct evhttpx_arena_cleanup_s * next;
+    void                          (* cb)(void *);
+    void                           * arg;
+};
+
+struct evhttpx_arena_s {
+    struct evhttpx_arena_chunk_s   * chunks;    /**< newest chunk first */
+    char                           * pos;       /**< next free byte in chunks */
+    char                           * end;       /**< end of chunks */
+    size_t                           next_size; /**< size of the next chunk */
+    size_t                           size;      /**< bytes in chunks */
+    struct evhttpx_arena_cleanup_s * cleanups;  /**< newest cleanup first */
+};
+
+static __thread evhttpx_arena_t * _evhttpx_arena_current = NULL;
+
+static struct evhttpx_arena_chunk_s *
+_evhttpx_arena_chunk_new(size_t size)
+{
+    struct evhttpx_arena_chunk_s * chunk;
+    size_t                         hdr_len;
+
+    hdr_len = _evhttpx_arena_align(sizeof(struct evhttpx_arena_chunk_s));
+
+    if (!(chunk = malloc(hdr_len + size))) {
+        return NULL;
+    }
+
+    chunk->next = NULL;
+    chunk->data = (char *)chunk + hdr_len;
+    chunk->size = size;
+
+    return chunk;
+}
+
+evhttpx_arena_t *
+evhttpx_arena_new(size_t size)
+{
+    struct evhttpx_arena_chunk_s * chunk;
+    evhttpx_arena_t              * arena;
+    size_t                         arena_len;
+
+    arena_len = _evhttpx_arena_align(sizeof(evhttpx_arena_t));
+
+    if (size < arena_len + EVHTTPX_ARENA_ALIGN) {
+        size = arena_len + EVHTTPX_ARENA_ALIGN;
+    }
+
+    /* the arena itself is the first thing carved out of its first chunk */
+    if (!(chunk = _evhttpx_arena_chunk_new(_evhttpx_arena_align(size)))) {
+        return NULL;
+    }
+
+    arena            = (evhttpx_arena_t *)chunk->data;
+    arena->chunks    = chunk;
+    arena->pos       = chunk->data + arena_len;
+    arena->end       = chunk->data + chunk->size;
+    arena->next_size = chunk->size * 2;
+    arena->size      = chunk->size;
+    arena->cleanups  = NULL;
+
+    return arena;
+}
+
+void *
+evhttpx_arena_alloc(evhttpx_arena_t * arena, size_t size)
+{
+    void * ptr;
+
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    size = _evhttpx_arena_align(size ? size : 1);
+
+    if ((size_t)(arena->end - arena->pos) < size) {
+        struct evhttpx_arena_chunk_s * chunk;
+        size_t                         chunk_size;
+
+        chunk_size = arena->next_size;
+
+        if (chunk_size < size) {
+            chunk_size = size;
+        }
+
+        if (!(chunk = _evhttpx_arena_chunk_new(chunk_size))) {
+            return NULL;
+        }
+
+        chunk->next   = arena->chunks;
+        arena->chunks = chunk;
+        arena->pos    = chunk->data;
+        arena->end    = chunk->data + chunk->size;
+        arena->size  += chunk->size;
+
+        if (arena->next_size < EVHTTPX_ARENA_MAX_CHUNK) {
+            arena->next_size *= 2;
+        }
+    }
+
+    ptr         = arena->pos;
+    arena->pos += size;
+
+    return ptr;
+}
+
+void *
+evhttpx_arena_calloc(evhttpx_arena_t * arena, size_t nmemb, size_t size)
+{
+    void * ptr;
+
+    if (size && nmemb > (size_t)-1 / size) {
+        return NULL;
+    }
+
+    if (!(ptr = evhttpx_arena_alloc(arena, nmemb * size))) {
+        return NULL;
+    }
+
+    memset(ptr, 0, nmemb * size);
+    return ptr;
+}
+
+char *
+evhttpx_arena_strndup(evhttpx_arena_t * arena, const char * s, size_t n)
+{
+    char * ret;
+
+    if (!(ret = evhttpx_arena_alloc(arena, n + 1))) {
+        return NULL;
+    }
+
+    memcpy(ret, s, n);
+    ret[n] = '\0';
+
+    return ret;
+}
+
+int
+evhttpx_arena_owns(evhttpx_arena_t * arena, const void * ptr)
+{
+    struct evhttpx_arena_chunk_s * chunk;
+    const char                   * p = ptr;
+
+    if (arena == NULL || ptr == NULL) {
+        return 0;
+    }
+
+    for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        if (p >= chunk->data && p < chunk->data + chunk->size) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void
+evhttpx_arena_release(evhttpx_arena_t * arena, void * ptr)
+{
+    if (ptr == NULL || evhttpx_arena_owns(arena, ptr)) {
+        return;
+    }
+
+    free(ptr);
+}
+
+int
+evhttpx_arena_add_cleanup(evhttpx_arena_t * arena, void (*cb)(void *), void * arg)
+{
+    struct evhttpx_arena_cleanup_s * cleanup;
+
+    if (arena == NULL || cb == NULL) {
+        return -1;
+    }
+
+    if (!(cleanup = evhttpx_arena_alloc(arena, sizeof(struct evhttpx_arena_cleanup_s)))) {
+        return -1;
+    }
+
+    cleanup->cb     = cb;
+    cleanup->arg    = arg;
+    cleanup->next   = arena->cleanups;
+    arena->cleanups = cleanup;
+
+    return 0;
+}
+
+void
+evhttpx_arena_free(evhttpx_arena_t * arena)
+{
+    struct evhttpx_arena_chunk_s   * chunk;
+    struct evhttpx_arena_chunk_s   * save;
+    struct evhttpx_arena_cleanup_s * cleanup;
+
+    if (arena == NULL) {
+        return;
+    }
+
+    if (_evhttpx_arena_current == arena) {
+        _evhttpx_arena_current = NULL;
+    }
+
+    /* cleanups live in the arena, run them all before freeing any of it */
+    for (cleanup = arena->cleanups; cleanup != NULL; cleanup = cleanup->next) {
+        cleanup->cb(cleanup->arg);
+    }
+
+    /* the first chunk holds the arena, so it has to go last */
+    for (chunk = arena->chunks; chunk != NULL; chunk = save) {
+        save = chunk->next;
+        free(chunk);
+    }
+}
+
+evhttpx_arena_t *
+evhttpx_arena_set_current(evhttpx_arena_t * arena)
+{
+    evhttpx_arena_t * prev = _evhttpx_arena_current;
+
+    _evhttpx_arena_current = arena;
+    return prev;
+}
+
+evhttpx_arena_t *
+evhttpx_arena_get_current(void)
+{
+    return _evhttpx_arena_current;
+}
+
+void *
+evhttpx_arena_current_malloc(size_t size)
+{
+    /* freeing into an arena does nothing, so buffers which are copied
+     * into bigger ones and then freed, as cJSON does while printing, would
+     * pile up in it. Big ones, and all of them once the arena has grown
+     * past its share, come off the heap and are really freed instead. */
+    if (_evhttpx_arena_current == NULL || size >= EVHTTPX_ARENA_LARGE ||
+        _evhttpx_arena_current->size >= EVHTTPX_ARENA_HOOKS_MAX) {
+        return malloc(size);
+    }
+
+    return evhttpx_arena_alloc(_evhttpx_arena_current, size);
+}
+
+void
+evhttpx_arena_current_free(void * ptr)
+{
+    evhttpx_arena_release(_evhttpx_arena_current, ptr);
+}
+
+/**
+ * @brief allocates a key/value pair and copies of key and val out of an arena
+ *
+ * @param arena the request arena
+ * @param key the key, may be NULL
+ * @param key_len length of the key
+ * @param val the value, may be NULL
+ * @param val_len length of the value
+ *
+ * @return evhttpx_kv_t * on success, NULL on error.
+ */
+static evhttpx_kv_t *
+_evhttpx_arena_kv_new(evhttpx_arena_t * arena,
+                      const char * key, size_t key_len,
+                      const char * val, size_t val_len)
+{
+    evhttpx_kv_t * kv;
+
+    if (!(kv = evhttpx_arena_calloc(arena, 1, sizeof(evhttpx_kv_t)))) {
+        return NULL;
+    }
+
+    kv->in_arena = 1;
+
+    if (key != NULL) {
+        if (!(kv->key = evhttpx_arena_strndup(arena, key, key_len))) {
+            return NULL;
+        }
+
+        kv->klen = key_len;
+    }
+
+    if (val != NULL) {
+        if (!(kv->val = evhttpx_arena_strndup(arena, val, val_len))) {
+            return NULL;
+        }
+
+        kv->vlen = val_len;
+    }
+
+    return kv;
+}
+
+/**
+ * @brief frees the heap allocated entries of a kvs which lives in a request
+ *        arena, the arena entries and the kvs itself go with the arena.
+ *
+ * @param kvs
+ */
+static void
+_evhttpx_kvs_release(evhttpx_kvs_t * kvs)
+{
+    evhttpx_kv_t * kv;
+    evhttpx_kv_t * save;
+
+    if (kvs == NULL) {
+        return;
+    }
+
+    for (kv = TAILQ_FIRST(kvs); kv != NULL; kv = save) {
+        save = TAILQ_NEXT(kv, next);
+
+        if (kv->in_arena == 0) {
+            TAILQ_REMOVE(kvs, kv, next);
+            evhttpx_kv_free(kv);
+        }
+    }
+}
+
 /**
  * @brief Creates a new evhttpx_request_t
  *
@@ -637,19 +1050,26 @@ _evhttpx_callback_find(evhttpx_callbacks_t * cbs,
 static evhttpx_request_t *
 _evhttpx_request_new(evhttpx_connection_t * c)
 {
+    evhttpx_arena_t   * arena;
     evhttpx_request_t * req;
 
-    if (!(req = calloc(sizeof(evhttpx_request_t), 1))) {
+    if (!(arena = evhttpx_arena_new(EVHTTPX_ARENA_CHUNK_SIZE))) {
+        return NULL;
+    }
+
+    if (!(req = evhttpx_arena_calloc(arena, 1, sizeof(evhttpx_request_t)))) {
+        evhttpx_arena_free(arena);
         return NULL;
     }
 
+    req->arena       = arena;
     req->conn        = c;
     req->httpx         = c->httpx;
     req->status      = EVHTTPX_RES_OK;
     req->buffer_in   = evbuffer_new();
     req->buffer_out  = evbuffer_new();
-    req->headers_in  = malloc(sizeof(evhttpx_headers_t));
-    req->headers_out = malloc(sizeof(evhttpx_headers_t));
+    req->headers_in  = evhttpx_arena_alloc(arena, sizeof(evhttpx_headers_t));
+    req->headers_out = evhttpx_arena_alloc(arena, sizeof(evhttpx_headers_t));
 
     TAILQ_INIT(req->headers_in);
     TAILQ_INIT(req->headers_out);
@@ -669,12 +1089,23 @@ _evhttpx_request_free(evhttpx_request_t * request)
         return;
     }
 
-    _evhttpx_request_fini_hook(request);
-    _evhttpx_uri_free(request->uri);
+    /* a fini hook returning EVHTTPX_RES_PAUSE keeps the request, which
+     * outlives its connection until evhttpx_request_free() is called */
+    if (request->conn != NULL) {
+        if (_evhttpx_request_fini_hook(request) == EVHTTPX_RES_PAUSE) {
+            request->conn = NULL;
+            return;
+        }
+    }
 
-    evhttpx_headers_free(request->headers_in);
-    evhttpx_headers_free(request->headers_out);
+    /* headers added by the application are heap allocated, everything the
+     * parser produced goes away with the arena. */
+    _evhttpx_kvs_release(request->headers_in);
+    _evhttpx_kvs_release(request->headers_out);
 
+    if (request->uri) {
+        _evhttpx_kvs_release(request->uri->query);
+    }
 
     if (request->buffer_in) {
         evbuffer_free(request->buffer_in);
@@ -684,47 +1115,33 @@ _evhttpx_request_free(evhttpx_request_t * request)
         evbuffer_free(request->buffer_out);
     }
 
-    free(request->hooks);
-    free(request);
+    /* hooks copied from a callback come from the arena, those set with
+     * evhttpx_set_hook() are calloc()'d */
+    evhttpx_arena_release(request->arena, request->hooks);
+
+    /* the request itself lives in its arena */
+    evhttpx_arena_free(request->arena);
 }
 
 /**
  * @brief create an overlay URI structure
  *
+ * @param arena the request arena the URI is allocated from
+ *
  * @return evhttpx_uri_t
  */
 static evhttpx_uri_t *
-_evhttpx_uri_new(void)
+_evhttpx_uri_new(evhttpx_arena_t * arena)
 {
     evhttpx_uri_t * uri;
 
-    if (!(uri = calloc(sizeof(evhttpx_uri_t), 1))) {
+    if (!(uri = evhttpx_arena_calloc(arena, 1, sizeof(evhttpx_uri_t)))) {
         return NULL;
     }
 
     return uri;
 }
 
-/**
- * @brief frees an overlay URI structure
- *
- * @param uri evhttpx_uri_t
- */
-static void
-_evhttpx_uri_free(evhttpx_uri_t * uri)
-{
-    if (uri == NULL) {
-        return;
-    }
-
-    evhttpx_query_free(uri->query);
-    _evhttpx_path_free(uri->path);
-
-    free(uri->fragment);
-    free(uri->query_raw);
-    free(uri);
-}
-
 /**
  * @brief parses the path and file from an input buffer
  *
@@ -735,20 +1152,21 @@ _evhttpx_uri_free(evhttpx_uri_t * uri)
  * @details if for example the input was "/a/b/c", the parser will
  *          consider "/a/b/" as the path, and "c" as the file.
  *
+ * @param arena the request arena the path is allocated from
  * @param data raw input data (assumes a /path/[file] structure)
  * @param len length of the input data
  *
  * @return evhttpx_request_t * on success, NULL on error.
  */
 static evhttpx_path_t *
-_evhttpx_path_new(const char * data, size_t len)
+_evhttpx_path_new(evhttpx_arena_t * arena, const char * data, size_t len)
 {
     evhttpx_path_t * req_path;
     const char   * data_end = (const char *)(data + len);
     char         * path     = NULL;
     char         * file     = NULL;
 
-    if (!(req_path = calloc(sizeof(evhttpx_path_t), 1))) {
+    if (!(req_path = evhttpx_arena_calloc(arena, 1, sizeof(evhttpx_path_t)))) {
         return NULL;
     }
 
@@ -756,13 +1174,13 @@ _evhttpx_path_new(const char * data, size_t len)
         /*
          * odd situation here, no preceding "/", so just assume the path is "/"
          */
-        path = strdup("/");
+        path = evhttpx_arena_strndup(arena, "/", 1);
     } else if (*data != '/') {
         /* request like GET stupid HTTP/1.0, treat stupid as the file, and
          * assume the path is "/"
          */
-        path = strdup("/");
-        file = strndup(data, len);
+        path = evhttpx_arena_strndup(arena, "/", 1);
+        file = evhttpx_arena_strndup(arena, data, len);
     } else {
         if (data[len - 1] != '/') {
             /*
@@ -786,19 +1204,17 @@ _evhttpx_path_new(const char * data, size_t len)
                     /* check for overflow */
                     if ((const char *)(data + path_len) > data_end) {
                         fprintf(stderr, "PATH Corrupted.. (path_len > len)\n");
-                        free(req_path);
                         return NULL;
                     }
 
                     /* check for overflow */
                     if ((const char *)(&data[i + 1] + file_len) > data_end) {
                         fprintf(stderr, "FILE Corrupted.. (file_len > len)\n");
-                        free(req_path);
                         return NULL;
                     }
 
-                    path = strndup(data, path_len);
-                    file = strndup(&data[i + 1], file_len);
+                    path = evhttpx_arena_strndup(arena, data, path_len);
+                    file = evhttpx_arena_strndup(arena, &data[i + 1], file_len);
 
                     break;
                 }
@@ -806,20 +1222,20 @@ _evhttpx_path_new(const char * data, size_t len)
 
             if (i == 0 && data[i] == '/' && !file && !path) {
                 /* drops here if the request is something like GET /foo */
-                path = strdup("/");
+                path = evhttpx_arena_strndup(arena, "/", 1);
 
                 if (len > 1) {
-                    file = strndup((const char *)(data + 1), len);
+                    file = evhttpx_arena_strndup(arena, (const char *)(data + 1), len - 1);
                 }
             }
         } else {
             /* the last character is a "/", thus the request is just a path */
-            path = strndup(data, len);
+            path = evhttpx_arena_strndup(arena, data, len);
         }
     }
 
     if (len != 0) {
-        req_path->full = strndup(data, len);
+        req_path->full = evhttpx_arena_strndup(arena, data, len);
     }
 
     req_path->path = path;
@@ -828,23 +1244,6 @@ _evhttpx_path_new(const char * data, size_t len)
     return req_path;
 }     /* _evhttpx_path_new */
 
-static void
-_evhttpx_path_free(evhttpx_path_t * path)
-{
-    if (path == NULL) {
-        return;
-    }
-
-    free(path->full);
-
-    free(path->path);
-    free(path->file);
-    free(path->match_start);
-    free(path->match_end);
-
-    free(path);
-}
-
 static int
 _evhttpx_request_parser_start(http_parser_t * p)
 {
@@ -871,13 +1270,12 @@ _evhttpx_request_parser_args(http_parser_t * p, const char * data, size_t len)
     evhttpx_connection_t * c   = http_parser_get_userdata(p);
     evhttpx_uri_t        * uri = c->request->uri;
 
-    if (!(uri->query = evhttpx_parse_query(data, len))) {
+    if (!(uri->query = _evhttpx_parse_query(c->request->arena, data, len))) {
         c->request->status = EVHTTPX_RES_ERROR;
         return -1;
     }
 
-    uri->query_raw = calloc(len + 1, 1);
-    memcpy(uri->query_raw, data, len);
+    uri->query_raw = (unsigned char *)evhttpx_arena_strndup(c->request->arena, data, len);
 
     return 0;
 }
@@ -898,19 +1296,14 @@ static int
 _evhttpx_request_parser_header_key(http_parser_t * p, const char * data, size_t len)
 {
     evhttpx_connection_t * c = http_parser_get_userdata(p);
-    char               * key_s;     /* = strndup(data, len); */
     evhttpx_header_t     * hdr;
 
-    key_s      = malloc(len + 1);
-    key_s[len] = '\0';
-    memcpy(key_s, data, len);
-
-    if ((hdr = evhttpx_header_key_add(c->request->headers_in, key_s, 0)) == NULL) {
+    if ((hdr = _evhttpx_arena_kv_new(c->request->arena, data, len, NULL, 0)) == NULL) {
         c->request->status = EVHTTPX_RES_FATAL;
         return -1;
     }
 
-    hdr->k_heaped = 1;
+    evhttpx_headers_add_header(c->request->headers_in, hdr);
     return 0;
 }
 
@@ -921,17 +1314,16 @@ _evhttpx_request_parser_header_val(http_parser_t * p, const char * data, size_t
     char               * val_s;
     evhttpx_header_t     * header;
 
-    val_s      = malloc(len + 1);
-    val_s[len] = '\0';
-    memcpy(val_s, data, len);
+    if ((val_s = evhttpx_arena_strndup(c->request->arena, data, len)) == NULL) {
+        c->request->status = EVHTTPX_RES_FATAL;
+        return -1;
+    }
 
     if ((header = evhttpx_header_val_add(c->request->headers_in, val_s, 0)) == NULL) {
         c->request->status = EVHTTPX_RES_FATAL;
         return -1;
     }
 
-    header->v_heaped = 1;
-
     if ((c->request->status = _evhttpx_header_hook(c->request, header)) != EVHTTPX_RES_OK) {
         return -1;
     }
@@ -1005,13 +1397,13 @@ _evhttpx_request_set_callbacks(evhttpx_request_t * request)
     cb       = NULL;
     cbarg    = NULL;
 
-    if ((callback = _evhttpx_callback_find(evhttpx->callbacks, path->full,
+    if ((callback = _evhttpx_callback_find(evhttpx, path->full,
                                          &path->matched_soff, &path->matched_eoff))) {
         /* matched a callback using both path and file (/a/b/c/d) */
         cb    = callback->cb;
         cbarg = callback->cbarg;
         hooks = callback->hooks;
-    } else if ((callback = _evhttpx_callback_find(evhttpx->callbacks, path->path,
+    } else if ((callback = _evhttpx_callback_find(evhttpx, path->path,
                                                 &path->matched_soff, &path->matched_eoff))) {
         /* matched a callback using *just* the path (/a/b/c/) */
         cb    = callback->cb;
@@ -1027,11 +1419,11 @@ _evhttpx_request_set_callbacks(evhttpx_request_t * request)
     }
 
     if (path->match_start == NULL) {
-        path->match_start = calloc(strlen(path->full) + 1, 1);
+        path->match_start = evhttpx_arena_calloc(request->arena, strlen(path->full) + 1, 1);
     }
 
     if (path->match_end == NULL) {
-        path->match_end = calloc(strlen(path->full) + 1, 1);
+        path->match_end = evhttpx_arena_calloc(request->arena, strlen(path->full) + 1, 1);
     }
 
     if (path->matched_eoff - path->matched_soff) {
@@ -1048,7 +1440,7 @@ _evhttpx_request_set_callbacks(evhttpx_request_t * request)
 
     if (hooks != NULL) {
         if (request->hooks == NULL) {
-            request->hooks = malloc(sizeof(evhttpx_hooks_t));
+            request->hooks = evhttpx_arena_alloc(request->arena, sizeof(evhttpx_hooks_t));
         }
 
         memcpy(request->hooks, hooks, sizeof(evhttpx_hooks_t));
@@ -1120,13 +1512,12 @@ _evhttpx_request_parser_path(http_parser_t * p, const char * data, size_t len)
     evhttpx_uri_t        * uri;
     evhttpx_path_t       * path;
 
-    if (!(uri = _evhttpx_uri_new())) {
+    if (!(uri = _evhttpx_uri_new(c->request->arena))) {
         c->request->status = EVHTTPX_RES_FATAL;
         return -1;
     }
 
-    if (!(path = _evhttpx_path_new(data, len))) {
-        _evhttpx_uri_free(uri);
+    if (!(path = _evhttpx_path_new(c->request->arena, data, len))) {
         c->request->status = EVHTTPX_RES_FATAL;
         return -1;
     }
@@ -1168,6 +1559,8 @@ _evhttpx_request_parser_headers(http_parser_t * p)
         return 0;
     }
 
+    _evhttpx_connection_flush(c);
+
     evbuffer_add_printf(bufferevent_get_output(c->bev),
                         "HTTP/%d.%d 100 Continue\r\n\r\n",
                         http_parser_get_major(p),
@@ -1310,10 +1703,9 @@ _evhttpx_request_parser_fini(http_parser_t * p)
         body_len       = evbuffer_get_length(buf_in);
         body           = (const char *)evbuffer_pullup(buf_in, body_len);
 
-        uri->query_raw = calloc(body_len + 1, 1);
-        memcpy(uri->query_raw, body, body_len);
-
-        uri->query     = evhttpx_parse_query(body, body_len);
+        uri->query_raw = (unsigned char *)evhttpx_arena_strndup(c->request->arena,
+                                                                body, body_len);
+        uri->query     = _evhttpx_parse_query(c->request->arena, body, body_len);
     }
 
 
@@ -1324,7 +1716,33 @@ _evhttpx_request_parser_fini(http_parser_t * p)
      *
      */
     if (c->request && c->request->cb) {
+        evhttpx_arena_t * prev;
+
+        /* let the callback allocate (e.g. through cJSON hooks) out of the
+         * request arena. */
+        prev = evhttpx_arena_set_current(c->request->arena);
         (c->request->cb)(c->request, c->request->cbarg);
+        evhttpx_arena_set_current(prev);
+    }
+
+    if (c->request && c->request->status == EVHTTPX_RES_PAUSE) {
+        /* the callback finishes this request later on, leave anything after
+         * it in the input buffer until the connection is resumed. */
+        return -1;
+    }
+
+    if (c->request && c->request->finished == 1 && c->request->keepalive == 0) {
+        /* the connection is closed once this reply is out, anything
+         * pipelined behind it is never going to be answered. */
+        return -1;
+    }
+
+    if (c->httpx->max_pipelined_requests) {
+        if (++c->num_inflight >= c->httpx->max_pipelined_requests) {
+            /* stop here until the replies queued so far are written */
+            c->pipeline_full = 1;
+            return -1;
+        }
     }
 
     return 0;
@@ -1348,6 +1766,19 @@ _evhttpx_create_reply(evhttpx_request_t * request, evhttpx_res code)
     evbuf_t    * buf          = evbuffer_new();
     const char * content_type = evhttpx_header_find(request->headers_out, "Content-Type");
 
+    /*
+     * if there is a set maximum number of keepalive requests configured, check
+     * to make sure we are not over it. If we have gone over the max we set the
+     * keepalive bit to 0, thus closing the connection. Every reply is counted
+     * here, a single write may carry the replies to several pipelined
+     * requests.
+     */
+    if (request->conn->httpx->max_keepalive_requests) {
+        if (++request->conn->num_requests >= request->conn->httpx->max_keepalive_requests) {
+            request->keepalive = 0;
+        }
+    }
+
     if (http_parser_get_multipart(request->conn->parser) == 1) {
         goto check_proto;
     }
@@ -1459,10 +1890,15 @@ _evhttpx_connection_readcb(evbev_t * bev, void * arg)
 
     buf = evbuffer_pullup(bufferevent_get_input(bev), avail);
 
+    /* replies to every request parsed below are collected in batch_buf and
+     * handed to the bufferevent in one go. */
     bufferevent_disable(bev, EV_WRITE);
     {
-        nread = http_parser_run(c->parser, &request_psets, (const char *)buf, avail);
+        c->batching = 1;
+        nread       = http_parser_run(c->parser, &request_psets, (const char *)buf, avail);
+        c->batching = 0;
     }
+    _evhttpx_connection_flush(c);
     bufferevent_enable(bev, EV_WRITE);
 
     if (c->owner != 1) {
@@ -1492,6 +1928,11 @@ _evhttpx_connection_readcb(evbev_t * bev, void * arg)
     if (avail != nread) {
         if (c->request && c->request->status == EVHTTPX_RES_PAUSE) {
             evhttpx_request_pause(c->request);
+        } else if (c->request && c->request->finished == 1 &&
+                   c->request->keepalive == 0) {
+            nread = avail;
+        } else if (c->pipeline_full == 1) {
+            evhttpx_connection_pause(c);
         } else {
             evhttpx_connection_free(c);
             return;
@@ -1501,6 +1942,14 @@ _evhttpx_connection_readcb(evbev_t * bev, void * arg)
     evbuffer_drain(bufferevent_get_input(bev), nread);
 } /* _evhttpx_connection_readcb */
 
+static void
+_evhttpx_connection_flush(evhttpx_connection_t * c)
+{
+    if (c->batch_buf && evbuffer_get_length(c->batch_buf)) {
+        bufferevent_write_buffer(c->bev, c->batch_buf);
+    }
+}
+
 static void
 _evhttpx_connection_writecb(evbev_t * bev, void * arg)
 {
@@ -1516,17 +1965,6 @@ _evhttpx_connection_writecb(evbev_t * bev, void * arg)
         return;
     }
 
-    /*
-     * if there is a set maximum number of keepalive requests configured, check
-     * to make sure we are not over it. If we have gone over the max we set the
-     * keepalive bit to 0, thus closing the connection.
-     */
-    if (c->httpx->max_keepalive_requests) {
-        if (++c->num_requests >= c->httpx->max_keepalive_requests) {
-            c->request->keepalive = 0;
-        }
-    }
-
     if (c->request->keepalive) {
         _evhttpx_request_free(c->request);
 
@@ -1548,6 +1986,14 @@ _evhttpx_connection_writecb(evbev_t * bev, void * arg)
 
 
         http_parser_set_userdata(c->parser, c);
+
+        /* everything answered so far has been written out */
+        c->num_inflight = 0;
+
+        if (c->pipeline_full == 1) {
+            c->pipeline_full = 0;
+            evhttpx_connection_resume(c);
+        }
         return;
     } else {
         evhttpx_connection_free(c);
@@ -1681,16 +2127,23 @@ static evhttpx_connection_t *
 _evhttpx_connection_new(evhttpx_t * httpx, int sock)
 {
     evhttpx_connection_t * connection;
+    int                    one = 1;
 
     if (!(connection = calloc(sizeof(evhttpx_connection_t), 1))) {
         return NULL;
     }
 
+    /* libevent writes a large reply out in several pieces, the last of
+     * which would otherwise wait for the peer to ack the others. */
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+               &one, (ev_socklen_t)sizeof(one));
+
     connection->error  = 0;
     connection->owner  = 1;
     connection->sock   = sock;
     connection->httpx    = httpx;
     connection->parser = http_parser_new();
+    connection->batch_buf = evbuffer_new();
 
     http_parser_init(connection->parser, httpx_type_request);
     http_parser_set_userdata(connection->parser, connection);
@@ -1728,67 +2181,226 @@ _evhttpx_run_post_accept(evhttpx_t * httpx, evhttpx_connection_t * connection)
     return 0;
 }
 
-#ifndef EVHTTPX_DISABLE_EVTHR
-static void
-_evhttpx_run_in_thread(evthr_t * thr, void * arg, void * shared)
+#ifndef EVHTTPX_DISABLE_EVTHR
+static void
+_evhttpx_run_in_thread(evthr_t * thr, void * arg, void * shared)
+{
+    evhttpx_t            * httpx        = shared;
+    evhttpx_connection_t * connection = arg;
+
+    connection->evbase = evthr_get_base(thr);
+    connection->thread = thr;
+
+    evthr_inc_backlog(connection->thread);
+
+    if (_evhttpx_connection_accept(connection->evbase, connection) < 0) {
+        evhttpx_connection_free(connection);
+        return;
+    }
+
+    if (_evhttpx_run_post_accept(httpx, connection) < 0) {
+        evhttpx_connection_free(connection);
+        return;
+    }
+}
+
+#endif
+
+static void
+_evhttpx_accept_cb(evserv_t * serv, int fd, struct sockaddr * s, int sl, void * arg)
+{
+    evhttpx_t            * httpx = arg;
+    evhttpx_connection_t * connection;
+
+    if (!(connection = _evhttpx_connection_new(httpx, fd))) {
+        return;
+    }
+
+    connection->saddr = malloc(sl);
+    memcpy(connection->saddr, s, sl);
+
+#ifndef EVHTTPX_DISABLE_EVTHR
+    if (httpx->thr_pool != NULL) {
+        if (evthr_pool_defer(httpx->thr_pool, _evhttpx_run_in_thread, connection) != EVTHR_RES_OK) {
+            evutil_closesocket(connection->sock);
+            evhttpx_connection_free(connection);
+            return;
+        }
+        return;
+    }
+#endif
+    connection->evbase = httpx->evbase;
+
+    if (_evhttpx_connection_accept(httpx->evbase, connection) < 0) {
+        evhttpx_connection_free(connection);
+        return;
+    }
+
+    if (_evhttpx_run_post_accept(httpx, connection) < 0) {
+        evhttpx_connection_free(connection);
+        return;
+    }
+}
+
+#ifndef EVHTTPX_DISABLE_EVTHR
+struct evhttpx_reuseport_s {
+    struct sockaddr_storage addr;
+    size_t                  addr_len;
+    int                     backlog;
+    evutil_socket_t       * socks;  /* bound by evhttpx_use_threads(), one per thread */
+    int                     nsocks;
+    int                     taken;  /* handed to the threads so far */
+
+    TAILQ_ENTRY(evhttpx_reuseport_s) next;
+};
+
+struct evhttpx_listener_s {
+    evhttpx_t * httpx;
+    evthr_t   * thread;
+    evserv_t  * server;
+
+    TAILQ_ENTRY(evhttpx_listener_s) next;
+};
+
+typedef struct evhttpx_reuseport_s evhttpx_reuseport_t;
+typedef struct evhttpx_listener_s  evhttpx_listener_t;
+
+static void
+_evhttpx_reuseport_accept_cb(evserv_t * serv, int fd, struct sockaddr * s, int sl, void * arg)
+{
+    evhttpx_listener_t   * listener = arg;
+    evhttpx_connection_t * connection;
+
+    if (!(connection = _evhttpx_connection_new(listener->httpx, fd))) {
+        evutil_closesocket(fd);
+        return;
+    }
+
+    connection->saddr = malloc(sl);
+    memcpy(connection->saddr, s, sl);
+
+    /* the listener lives on the thread's own base, so we are already
+     * running in the thread which is going to own the connection. */
+    _evhttpx_run_in_thread(listener->thread, connection, listener->httpx);
+}
+
+static evutil_socket_t
+_evhttpx_reuseport_socket(evhttpx_reuseport_t * rp)
 {
-    evhttpx_t            * httpx        = shared;
-    evhttpx_connection_t * connection = arg;
+    evutil_socket_t sock;
+    int             one = 1;
 
-    connection->evbase = evthr_get_base(thr);
-    connection->thread = thr;
+    if ((sock = socket(rp->addr.ss_family, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
 
-    evthr_inc_backlog(connection->thread);
+    if (evutil_make_socket_nonblocking(sock) < 0 ||
+        evutil_make_socket_closeonexec(sock) < 0) {
+        goto error;
+    }
 
-    if (_evhttpx_connection_accept(connection->evbase, connection) < 0) {
-        evhttpx_connection_free(connection);
-        return;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
+                   &one, (ev_socklen_t)sizeof(one)) < 0) {
+        goto error;
     }
 
-    if (_evhttpx_run_post_accept(httpx, connection) < 0) {
-        evhttpx_connection_free(connection);
-        return;
+#ifdef SO_REUSEPORT
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT,
+                   &one, (ev_socklen_t)sizeof(one)) < 0) {
+        goto error;
     }
-}
+#endif
 
+#ifdef USE_DEFER_ACCEPT
+    setsockopt(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+               &one, (ev_socklen_t)sizeof(one));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+               &one, (ev_socklen_t)sizeof(one));
 #endif
 
+    if (bind(sock, (struct sockaddr *)&rp->addr, rp->addr_len) < 0) {
+        goto error;
+    }
+
+    return sock;
+error:
+    evutil_closesocket(sock);
+    return -1;
+} /* _evhttpx_reuseport_socket */
+
+/* closes the sockets no thread has taken yet */
 static void
-_evhttpx_accept_cb(evserv_t * serv, int fd, struct sockaddr * s, int sl, void * arg)
+_evhttpx_reuseport_close(evhttpx_reuseport_t * rp)
 {
-    evhttpx_t            * httpx = arg;
-    evhttpx_connection_t * connection;
+    int saved_errno = errno;
 
-    if (!(connection = _evhttpx_connection_new(httpx, fd))) {
-        return;
+    while (rp->nsocks > rp->taken) {
+        evutil_closesocket(rp->socks[--rp->nsocks]);
     }
 
-    connection->saddr = malloc(sl);
-    memcpy(connection->saddr, s, sl);
+    free(rp->socks);
+    rp->socks  = NULL;
+    rp->nsocks = 0;
+    rp->taken  = 0;
+    errno      = saved_errno;
+}
 
-#ifndef EVHTTPX_DISABLE_EVTHR
-    if (httpx->thr_pool != NULL) {
-        if (evthr_pool_defer(httpx->thr_pool, _evhttpx_run_in_thread, connection) != EVTHR_RES_OK) {
-            evutil_closesocket(connection->sock);
-            evhttpx_connection_free(connection);
-            return;
+/* binds every thread's socket up front, so that a port which cannot be
+ * bound is reported to the caller instead of being found out by the
+ * threads after they have started. */
+static int
+_evhttpx_reuseports_bind(evhttpx_t * httpx, int nthreads)
+{
+    evhttpx_reuseport_t * rp;
+
+    TAILQ_FOREACH(rp, &httpx->reuseports, next) {
+        if (!(rp->socks = calloc(sizeof(evutil_socket_t), nthreads))) {
+            goto error;
         }
-        return;
-    }
-#endif
-    connection->evbase = httpx->evbase;
 
-    if (_evhttpx_connection_accept(httpx->evbase, connection) < 0) {
-        evhttpx_connection_free(connection);
-        return;
+        for (rp->nsocks = 0; rp->nsocks < nthreads; rp->nsocks++) {
+            if ((rp->socks[rp->nsocks] = _evhttpx_reuseport_socket(rp)) < 0) {
+                goto error;
+            }
+        }
     }
 
-    if (_evhttpx_run_post_accept(httpx, connection) < 0) {
-        evhttpx_connection_free(connection);
-        return;
+    return 0;
+error:
+    TAILQ_FOREACH(rp, &httpx->reuseports, next) {
+        _evhttpx_reuseport_close(rp);
     }
+
+    return -1;
 }
 
+static evhttpx_listener_t *
+_evhttpx_listener_new(evhttpx_t * httpx, evthr_t * thr,
+        evhttpx_reuseport_t * rp, evutil_socket_t sock)
+{
+    evhttpx_listener_t * listener;
+
+    if (!(listener = calloc(sizeof(evhttpx_listener_t), 1))) {
+        return NULL;
+    }
+
+    listener->httpx  = httpx;
+    listener->thread = thr;
+    listener->server = evconnlistener_new(evthr_get_base(thr),
+            _evhttpx_reuseport_accept_cb, (void *)listener,
+            LEV_OPT_THREADSAFE | LEV_OPT_CLOSE_ON_FREE,
+            rp->backlog, sock);
+
+    if (listener->server == NULL) {
+        free(listener);
+        return NULL;
+    }
+
+    return listener;
+} /* _evhttpx_listener_new */
+
+#endif
+
 #ifndef EVHTTPX_DISABLE_SSL
 #ifndef EVHTTPX_DISABLE_EVTHR
 static unsigned long
@@ -2038,6 +2650,7 @@ evhttpx_kvlen_new(const char * key, size_t key_len,
 
     kv->k_heaped = kalloc;
     kv->v_heaped = valloc;
+    kv->in_arena = 0;
     kv->klen     = key_len;
     kv->vlen     = val_len;
 
@@ -2081,6 +2694,7 @@ evhttpx_kv_new(const char * key, const char * val, char kalloc, char valloc)
 
     kv->k_heaped = kalloc;
     kv->v_heaped = valloc;
+    kv->in_arena = 0;
     kv->klen     = 0;
     kv->vlen     = 0;
 
@@ -2118,7 +2732,7 @@ evhttpx_kv_new(const char * key, const char * val, char kalloc, char valloc)
 void
 evhttpx_kv_free(evhttpx_kv_t * kv)
 {
-    if (kv == NULL) {
+    if (kv == NULL || kv->in_arena) {
         return;
     }
 
@@ -2355,8 +2969,27 @@ evhttpx_unescape_string(unsigned char ** out,
     return 0;
 }         /* evhttpx_unescape_string */
 
-evhttpx_query_t *
-evhttpx_parse_query(const char * query, size_t len)
+static void
+_evhttpx_query_add(evhttpx_arena_t * arena, evhttpx_query_t * query_args,
+                   const char * key, const char * val)
+{
+    evhttpx_kv_t * kv;
+
+    if (arena != NULL) {
+        kv = _evhttpx_arena_kv_new(arena, key, strlen(key), val, strlen(val));
+    } else {
+        kv = evhttpx_kv_new(key, val, 1, 1);
+    }
+
+    evhttpx_kvs_add_kv(query_args, kv);
+}
+
+/**
+ * @brief Parses query arguments, allocating the kvs out of arena when one is
+ *        given and off the heap otherwise.
+ */
+static evhttpx_query_t *
+_evhttpx_parse_query(evhttpx_arena_t * arena, const char * query, size_t len)
 {
     evhttpx_query_t    * query_args;
     query_parser_state state   = s_query_start;
@@ -2367,15 +3000,27 @@ evhttpx_parse_query(const char * query, size_t len)
     unsigned char      ch;
     size_t             i;
 
-    query_args = evhttpx_query_new();
+    if (arena != NULL) {
+        query_args = evhttpx_arena_alloc(arena, sizeof(evhttpx_query_t));
+        key_buf    = evhttpx_arena_alloc(arena, len + 1);
+        val_buf    = evhttpx_arena_alloc(arena, len + 1);
 
-    if (!(key_buf = malloc(len + 1))) {
-        return NULL;
-    }
+        if (!query_args || !key_buf || !val_buf) {
+            return NULL;
+        }
 
-    if (!(val_buf = malloc(len + 1))) {
-        free(key_buf);
-        return NULL;
+        TAILQ_INIT(query_args);
+    } else {
+        query_args = evhttpx_query_new();
+
+        if (!(key_buf = malloc(len + 1))) {
+            return NULL;
+        }
+
+        if (!(val_buf = malloc(len + 1))) {
+            free(key_buf);
+            return NULL;
+        }
     }
 
     key_idx = 0;
@@ -2472,8 +3117,7 @@ query_key:
                 switch (ch) {
                     case ';':
                     case '&':
-                        evhttpx_kvs_add_kv(query_args,
-                                evhttpx_kv_new(key_buf, val_buf, 1, 1));
+                        _evhttpx_query_add(arena, query_args, key_buf, val_buf);
 
                         memset(key_buf, 0, len);
                         memset(val_buf, 0, len);
@@ -2536,19 +3180,29 @@ query_key:
     }
 
     if (key_idx && val_idx) {
-        evhttpx_kvs_add_kv(query_args, evhttpx_kv_new(key_buf, val_buf, 1, 1));
+        _evhttpx_query_add(arena, query_args, key_buf, val_buf);
     }
 
-    free(key_buf);
-    free(val_buf);
+    if (arena == NULL) {
+        free(key_buf);
+        free(val_buf);
+    }
 
     return query_args;
 error:
-    free(key_buf);
-    free(val_buf);
+    if (arena == NULL) {
+        free(key_buf);
+        free(val_buf);
+    }
 
     return NULL;
-}     /* evhttpx_parse_query */
+}     /* _evhttpx_parse_query */
+
+evhttpx_query_t *
+evhttpx_parse_query(const char * query, size_t len)
+{
+    return _evhttpx_parse_query(NULL, query, len);
+}
 
 void
 evhttpx_send_reply_start(evhttpx_request_t * request, evhttpx_res code)
@@ -2563,6 +3217,10 @@ evhttpx_send_reply_start(evhttpx_request_t * request, evhttpx_res code)
         return;
     }
 
+    /* the body follows straight on the bufferevent, so anything batched
+     * before this request has to go first. */
+    _evhttpx_connection_flush(c);
+
     bufferevent_write_buffer(c->bev, reply_buf);
     evbuffer_free(reply_buf);
 }
@@ -2601,7 +3259,11 @@ evhttpx_send_reply(evhttpx_request_t * request,
         return;
     }
 
-    bufferevent_write_buffer(evhttpx_connection_get_bev(c), reply_buf);
+    if (c->batching == 1) {
+        evbuffer_add_buffer(c->batch_buf, reply_buf);
+    } else {
+        bufferevent_write_buffer(evhttpx_connection_get_bev(c), reply_buf);
+    }
     evbuffer_free(reply_buf);
 }
 
@@ -2722,8 +3384,42 @@ evhttpx_send_reply_chunk_end(evhttpx_request_t * request)
 void
 evhttpx_unbind_socket(evhttpx_t * httpx)
 {
-    evconnlistener_free(httpx->server);
-    httpx->server = NULL;
+#ifndef EVHTTPX_DISABLE_EVTHR
+    evhttpx_listener_t * listener;
+
+    pthread_mutex_lock(&httpx->listeners_lock);
+
+    while ((listener = TAILQ_FIRST(&httpx->listeners)) != NULL) {
+        TAILQ_REMOVE(&httpx->listeners, listener, next);
+        evconnlistener_free(listener->server);
+        free(listener);
+    }
+
+    pthread_mutex_unlock(&httpx->listeners_lock);
+#endif
+
+    if (httpx->server != NULL) {
+        evconnlistener_free(httpx->server);
+        httpx->server = NULL;
+    }
+}
+
+static void
+_evhttpx_set_servername_cb(evhttpx_t * httpx)
+{
+#ifndef EVHTTPX_DISABLE_SSL
+    if (httpx->ssl_ctx != NULL) {
+        /* if ssl is enabled and we have virtual hosts, set our servername
+         * callback. We do this here because we want to make sure that this gets
+         * set after all potential virtualhosts have been set, not just after
+         * ssl_init.
+         */
+        if (TAILQ_FIRST(&httpx->vhosts) != NULL) {
+            SSL_CTX_set_tlsext_servername_callback(httpx->ssl_ctx,
+                    _evhttpx_ssl_servername);
+        }
+    }
+#endif
 }
 
 int
@@ -2753,86 +3449,142 @@ evhttpx_bind_sockaddr(evhttpx_t * httpx,
     }
 #endif
 
-#ifndef EVHTTPX_DISABLE_SSL
-    if (httpx->ssl_ctx != NULL) {
-        /* if ssl is enabled and we have virtual hosts, set our servername
-         * callback. We do this here because we want to make sure that this gets
-         * set after all potential virtualhosts have been set, not just after
-         * ssl_init.
-         */
-        if (TAILQ_FIRST(&httpx->vhosts) != NULL) {
-            SSL_CTX_set_tlsext_servername_callback(httpx->ssl_ctx,
-                    _evhttpx_ssl_servername);
-        }
-    }
-#endif
+    _evhttpx_set_servername_cb(httpx);
 
     return httpx->server ? 0 : -1;
 }
 
-int
-evhttpx_bind_socket(evhttpx_t * httpx,
-        const char * baddr,
+static int
+_evhttpx_parse_sockaddr(const char * baddr,
         uint16_t port,
-        int backlog)
+        struct sockaddr_storage * ss,
+        size_t * sin_len)
 {
-    struct sockaddr_in  sin;
-    struct sockaddr_in6 sin6;
+    struct sockaddr_in  * sin;
+    struct sockaddr_in6 * sin6;
 
 #ifndef NO_SYS_UN
-    struct sockaddr_un sun;
+    struct sockaddr_un * sun;
 #endif
-    struct sockaddr  * sa;
-    size_t             sin_len;
 
-    memset(&sin, 0, sizeof(sin));
+    memset(ss, 0, sizeof(*ss));
 
     if (!strncmp(baddr, "ipv6:", 5)) {
-        memset(&sin6, 0, sizeof(sin6));
+        sin6   = (struct sockaddr_in6 *)ss;
+        baddr += 5;
 
-        baddr           += 5;
-        sin_len          = sizeof(struct sockaddr_in6);
-        sin6.sin6_port   = htons(port);
-        sin6.sin6_family = AF_INET6;
+        *sin_len          = sizeof(struct sockaddr_in6);
+        sin6->sin6_port   = htons(port);
+        sin6->sin6_family = AF_INET6;
 
-        evutil_inet_pton(AF_INET6, baddr, &sin6.sin6_addr);
-        sa = (struct sockaddr *)&sin6;
+        evutil_inet_pton(AF_INET6, baddr, &sin6->sin6_addr);
     } else if (!strncmp(baddr, "unix:", 5)) {
 #ifndef NO_SYS_UN
+        sun    = (struct sockaddr_un *)ss;
         baddr += 5;
 
-        if (strlen(baddr) >= sizeof(sun.sun_path)) {
+        if (strlen(baddr) >= sizeof(sun->sun_path)) {
             return -1;
         }
 
-        memset(&sun, 0, sizeof(sun));
+        *sin_len        = sizeof(struct sockaddr_un);
+        sun->sun_family = AF_UNIX;
 
-        sin_len        = sizeof(struct sockaddr_un);
-        sun.sun_family = AF_UNIX;
-
-        strncpy(sun.sun_path, baddr, strlen(baddr));
-
-        sa = (struct sockaddr *)&sun;
+        strncpy(sun->sun_path, baddr, strlen(baddr));
 #else
         fprintf(stderr, "System does not support AF_UNIX sockets\n");
         return -1;
 #endif
     } else {
+        sin = (struct sockaddr_in *)ss;
+
         if (!strncmp(baddr, "ipv4:", 5)) {
             baddr += 5;
         }
 
-        sin_len             = sizeof(struct sockaddr_in);
+        *sin_len             = sizeof(struct sockaddr_in);
+
+        sin->sin_family      = AF_INET;
+        sin->sin_port        = htons(port);
+        sin->sin_addr.s_addr = inet_addr(baddr);
+    }
+
+    return 0;
+} /* _evhttpx_parse_sockaddr */
+
+int
+evhttpx_bind_socket(evhttpx_t * httpx,
+        const char * baddr,
+        uint16_t port,
+        int backlog)
+{
+    struct sockaddr_storage ss;
+    size_t                  sin_len;
+
+    if (_evhttpx_parse_sockaddr(baddr, port, &ss, &sin_len) < 0) {
+        return -1;
+    }
+
+    return evhttpx_bind_sockaddr(httpx, (struct sockaddr *)&ss, sin_len, backlog);
+}
+
+#ifndef EVHTTPX_DISABLE_EVTHR
+int
+evhttpx_bind_socket_reuseport(evhttpx_t * httpx,
+        const char * baddr,
+        uint16_t port,
+        int backlog)
+{
+#ifdef SO_REUSEPORT
+    evhttpx_reuseport_t * rp;
+
+    if (httpx->thr_pool != NULL) {
+        /* the threads have already bound their listeners */
+        return -1;
+    }
+
+    if (!(rp = calloc(sizeof(evhttpx_reuseport_t), 1))) {
+        return -1;
+    }
+
+    if (_evhttpx_parse_sockaddr(baddr, port, &rp->addr, &rp->addr_len) < 0 ||
+        rp->addr.ss_family == AF_UNIX) {
+        free(rp);
+        return -1;
+    }
+
+    rp->backlog = backlog;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    _evhttpx_set_servername_cb(httpx);
 
-        sin.sin_family      = AF_INET;
-        sin.sin_port        = htons(port);
-        sin.sin_addr.s_addr = inet_addr(baddr);
+    TAILQ_INSERT_TAIL(&httpx->reuseports, rp, next);
 
-        sa = (struct sockaddr *)&sin;
+    return 0;
+#else
+    return -1;
+#endif
+} /* evhttpx_bind_socket_reuseport */
+
+void
+evhttpx_unbind_socket_reuseport(evhttpx_t * httpx)
+{
+    evhttpx_reuseport_t * rp;
+
+    if (httpx->thr_pool != NULL) {
+        /* the threads own their listeners by now */
+        return;
+    }
+
+    while ((rp = TAILQ_FIRST(&httpx->reuseports)) != NULL) {
+        TAILQ_REMOVE(&httpx->reuseports, rp, next);
+        _evhttpx_reuseport_close(rp);
+        free(rp);
     }
+}
 
-    return evhttpx_bind_sockaddr(httpx, sa, sin_len, backlog);
-} /* evhttpx_bind_socket */
+#endif
 
 void
 evhttpx_callbacks_free(evhttpx_callbacks_t * callbacks)
@@ -3076,6 +3828,15 @@ evhttpx_set_cb(evhttpx_t * httpx,
         return NULL;
     }
 
+    /* only index a callback the list owns, the table must never point at
+     * one which has been freed. */
+    if (_evhttpx_callback_index(httpx, hcb)) {
+        TAILQ_REMOVE(httpx->callbacks, hcb, next);
+        evhttpx_callback_free(hcb);
+        _evhttpx_unlock(httpx);
+        return NULL;
+    }
+
     _evhttpx_unlock(httpx);
     return hcb;
 }
@@ -3084,7 +3845,30 @@ evhttpx_set_cb(evhttpx_t * httpx,
 static void
 _evhttpx_thread_init(evthr_t * thr, void * arg)
 {
-    evhttpx_t * httpx = (evhttpx_t *)arg;
+    evhttpx_t           * httpx = (evhttpx_t *)arg;
+    evhttpx_reuseport_t * rp;
+    evhttpx_listener_t  * listener;
+
+    evutil_socket_t       sock;
+
+    TAILQ_FOREACH(rp, &httpx->reuseports, next) {
+        pthread_mutex_lock(&httpx->listeners_lock);
+        sock = rp->socks[rp->taken++];
+        pthread_mutex_unlock(&httpx->listeners_lock);
+
+        if (!(listener = _evhttpx_listener_new(httpx, thr, rp, sock))) {
+            /* the port is bound already, a thread which silently does
+             * not accept on it would leave its share of the connections
+             * queued forever. */
+            fprintf(stderr, "Failed to listen on SO_REUSEPORT socket: %s\n",
+                    strerror(errno));
+            abort();
+        }
+
+        pthread_mutex_lock(&httpx->listeners_lock);
+        TAILQ_INSERT_TAIL(&httpx->listeners, listener, next);
+        pthread_mutex_unlock(&httpx->listeners_lock);
+    }
 
     if (httpx->thread_init_cb) {
         httpx->thread_init_cb(httpx, thr, httpx->thread_init_cbarg);
@@ -3097,6 +3881,8 @@ evhttpx_use_threads(evhttpx_t * httpx,
         int nthreads,
         void * arg)
 {
+    evhttpx_reuseport_t * rp;
+
     httpx->thread_init_cb    = init_cb;
     httpx->thread_init_cbarg = arg;
 
@@ -3104,8 +3890,16 @@ evhttpx_use_threads(evhttpx_t * httpx,
     evhttpx_ssl_use_threads();
 #endif
 
+    if (_evhttpx_reuseports_bind(httpx, nthreads) < 0) {
+        return -1;
+    }
+
     if (!(httpx->thr_pool = evthr_pool_new(nthreads,
                     _evhttpx_thread_init, httpx))) {
+        TAILQ_FOREACH(rp, &httpx->reuseports, next) {
+            _evhttpx_reuseport_close(rp);
+        }
+
         return -1;
     }
 
@@ -3164,10 +3958,21 @@ evhttpx_set_glob_cb(evhttpx_t * httpx,
         return NULL;
     }
 
+    httpx->num_globs++;
+
     _evhttpx_unlock(httpx);
     return hcb;
 }
 
+evhttpx_callback_t *
+evhttpx_get_cb(evhttpx_t * httpx, const char * path)
+{
+    unsigned int start_offset;
+    unsigned int end_offset;
+
+    return _evhttpx_callback_find(httpx, path, &start_offset, &end_offset);
+}
+
 void
 evhttpx_set_gencb(evhttpx_t * httpx,
         evhttpx_callback_cb cb,
@@ -3396,6 +4201,12 @@ evhttpx_request_set_bev(evhttpx_request_t * request, evbev_t * bev)
     evhttpx_connection_set_bev(request->conn, bev);
 }
 
+evhttpx_arena_t *
+evhttpx_request_get_arena(evhttpx_request_t * request)
+{
+    return request->arena;
+}
+
 evhttpx_connection_t *
 evhttpx_request_get_connection(evhttpx_request_t * request)
 {
@@ -3444,6 +4255,10 @@ evhttpx_connection_free(evhttpx_connection_t * connection)
     free(connection->hooks);
     free(connection->saddr);
 
+    if (connection->batch_buf) {
+        evbuffer_free(connection->batch_buf);
+    }
+
     if (connection->resume_ev) {
         event_free(connection->resume_ev);
     }
@@ -3497,6 +4312,12 @@ evhttpx_set_max_keepalive_requests(evhttpx_t * httpx, uint64_t num)
     httpx->max_keepalive_requests = num;
 }
 
+void
+evhttpx_set_max_pipelined_requests(evhttpx_t * httpx, uint64_t num)
+{
+    httpx->max_pipelined_requests = num;
+}
+
 /**
  * @brief set bufferevent flags, defaults to BEV_OPT_CLOSE_ON_FREE
  *
@@ -3579,6 +4400,7 @@ evhttpx_add_vhost(evhttpx_t * evhttpx, const char * name, evhttpx_t * vhost)
     vhost->bev_flags              = evhttpx->bev_flags;
     vhost->max_body_size          = evhttpx->max_body_size;
     vhost->max_keepalive_requests = evhttpx->max_keepalive_requests;
+    vhost->max_pipelined_requests = evhttpx->max_pipelined_requests;
     vhost->recv_timeo             = evhttpx->recv_timeo;
     vhost->send_timeo             = evhttpx->send_timeo;
 
@@ -3609,6 +4431,12 @@ evhttpx_new(evbase_t * evbase, void * arg)
     TAILQ_INIT(&httpx->vhosts);
     TAILQ_INIT(&httpx->aliases);
 
+#ifndef EVHTTPX_DISABLE_EVTHR
+    pthread_mutex_init(&httpx->listeners_lock, NULL);
+    TAILQ_INIT(&httpx->reuseports);
+    TAILQ_INIT(&httpx->listeners);
+#endif
+
     evhttpx_set_gencb(httpx, _evhttpx_default_request_cb, (void *)httpx);
 
     return httpx;
@@ -3619,10 +4447,34 @@ evhttpx_free(evhttpx_t * evhttpx)
 {
     evhttpx_alias_t * evhttpx_alias, * tmp;
 
+#ifndef EVHTTPX_DISABLE_EVTHR
+    evhttpx_reuseport_t * rp;
+    evhttpx_listener_t  * listener;
+#endif
+
     if (evhttpx == NULL) {
         return;
     }
 
+#ifndef EVHTTPX_DISABLE_EVTHR
+    /* per-thread listeners must go before the bases they live on */
+    pthread_mutex_lock(&evhttpx->listeners_lock);
+
+    while ((listener = TAILQ_FIRST(&evhttpx->listeners)) != NULL) {
+        TAILQ_REMOVE(&evhttpx->listeners, listener, next);
+        evconnlistener_free(listener->server);
+        free(listener);
+    }
+
+    pthread_mutex_unlock(&evhttpx->listeners_lock);
+
+    while ((rp = TAILQ_FIRST(&evhttpx->reuseports)) != NULL) {
+        TAILQ_REMOVE(&evhttpx->reuseports, rp, next);
+        _evhttpx_reuseport_close(rp);
+        free(rp);
+    }
+#endif
+
     if (evhttpx->thr_pool) {
         evthr_pool_stop(evhttpx->thr_pool);
         evthr_pool_free(evhttpx->thr_pool);
@@ -3632,6 +4484,10 @@ evhttpx_free(evhttpx_t * evhttpx)
         free(evhttpx->callbacks);
     }
 
+    if (evhttpx->cb_table) {
+        free(evhttpx->cb_table);
+    }
+
     if (evhttpx->server_name) {
         free(evhttpx->server_name);
     }
@@ -3644,6 +4500,10 @@ evhttpx_free(evhttpx_t * evhttpx)
         free(evhttpx_alias);
     }
 
+#ifndef EVHTTPX_DISABLE_EVTHR
+    pthread_mutex_destroy(&evhttpx->listeners_lock);
+#endif
+
     free(evhttpx);
 }
 
@@ -11,6 +11,10 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <pthread.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#define EVTHR_USE_EVENTFD
+#endif
 
 #include <event2/event.h>
 #include <event2/thread.h>
@@ -31,10 +35,11 @@ typedef struct evthr_cmd        evthr_cmd_t;
 typedef struct evthr_pool_slist evthr_pool_slist_t;
 
 struct evthr_cmd {
-    uint8_t  stop : 1;
-    void   * args;
-    evthr_cb cb;
-} __attribute__ ((packed));
+    uint8_t                stop : 1;
+    void                 * args;
+    evthr_cb               cb;
+    evthr_cmd_t * volatile next;
+};
 
 TAILQ_HEAD(evthr_pool_slist, evthr);
 
@@ -43,21 +48,30 @@ struct evthr_pool {
     evthr_pool_slist_t threads;
 };
 
+/*
+ * commands are handed to a thread through an intrusive multi-producer,
+ * single-consumer queue: producers swap themselves in at cmd_head, the
+ * thread pops from cmd_tail. rdr/wdr is an eventfd (a pipe where there is
+ * none) which is only written to when the thread is not already about to
+ * wake up, see `notified'.
+ */
 struct evthr {
-    int             cur_backlog;
-    int             max_backlog;
-    int             rdr;
-    int             wdr;
-    char            err;
-    ev_t          * event;
-    evbase_t      * evbase;
-    pthread_mutex_t lock;
-    pthread_mutex_t stat_lock;
-    pthread_mutex_t rlock;
-    pthread_t     * thr;
-    evthr_init_cb   init_cb;
-    void          * arg;
-    void          * aux;
+    int                    cur_backlog;
+    int                    max_backlog;
+    int                    rdr;
+    int                    wdr;
+    int                    notified;
+    char                   err;
+    ev_t                 * event;
+    evbase_t             * evbase;
+    pthread_mutex_t        lock;
+    pthread_t            * thr;
+    evthr_init_cb          init_cb;
+    void                 * arg;
+    void                 * aux;
+    evthr_cmd_t * volatile cmd_head;
+    evthr_cmd_t          * cmd_tail;
+    evthr_cmd_t            cmd_stub;
 
     TAILQ_ENTRY(evthr) next;
 };
@@ -90,65 +104,115 @@ evthr_set_max_backlog(evthr_t * evthr, int max) {
 }
 
 static void
-_evthr_read_cmd(int sock, short __unused__ which, void * args) {
-    evthr_t   * thread;
-    evthr_cmd_t cmd;
-    ssize_t     recvd;
+_evthr_cmd_push(evthr_t * thread, evthr_cmd_t * cmd) {
+    evthr_cmd_t * prev;
 
-    if (!(thread = (evthr_t *)args)) {
-        return;
+    cmd->next = NULL;
+
+    /* make the command visible before it is linked in */
+    __sync_synchronize();
+
+    prev       = __sync_lock_test_and_set(&thread->cmd_head, cmd);
+    prev->next = cmd;
+}
+
+static evthr_cmd_t *
+_evthr_cmd_pop(evthr_t * thread) {
+    evthr_cmd_t * tail = thread->cmd_tail;
+    evthr_cmd_t * next = tail->next;
+
+    if (tail == &thread->cmd_stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+
+        thread->cmd_tail = next;
+        tail             = next;
+        next             = next->next;
     }
 
-    if (pthread_mutex_trylock(&thread->lock) != 0) {
-        return;
+    if (next != NULL) {
+        thread->cmd_tail = next;
+        return tail;
     }
 
-    pthread_mutex_lock(&thread->rlock);
+    if (tail != thread->cmd_head) {
+        /* a producer has swapped in the head but not linked it yet */
+        return NULL;
+    }
 
-    if ((recvd = recv(sock, &cmd, sizeof(evthr_cmd_t), 0)) <= 0) {
-        pthread_mutex_unlock(&thread->rlock);
-        if (errno == EAGAIN) {
-            goto end;
-        } else {
-            goto error;
-        }
+    _evthr_cmd_push(thread, &thread->cmd_stub);
+
+    if ((next = tail->next) != NULL) {
+        thread->cmd_tail = next;
+        return tail;
     }
 
-    if (recvd < sizeof(evthr_cmd_t)) {
-        pthread_mutex_unlock(&thread->rlock);
-        goto error;
+    return NULL;
+} /* _evthr_cmd_pop */
+
+static int
+_evthr_notify(evthr_t * thread) {
+    uint64_t one = 1;
+
+    if (__sync_lock_test_and_set(&thread->notified, 1) == 1) {
+        /* the thread has not drained the queue since the last wakeup */
+        return 0;
     }
 
-    pthread_mutex_unlock(&thread->rlock);
+    if (write(thread->wdr, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        __sync_lock_release(&thread->notified);
+        return -1;
+    }
 
-    if (recvd != sizeof(evthr_cmd_t)) {
+    return 0;
+}
+
+static void
+_evthr_read_cmd(int sock, short __unused__ which, void * args) {
+    evthr_t     * thread;
+    evthr_cmd_t * cmd;
+    evthr_cmd_t   c;
+    uint64_t      count;
+
+    if (!(thread = (evthr_t *)args)) {
+        return;
+    }
+
+    if (read(sock, &count, sizeof(count)) < 0 && errno != EAGAIN) {
         goto error;
     }
 
-    if (cmd.stop == 1) {
-        goto stop;
+    /* re-arm before draining, anything pushed from here on either shows up
+     * in the loop below or writes a new wakeup. */
+    __sync_lock_release(&thread->notified);
+    __sync_synchronize();
+
+    while ((cmd = _evthr_cmd_pop(thread)) != NULL) {
+        c = *cmd;
+        free(cmd);
+
+        if (c.stop == 1) {
+            event_base_loopbreak(thread->evbase);
+            return;
+        }
+
+        if (c.cb != NULL) {
+            c.cb(thread, c.args, thread->arg);
+        }
+
+        evthr_dec_backlog(thread);
     }
 
-    if (cmd.cb != NULL) {
-        cmd.cb(thread, cmd.args, thread->arg);
-        goto done;
-    } else {
-        goto done;
+    if (thread->cmd_head != thread->cmd_tail) {
+        /* a push was caught half way, come back for it */
+        event_active(thread->event, EV_READ, 0);
     }
 
-stop:
-    event_base_loopbreak(thread->evbase);
-done:
-    evthr_dec_backlog(thread);
-end:
-    pthread_mutex_unlock(&thread->lock);
     return;
 error:
-    pthread_mutex_lock(&thread->stat_lock);
-    thread->cur_backlog = -1;
-    thread->err         = 1;
-    pthread_mutex_unlock(&thread->stat_lock);
-    pthread_mutex_unlock(&thread->lock);
+    __sync_lock_test_and_set(&thread->cur_backlog, -1);
+    thread->err = 1;
     event_base_loopbreak(thread->evbase);
     return;
 } /* _evthr_read_cmd */
@@ -189,8 +253,8 @@ _evthr_loop(void * args) {
 
 evthr_res
 evthr_defer(evthr_t * thread, evthr_cb cb, void * arg) {
-    int         cur_backlog;
-    evthr_cmd_t cmd;
+    int           cur_backlog;
+    evthr_cmd_t * cmd;
 
     cur_backlog = evthr_get_backlog(thread);
 
@@ -204,44 +268,43 @@ evthr_defer(evthr_t * thread, evthr_cb cb, void * arg) {
         return EVTHR_RES_FATAL;
     }
 
-    /* cmd.magic = _EVTHR_MAGIC; */
-    cmd.cb   = cb;
-    cmd.args = arg;
-    cmd.stop = 0;
+    if (!(cmd = calloc(sizeof(evthr_cmd_t), 1))) {
+        return EVTHR_RES_RETRY;
+    }
 
-    pthread_mutex_lock(&thread->rlock);
+    cmd->cb   = cb;
+    cmd->args = arg;
+    cmd->stop = 0;
 
     evthr_inc_backlog(thread);
 
-    if (send(thread->wdr, &cmd, sizeof(cmd), 0) <= 0) {
-        evthr_dec_backlog(thread);
-        pthread_mutex_unlock(&thread->rlock);
-        return EVTHR_RES_RETRY;
-    }
+    _evthr_cmd_push(thread, cmd);
 
-    pthread_mutex_unlock(&thread->rlock);
+    /* once queued the command belongs to the thread, if the wakeup cannot
+     * be written it still runs on the next one. */
+    _evthr_notify(thread);
 
     return EVTHR_RES_OK;
 }
 
 evthr_res
 evthr_stop(evthr_t * thread) {
-    evthr_cmd_t cmd;
+    evthr_cmd_t * cmd;
 
-    /* cmd.magic = _EVTHR_MAGIC; */
-    cmd.cb   = NULL;
-    cmd.args = NULL;
-    cmd.stop = 1;
+    if (!(cmd = calloc(sizeof(evthr_cmd_t), 1))) {
+        return EVTHR_RES_RETRY;
+    }
 
-    pthread_mutex_lock(&thread->rlock);
+    cmd->cb   = NULL;
+    cmd->args = NULL;
+    cmd->stop = 1;
 
-    if (write(thread->wdr, &cmd, sizeof(evthr_cmd_t)) < 0) {
-        pthread_mutex_unlock(&thread->rlock);
+    _evthr_cmd_push(thread, cmd);
+
+    if (_evthr_notify(thread) < 0) {
         return EVTHR_RES_RETRY;
     }
 
-    pthread_mutex_unlock(&thread->rlock);
-
     return EVTHR_RES_OK;
 }
 
@@ -265,12 +328,20 @@ evthr_new(evthr_init_cb init_cb, void * args) {
     evthr_t * thread;
     int       fds[2];
 
-    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+#ifdef EVTHR_USE_EVENTFD
+    if ((fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        return NULL;
+    }
+
+    fds[1] = fds[0];
+#else
+    if (pipe(fds) == -1) {
         return NULL;
     }
 
     evutil_make_socket_nonblocking(fds[0]);
     evutil_make_socket_nonblocking(fds[1]);
+#endif
 
     if (!(thread = calloc(sizeof(evthr_t), sizeof(char)))) {
         return NULL;
@@ -282,17 +353,11 @@ evthr_new(evthr_init_cb init_cb, void * args) {
     thread->rdr     = fds[0];
     thread->wdr     = fds[1];
 
-    if (pthread_mutex_init(&thread->lock, NULL)) {
-        evthr_free(thread);
-        return NULL;
-    }
+    thread->cmd_stub.next = NULL;
+    thread->cmd_head      = &thread->cmd_stub;
+    thread->cmd_tail      = &thread->cmd_stub;
 
-    if (pthread_mutex_init(&thread->stat_lock, NULL)) {
-        evthr_free(thread);
-        return NULL;
-    }
-
-    if (pthread_mutex_init(&thread->rlock, NULL)) {
+    if (pthread_mutex_init(&thread->lock, NULL)) {
         evthr_free(thread);
         return NULL;
     }
@@ -319,15 +384,22 @@ evthr_start(evthr_t * thread) {
 
 void
 evthr_free(evthr_t * thread) {
+    evthr_cmd_t * cmd;
+
     if (thread == NULL) {
         return;
     }
 
+    /* whatever was still queued behind a stop is never going to run */
+    while ((cmd = _evthr_cmd_pop(thread)) != NULL) {
+        free(cmd);
+    }
+
     if (thread->rdr > 0) {
         close(thread->rdr);
     }
 
-    if (thread->wdr > 0) {
+    if (thread->wdr > 0 && thread->wdr != thread->rdr) {
         close(thread->wdr);
     }
 
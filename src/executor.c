@@ -0,0 +1,453 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  executor.c
+ *
+ *    Description:  storage worker pool running blocking leveldb jobs off
+ *                  the event loops.
+ *
+ * =============================================================================
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "executor.h"
+
+typedef struct reveldb_job_s_ reveldb_job_t;
+
+struct reveldb_executor_s_ {
+#ifndef EVHTTPX_DISABLE_EVTHR
+    evthr_pool_t *pool;
+#endif
+    unsigned int nthreads;
+    size_t high_watermark; /* output queued for a client before a stream waits. */
+};
+
+struct reveldb_job_s_ {
+    reveldb_executor_t *executor;
+    evhttpx_request_t *req;
+    evbase_t *evbase; /* loop owning the connection of req. */
+    struct event *wakeup; /* made on that loop, so that handing the job back
+                             to it from a storage thread cannot fail. */
+    int run_inline; /* set when the loop itself produces the next part. */
+    int running; /* set while the job is away from the loop. */
+    int detached; /* set once the connection of req went away, req is then
+                     kept until the job is handed back. */
+    reveldb_executor_job_cb cb;
+    void *arg;
+    char *response;
+    unsigned int code;
+    /* streamed replies. */
+    reveldb_executor_stream_cb stream_cb;
+    reveldb_executor_stream_fini_cb stream_fini;
+    void *stream_arg;
+    struct evbuffer *stream_buf; /* part produced by the last stream_cb. */
+    int stream_more; /* set while stream_cb has more to produce. */
+    int stream_started; /* set once the reply head is out. */
+};
+
+/* job being run by the calling storage thread, if any. */
+static __thread reveldb_job_t *_executor_current_job = NULL;
+
+reveldb_executor_t *
+reveldb_executor_init(unsigned int nthreads, size_t high_watermark)
+{
+    reveldb_executor_t *executor = (reveldb_executor_t *)
+        malloc(sizeof(reveldb_executor_t));
+    if (executor == NULL) {
+        LOG_ERROR(("failed to malloc reveldb_executor_t."));
+        return NULL;
+    }
+    memset(executor, 0, sizeof(reveldb_executor_t));
+
+#ifndef EVHTTPX_DISABLE_EVTHR
+    if (nthreads > 0) {
+        executor->pool = evthr_pool_new(nthreads, NULL, NULL);
+        if (executor->pool == NULL || evthr_pool_start(executor->pool) < 0) {
+            LOG_ERROR(("failed to start %u storage threads, "
+                        "running storage jobs on the event loops.", nthreads));
+            evthr_pool_free(executor->pool);
+            executor->pool = NULL;
+            nthreads = 0;
+        }
+    }
+#else
+    nthreads = 0;
+#endif
+    executor->nthreads = nthreads;
+    executor->high_watermark = (high_watermark > 0) ?
+        high_watermark : REVELDB_EXECUTOR_HIGH_WATERMARK;
+
+    return executor;
+}
+
+static void _executor_stream_schedule(reveldb_job_t *job);
+
+static void
+_executor_job_free(reveldb_job_t *job)
+{
+    /* stream_fini already ran if stream_cb reported the end. */
+    if (job->stream_more && job->stream_fini != NULL) {
+        job->stream_fini(job->stream_arg);
+    }
+    if (job->stream_buf != NULL) evbuffer_free(job->stream_buf);
+    if (job->detached && job->req != NULL) evhttpx_request_free(job->req);
+    event_free(job->wakeup);
+    free(job);
+}
+
+/* the connection of req is going away. a job away from the loop keeps the
+ * request until it is handed back, whatever it replies is dropped then. */
+static evhttpx_res
+_executor_abort(evhttpx_request_t *req, void *arg)
+{
+    reveldb_job_t *job = (reveldb_job_t *)arg;
+    evhttpx_connection_t *conn = evhttpx_request_get_connection(req);
+
+    if (job->stream_cb != NULL) {
+        evhttpx_unset_hook(&conn->hooks, evhttpx_hook_on_write);
+    }
+    evhttpx_unset_hook(&req->hooks, evhttpx_hook_on_request_fini);
+    job->detached = 1;
+    if (job->running) return EVHTTPX_RES_PAUSE;
+
+    job->req = NULL;
+    _executor_job_free(job);
+    return EVHTTPX_RES_OK;
+}
+
+static evhttpx_res
+_executor_stream_drained(evhttpx_connection_t *conn, void *arg)
+{
+    reveldb_job_t *job = (reveldb_job_t *)arg;
+
+    bufferevent_setwatermark(evhttpx_connection_get_bev(conn), EV_WRITE, 0, 0);
+    evhttpx_unset_hook(&conn->hooks, evhttpx_hook_on_write);
+    _executor_stream_schedule(job);
+    return EVHTTPX_RES_OK;
+}
+
+/* runs on the loop owning the connection once a part has been produced. */
+static void
+_executor_stream_done(reveldb_job_t *job)
+{
+    evhttpx_request_t *req = job->req;
+    evhttpx_connection_t *conn = NULL;
+    evbev_t *bev = NULL;
+
+    if (job->stream_started == 0) {
+        job->stream_started = 1;
+        evhttpx_headers_add_header(req->headers_out,
+                evhttpx_header_new("Content-Type",
+                    "application/json", 0, 0));
+        evhttpx_send_reply_chunk_start(req, EVHTTPX_RES_OK);
+    }
+    evhttpx_send_reply_chunk(req, job->stream_buf);
+
+    if (job->stream_more == 0) {
+        evhttpx_unset_hook(&req->hooks, evhttpx_hook_on_request_fini);
+        /* resume first, ending the reply may free an idle connection. */
+        evhttpx_request_resume(req);
+        evhttpx_send_reply_chunk_end(req);
+        _executor_job_free(job);
+        return;
+    }
+
+    conn = evhttpx_request_get_connection(req);
+    bev = evhttpx_connection_get_bev(conn);
+    if (evbuffer_get_length(bufferevent_get_output(bev))
+            > job->executor->high_watermark) {
+        /* let the client catch up before producing any more. */
+        bufferevent_setwatermark(bev, EV_WRITE,
+                job->executor->high_watermark / 2, 0);
+        evhttpx_set_hook(&conn->hooks, evhttpx_hook_on_write,
+                (evhttpx_hook)_executor_stream_drained, job);
+        return;
+    }
+    _executor_stream_schedule(job);
+}
+
+static void
+_executor_stream_part(reveldb_job_t *job)
+{
+    /* parts must not depend on the request, it may go away meanwhile. */
+    evhttpx_arena_t *prev = evhttpx_arena_set_current(NULL);
+
+    job->stream_more = job->stream_cb(job->stream_buf, job->stream_arg);
+    if (job->stream_more == 0 && job->stream_fini != NULL) {
+        job->stream_fini(job->stream_arg);
+    }
+    evhttpx_arena_set_current(prev);
+}
+
+static void
+_executor_done(evutil_socket_t fd, short events, void *arg)
+{
+    reveldb_job_t *job = (reveldb_job_t *)arg;
+    evhttpx_request_t *req = job->req;
+
+    job->running = 0;
+    if (job->detached) {
+        /* nobody is left to reply to. */
+        evhttpx_arena_release(evhttpx_request_get_arena(req), job->response);
+        _executor_job_free(job);
+        return;
+    }
+    if (job->stream_cb != NULL) {
+        _executor_stream_done(job);
+        return;
+    }
+
+    evhttpx_unset_hook(&req->hooks, evhttpx_hook_on_request_fini);
+    if (job->response != NULL) {
+        evbuffer_add_printf(req->buffer_out, "%s", job->response);
+        evhttpx_arena_release(evhttpx_request_get_arena(req), job->response);
+        evhttpx_send_reply(req, job->code);
+    }
+    evhttpx_request_resume(req);
+    _executor_job_free(job);
+}
+
+static void
+_executor_wakeup(evutil_socket_t fd, short events, void *arg)
+{
+    reveldb_job_t *job = (reveldb_job_t *)arg;
+
+    if (job->run_inline) {
+        job->run_inline = 0;
+        if (job->detached == 0) _executor_stream_part(job);
+    }
+    _executor_done(fd, events, job);
+}
+
+/* a job on the loop owning the connection of req, watching for the
+ * connection to go away, NULL if there is no memory left. */
+static reveldb_job_t *
+_executor_job_new(reveldb_executor_t *executor, evhttpx_request_t *req)
+{
+    reveldb_job_t *job = (reveldb_job_t *)malloc(sizeof(reveldb_job_t));
+
+    if (job == NULL) {
+        LOG_ERROR(("failed to malloc reveldb_job_t."));
+        return NULL;
+    }
+    memset(job, 0, sizeof(reveldb_job_t));
+    job->executor = executor;
+    job->req = req;
+    job->evbase = evhttpx_request_get_connection(req)->evbase;
+    job->wakeup = event_new(job->evbase, -1, 0, _executor_wakeup, job);
+    if (job->wakeup == NULL) {
+        LOG_ERROR(("failed to create the wakeup event of a storage job."));
+        free(job);
+        return NULL;
+    }
+    if (evhttpx_set_hook(&req->hooks, evhttpx_hook_on_request_fini,
+                (evhttpx_hook)_executor_abort, job) != 0) {
+        LOG_ERROR(("failed to hook the end of the request of a storage job."));
+        event_free(job->wakeup);
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+#ifndef EVHTTPX_DISABLE_EVTHR
+static void
+_executor_run(evthr_t *thr, void *arg, void *shared)
+{
+    reveldb_job_t *job = (reveldb_job_t *)arg;
+    evhttpx_arena_t *prev = NULL;
+
+    if (job->cb != NULL) {
+        _executor_current_job = job;
+        prev = evhttpx_arena_set_current(evhttpx_request_get_arena(job->req));
+        job->cb(job->req, job->arg);
+        evhttpx_arena_set_current(prev);
+        _executor_current_job = NULL;
+        job->cb = NULL;
+    }
+
+    /* the job may have turned into a stream, produce its first part
+     * right away. */
+    if (job->stream_cb != NULL) _executor_stream_part(job);
+
+    /* hand the request back to the loop it belongs to. */
+    event_active(job->wakeup, EV_TIMEOUT, 0);
+}
+#endif
+
+/* produces the next part of a stream on a storage thread, or on the loop
+ * itself when there are none. */
+static void
+_executor_stream_schedule(reveldb_job_t *job)
+{
+    job->running = 1;
+#ifndef EVHTTPX_DISABLE_EVTHR
+    if (job->executor->pool != NULL &&
+            evthr_pool_defer(job->executor->pool, _executor_run, job)
+            == EVTHR_RES_OK) {
+        return;
+    }
+#endif
+    /* go through the loop so other connections get a turn between parts. */
+    job->run_inline = 1;
+    event_active(job->wakeup, EV_TIMEOUT, 0);
+}
+
+void
+reveldb_executor_submit(reveldb_executor_t *executor,
+        evhttpx_request_t *req,
+        reveldb_executor_job_cb cb, void *arg)
+{
+    assert(req != NULL);
+    assert(cb != NULL);
+
+#ifndef EVHTTPX_DISABLE_EVTHR
+    if (executor != NULL && executor->pool != NULL) {
+        reveldb_job_t *job = _executor_job_new(executor, req);
+        if (job == NULL) {
+            cb(req, arg);
+            return;
+        }
+        job->cb = cb;
+        job->arg = arg;
+        job->running = 1;
+
+        /* stop reading from the connection until the reply is out. */
+        evhttpx_request_pause(req);
+        if (evthr_pool_defer(executor->pool, _executor_run, job)
+                != EVTHR_RES_OK) {
+            evhttpx_unset_hook(&req->hooks, evhttpx_hook_on_request_fini);
+            _executor_job_free(job);
+            req->status = EVHTTPX_RES_OK;
+            evhttpx_request_resume(req);
+            cb(req, arg);
+        }
+        return;
+    }
+#endif
+    cb(req, arg);
+}
+
+int
+reveldb_executor_stream(reveldb_executor_t *executor,
+        evhttpx_request_t *req,
+        reveldb_executor_stream_cb cb,
+        reveldb_executor_stream_fini_cb fini, void *arg)
+{
+    reveldb_job_t *job = _executor_current_job;
+    struct evbuffer *buf = NULL;
+
+    assert(req != NULL);
+    assert(cb != NULL);
+
+    if (executor == NULL) return -1;
+    if ((buf = evbuffer_new()) == NULL) {
+        LOG_ERROR(("failed to create the stream buffer."));
+        return -1;
+    }
+
+    if (job != NULL && job->req == req) {
+        /* the storage thread running the job goes on with the first part. */
+        job->stream_cb = cb;
+        job->stream_fini = fini;
+        job->stream_arg = arg;
+        job->stream_buf = buf;
+        job->stream_more = 1;
+        return 0;
+    }
+
+    /* called from the loop, the parts are produced in the background. */
+    job = _executor_job_new(executor, req);
+    if (job == NULL) {
+        evbuffer_free(buf);
+        return -1;
+    }
+    job->stream_cb = cb;
+    job->stream_fini = fini;
+    job->stream_arg = arg;
+    job->stream_buf = buf;
+    job->stream_more = 1;
+
+    evhttpx_request_pause(req);
+    _executor_stream_schedule(job);
+    return 0;
+}
+
+int
+reveldb_executor_reply(evhttpx_request_t *req,
+        char *response, unsigned int code)
+{
+    reveldb_job_t *job = _executor_current_job;
+
+    if (job == NULL || job->req != req) return -1;
+
+    job->response = response;
+    job->code = code;
+    return 0;
+}
+
+typedef struct reveldb_task_s_ {
+    reveldb_executor_task_cb cb;
+    void *arg;
+} reveldb_task_t;
+
+#ifndef EVHTTPX_DISABLE_EVTHR
+static void
+_executor_run_task(evthr_t *thr, void *arg, void *shared)
+{
+    reveldb_task_t task = *(reveldb_task_t *)arg;
+
+    free(arg);
+    task.cb(task.arg);
+}
+#endif
+
+int
+reveldb_executor_defer(reveldb_executor_t *executor,
+        reveldb_executor_task_cb cb, void *arg)
+{
+#ifndef EVHTTPX_DISABLE_EVTHR
+    reveldb_task_t *task = NULL;
+
+    if (executor == NULL || executor->pool == NULL) return -1;
+    task = (reveldb_task_t *)malloc(sizeof(reveldb_task_t));
+    if (task == NULL) {
+        LOG_ERROR(("failed to malloc reveldb_task_t."));
+        return -1;
+    }
+    task->cb = cb;
+    task->arg = arg;
+    if (evthr_pool_defer(executor->pool, _executor_run_task, task)
+            != EVTHR_RES_OK) {
+        free(task);
+        return -1;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+unsigned int
+reveldb_executor_threads(reveldb_executor_t *executor)
+{
+    return (executor != NULL) ? executor->nthreads : 0;
+}
+
+void
+reveldb_executor_free(reveldb_executor_t *executor)
+{
+    if (executor == NULL) return;
+#ifndef EVHTTPX_DISABLE_EVTHR
+    if (executor->pool != NULL) {
+        evthr_pool_stop(executor->pool);
+        evthr_pool_free(executor->pool);
+    }
+#endif
+    free(executor);
+}
@@ -0,0 +1,72 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  executor.h
+ *
+ *    Description:  storage worker pool running blocking leveldb jobs off
+ *                  the event loops.
+ *
+ * =============================================================================
+ */
+#ifndef _REVELDB_EXECUTOR_H_
+#define _REVELDB_EXECUTOR_H_
+
+#include <reveldb/evhttpx/evhttpx.h>
+
+typedef struct reveldb_executor_s_ reveldb_executor_t;
+
+/* a job is an ordinary request handler, run on a storage thread. */
+typedef void (*reveldb_executor_job_cb)(evhttpx_request_t *req, void *arg);
+
+/* output queued for a client before a stream waits for it to drain,
+ * unless set otherwise. */
+#define REVELDB_EXECUTOR_HIGH_WATERMARK (1024 * 1024)
+
+/* produces the next part of a streamed reply into buf, returns 1 while
+ * there is more to come and 0 after the last part. */
+typedef int (*reveldb_executor_stream_cb)(struct evbuffer *buf, void *arg);
+
+/* releases the state of a stream, after its last part or when the client
+ * went away. */
+typedef void (*reveldb_executor_stream_fini_cb)(void *arg);
+
+extern reveldb_executor_t * reveldb_executor_init(unsigned int nthreads,
+        size_t high_watermark);
+
+/* pauses the request and runs cb on a storage thread, the reply is sent
+ * and the request resumed back on the loop owning the connection.
+ * cb runs right away when the executor has no threads. */
+extern void reveldb_executor_submit(reveldb_executor_t *executor,
+        evhttpx_request_t *req,
+        reveldb_executor_job_cb cb, void *arg);
+
+/* takes over response (and code) when called from the job running req,
+ * returns 0 then, -1 when the caller has to send the reply itself. */
+extern int reveldb_executor_reply(evhttpx_request_t *req,
+        char *response, unsigned int code);
+
+/* replies to req with a chunked body produced part by part by cb, off the
+ * event loop when there are storage threads. Parts stop being produced
+ * while more than high_watermark bytes wait on the connection. Returns 0
+ * when the stream took over the reply, -1 when the caller has to reply
+ * itself. */
+extern int reveldb_executor_stream(reveldb_executor_t *executor,
+        evhttpx_request_t *req,
+        reveldb_executor_stream_cb cb,
+        reveldb_executor_stream_fini_cb fini, void *arg);
+
+/* a task not tied to any request. */
+typedef void (*reveldb_executor_task_cb)(void *arg);
+
+/* runs cb on one of the threads of the executor, it should not wait for
+ * other tasks or jobs. returns -1 if there is no thread to run it on, cb
+ * is not run then. */
+extern int reveldb_executor_defer(reveldb_executor_t *executor,
+        reveldb_executor_task_cb cb, void *arg);
+
+/* the number of threads of the executor, 0 if it runs jobs inline. */
+extern unsigned int reveldb_executor_threads(reveldb_executor_t *executor);
+
+extern void reveldb_executor_free(reveldb_executor_t *executor);
+
+#endif /* _REVELDB_EXECUTOR_H_ */
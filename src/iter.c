@@ -31,11 +31,14 @@ xleveldb_init_iter(const char *uuid, reveldb_t *reveldb,
     memset(iter, 0, (sizeof(xleveldb_iter_t) + uuid_len + 1));
     iter->uuid = (char *)iter + sizeof(xleveldb_iter_t);
     memcpy(iter->uuid, uuid, uuid_len);
+    reveldb_retain_db(reveldb);
     iter->reveldb = reveldb;
     iter->external_roptions = external_roptions;
-    iter->iter = leveldb_create_iterator(reveldb->instance->db,
+    pthread_mutex_init(&iter->lock, NULL);
+    iter->refs = 1;
+    iter->iter = xleveldb_cursor_create(reveldb->instance,
             (use_external_roptions == false) ? reveldb->instance->roptions : external_roptions);
-    leveldb_iter_seek_to_first(iter->iter);
+    xleveldb_cursor_seek_to_first(iter->iter);
     return iter;
 }
 
@@ -95,13 +98,15 @@ xleveldb_free_iter(xleveldb_iter_t *iter)
 {
     if (iter != NULL) {
         if (iter->iter != NULL) {
-            leveldb_iter_destroy(iter->iter);
+            xleveldb_cursor_destroy(iter->iter);
             iter->iter = NULL;
         }
         if (iter->external_roptions != NULL) {
             leveldb_readoptions_destroy(iter->external_roptions);
             iter->external_roptions = NULL;
         }
+        reveldb_release_db(iter->reveldb);
+        pthread_mutex_destroy(&iter->lock);
         free(iter);
     }
 }
@@ -109,20 +114,20 @@ xleveldb_free_iter(xleveldb_iter_t *iter)
 unsigned char
 xleveldb_iter_valid(const xleveldb_iter_t *iter)
 {
-    return leveldb_iter_valid(iter->iter);
+    return xleveldb_cursor_valid(iter->iter);
 }
 
 void
 xleveldb_iter_seek_to_first(xleveldb_iter_t *iter)
 {
-    leveldb_iter_seek_to_first(iter->iter);
+    xleveldb_cursor_seek_to_first(iter->iter);
     return;
 }
 
 void
 xleveldb_iter_seek_to_last(xleveldb_iter_t *iter)
 {
-    leveldb_iter_seek_to_last(iter->iter);
+    xleveldb_cursor_seek_to_last(iter->iter);
     return;
 }
 
@@ -131,21 +136,21 @@ xleveldb_iter_seek(
         xleveldb_iter_t *iter,
         const char *k, size_t klen)
 {
-    leveldb_iter_seek(iter->iter, k, klen);
+    xleveldb_cursor_seek(iter->iter, k, klen);
     return;
 }
 
 void
 xleveldb_iter_next(xleveldb_iter_t *iter)
 {
-    leveldb_iter_next(iter->iter);
+    xleveldb_cursor_next(iter->iter);
     return;
 }
 
 void
 xleveldb_iter_prev(xleveldb_iter_t *iter)
 {
-    leveldb_iter_prev(iter->iter);
+    xleveldb_cursor_prev(iter->iter);
     return;
 }
 
@@ -156,7 +161,7 @@ xleveldb_iter_forward(
 {
     int i;
     for(i = 0; i< step; i++) {
-        leveldb_iter_next(iter->iter);
+        xleveldb_cursor_next(iter->iter);
     }
     return;
 }
@@ -168,7 +173,7 @@ xleveldb_iter_backward(
 {
     int i;
     for(i = 0; i< step; i++) {
-        leveldb_iter_prev(iter->iter);
+        xleveldb_cursor_prev(iter->iter);
     }
     return;
 
@@ -179,7 +184,7 @@ xleveldb_iter_key(
         const xleveldb_iter_t *iter,
         size_t *klen)
 {
-    return leveldb_iter_key(iter->iter, klen);
+    return xleveldb_cursor_key(iter->iter, klen);
 }
 
 const char *
@@ -187,7 +192,7 @@ xleveldb_iter_value(
         const xleveldb_iter_t *iter,
         size_t *vlen)
 {
-    return leveldb_iter_value(iter->iter, vlen);
+    return xleveldb_cursor_value(iter->iter, vlen);
 }
 
 void
@@ -195,8 +200,8 @@ xleveldb_iter_kv(const xleveldb_iter_t *iter,
         const char **key, size_t *klen,
         const char **value, size_t *vlen)
 {
-    *key = leveldb_iter_key(iter->iter, klen);
-    *value = leveldb_iter_value(iter->iter, vlen);
+    *key = xleveldb_cursor_key(iter->iter, klen);
+    *value = xleveldb_cursor_value(iter->iter, vlen);
     return;
 }
 
@@ -14,7 +14,10 @@
  */
 #ifndef _XLEVELDB_ITER_H_
 #define _XLEVELDB_ITER_H_
+#include <pthread.h>
+
 #include <reveldb/reveldb.h>
+#include <reveldb/engine/cursor.h>
 
 struct rb_node;
 
@@ -22,10 +25,14 @@ typedef struct xleveldb_iter_s_ xleveldb_iter_t;
 
 struct xleveldb_iter_s_ {
     char *uuid;
-    leveldb_iterator_t *iter;
+    xleveldb_cursor_t *iter;
     reveldb_t *reveldb;
     /* external_roptions is used when and only when iterate on snapshot. */
     leveldb_readoptions_t *external_roptions;
+    /* held while a request moves or reads the iterator. */
+    pthread_mutex_t lock;
+    /* the registry and every request using it, under the registry lock. */
+    unsigned int refs;
     struct rb_node node;
 };
 
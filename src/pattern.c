@@ -0,0 +1,454 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  pattern.c
+ *
+ *    Description:  cache of compiled regular expressions for the regex
+ *                  scans.
+ *
+ * =============================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pattern.h"
+
+struct reveldb_pattern_s_ {
+    struct re_pattern_buffer buffer;
+    char *source;
+    reg_syntax_t syntax;
+    uint64_t hash;
+    char *prefix;
+    size_t prefix_len;
+    char *literal; /* the longest one every match contains far in. */
+    size_t literal_len;
+    int backrefs;
+    reveldb_pattern_t *next; /* hash chain. */
+    reveldb_pattern_t *newer; /* idle patterns, by release time. */
+    reveldb_pattern_t *older;
+};
+
+struct reveldb_pattern_cache_s_ {
+    pthread_mutex_t lock;
+    reveldb_pattern_t **buckets;
+    size_t nbuckets;
+    reveldb_pattern_t *newest;
+    reveldb_pattern_t *oldest;
+    unsigned int count;
+    unsigned int capacity;
+};
+
+/* FNV-1a over the syntax and the pattern. */
+static uint64_t
+_pattern_hash(const char *pattern, reg_syntax_t syntax)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i = 0;
+
+    for (i = 0; i < sizeof(syntax); i++) {
+        hash ^= ((uint64_t)syntax >> (i * 8)) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+    for (i = 0; pattern[i] != '\0'; i++) {
+        hash ^= (unsigned char)pattern[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* the position right after the bracket expression opening at i. */
+static size_t
+_pattern_skip_bracket(const char *p, size_t len, size_t i,
+        reg_syntax_t syntax)
+{
+    i++;
+    if (i < len && p[i] == '^') i++;
+    if (i < len && p[i] == ']') i++;
+    while (i < len && p[i] != ']') {
+        if ((syntax & RE_BACKSLASH_ESCAPE_IN_LISTS) && p[i] == '\\') {
+            i += 2;
+            continue;
+        }
+        if (p[i] == '[' && i + 1 < len
+                && (p[i + 1] == ':' || p[i + 1] == '.' || p[i + 1] == '=')) {
+            /* [:class:], [.symbol.] and [=equivalent=]. */
+            char delim = p[i + 1];
+            i += 2;
+            while (i + 1 < len && !(p[i] == delim && p[i + 1] == ']')) i++;
+            i += 2;
+            continue;
+        }
+        i++;
+    }
+    return i + 1;
+}
+
+/* whether an alternative outside of any group may match without the
+ * literal the pattern begins with. */
+static int
+_pattern_has_alternative(const char *p, size_t len, reg_syntax_t syntax)
+{
+    size_t i = 0;
+    int depth = 0;
+    int bk_parens = !(syntax & RE_NO_BK_PARENS);
+    int bk_vbar = !(syntax & RE_NO_BK_VBAR);
+
+    while (i < len) {
+        if (p[i] == '[') {
+            i = _pattern_skip_bracket(p, len, i, syntax);
+            continue;
+        }
+        if (p[i] == '\\' && i + 1 < len) {
+            if (bk_parens && p[i + 1] == '(') depth++;
+            if (bk_parens && p[i + 1] == ')') depth--;
+            if (bk_vbar && p[i + 1] == '|' && depth <= 0) return 1;
+            i += 2;
+            continue;
+        }
+        if (!bk_parens && p[i] == '(') depth++;
+        if (!bk_parens && p[i] == ')') depth--;
+        if (!bk_vbar && p[i] == '|' && depth <= 0) return 1;
+        if ((syntax & RE_NEWLINE_ALT) && p[i] == '\n') return 1;
+        i++;
+    }
+    return 0;
+}
+
+/* the position right after the group opening at i. */
+static size_t
+_pattern_skip_group(const char *p, size_t len, size_t i, reg_syntax_t syntax)
+{
+    int depth = 0;
+    int bk_parens = !(syntax & RE_NO_BK_PARENS);
+
+    while (i < len) {
+        if (p[i] == '[') {
+            i = _pattern_skip_bracket(p, len, i, syntax);
+            continue;
+        }
+        if (p[i] == '\\' && i + 1 < len) {
+            if (bk_parens && p[i + 1] == '(') depth++;
+            if (bk_parens && p[i + 1] == ')' && --depth == 0) return i + 2;
+            i += 2;
+            continue;
+        }
+        if (!bk_parens && p[i] == '(') depth++;
+        if (!bk_parens && p[i] == ')' && --depth == 0) return i + 1;
+        i++;
+    }
+    return len;
+}
+
+/* whether what follows a character may repeat it, or leave it out. */
+static int
+_pattern_is_repeated(const char *p, size_t len)
+{
+    if (len == 0) return 0;
+    if (strchr("*+?{", p[0]) != NULL) return 1;
+    return (p[0] == '\\') && (len > 1) && (strchr("+?{|", p[1]) != NULL);
+}
+
+/* ends the run of literal characters found so far, the first run is the
+ * prefix if nothing came before it. floats tells whether something that
+ * may repeat without bound came before it. */
+static void
+_pattern_end_run(reveldb_pattern_t *pattern, const char *run, size_t *run_len,
+        int *at_start, int floats)
+{
+    if (*at_start) {
+        memcpy(pattern->prefix, run, *run_len);
+        pattern->prefix[*run_len] = '\0';
+        pattern->prefix_len = *run_len;
+        *at_start = 0;
+    }
+    if (floats && *run_len > pattern->literal_len) {
+        memcpy(pattern->literal, run, *run_len);
+        pattern->literal[*run_len] = '\0';
+        pattern->literal_len = *run_len;
+    }
+    *run_len = 0;
+}
+
+/* finds the literals every string matched by re_match() contains: the one
+ * it starts with, as re_match() anchors the pattern there whether it
+ * begins with ^ or not, and the longest one coming after a repetition.
+ * the automaton gets to the others within a few bytes, so only the latter
+ * is worth looking for over the whole string. both are runs of characters
+ * which can be nothing but themselves, outside of any group. returns -1
+ * if they could not be allocated. */
+static int
+_pattern_literals(reveldb_pattern_t *pattern, const char *p,
+        reg_syntax_t syntax)
+{
+    size_t len = strlen(p);
+    size_t i = 0;
+    size_t run_len = 0;
+    int at_start = 1;
+    int floats = 0; /* something unbounded came before. */
+    int run_floats = 0;
+    int bk_parens = !(syntax & RE_NO_BK_PARENS);
+    char *run = (char *)malloc(len + 1);
+
+    pattern->prefix = (char *)malloc(len + 1);
+    pattern->literal = (char *)malloc(len + 1);
+    if (run == NULL || pattern->prefix == NULL || pattern->literal == NULL) {
+        free(run);
+        return -1;
+    }
+    pattern->prefix[0] = pattern->literal[0] = '\0';
+    if ((syntax & RE_ICASE) || _pattern_has_alternative(p, len, syntax)) {
+        free(run);
+        return 0;
+    }
+
+    if (i < len && p[i] == '^') i++;
+    while (i < len) {
+        char c = p[i];
+        size_t step = 1;
+        int literal = 1;
+
+        if (c == '[') {
+            _pattern_end_run(pattern, run, &run_len, &at_start, run_floats);
+            i = _pattern_skip_bracket(p, len, i, syntax);
+            continue;
+        }
+        if ((bk_parens && c == '\\' && i + 1 < len && p[i + 1] == '(')
+                || (!bk_parens && c == '(')) {
+            /* whatever the group holds, it may be long. */
+            _pattern_end_run(pattern, run, &run_len, &at_start, run_floats);
+            i = _pattern_skip_group(p, len, i, syntax);
+            floats = 1;
+            continue;
+        }
+        /* .* and the like, bracket expressions seldom repeat for long. */
+        if (c != '?' && !(c == '\\' && p[i + 1] == '?')
+                && _pattern_is_repeated(p + i, len - i)
+                && i > 0 && p[i - 1] == '.' && (i < 2 || p[i - 2] != '\\')) {
+            floats = 1;
+        }
+        if (c == '\\') {
+            /* escapes of these are plain characters in every syntax. */
+            step = (i + 1 < len) ? 2 : 1;
+            if (step == 2 && strchr(".*[]^$\\", p[i + 1]) != NULL) {
+                c = p[i + 1];
+            } else {
+                literal = 0;
+            }
+        } else if (strchr(".[]()*+?{}|^$\n", c) != NULL) {
+            literal = 0;
+        }
+        if (literal && _pattern_is_repeated(p + i + step, len - i - step)) {
+            literal = 0;
+        }
+
+        if (literal && run_len == 0) run_floats = floats;
+        if (literal) run[run_len++] = c;
+        else _pattern_end_run(pattern, run, &run_len, &at_start, run_floats);
+        i += step;
+    }
+    _pattern_end_run(pattern, run, &run_len, &at_start, run_floats);
+    free(run);
+    return 0;
+}
+
+static void
+_pattern_destroy(reveldb_pattern_t *pattern)
+{
+    regfree(&pattern->buffer);
+    free(pattern->source);
+    free(pattern->prefix);
+    free(pattern->literal);
+    free(pattern);
+}
+
+static reveldb_pattern_t *
+_pattern_compile(const char *source, reg_syntax_t syntax, uint64_t hash)
+{
+    reveldb_pattern_t *pattern = (reveldb_pattern_t *)
+        malloc(sizeof(reveldb_pattern_t));
+
+    if (pattern == NULL) return NULL;
+    memset(pattern, 0, sizeof(reveldb_pattern_t));
+    if (re_compile_pattern(source, strlen(source), &pattern->buffer) != NULL) {
+        regfree(&pattern->buffer);
+        free(pattern);
+        return NULL;
+    }
+    pattern->source = strdup(source);
+    pattern->syntax = syntax;
+    pattern->hash = hash;
+    pattern->backrefs = re_backrefs(&pattern->buffer);
+    if (pattern->source == NULL
+            || _pattern_literals(pattern, source, syntax) != 0) {
+        _pattern_destroy(pattern);
+        return NULL;
+    }
+    return pattern;
+}
+
+/* takes an idle pattern out of the hash chain and the list. */
+static void
+_pattern_unlink(reveldb_pattern_cache_t *cache, reveldb_pattern_t **link)
+{
+    reveldb_pattern_t *pattern = *link;
+
+    *link = pattern->next;
+    if (pattern->newer != NULL) pattern->newer->older = pattern->older;
+    else cache->newest = pattern->older;
+    if (pattern->older != NULL) pattern->older->newer = pattern->newer;
+    else cache->oldest = pattern->newer;
+    pattern->next = pattern->newer = pattern->older = NULL;
+    cache->count--;
+}
+
+static reveldb_pattern_t **
+_pattern_bucket(reveldb_pattern_cache_t *cache, uint64_t hash)
+{
+    return &cache->buckets[hash & (cache->nbuckets - 1)];
+}
+
+reveldb_pattern_cache_t *
+reveldb_pattern_cache_init(unsigned int capacity)
+{
+    reveldb_pattern_cache_t *cache = (reveldb_pattern_cache_t *)
+        malloc(sizeof(reveldb_pattern_cache_t));
+    if (cache == NULL) return NULL;
+    memset(cache, 0, sizeof(reveldb_pattern_cache_t));
+
+    cache->capacity = (capacity > 0) ? capacity : REVELDB_PATTERN_CACHE_SIZE;
+    cache->nbuckets = 16;
+    while (cache->nbuckets < cache->capacity) cache->nbuckets *= 2;
+    cache->buckets = (reveldb_pattern_t **)
+        calloc(cache->nbuckets, sizeof(reveldb_pattern_t *));
+    if (cache->buckets == NULL) {
+        free(cache);
+        return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+static reveldb_pattern_t *
+_pattern_checkout(reveldb_pattern_cache_t *cache, const char *source,
+        reg_syntax_t syntax)
+{
+    uint64_t hash = _pattern_hash(source, syntax);
+    reveldb_pattern_t **link = NULL;
+    reveldb_pattern_t *pattern = NULL;
+
+    if (cache != NULL) {
+        pthread_mutex_lock(&cache->lock);
+        link = _pattern_bucket(cache, hash);
+        while (*link != NULL) {
+            if ((*link)->hash == hash && (*link)->syntax == syntax
+                    && strcmp((*link)->source, source) == 0) {
+                pattern = *link;
+                _pattern_unlink(cache, link);
+                break;
+            }
+            link = &(*link)->next;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        if (pattern != NULL) return pattern;
+    }
+    /* compiled out of the lock, it takes far longer than a lookup. */
+    return _pattern_compile(source, syntax, hash);
+}
+
+reveldb_pattern_t *
+reveldb_pattern_acquire(reveldb_pattern_cache_t *cache, const char *source)
+{
+    return _pattern_checkout(cache, source, re_syntax_options);
+}
+
+reveldb_pattern_t *
+reveldb_pattern_dup(reveldb_pattern_cache_t *cache,
+        reveldb_pattern_t *pattern)
+{
+    return _pattern_checkout(cache, pattern->source, pattern->syntax);
+}
+
+void
+reveldb_pattern_release(reveldb_pattern_cache_t *cache,
+        reveldb_pattern_t *pattern)
+{
+    reveldb_pattern_t **link = NULL;
+    reveldb_pattern_t *evicted = NULL;
+
+    if (pattern == NULL) return;
+    if (cache == NULL) {
+        _pattern_destroy(pattern);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    link = _pattern_bucket(cache, pattern->hash);
+    pattern->next = *link;
+    *link = pattern;
+    pattern->older = cache->newest;
+    if (cache->newest != NULL) cache->newest->newer = pattern;
+    else cache->oldest = pattern;
+    cache->newest = pattern;
+    cache->count++;
+
+    if (cache->count > cache->capacity) {
+        evicted = cache->oldest;
+        link = _pattern_bucket(cache, evicted->hash);
+        while (*link != evicted) link = &(*link)->next;
+        _pattern_unlink(cache, link);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (evicted != NULL) _pattern_destroy(evicted);
+}
+
+struct re_pattern_buffer *
+reveldb_pattern_buffer(reveldb_pattern_t *pattern)
+{
+    return &pattern->buffer;
+}
+
+const char *
+reveldb_pattern_prefix(reveldb_pattern_t *pattern, size_t *prefix_len)
+{
+    *prefix_len = pattern->prefix_len;
+    return pattern->prefix;
+}
+
+int
+reveldb_pattern_match(reveldb_pattern_t *pattern, const char *str, size_t len)
+{
+    if ((pattern->literal_len > 0)
+            && (memmem(str, len, pattern->literal,
+                    pattern->literal_len) == NULL)) return 0;
+    return re_match_exists(&pattern->buffer, str, len) > 0;
+}
+
+int
+reveldb_pattern_backtracks(reveldb_pattern_t *pattern)
+{
+    return pattern->backrefs > 0;
+}
+
+void
+reveldb_pattern_cache_free(reveldb_pattern_cache_t *cache)
+{
+    if (cache == NULL) return;
+    while (cache->oldest != NULL) {
+        reveldb_pattern_t *pattern = cache->oldest;
+        reveldb_pattern_t **link = _pattern_bucket(cache, pattern->hash);
+        while (*link != pattern) link = &(*link)->next;
+        _pattern_unlink(cache, link);
+        _pattern_destroy(pattern);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
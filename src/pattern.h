@@ -0,0 +1,70 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  pattern.h
+ *
+ *    Description:  cache of compiled regular expressions for the regex
+ *                  scans.
+ *
+ * =============================================================================
+ */
+#ifndef _REVELDB_PATTERN_H_
+#define _REVELDB_PATTERN_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <regex/regex.h>
+
+typedef struct reveldb_pattern_cache_s_ reveldb_pattern_cache_t;
+typedef struct reveldb_pattern_s_ reveldb_pattern_t;
+
+/* idle compiled patterns kept around, unless set otherwise. */
+#define REVELDB_PATTERN_CACHE_SIZE 256
+
+/* keeps up to capacity compiled patterns no scan is using, the least
+ * recently released one goes first. */
+extern reveldb_pattern_cache_t * reveldb_pattern_cache_init(
+        unsigned int capacity);
+
+/* the pattern compiled with the current re_syntax_options, taken out of
+ * the cache if an idle one is there and compiled otherwise. NULL if it is
+ * not a valid regular expression. The pattern belongs to the caller until
+ * it is released: matching updates the automaton it holds, so it can not
+ * be used by two scans at once. cache may be NULL. */
+extern reveldb_pattern_t * reveldb_pattern_acquire(
+        reveldb_pattern_cache_t *cache, const char *pattern);
+
+/* another copy of pattern, for a scan walking alongside the one using it.
+ * NULL if there is no memory left to compile it. */
+extern reveldb_pattern_t * reveldb_pattern_dup(
+        reveldb_pattern_cache_t *cache, reveldb_pattern_t *pattern);
+
+/* hands a pattern back to the cache, or frees it if the cache is NULL. */
+extern void reveldb_pattern_release(reveldb_pattern_cache_t *cache,
+        reveldb_pattern_t *pattern);
+
+/* the buffer to hand to re_match(). */
+extern struct re_pattern_buffer * reveldb_pattern_buffer(
+        reveldb_pattern_t *pattern);
+
+/* the literal every string matched by re_match() starts with, of length
+ * 0 if the pattern does not begin with one. */
+extern const char * reveldb_pattern_prefix(reveldb_pattern_t *pattern,
+        size_t *prefix_len);
+
+/* returns 1 if re_match() would match str, 0 otherwise. strings lacking
+ * a literal every match contains somewhere past a repetition, as in
+ * .*"status":"error", are turned down by memmem() alone, the others are
+ * run through the automaton until its first accepting state rather than
+ * through the longest match. */
+extern int reveldb_pattern_match(reveldb_pattern_t *pattern,
+        const char *str, size_t len);
+
+/* returns 1 if matching may take more than linear time, which patterns
+ * with back-references do. */
+extern int reveldb_pattern_backtracks(reveldb_pattern_t *pattern);
+
+extern void reveldb_pattern_cache_free(reveldb_pattern_cache_t *cache);
+
+#endif /* _REVELDB_PATTERN_H_ */
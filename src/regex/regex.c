@@ -75,6 +75,39 @@
 #include "regcomp.c"
 #include "regexec.c"
 
+/* Added for reveldb: matching without registers lets re_search_internal
+   stop at the first accepting state instead of running on in search of
+   the longest match.  */
+int
+re_match_exists (struct re_pattern_buffer *bufp, const char *string,
+		 int length)
+{
+#ifdef _LIBC
+  re_dfa_t *dfa = (re_dfa_t *) bufp->buffer;
+#endif
+  reg_errcode_t err;
+  int eflags = 0;
+
+  if (BE (length < 0, 0))
+    return -1;
+  eflags |= (bufp->not_bol) ? REG_NOTBOL : 0;
+  eflags |= (bufp->not_eol) ? REG_NOTEOL : 0;
+
+  __libc_lock_lock (dfa->lock);
+  err = re_search_internal (bufp, string, length, 0, 0, length, 0, NULL,
+			    eflags);
+  __libc_lock_unlock (dfa->lock);
+  if (err == REG_NOERROR)
+    return 1;
+  return (err == REG_NOMATCH) ? 0 : -1;
+}
+
+int
+re_backrefs (const struct re_pattern_buffer *bufp)
+{
+  return ((const re_dfa_t *) bufp->buffer)->nbackref;
+}
+
 /* Binary backward compatibility.  */
 #if _LIBC
 # include <shlib-compat.h>
@@ -504,6 +504,18 @@ extern int re_search_2 (struct re_pattern_buffer *__buffer,
 extern int re_match (struct re_pattern_buffer *__buffer, const char *__cstring,
 		     int __length, int __start, struct re_registers *__regs);
 
+/* Added for reveldb: return 1 if the regexp in BUFFER matches STRING
+   starting at its first character, 0 if it does not and -1 on error.
+   Unlike `re_match', the match is not extended to the longest one, the
+   automaton stops at the first accepting state it reaches.  */
+extern int re_match_exists (struct re_pattern_buffer *__buffer,
+			    const char *__string, int __length);
+
+/* Added for reveldb: the number of back-references in the regexp in
+   BUFFER.  Without any, matching takes time linear in the length of the
+   string.  */
+extern int re_backrefs (const struct re_pattern_buffer *__buffer);
+
 
 /* Relates to `re_match' as `re_search_2' relates to `re_search'.  */
 extern int re_match_2 (struct re_pattern_buffer *__buffer,
@@ -571,6 +571,28 @@ _rest_pattern_unescape(const char *pattern)
     return safe_urldecode(pattern);
 }
 
+static void
+_rest_reset_err(char **err)
+{
+    if (*err != NULL) {
+        leveldb_free(*err);
+        *err = NULL;
+    }
+}
+
+/* returns true if every item of the array is a string. */
+static bool
+_rest_json_strings_check(cJSON *array)
+{
+    cJSON *item = NULL;
+
+    if (array->type != cJSON_Array) return false;
+    for (item = array->child; item != NULL; item = item->next) {
+        if (item->type != cJSON_String) return false;
+    }
+    return true;
+}
+
 static char *
 _rest_do_mget(evhttpx_request_t *req, reveldb_t *db, bool quiet)
 {
@@ -580,8 +602,13 @@ _rest_do_mget(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     char *response = NULL;
     int items = 0;
     int arridx = -1;
-    size_t value_len = -1;
+    cJSON *item = NULL;
+    const char **mkeys = NULL;
+    size_t *mkeylens = NULL;
+    char **values = NULL;
+    size_t *value_lens = NULL;
     evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    char *err = NULL;
 
     /* buffer containing data from client */
     evbuf_t *buffer_in = req->buffer_in;
@@ -601,24 +628,7 @@ _rest_do_mget(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     }
 
     keys = cJSON_GetObjectItem(root, "keys");
-    if (keys != NULL) {
-        items = cJSON_GetArraySize(keys);
-        for (arridx = 0; arridx < items; arridx++) {
-            char *key = cJSON_GetArrayItem(keys, arridx)->valuestring;
-            char *value = leveldb_get(
-                    db->instance->db,
-                    db->instance->roptions,
-                    key, strlen(key),
-                    &value_len,
-                    &(db->instance->err));
-            if (value != NULL) {
-                evhttpx_kv_t *kv =
-                    evhttpx_kvlen_new(key, strlen(key), value, value_len, 1, 1);
-                evhttpx_kvs_add_kv(kvs, kv);
-                leveldb_free(value);
-            }
-        }
-    } else {
+    if (keys == NULL || _rest_json_strings_check(keys) == false) {
         if (quiet == false) {
             response = _rest_jsonfy_response_on_error(req, EVHTTPX_RES_BADREQ,
                     "Bad Request", "Invalid post filed format.");
@@ -628,6 +638,53 @@ _rest_do_mget(evhttpx_request_t *req, reveldb_t *db, bool quiet)
         return response;
     }
 
+    items = cJSON_GetArraySize(keys);
+    mkeys = (const char **)malloc(sizeof(char *) * (items + 1));
+    mkeylens = (size_t *)malloc(sizeof(size_t) * (items + 1));
+    values = (char **)malloc(sizeof(char *) * (items + 1));
+    value_lens = (size_t *)malloc(sizeof(size_t) * (items + 1));
+    assert(mkeys != NULL && mkeylens != NULL);
+    assert(values != NULL && value_lens != NULL);
+    for (arridx = 0, item = keys->child;
+            arridx < items; arridx++, item = item->next) {
+        mkeys[arridx] = item->valuestring;
+        mkeylens[arridx] = strlen(mkeys[arridx]);
+    }
+
+    /* large requests are looked up in key order, the reply keeps the
+     * order the keys were given in. */
+    xleveldb_mget(
+            db->instance,
+            db->instance->roptions,
+            items, mkeys, mkeylens,
+            values, value_lens,
+            &err);
+    for (arridx = 0; arridx < items; arridx++) {
+        if (values[arridx] == NULL) continue;
+        if (err == NULL) {
+            evhttpx_kv_t *kv = evhttpx_kvlen_new(mkeys[arridx],
+                    mkeylens[arridx], values[arridx], value_lens[arridx], 1, 1);
+            evhttpx_kvs_add_kv(kvs, kv);
+        }
+        leveldb_free(values[arridx]);
+    }
+    free(mkeys);
+    free(mkeylens);
+    free(values);
+    free(value_lens);
+
+    if (err != NULL) {
+        if (quiet == false) {
+            response = _rest_jsonfy_response_on_error(req,
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
+        } else {
+            response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                    "Internal Server Error", err);
+        }
+        _rest_reset_err(&err);
+        return response;
+    }
+
     if (quiet == false) {
         response = _rest_jsonfy_response_on_kvs(kvs);
     } else {
@@ -645,8 +702,13 @@ _rest_do_mseize(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     char *response = NULL;
     int items = 0;
     int arridx = -1;
+    cJSON *item = NULL;
     size_t value_len = -1;
     evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    const leveldb_snapshot_t *snapshot = NULL;
+    leveldb_readoptions_t *roptions = NULL;
+    leveldb_writebatch_t *deletes = NULL;
+    char *err = NULL;
 
     /* buffer containing data from client */
     evbuf_t *buffer_in = req->buffer_in;
@@ -666,31 +728,7 @@ _rest_do_mseize(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     }
 
     keys = cJSON_GetObjectItem(root, "keys");
-    if (keys != NULL) {
-        items = cJSON_GetArraySize(keys);
-        for (arridx = 0; arridx < items; arridx++) {
-            char *key = cJSON_GetArrayItem(keys, arridx)->valuestring;
-            char *value = leveldb_get(
-                    db->instance->db,
-                    db->instance->roptions,
-                    key, strlen(key),
-                    &value_len,
-                    &(db->instance->err));
-            if (value != NULL) {
-                evhttpx_kv_t *kv =
-                    evhttpx_kvlen_new(key, strlen(key), value, value_len, 1, 1);
-                evhttpx_kvs_add_kv(kvs, kv);
-                leveldb_delete(
-                        db->instance->db,
-                        db->instance->woptions,
-                        key, strlen(key),
-                        &(db->instance->err));
-                if (db->instance->err != NULL)
-                    xleveldb_reset_err(db->instance);
-                leveldb_free(value);
-            }
-        }
-    } else {
+    if (keys == NULL || _rest_json_strings_check(keys) == false) {
         if (quiet == false) {
             response = _rest_jsonfy_response_on_error(req, EVHTTPX_RES_BADREQ,
                     "Bad Request", "Invalid post filed format.");
@@ -700,6 +738,64 @@ _rest_do_mseize(evhttpx_request_t *req, reveldb_t *db, bool quiet)
         return response;
     }
 
+    /* every key is read from the same snapshot and whatever was found is
+     * deleted with a single write batch. no snapshot spans the shards of
+     * a sharded database, its keys are read as they are. */
+    if (db->instance->nshards <= 1) {
+        snapshot = leveldb_create_snapshot(db->instance->db);
+    }
+    roptions = leveldb_readoptions_create();
+    leveldb_readoptions_set_verify_checksums(roptions,
+            reveldb_config->db_config->verify_checksums);
+    leveldb_readoptions_set_fill_cache(roptions,
+            reveldb_config->db_config->fill_cache);
+    leveldb_readoptions_set_snapshot(roptions, snapshot);
+    deletes = leveldb_writebatch_create();
+
+    items = cJSON_GetArraySize(keys);
+    for (arridx = 0, item = keys->child;
+            arridx < items; arridx++, item = item->next) {
+        char *key = item->valuestring;
+        char *value = xleveldb_get(
+                db->instance,
+                roptions,
+                key, strlen(key),
+                &value_len,
+                &err);
+        if (err != NULL) break;
+        if (value != NULL) {
+            evhttpx_kv_t *kv =
+                evhttpx_kvlen_new(key, strlen(key), value, value_len, 1, 1);
+            evhttpx_kvs_add_kv(kvs, kv);
+            leveldb_writebatch_delete(deletes, key, strlen(key));
+            leveldb_free(value);
+        }
+    }
+    leveldb_readoptions_destroy(roptions);
+    if (snapshot != NULL) {
+        leveldb_release_snapshot(db->instance->db, snapshot);
+    }
+    if (err == NULL) {
+        xleveldb_write(
+                db->instance,
+                db->instance->woptions,
+                deletes,
+                &err);
+    }
+    leveldb_writebatch_destroy(deletes);
+
+    if (err != NULL) {
+        if (quiet == false) {
+            response = _rest_jsonfy_response_on_error(req,
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
+        } else {
+            response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                    "Internal Server Error", err);
+        }
+        _rest_reset_err(&err);
+        return response;
+    }
+
     if (quiet == false) {
         response = _rest_jsonfy_response_on_kvs(kvs);
     } else {
@@ -718,6 +814,10 @@ _rest_do_mset(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     char *response = NULL;
     int items = 0;
     int arridx = -1;
+    cJSON *key = NULL;
+    cJSON *value = NULL;
+    leveldb_writebatch_t *puts = NULL;
+    char *err = NULL;
 
     /* buffer containing data from client */
     evbuf_t *buffer_in = req->buffer_in;
@@ -738,39 +838,9 @@ _rest_do_mset(evhttpx_request_t *req, reveldb_t *db, bool quiet)
 
     keys = cJSON_GetObjectItem(root, "keys");
     values = cJSON_GetObjectItem(root, "values");
-    if (keys != NULL && values != NULL) {
-        if ((items = cJSON_GetArraySize(keys)) != cJSON_GetArraySize(values)) {
-            if (quiet == false) {
-                response = _rest_jsonfy_response_on_error(
-                        req, EVHTTPX_RES_BADREQ, "Bad Request",
-                        "Keys and values does not equal.");
-            } else {
-                response = _rest_jsonfy_quiet_response(EVHTTPX_RES_BADREQ);
-            }
-            return response;
-        }
-        for (arridx = 0; arridx < items; arridx++) {
-            char *key = cJSON_GetArrayItem(keys, arridx)->valuestring;
-            char *value = cJSON_GetArrayItem(values, arridx)->valuestring;
-            leveldb_put(
-                    db->instance->db,
-                    db->instance->woptions,
-                    key, strlen(key),
-                    value, strlen(value),
-                    &(db->instance->err));
-            if (db->instance->err != NULL) {
-                if (quiet == false) {
-                    response = _rest_jsonfy_response_on_error(req,
-                            EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
-                } else {
-                    response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                            "Internal Server Error", db->instance->err);
-                }
-                xleveldb_reset_err(db->instance);
-                return response;
-            }
-        }
-    } else {
+    if (keys == NULL || values == NULL
+            || _rest_json_strings_check(keys) == false
+            || _rest_json_strings_check(values) == false) {
         if (quiet == false) {
             response = _rest_jsonfy_response_on_error(req, EVHTTPX_RES_BADREQ,
                     "Bad Request", "Invalid post filed format.");
@@ -779,6 +849,41 @@ _rest_do_mset(evhttpx_request_t *req, reveldb_t *db, bool quiet)
         }
         return response;
     }
+    if ((items = cJSON_GetArraySize(keys)) != cJSON_GetArraySize(values)) {
+        if (quiet == false) {
+            response = _rest_jsonfy_response_on_error(
+                    req, EVHTTPX_RES_BADREQ, "Bad Request",
+                    "Keys and values does not equal.");
+        } else {
+            response = _rest_jsonfy_quiet_response(EVHTTPX_RES_BADREQ);
+        }
+        return response;
+    }
+
+    /* all or none of the pairs are written. */
+    puts = leveldb_writebatch_create();
+    for (arridx = 0, key = keys->child, value = values->child;
+            arridx < items; arridx++, key = key->next, value = value->next) {
+        leveldb_writebatch_put(puts, key->valuestring, strlen(key->valuestring),
+                value->valuestring, strlen(value->valuestring));
+    }
+    xleveldb_write(
+            db->instance,
+            db->instance->woptions,
+            puts,
+            &err);
+    leveldb_writebatch_destroy(puts);
+    if (err != NULL) {
+        if (quiet == false) {
+            response = _rest_jsonfy_response_on_error(req,
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
+        } else {
+            response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                    "Internal Server Error", err);
+        }
+        _rest_reset_err(&err);
+        return response;
+    }
 
     if (quiet == false) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_OK,
@@ -798,6 +903,9 @@ _rest_do_mdel(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     char *response = NULL;
     int items = 0;
     int arridx = -1;
+    cJSON *item = NULL;
+    leveldb_writebatch_t *deletes = NULL;
+    char *err = NULL;
 
     /* buffer containing data from client */
     evbuf_t *buffer_in = req->buffer_in;
@@ -817,28 +925,7 @@ _rest_do_mdel(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     }
 
     keys = cJSON_GetObjectItem(root, "keys");
-    if (keys != NULL) {
-        items = cJSON_GetArraySize(keys);
-        for (arridx = 0; arridx < items; arridx++) {
-            char *key = cJSON_GetArrayItem(keys, arridx)->valuestring;
-            leveldb_delete(
-                    db->instance->db,
-                    db->instance->woptions,
-                    key, strlen(key),
-                    &(db->instance->err));
-            if (db->instance->err != NULL) {
-                if (quiet == false) {
-                    response = _rest_jsonfy_response_on_error(req,
-                            EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
-                } else {
-                    response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                            "Internal Server Error", db->instance->err);
-                }
-                xleveldb_reset_err(db->instance);
-                return response;
-            }
-        }
-    } else {
+    if (keys == NULL || _rest_json_strings_check(keys) == false) {
         if (quiet == false) {
             response = _rest_jsonfy_response_on_error(req, EVHTTPX_RES_BADREQ,
                     "Bad Request", "Invalid post filed format.");
@@ -847,10 +934,36 @@ _rest_do_mdel(evhttpx_request_t *req, reveldb_t *db, bool quiet)
         }
         return response;
     }
+    items = cJSON_GetArraySize(keys);
+
+    /* all or none of the keys are deleted. */
+    deletes = leveldb_writebatch_create();
+    for (arridx = 0, item = keys->child;
+            arridx < items; arridx++, item = item->next) {
+        char *key = item->valuestring;
+        leveldb_writebatch_delete(deletes, key, strlen(key));
+    }
+    xleveldb_write(
+            db->instance,
+            db->instance->woptions,
+            deletes,
+            &err);
+    leveldb_writebatch_destroy(deletes);
+    if (err != NULL) {
+        if (quiet == false) {
+            response = _rest_jsonfy_response_on_error(req,
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
+        } else {
+            response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                    "Internal Server Error", err);
+        }
+        _rest_reset_err(&err);
+        return response;
+    }
 
     if (quiet == false) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_OK,
-                "OK", "Multiple set done.");
+                "OK", "Multiple delete done.");
     } else {
         response = _rest_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
@@ -864,8 +977,8 @@ _rest_send_reply(evhttpx_request_t *req,
     if (req == NULL) return;
     if (response != NULL) {
         evbuffer_add_printf(req->buffer_out, "%s", response);
+        evhttpx_arena_release(evhttpx_request_get_arena(req), response);
         evhttpx_send_reply(req, code);
-        free(response);
     }
     return;
 }
@@ -896,7 +1009,11 @@ URI_rest_new_cb(evhttpx_request_t *req, void *userdata)
 
     /* init new leveldb instance and insert it into reveldb. */
     reveldb_t *db = reveldb_init(dbname, reveldb_config);
-    reveldb_insert_db(&reveldb, db);
+    if (db != NULL && reveldb_insert_db(&reveldb, db) == 0) {
+        /* one of that name is open already, which is all that was asked. */
+        reveldb_free_db(db);
+        db = reveldb_request_db(&reveldb, req, dbname);
+    }
 
     if (db != NULL) {
         if (is_quiet == true) {
@@ -919,6 +1036,7 @@ URI_rest_add_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     const char *key = NULL;
     const char *value = NULL;
     const char *dbname = NULL;
@@ -950,7 +1068,7 @@ URI_rest_add_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -958,22 +1076,22 @@ URI_rest_add_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    leveldb_put(
-            db->instance->db,
+    xleveldb_put(
+            db->instance,
             db->instance->woptions,
             key, strlen(key),
             value, strlen(value),
-            &(db->instance->err));
-    if (db->instance->err != NULL) {
+            &err);
+    if (err != NULL) {
         if (is_quiet == false) {
             response = _rest_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
         } else {
              response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                     "Internal Server Error", db->instance->err);
+                     "Internal Server Error", err);
         }
         _rest_send_reply(req, response, EVHTTPX_RES_SERVERR);
-        xleveldb_reset_err(db->instance);
+        _rest_reset_err(&err);
     } else {
         if (is_quiet == false) {
             response = _rest_jsonfy_general_response(EVHTTPX_RES_OK,
@@ -984,6 +1102,7 @@ URI_rest_add_cb(evhttpx_request_t *req, void *userdata)
         _rest_send_reply(req, response, EVHTTPX_RES_OK);
     }
 
+    _rest_reset_err(&err);
     return;
 }
 
@@ -992,6 +1111,7 @@ URI_rest_set_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     const char *key = NULL;
     const char *value = NULL;
     const char *dbname = NULL;
@@ -1023,7 +1143,7 @@ URI_rest_set_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1031,21 +1151,21 @@ URI_rest_set_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    leveldb_put(
-            db->instance->db,
+    xleveldb_put(
+            db->instance,
             db->instance->woptions,
             key, strlen(key),
             value, strlen(value),
-            &(db->instance->err));
-    if (db->instance->err != NULL) {
+            &err);
+    if (err != NULL) {
         if (is_quiet == false) {
             response = _rest_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
         } else {
              response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                     "Internal Server Error", db->instance->err);
+                     "Internal Server Error", err);
         }
-        xleveldb_reset_err(db->instance);
+        _rest_reset_err(&err);
         _rest_send_reply(req, response, EVHTTPX_RES_SERVERR);
     } else {
         if (is_quiet == false) {
@@ -1057,6 +1177,7 @@ URI_rest_set_cb(evhttpx_request_t *req, void *userdata)
         _rest_send_reply(req, response, EVHTTPX_RES_OK);
     }
 
+    _rest_reset_err(&err);
     return;
 }
 
@@ -1080,7 +1201,7 @@ URI_rest_mset_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1098,12 +1219,13 @@ URI_rest_get_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     bool is_quiet = false;
     char *value = NULL;
     char *response = NULL;
     const char *key = NULL;
     const char *dbname = NULL;
-    unsigned int value_len = 0;
+    size_t value_len = 0;
     
     response = _rest_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -1124,7 +1246,7 @@ URI_rest_get_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1132,12 +1254,12 @@ URI_rest_get_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
    
-    value = leveldb_get(
-            db->instance->db,
+    value = xleveldb_get(
+            db->instance,
             db->instance->roptions,
             key, strlen(key),
             &value_len,
-            &(db->instance->err));
+            &err);
     if (value != NULL) {
         if (is_quiet == false) {
             response = _rest_jsonfy_response_on_kv_with_len(
@@ -1159,6 +1281,7 @@ URI_rest_get_cb(evhttpx_request_t *req, void *userdata)
         _rest_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
     }
 
+    _rest_reset_err(&err);
     return;
 }
 
@@ -1182,7 +1305,7 @@ URI_rest_mget_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1200,12 +1323,13 @@ URI_rest_seize_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     bool is_quiet = false;
     char *value = NULL;
     char *response = NULL;
     const char *key = NULL;
     const char *dbname = NULL;
-    unsigned int value_len = 0;
+    size_t value_len = 0;
     
     response = _rest_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -1225,7 +1349,7 @@ URI_rest_seize_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1233,19 +1357,19 @@ URI_rest_seize_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
    
-    value = leveldb_get(
-            db->instance->db,
+    value = xleveldb_get(
+            db->instance,
             db->instance->roptions,
             key, strlen(key),
             &value_len,
-            &(db->instance->err));
+            &err);
     if (value != NULL) {
-        leveldb_delete(
-                db->instance->db,
+        xleveldb_delete(
+                db->instance,
                 db->instance->woptions,
                 key, strlen(key),
-                &(db->instance->err));
-        if (db->instance->err == NULL) {
+                &err);
+        if (err == NULL) {
             if (is_quiet == false) {
                 response = _rest_jsonfy_msgalt_response_on_kv_with_len(
                         key, strlen(key), value, value_len,
@@ -1265,7 +1389,7 @@ URI_rest_seize_cb(evhttpx_request_t *req, void *userdata)
                 response = _rest_jsonfy_quiet_response_on_kv_with_len(
                         key, strlen(key), value, value_len);
             }
-             xleveldb_reset_err(db->instance);
+             _rest_reset_err(&err);
         } 
         free(value);
         _rest_send_reply(req, response, EVHTTPX_RES_OK);
@@ -1280,6 +1404,7 @@ URI_rest_seize_cb(evhttpx_request_t *req, void *userdata)
         _rest_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
     }
 
+    _rest_reset_err(&err);
     return;
 }
 
@@ -1303,7 +1428,7 @@ URI_rest_mseize_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1321,6 +1446,7 @@ URI_rest_cas_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     bool is_quiet = false;
     char *value = NULL;
     char *response = NULL;
@@ -1328,7 +1454,7 @@ URI_rest_cas_cb(evhttpx_request_t *req, void *userdata)
     const char *oval = NULL;
     const char *nval = NULL;
     const char *dbname = NULL;
-    unsigned int value_len = 0;
+    size_t value_len = 0;
     
     response = _rest_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -1362,7 +1488,7 @@ URI_rest_cas_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1370,12 +1496,12 @@ URI_rest_cas_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
    
-    value = leveldb_get(
-            db->instance->db,
+    value = xleveldb_get(
+            db->instance,
             db->instance->roptions,
             key, strlen(key),
             &value_len,
-            &(db->instance->err));
+            &err);
     if (value != NULL) {
         if (value_len != strlen(oval)) {
             if (is_quiet == false) {
@@ -1389,21 +1515,21 @@ URI_rest_cas_cb(evhttpx_request_t *req, void *userdata)
             return;
         } else {
             if (strncmp(value, oval, value_len) == 0) {
-                leveldb_put(
-                        db->instance->db,
+                xleveldb_put(
+                        db->instance,
                         db->instance->woptions,
                         key, strlen(key),
                         nval, strlen(nval),
-                        &(db->instance->err));
-                if (db->instance->err != NULL) {
+                        &err);
+                if (err != NULL) {
                     if (is_quiet == false) {
                         response = _rest_jsonfy_response_on_error(req,
-                                EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
+                                EVHTTPX_RES_SERVERR, "Internal Server Error", err);
                     } else {
                         response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                                "Internal Server Error", db->instance->err);
+                                "Internal Server Error", err);
                     }
-                    xleveldb_reset_err(db->instance);
+                    _rest_reset_err(&err);
                     _rest_send_reply(req, response, EVHTTPX_RES_SERVERR);
                 } else {
                     if (is_quiet == false) {
@@ -1439,6 +1565,7 @@ URI_rest_cas_cb(evhttpx_request_t *req, void *userdata)
         }
         _rest_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
     }
+    _rest_reset_err(&err);
     return;
 }
 
@@ -1447,6 +1574,7 @@ URI_rest_replace_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     bool is_quiet = false;
     char *value_old = NULL;
     tstring_t *value_new = NULL;
@@ -1481,7 +1609,7 @@ URI_rest_replace_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1489,28 +1617,28 @@ URI_rest_replace_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
    
-    value_old = leveldb_get(
-            db->instance->db,
+    value_old = xleveldb_get(
+            db->instance,
             db->instance->roptions,
             key, strlen(key),
             &value_old_len,
-            &(db->instance->err));
+            &err);
     if (value_old != NULL) {
         value_new = tstring_new_len(value, strlen(value));
-        leveldb_put(
-            db->instance->db,
+        xleveldb_put(
+            db->instance,
             db->instance->woptions,
             key, strlen(key),
             tstring_data(value_new), tstring_size(value_new),
-            &(db->instance->err));
-        if (db->instance->err != NULL) {
+            &err);
+        if (err != NULL) {
             if (is_quiet == false) {
                 response = _rest_jsonfy_response_on_error(req,
                         EVHTTPX_RES_SERVERR, "Internal Server Error",
-                        db->instance->err);
+                        err);
             } else {
                 response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                        "Internal Server Error", db->instance->err);
+                        "Internal Server Error", err);
             }
         } else {
             if (is_quiet == false) {
@@ -1536,6 +1664,7 @@ URI_rest_replace_cb(evhttpx_request_t *req, void *userdata)
         _rest_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
     }
 
+    _rest_reset_err(&err);
     return;
 }
 
@@ -1544,6 +1673,7 @@ URI_rest_del_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     char *response = NULL;
     const char *key = NULL;
     const char *dbname = NULL;
@@ -1567,7 +1697,7 @@ URI_rest_del_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1575,23 +1705,23 @@ URI_rest_del_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    leveldb_delete(
-            db->instance->db,
+    xleveldb_delete(
+            db->instance,
             db->instance->woptions,
             key, strlen(key),
-            &(db->instance->err));
-    if (db->instance->err != NULL) {
+            &err);
+    if (err != NULL) {
         if (is_quiet == false ) {
         response = _rest_jsonfy_response_on_error(req,
                 EVHTTPX_RES_SERVERR, 
                 "Internal Server Error",
-                db->instance->err);
+                err);
         } else {
             response = _rest_jsonfy_general_response(EVHTTPX_RES_SERVERR, 
                 "Internal Server Error",
-                db->instance->err);
+                err);
         }
-        xleveldb_reset_err(db->instance);
+        _rest_reset_err(&err);
         _rest_send_reply(req, response, EVHTTPX_RES_SERVERR);
     } else {
         if (is_quiet == false) {
@@ -1603,6 +1733,7 @@ URI_rest_del_cb(evhttpx_request_t *req, void *userdata)
         _rest_send_reply(req, response, EVHTTPX_RES_OK);
     }
 
+    _rest_reset_err(&err);
     return;
 }
 
@@ -1626,7 +1757,7 @@ URI_rest_mdel_cb(evhttpx_request_t *req, void *userdata)
     _rest_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rest_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -14,6 +14,7 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,8 +23,12 @@
 #include <reveldb/engine/xleveldb.h>
 #include <reveldb/util/rbtree.h>
 
+#include "log.h"
 #include "tstring.h"
 
+/* guards the database registry, handlers may run on several threads. */
+static pthread_rwlock_t _reveldb_registry_lock = PTHREAD_RWLOCK_INITIALIZER;
+
 reveldb_t * reveldb_init(const char *dbname, reveldb_config_t *config)
 {
     assert(dbname != NULL);
@@ -51,6 +56,9 @@ reveldb_t * reveldb_init(const char *dbname, reveldb_config_t *config)
     xleveldb_instance_t *instance = xleveldb_instance_init(xleveldb_config);
 
     db->instance = instance;
+    db->refs = 1;
+    db->destroyed = false;
+    RB_CLEAR_NODE(&db->node);
 
     tstring_free(fullpath);
 
@@ -59,8 +67,11 @@ reveldb_t * reveldb_init(const char *dbname, reveldb_config_t *config)
 
 reveldb_t * reveldb_search_db(struct rb_root *root, const char *dbname)
 {
-    struct rb_node *node = root->rb_node;
+    struct rb_node *node = NULL;
+    reveldb_t *found = NULL;
 
+    pthread_rwlock_rdlock(&_reveldb_registry_lock);
+    node = root->rb_node;
     while (node) {
         reveldb_t *db = container_of(node, reveldb_t, node);
         int result;
@@ -71,16 +82,68 @@ reveldb_t * reveldb_search_db(struct rb_root *root, const char *dbname)
             node = node->rb_left;
         else if (result > 0)
             node = node->rb_right;
-        else
-            return db;
+        else {
+            found = db;
+            /* the registry still holds its reference, it can not drop
+             * to zero meanwhile. */
+            __sync_add_and_fetch(&found->refs, 1);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&_reveldb_registry_lock);
+    return found;
+}
+
+static void
+_reveldb_release_cb(void *arg)
+{
+    reveldb_release_db((reveldb_t *)arg);
+}
+
+reveldb_t * reveldb_request_db(struct rb_root *root,
+        evhttpx_request_t *req, const char *dbname)
+{
+    reveldb_t *db = reveldb_search_db(root, dbname);
+
+    if (db == NULL) return NULL;
+    if (evhttpx_arena_add_cleanup(evhttpx_request_get_arena(req),
+                _reveldb_release_cb, db) < 0) {
+        LOG_ERROR(("failed to tie database %s to a request.", dbname));
+        reveldb_release_db(db);
+        return NULL;
+    }
+    return db;
+}
+
+void reveldb_retain_db(reveldb_t *db)
+{
+    assert(db != NULL);
+    __sync_add_and_fetch(&db->refs, 1);
+}
+
+void reveldb_release_db(reveldb_t *db)
+{
+    char *err = NULL;
+
+    if (db == NULL) return;
+    if (__sync_sub_and_fetch(&db->refs, 1) > 0) return;
+
+    if (db->destroyed) {
+        xleveldb_instance_destroy(db->instance, &err);
+        if (err != NULL) {
+            LOG_ERROR(("failed to destroy database %s: %s", db->dbname, err));
+            leveldb_free(err);
+        }
     }
-    return NULL;
+    reveldb_free_db(db);
 }
 
 int reveldb_insert_db(struct rb_root *root, reveldb_t *db)
 {
-    struct rb_node **new = &(root->rb_node), *parent = NULL;
+    struct rb_node **new = NULL, *parent = NULL;
 
+    pthread_rwlock_wrlock(&_reveldb_registry_lock);
+    new = &(root->rb_node);
     /* Figure out where to put new node */
     while (*new) {
         reveldb_t *this = container_of(*new, reveldb_t, node);
@@ -91,17 +154,48 @@ int reveldb_insert_db(struct rb_root *root, reveldb_t *db)
             new = &((*new)->rb_left);
         else if (result > 0)
             new = &((*new)->rb_right);
-        else
+        else {
+            pthread_rwlock_unlock(&_reveldb_registry_lock);
             return 0;
+        }
     }
 
     /* Add new node and rebalance tree. */
     rb_link_node(&db->node, parent, new);
     rb_insert_color(&db->node, root);
+    pthread_rwlock_unlock(&_reveldb_registry_lock);
 
     return 1;
 }
 
+void reveldb_remove_db(struct rb_root *root, reveldb_t *db)
+{
+    assert(db != NULL);
+
+    pthread_rwlock_wrlock(&_reveldb_registry_lock);
+    /* it may have been removed already by a concurrent request. */
+    if (RB_EMPTY_NODE(&db->node)) {
+        pthread_rwlock_unlock(&_reveldb_registry_lock);
+        return;
+    }
+    rb_erase(&(db->node), root);
+    RB_CLEAR_NODE(&db->node);
+    pthread_rwlock_unlock(&_reveldb_registry_lock);
+    reveldb_release_db(db);
+}
+
+void reveldb_destroy_db(struct rb_root *root, reveldb_t *db, char **errptr)
+{
+    assert(db != NULL);
+
+    db->destroyed = true;
+    reveldb_remove_db(root, db);
+    if (__sync_sub_and_fetch(&db->refs, 1) > 0) return;
+
+    xleveldb_instance_destroy(db->instance, errptr);
+    reveldb_free_db(db);
+}
+
 void reveldb_free_db(reveldb_t *db)
 {
     if (db != NULL) {
@@ -110,11 +204,29 @@ void reveldb_free_db(reveldb_t *db)
             db->dbname = NULL;
         }
         if (db->instance != NULL) {
+            /* reveldb_init() made the config, the instance only uses it. */
+            xleveldb_config_t *config = db->instance->config;
             xleveldb_instance_fini(db->instance);
             db->instance = NULL;
+            free(config->dbname);
+            free(config);
         }
         free(db);
         db = NULL;
     }
 }
 
+int reveldb_foreach_db(struct rb_root *root,
+        int (*cb)(reveldb_t *db, void *arg), void *arg)
+{
+    struct rb_node *node = NULL;
+    int res = 0;
+
+    pthread_rwlock_rdlock(&_reveldb_registry_lock);
+    for (node = rb_first(root); node != NULL; node = rb_next(node)) {
+        reveldb_t *db = container_of(node, reveldb_t, node);
+        if ((res = cb(db, arg)) != 0) break;
+    }
+    pthread_rwlock_unlock(&_reveldb_registry_lock);
+    return res;
+}
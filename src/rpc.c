@@ -16,11 +16,20 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <event2/thread.h>
 
 #include <reveldb/rpc.h>
+#include <reveldb/engine/cursor.h>
 #include <regex/regex.h>
 
 #include "log.h"
+#include "executor.h"
+#include "committer.h"
+#include "compactor.h"
+#include "pattern.h"
+#include "similar.h"
 #include "iter.h"
 #include "snapshot.h"
 #include "writebatch.h"
@@ -30,8 +39,6 @@
 #include "utility.h"
 #include "uuid/uuid.h"
 
-# define eq(x, y) (tolower(x) == tolower(y))
-
 static void
 _rpc_fill_ports(reveldb_rpc_t *rpc, const char *ports)
 {
@@ -57,54 +64,6 @@ _rpc_fill_ports(reveldb_rpc_t *rpc, const char *ports)
     return;
 }
 
-static unsigned int
-_rpc_levenshtein(const char *dst, size_t dst_len,
-        const char *src, size_t src_len)
-{
-    unsigned int len1 = dst_len,
-                 len2 = src_len;
-    unsigned int *v = calloc(len2 + 1, sizeof(unsigned int));
-    unsigned int i, j, current, next, cost;
-
-    /* strip common prefixes */
-    while (len1 > 0 && len2 > 0 && eq(dst[0], dst[0]))
-        dst++, dst++, len1--, len2--;
-
-    /* handle degenerate cases */
-    if (!len1) return len2;
-    if (!len2) return len1;
-    
-    /* initialize the column vector */
-    for (j = 0; j < len2 + 1; j++)
-        v[j] = j;
-
-    for (i = 0; i < len1; i++) {
-        /* set the value of the first row */
-        current = i + 1;
-        /* for each row in the column, compute the cost */
-        for (j = 0; j < len2; j++) {
-            /*
-             * cost of replacement is 0 if the two chars are the same, or have
-             * been transposed with the chars immediately before. otherwise 1.
-             */
-            cost = !(eq(dst[i], dst[j]) || (i && j &&
-                     eq(dst[i-1], dst[j]) && eq(dst[i], dst[j-1])));
-            /* find the least cost of insertion, deletion, or replacement */
-            next = min(min(v[j+1] + 1,
-                            current + 1),
-                            v[j] + cost);
-            /* stash the previous row's cost in the column vector */
-            v[j] = current;
-            /* make the cost of the next transition current */
-            current = next;
-        }
-        /* keep the final cost at the bottom of the column */
-        v[len2] = next;
-    }
-    free(v);
-    return next;
-}
-
 static int
 _rpc_parse_kv_pair(evhttpx_kv_t *kv, void *arg)
 {
@@ -192,7 +151,8 @@ _rpc_jsonfy_msgalt_response_on_kv_with_len(
     assert(key != NULL);
     assert(value != NULL);
     char *out = NULL;
-    char *now = gmttime_now();
+    char now[GMTTIME_LEN];
+    gmttime_now_r(now, sizeof(now));
 
     cJSON *root = cJSON_CreateObject();
     cJSON *kv = cJSON_CreateObject();
@@ -207,7 +167,6 @@ _rpc_jsonfy_msgalt_response_on_kv_with_len(
     /* unformatted json has less data. */
     out = cJSON_PrintUnformatted(root);
 
-    free(now);
     cJSON_Delete(root);
     return out;
 }
@@ -220,7 +179,8 @@ _rpc_jsonfy_response_on_kv_with_len(
     assert(key != NULL);
     assert(value != NULL);
     char *out = NULL;
-    char *now = gmttime_now();
+    char now[GMTTIME_LEN];
+    gmttime_now_r(now, sizeof(now));
 
     cJSON *root = cJSON_CreateObject();
     cJSON *kv = cJSON_CreateObject();
@@ -235,7 +195,6 @@ _rpc_jsonfy_response_on_kv_with_len(
     /* unformatted json has less data. */
     out = cJSON_PrintUnformatted(root);
 
-    free(now);
     cJSON_Delete(root);
     return out;
 }
@@ -261,7 +220,8 @@ _rpc_jsonfy_response_on_iter(const char *uuid)
 {
     assert(uuid != NULL);
     char *out = NULL;
-    char *now = gmttime_now();
+    char now[GMTTIME_LEN];
+    gmttime_now_r(now, sizeof(now));
 
     cJSON *root = cJSON_CreateObject();
     cJSON *kv = cJSON_CreateObject();
@@ -276,7 +236,6 @@ _rpc_jsonfy_response_on_iter(const char *uuid)
     /* unformatted json has less data. */
     out = cJSON_PrintUnformatted(root);
 
-    free(now);
     cJSON_Delete(root);
     return out;
 }
@@ -287,7 +246,8 @@ _rpc_jsonfy_response_on_kv(const char *key, const char *value)
     assert(key != NULL);
     assert(value != NULL);
     char *out = NULL;
-    char *now = gmttime_now();
+    char now[GMTTIME_LEN];
+    gmttime_now_r(now, sizeof(now));
 
     cJSON *root = cJSON_CreateObject();
     cJSON *kv = cJSON_CreateObject();
@@ -302,7 +262,6 @@ _rpc_jsonfy_response_on_kv(const char *key, const char *value)
     /* unformatted json has less data. */
     out = cJSON_PrintUnformatted(root);
 
-    free(now);
     cJSON_Delete(root);
     return out;
 }
@@ -352,7 +311,8 @@ _rpc_jsonfy_response_on_kvs(evhttpx_kvs_t *kvs)
     assert(kvs != NULL);
 
     char *out = NULL;
-    char *now = gmttime_now();
+    char now[GMTTIME_LEN];
+    gmttime_now_r(now, sizeof(now));
 
     cJSON *root = cJSON_CreateObject();
     cJSON *jsonkvs = _rpc_jsonfy_kv_pairs2nd(kvs);
@@ -366,7 +326,6 @@ _rpc_jsonfy_response_on_kvs(evhttpx_kvs_t *kvs)
     /* unformatted json has less data. */
     out = cJSON_PrintUnformatted(root);
 
-    free(now);
     cJSON_Delete(root);
     return out;
 }
@@ -390,7 +349,8 @@ _rpc_jsonfy_general_response(
     assert(message != NULL);
 
     char *out = NULL;
-    char *now = gmttime_now();
+    char now[GMTTIME_LEN];
+    gmttime_now_r(now, sizeof(now));
 
     cJSON *root = cJSON_CreateObject();
 
@@ -402,7 +362,6 @@ _rpc_jsonfy_general_response(
     /* unformatted json has less data. */
     out = cJSON_PrintUnformatted(root);
 
-    free(now);
     cJSON_Delete(root);
     return out;
 }
@@ -434,7 +393,7 @@ _rpc_jsonfy_response_on_error(evhttpx_request_t *req,
         const char *message)
 {
     /* json formatted response. */
-    char *now = NULL;
+    char now[GMTTIME_LEN];
     char *response = NULL;
     cJSON *root = NULL;
     cJSON *request = NULL;
@@ -443,7 +402,7 @@ _rpc_jsonfy_response_on_error(evhttpx_request_t *req,
     /* request query pairs. */
     evhttpx_query_t *uri_query = req->uri->query;
 
-    now = gmttime_now();
+    gmttime_now_r(now, sizeof(now));
 
     root = cJSON_CreateObject();
     cJSON_AddNumberToObject(root, "code", code);
@@ -460,7 +419,6 @@ _rpc_jsonfy_response_on_error(evhttpx_request_t *req,
     response = cJSON_PrintUnformatted(root);
 
     cJSON_Delete(root);
-    free(now);
     return response;
 }
 
@@ -474,7 +432,8 @@ _rpc_jsonfy_response_on_sanity_check(
     assert(message != NULL);
 
     char *out = NULL;
-    char *now = gmttime_now();
+    char now[GMTTIME_LEN];
+    gmttime_now_r(now, sizeof(now));
 
     cJSON *root = cJSON_CreateObject();
 
@@ -486,7 +445,6 @@ _rpc_jsonfy_response_on_sanity_check(
     /* unformatted json has less data. */
     out = cJSON_PrintUnformatted(root);
 
-    free(now);
     cJSON_Delete(root);
     return out;
 }
@@ -497,11 +455,11 @@ _rpc_jsonfy_size_response(const char *start_key,
         uint64_t size, bool quiet)
 {
     char *out = NULL;
-    char *now = NULL;
+    char now[GMTTIME_LEN];
     size_t out_len = 64;
 
     if (quiet == false) {
-        now = gmttime_now();
+        gmttime_now_r(now, sizeof(now));
         cJSON *root = cJSON_CreateObject();
         cJSON_AddNumberToObject(root, "code", EVHTTPX_RES_OK);
         cJSON_AddStringToObject(root, "status", "OK");
@@ -513,7 +471,6 @@ _rpc_jsonfy_size_response(const char *start_key,
         // out = cJSON_Print(root);
         /* unformatted json has less data. */
         out = cJSON_PrintUnformatted(root);
-        free(now);
         cJSON_Delete(root);
         return out;
     } else {
@@ -528,11 +485,11 @@ static char *
 _rpc_jsonfy_version_response(int major, int minor, bool quiet)
 {
     char *out = NULL;
-    char *now = NULL;
+    char now[GMTTIME_LEN];
     size_t out_len = 64;
 
     if (quiet == false) {
-        now = gmttime_now();
+        gmttime_now_r(now, sizeof(now));
         cJSON *root = cJSON_CreateObject();
         cJSON_AddNumberToObject(root, "code", EVHTTPX_RES_OK);
         cJSON_AddStringToObject(root, "status", "OK");
@@ -543,7 +500,6 @@ _rpc_jsonfy_version_response(int major, int minor, bool quiet)
         // out = cJSON_Print(root);
         /* unformatted json has less data. */
         out = cJSON_PrintUnformatted(root);
-        free(now);
         cJSON_Delete(root);
         return out;
     } else {
@@ -675,6 +631,84 @@ _rpc_query_quiet_check(evhttpx_request_t *req)
     return false;
 }
 
+/*
+ * if "format=raw", the value is sent as it is instead of in a json
+ * formatted response, _rpc_query_raw_check will return true.
+ * */
+static bool
+_rpc_query_raw_check(evhttpx_request_t *req)
+{
+    assert(req != NULL);
+    const char *format = NULL;
+
+    evhttpx_query_t *query = req->uri->query;
+
+    format = evhttpx_kv_find(query, "format");
+
+    if (format != NULL && strcmp(format, "raw") == 0) {
+        return true;
+    }
+    return false;
+}
+
+/*
+ * boolean query arguments other than quiet, "1"/"true" and "0"/"false"
+ * are recognized, dflt is returned otherwise.
+ * */
+static bool
+_rpc_query_bool_check(evhttpx_request_t *req,
+        const char *name, bool dflt)
+{
+    assert(req != NULL);
+    const char *value = NULL;
+
+    evhttpx_query_t *query = req->uri->query;
+
+    value = evhttpx_kv_find(query, name);
+
+    if (value != NULL) {
+        if (strcmp(value, "1") == 0 || strcmp(value, "true") == 0) {
+            return true;
+        }
+        if (strcmp(value, "0") == 0 || strcmp(value, "false") == 0) {
+            return false;
+        }
+    }
+    return dflt;
+}
+
+/*
+ * durability=none|async|sync picks when a write is acknowledged: once it
+ * is queued, once it is written or once it is synced to disk. Defaults to
+ * sync if the engine syncs its writes, async otherwise.
+ * */
+static char *
+_rpc_query_durability_check(evhttpx_request_t *req,
+        reveldb_durability_t *durability)
+{
+    assert(req != NULL);
+    const char *value = NULL;
+
+    evhttpx_query_t *query = req->uri->query;
+
+    value = evhttpx_kv_find(query, "durability");
+
+    if (value == NULL) {
+        *durability = (reveldb_config->db_config->sync == true) ?
+            REVELDB_DURABILITY_SYNC : REVELDB_DURABILITY_ASYNC;
+    } else if (strcmp(value, "none") == 0) {
+        *durability = REVELDB_DURABILITY_NONE;
+    } else if (strcmp(value, "async") == 0) {
+        *durability = REVELDB_DURABILITY_ASYNC;
+    } else if (strcmp(value, "sync") == 0) {
+        *durability = REVELDB_DURABILITY_SYNC;
+    } else {
+        return _rpc_jsonfy_general_response(EVHTTPX_RES_BADREQ,
+                "Bad Request", "Durability must be none, async or sync.");
+    }
+    return NULL;
+}
+
 static void 
 _rpc_query_database_check(
         evhttpx_request_t *req,
@@ -729,6 +763,28 @@ _rpc_pattern_unescape(const char *pattern)
     return safe_urldecode(pattern);
 }
 
+static void
+_rpc_reset_err(char **err)
+{
+    if (*err != NULL) {
+        leveldb_free(*err);
+        *err = NULL;
+    }
+}
+
+/* returns true if every item of the array is a string. */
+static bool
+_rpc_json_strings_check(cJSON *array)
+{
+    cJSON *item = NULL;
+
+    if (array->type != cJSON_Array) return false;
+    for (item = array->child; item != NULL; item = item->next) {
+        if (item->type != cJSON_String) return false;
+    }
+    return true;
+}
+
 static char *
 _rpc_do_mget(evhttpx_request_t *req, reveldb_t *db, bool quiet)
 {
@@ -738,8 +794,13 @@ _rpc_do_mget(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     char *response = NULL;
     int items = 0;
     int arridx = -1;
-    size_t value_len = -1;
+    cJSON *item = NULL;
+    const char **mkeys = NULL;
+    size_t *mkeylens = NULL;
+    char **values = NULL;
+    size_t *value_lens = NULL;
     evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    char *err = NULL;
 
     /* buffer containing data from client */
     evbuf_t *buffer_in = req->buffer_in;
@@ -759,24 +820,7 @@ _rpc_do_mget(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     }
 
     keys = cJSON_GetObjectItem(root, "keys");
-    if (keys != NULL) {
-        items = cJSON_GetArraySize(keys);
-        for (arridx = 0; arridx < items; arridx++) {
-            char *key = cJSON_GetArrayItem(keys, arridx)->valuestring;
-            char *value = leveldb_get(
-                    db->instance->db,
-                    db->instance->roptions,
-                    key, strlen(key),
-                    &value_len,
-                    &(db->instance->err));
-            if (value != NULL) {
-                evhttpx_kv_t *kv =
-                    evhttpx_kvlen_new(key, strlen(key), value, value_len, 1, 1);
-                evhttpx_kvs_add_kv(kvs, kv);
-                leveldb_free(value);
-            }
-        }
-    } else {
+    if (keys == NULL || _rpc_json_strings_check(keys) == false) {
         if (quiet == false) {
             response = _rpc_jsonfy_response_on_error(req, EVHTTPX_RES_BADREQ,
                     "Bad Request", "Invalid post filed format.");
@@ -786,6 +830,53 @@ _rpc_do_mget(evhttpx_request_t *req, reveldb_t *db, bool quiet)
         return response;
     }
 
+    items = cJSON_GetArraySize(keys);
+    mkeys = (const char **)malloc(sizeof(char *) * (items + 1));
+    mkeylens = (size_t *)malloc(sizeof(size_t) * (items + 1));
+    values = (char **)malloc(sizeof(char *) * (items + 1));
+    value_lens = (size_t *)malloc(sizeof(size_t) * (items + 1));
+    assert(mkeys != NULL && mkeylens != NULL);
+    assert(values != NULL && value_lens != NULL);
+    for (arridx = 0, item = keys->child;
+            arridx < items; arridx++, item = item->next) {
+        mkeys[arridx] = item->valuestring;
+        mkeylens[arridx] = strlen(mkeys[arridx]);
+    }
+
+    /* large requests are looked up in key order, the reply keeps the
+     * order the keys were given in. */
+    xleveldb_mget(
+            db->instance,
+            db->instance->roptions,
+            items, mkeys, mkeylens,
+            values, value_lens,
+            &err);
+    for (arridx = 0; arridx < items; arridx++) {
+        if (values[arridx] == NULL) continue;
+        if (err == NULL) {
+            evhttpx_kv_t *kv = evhttpx_kvlen_new(mkeys[arridx],
+                    mkeylens[arridx], values[arridx], value_lens[arridx], 1, 1);
+            evhttpx_kvs_add_kv(kvs, kv);
+        }
+        leveldb_free(values[arridx]);
+    }
+    free(mkeys);
+    free(mkeylens);
+    free(values);
+    free(value_lens);
+
+    if (err != NULL) {
+        if (quiet == false) {
+            response = _rpc_jsonfy_response_on_error(req,
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
+        } else {
+            response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                    "Internal Server Error", err);
+        }
+        _rpc_reset_err(&err);
+        return response;
+    }
+
     if (quiet == false) {
         response = _rpc_jsonfy_response_on_kvs(kvs);
     } else {
@@ -795,7 +886,8 @@ _rpc_do_mget(evhttpx_request_t *req, reveldb_t *db, bool quiet)
 }
 
 static char *
-_rpc_do_mseize(evhttpx_request_t *req, reveldb_t *db, bool quiet)
+_rpc_do_mseize(evhttpx_request_t *req, reveldb_t *db, bool quiet,
+        leveldb_writebatch_t **batch)
 {
     assert(req != NULL);
     cJSON *root = NULL;
@@ -803,8 +895,16 @@ _rpc_do_mseize(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     char *response = NULL;
     int items = 0;
     int arridx = -1;
+    cJSON *item = NULL;
     size_t value_len = -1;
     evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    const leveldb_snapshot_t *snapshot = NULL;
+    leveldb_readoptions_t *roptions = NULL;
+    leveldb_writebatch_t *deletes = NULL;
+    int found = 0;
+    char *err = NULL;
+
+    *batch = NULL;
 
     /* buffer containing data from client */
     evbuf_t *buffer_in = req->buffer_in;
@@ -824,31 +924,7 @@ _rpc_do_mseize(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     }
 
     keys = cJSON_GetObjectItem(root, "keys");
-    if (keys != NULL) {
-        items = cJSON_GetArraySize(keys);
-        for (arridx = 0; arridx < items; arridx++) {
-            char *key = cJSON_GetArrayItem(keys, arridx)->valuestring;
-            char *value = leveldb_get(
-                    db->instance->db,
-                    db->instance->roptions,
-                    key, strlen(key),
-                    &value_len,
-                    &(db->instance->err));
-            if (value != NULL) {
-                evhttpx_kv_t *kv =
-                    evhttpx_kvlen_new(key, strlen(key), value, value_len, 1, 1);
-                evhttpx_kvs_add_kv(kvs, kv);
-                leveldb_delete(
-                        db->instance->db,
-                        db->instance->woptions,
-                        key, strlen(key),
-                        &(db->instance->err));
-                if (db->instance->err != NULL)
-                    xleveldb_reset_err(db->instance);
-                leveldb_free(value);
-            }
-        }
-    } else {
+    if (keys == NULL || _rpc_json_strings_check(keys) == false) {
         if (quiet == false) {
             response = _rpc_jsonfy_response_on_error(req, EVHTTPX_RES_BADREQ,
                     "Bad Request", "Invalid post filed format.");
@@ -858,6 +934,63 @@ _rpc_do_mseize(evhttpx_request_t *req, reveldb_t *db, bool quiet)
         return response;
     }
 
+    /* every key is read from the same snapshot and whatever was found is
+     * deleted with a single write batch. no snapshot spans the shards of
+     * a sharded database, its keys are read as they are. */
+    if (db->instance->nshards <= 1) {
+        snapshot = leveldb_create_snapshot(db->instance->db);
+    }
+    roptions = leveldb_readoptions_create();
+    leveldb_readoptions_set_verify_checksums(roptions,
+            reveldb_config->db_config->verify_checksums);
+    leveldb_readoptions_set_fill_cache(roptions,
+            reveldb_config->db_config->fill_cache);
+    leveldb_readoptions_set_snapshot(roptions, snapshot);
+    deletes = leveldb_writebatch_create();
+
+    items = cJSON_GetArraySize(keys);
+    for (arridx = 0, item = keys->child;
+            arridx < items; arridx++, item = item->next) {
+        char *key = item->valuestring;
+        char *value = xleveldb_get(
+                db->instance,
+                roptions,
+                key, strlen(key),
+                &value_len,
+                &err);
+        if (err != NULL) break;
+        if (value != NULL) {
+            evhttpx_kv_t *kv =
+                evhttpx_kvlen_new(key, strlen(key), value, value_len, 1, 1);
+            evhttpx_kvs_add_kv(kvs, kv);
+            leveldb_writebatch_delete(deletes, key, strlen(key));
+            leveldb_free(value);
+            found++;
+        }
+    }
+    leveldb_readoptions_destroy(roptions);
+    if (snapshot != NULL) {
+        leveldb_release_snapshot(db->instance->db, snapshot);
+    }
+    if (err != NULL || found == 0) {
+        leveldb_writebatch_destroy(deletes);
+    } else {
+        /* the caller commits it, the reply goes out once it is written. */
+        *batch = deletes;
+    }
+
+    if (err != NULL) {
+        if (quiet == false) {
+            response = _rpc_jsonfy_response_on_error(req,
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
+        } else {
+            response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                    "Internal Server Error", err);
+        }
+        _rpc_reset_err(&err);
+        return response;
+    }
+
     if (quiet == false) {
         response = _rpc_jsonfy_response_on_kvs(kvs);
     } else {
@@ -867,7 +1000,8 @@ _rpc_do_mseize(evhttpx_request_t *req, reveldb_t *db, bool quiet)
 }
 
 static char *
-_rpc_do_mset(evhttpx_request_t *req, reveldb_t *db, bool quiet)
+_rpc_do_mset(evhttpx_request_t *req, reveldb_t *db, bool quiet,
+        leveldb_writebatch_t **batch)
 {
     assert(req != NULL);
     cJSON *root = NULL;
@@ -876,6 +1010,11 @@ _rpc_do_mset(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     char *response = NULL;
     int items = 0;
     int arridx = -1;
+    cJSON *key = NULL;
+    cJSON *value = NULL;
+    leveldb_writebatch_t *puts = NULL;
+
+    *batch = NULL;
 
     /* buffer containing data from client */
     evbuf_t *buffer_in = req->buffer_in;
@@ -896,39 +1035,9 @@ _rpc_do_mset(evhttpx_request_t *req, reveldb_t *db, bool quiet)
 
     keys = cJSON_GetObjectItem(root, "keys");
     values = cJSON_GetObjectItem(root, "values");
-    if (keys != NULL && values != NULL) {
-        if ((items = cJSON_GetArraySize(keys)) != cJSON_GetArraySize(values)) {
-            if (quiet == false) {
-                response = _rpc_jsonfy_response_on_error(
-                        req, EVHTTPX_RES_BADREQ, "Bad Request",
-                        "Keys and values does not equal.");
-            } else {
-                response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_BADREQ);
-            }
-            return response;
-        }
-        for (arridx = 0; arridx < items; arridx++) {
-            char *key = cJSON_GetArrayItem(keys, arridx)->valuestring;
-            char *value = cJSON_GetArrayItem(values, arridx)->valuestring;
-            leveldb_put(
-                    db->instance->db,
-                    db->instance->woptions,
-                    key, strlen(key),
-                    value, strlen(value),
-                    &(db->instance->err));
-            if (db->instance->err != NULL) {
-                if (quiet == false) {
-                    response = _rpc_jsonfy_response_on_error(req,
-                            EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
-                } else {
-                    response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                            "Internal Server Error", db->instance->err);
-                }
-                xleveldb_reset_err(db->instance);
-                return response;
-            }
-        }
-    } else {
+    if (keys == NULL || values == NULL
+            || _rpc_json_strings_check(keys) == false
+            || _rpc_json_strings_check(values) == false) {
         if (quiet == false) {
             response = _rpc_jsonfy_response_on_error(req, EVHTTPX_RES_BADREQ,
                     "Bad Request", "Invalid post filed format.");
@@ -937,6 +1046,26 @@ _rpc_do_mset(evhttpx_request_t *req, reveldb_t *db, bool quiet)
         }
         return response;
     }
+    if ((items = cJSON_GetArraySize(keys)) != cJSON_GetArraySize(values)) {
+        if (quiet == false) {
+            response = _rpc_jsonfy_response_on_error(
+                    req, EVHTTPX_RES_BADREQ, "Bad Request",
+                    "Keys and values does not equal.");
+        } else {
+            response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_BADREQ);
+        }
+        return response;
+    }
+
+    /* all or none of the pairs are written. */
+    puts = leveldb_writebatch_create();
+    for (arridx = 0, key = keys->child, value = values->child;
+            arridx < items; arridx++, key = key->next, value = value->next) {
+        leveldb_writebatch_put(puts, key->valuestring, strlen(key->valuestring),
+                value->valuestring, strlen(value->valuestring));
+    }
+    /* the caller commits it, the reply goes out once it is written. */
+    *batch = puts;
 
     if (quiet == false) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
@@ -948,7 +1077,8 @@ _rpc_do_mset(evhttpx_request_t *req, reveldb_t *db, bool quiet)
 }
 
 static char *
-_rpc_do_mdel(evhttpx_request_t *req, reveldb_t *db, bool quiet)
+_rpc_do_mdel(evhttpx_request_t *req, reveldb_t *db, bool quiet,
+        leveldb_writebatch_t **batch)
 {
     assert(req != NULL);
     cJSON *root = NULL;
@@ -956,6 +1086,10 @@ _rpc_do_mdel(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     char *response = NULL;
     int items = 0;
     int arridx = -1;
+    cJSON *item = NULL;
+    leveldb_writebatch_t *deletes = NULL;
+
+    *batch = NULL;
 
     /* buffer containing data from client */
     evbuf_t *buffer_in = req->buffer_in;
@@ -975,28 +1109,7 @@ _rpc_do_mdel(evhttpx_request_t *req, reveldb_t *db, bool quiet)
     }
 
     keys = cJSON_GetObjectItem(root, "keys");
-    if (keys != NULL) {
-        items = cJSON_GetArraySize(keys);
-        for (arridx = 0; arridx < items; arridx++) {
-            char *key = cJSON_GetArrayItem(keys, arridx)->valuestring;
-            leveldb_delete(
-                    db->instance->db,
-                    db->instance->woptions,
-                    key, strlen(key),
-                    &(db->instance->err));
-            if (db->instance->err != NULL) {
-                if (quiet == false) {
-                    response = _rpc_jsonfy_response_on_error(req,
-                            EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
-                } else {
-                    response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                            "Internal Server Error", db->instance->err);
-                }
-                xleveldb_reset_err(db->instance);
-                return response;
-            }
-        }
-    } else {
+    if (keys == NULL || _rpc_json_strings_check(keys) == false) {
         if (quiet == false) {
             response = _rpc_jsonfy_response_on_error(req, EVHTTPX_RES_BADREQ,
                     "Bad Request", "Invalid post filed format.");
@@ -1005,29 +1118,430 @@ _rpc_do_mdel(evhttpx_request_t *req, reveldb_t *db, bool quiet)
         }
         return response;
     }
+    items = cJSON_GetArraySize(keys);
+
+    /* all or none of the keys are deleted. */
+    deletes = leveldb_writebatch_create();
+    for (arridx = 0, item = keys->child;
+            arridx < items; arridx++, item = item->next) {
+        char *key = item->valuestring;
+        leveldb_writebatch_delete(deletes, key, strlen(key));
+    }
+    /* the caller commits it, the reply goes out once it is written. */
+    *batch = deletes;
 
     if (quiet == false) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                "OK", "Multiple set done.");
+                "OK", "Multiple delete done.");
     } else {
         response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
     return response;
 }
 
+static void
+_rpc_free_value(const void *data, size_t datalen, void *extra)
+{
+    leveldb_free((void *)data);
+}
+
+/* sends value as the body without copying it, the buffer leveldb returned
+ * is referenced by the output and freed once it has been written out. */
+static void
+_rpc_send_raw_reply(evhttpx_request_t *req,
+        char *value, size_t value_len)
+{
+    if (req == NULL) return;
+    if (value_len == 0) {
+        leveldb_free(value);
+    } else if (evbuffer_add_reference(req->buffer_out, value, value_len,
+                _rpc_free_value, NULL) < 0) {
+        leveldb_free(value);
+        evhttpx_send_reply(req, EVHTTPX_RES_SERVERR);
+        return;
+    }
+    evhttpx_headers_add_header(req->headers_out,
+            evhttpx_header_new("Content-Type",
+                "application/octet-stream", 0, 0));
+    evhttpx_send_reply(req, EVHTTPX_RES_OK);
+    return;
+}
+
 static void
 _rpc_send_reply(evhttpx_request_t *req,
         char *response, unsigned int code)
 {
     if (req == NULL) return;
     if (response != NULL) {
+        /* storage jobs reply from the loop owning the connection. */
+        if (reveldb_executor_reply(req, response, code) == 0) return;
         evbuffer_add_printf(req->buffer_out, "%s", response);
+        /* cJSON output lives in the request arena, hand-rolled
+         * responses are heap allocated. */
+        evhttpx_arena_release(evhttpx_request_get_arena(req), response);
         evhttpx_send_reply(req, code);
-        free(response);
     }
     return;
 }
 
+/* reply to a write, sent once the write has been committed. */
+typedef struct rpc_write_s_ {
+    bool quiet;
+    char *response;
+    unsigned int code;
+} rpc_write_t;
+
+static void
+_rpc_write_done(evhttpx_request_t *req, const char *err, void *arg)
+{
+    rpc_write_t *write = (rpc_write_t *)arg;
+    char *response = write->response;
+    unsigned int code = write->code;
+
+    if (req == NULL) {
+        /* the client went away. */
+        evhttpx_arena_release(evhttpx_arena_get_current(), response);
+        free(write);
+        return;
+    }
+    if (err != NULL) {
+        evhttpx_arena_release(evhttpx_request_get_arena(req), response);
+        if (write->quiet == false) {
+            response = _rpc_jsonfy_response_on_error(req,
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
+        } else {
+            response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                    "Internal Server Error", err);
+        }
+        code = EVHTTPX_RES_SERVERR;
+    }
+    free(write);
+    _rpc_send_reply(req, response, code);
+}
+
+/* hands batch over to the group committer, response is sent once the
+ * batch is as durable as asked for. */
+static void
+_rpc_commit(evhttpx_request_t *req,
+        reveldb_committer_t *committer, reveldb_t *db,
+        leveldb_writebatch_t *batch, reveldb_durability_t durability,
+        bool is_quiet, char *response, unsigned int code)
+{
+    rpc_write_t *write = (rpc_write_t *)malloc(sizeof(rpc_write_t));
+
+    if (write == NULL) {
+        LOG_ERROR(("failed to malloc rpc_write_t."));
+        leveldb_writebatch_destroy(batch);
+        evhttpx_arena_release(evhttpx_request_get_arena(req), response);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
+    write->quiet = is_quiet;
+    write->response = response;
+    write->code = code;
+    reveldb_committer_write(committer, req, db, batch,
+            durability, _rpc_write_done, write);
+}
+
+/* a read-modify-write of key, read and written by the committer so that
+ * no other write to key comes in between. */
+typedef struct rpc_update_s_ {
+    rpc_write_t write; /* first, _rpc_write_done frees the update with it. */
+    evhttpx_request_t *req;
+    const char *key; /* copied right after the update, the query of req
+                        may go away before the committer gets to it. */
+    const char *value;
+    const char *oval;
+    long long step;
+    uint32_t pos;
+} rpc_update_t;
+
+/* the reply to an update which is not going to write anything. */
+static void
+_rpc_update_reply_error(rpc_update_t *update,
+        unsigned int code, const char *status, const char *message)
+{
+    if (update->write.quiet == false) {
+        update->write.response = _rpc_jsonfy_response_on_error(update->req,
+                code, status, message);
+    } else {
+        update->write.response = _rpc_jsonfy_general_response(code,
+                status, message);
+    }
+    update->write.code = code;
+}
+
+static void
+_rpc_update_reply_ok(rpc_update_t *update, const char *message)
+{
+    if (update->write.quiet == false) {
+        update->write.response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
+                "OK", message);
+    } else {
+        update->write.response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
+    }
+    update->write.code = EVHTTPX_RES_OK;
+}
+
+/* hands the update fn describes over to the committer, the reply fn
+ * decides on is sent once its write is as durable as asked for. */
+static void
+_rpc_update(evhttpx_request_t *req,
+        reveldb_committer_t *committer, reveldb_t *db,
+        reveldb_durability_t durability,
+        reveldb_committer_update_cb fn, const rpc_update_t *params)
+{
+    char *response = NULL;
+    size_t key_len = strlen(params->key) + 1;
+    size_t value_len = (params->value != NULL) ? strlen(params->value) + 1 : 0;
+    size_t oval_len = (params->oval != NULL) ? strlen(params->oval) + 1 : 0;
+    rpc_update_t *update = (rpc_update_t *)malloc(sizeof(rpc_update_t)
+            + key_len + value_len + oval_len);
+    char *strings = NULL;
+
+    if (update == NULL) {
+        LOG_ERROR(("failed to malloc rpc_update_t."));
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
+    strings = (char *)(update + 1);
+    memcpy(update, params, sizeof(rpc_update_t));
+    update->req = req;
+    update->key = memcpy(strings, params->key, key_len);
+    if (params->value != NULL) {
+        update->value = memcpy(strings + key_len, params->value, value_len);
+    }
+    if (params->oval != NULL) {
+        update->oval = memcpy(strings + key_len + value_len,
+                params->oval, oval_len);
+    }
+    reveldb_committer_update(committer, req, db,
+            update->key, strlen(update->key), fn,
+            durability, _rpc_write_done, &update->write);
+}
+
+/* adds step to the number stored at key. */
+static int
+_rpc_update_step(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, rpc_update_t *update,
+        long long step, const char *message)
+{
+    char *err = NULL;
+    char *value = NULL;
+    size_t value_len = 0;
+    long long llvalue = -1;
+    char valuebuf[64] = {0};
+
+    value = xleveldb_get(instance, instance->roptions,
+            update->key, strlen(update->key), &value_len, &err);
+    _rpc_reset_err(&err);
+    if (value == NULL) {
+        _rpc_update_reply_error(update, EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Key value pair not found.");
+        return 0;
+    }
+    if (!safe_strntoll(value, value_len, &llvalue)) {
+        free(value);
+        _rpc_update_reply_error(update, EVHTTPX_RES_BADREQ, "Bad Request",
+                "Value is not numerical, incr is not allowed.");
+        return 0;
+    }
+    free(value);
+
+    llvalue += step;
+    sprintf(valuebuf, "%lld", llvalue);
+    leveldb_writebatch_put(batch, update->key, strlen(update->key),
+            valuebuf, strlen(valuebuf));
+    _rpc_update_reply_ok(update, message);
+    return 1;
+}
+
+static int
+_rpc_update_incr(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, void *arg)
+{
+    rpc_update_t *update = (rpc_update_t *)arg;
+
+    return _rpc_update_step(instance, batch, update,
+            update->step, "Incr value done.");
+}
+
+static int
+_rpc_update_decr(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, void *arg)
+{
+    rpc_update_t *update = (rpc_update_t *)arg;
+
+    return _rpc_update_step(instance, batch, update,
+            -update->step, "Decr value done.");
+}
+
+typedef enum {
+    RPC_SPLICE_APPEND = 0,
+    RPC_SPLICE_PREPEND,
+    RPC_SPLICE_INSERT,
+    RPC_SPLICE_REPLACE,
+} rpc_splice_t;
+
+/* puts value into the one stored at key as how says. */
+static int
+_rpc_update_splice(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, rpc_update_t *update,
+        rpc_splice_t how, const char *message)
+{
+    char *err = NULL;
+    char *value_old = NULL;
+    tstring_t *value_new = NULL;
+    size_t value_old_len = 0;
+
+    value_old = xleveldb_get(instance, instance->roptions,
+            update->key, strlen(update->key), &value_old_len, &err);
+    _rpc_reset_err(&err);
+    if (value_old == NULL) {
+        _rpc_update_reply_error(update, EVHTTPX_RES_NOTFOUND, "Not Found",
+                (how == RPC_SPLICE_REPLACE) ?
+                "Key value pair not found." : "Key not found.");
+        return 0;
+    }
+
+    switch (how) {
+        case RPC_SPLICE_APPEND:
+            value_new = tstring_new_len(value_old, value_old_len);
+            tstring_append_len(value_new, update->value, strlen(update->value));
+            break;
+        case RPC_SPLICE_PREPEND:
+            value_new = tstring_new_len(value_old, value_old_len);
+            tstring_prepend_len(value_new, update->value, strlen(update->value));
+            break;
+        case RPC_SPLICE_INSERT:
+            value_new = tstring_new_len(value_old, value_old_len);
+            tstring_insert_len(value_new, update->pos,
+                    update->value, strlen(update->value));
+            break;
+        case RPC_SPLICE_REPLACE:
+            value_new = tstring_new_len(update->value, strlen(update->value));
+            break;
+    }
+    leveldb_writebatch_put(batch, update->key, strlen(update->key),
+            tstring_data(value_new), tstring_size(value_new));
+    leveldb_free(value_old);
+    tstring_free(value_new);
+    _rpc_update_reply_ok(update, message);
+    return 1;
+}
+
+static int
+_rpc_update_append(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, void *arg)
+{
+    return _rpc_update_splice(instance, batch, (rpc_update_t *)arg,
+            RPC_SPLICE_APPEND, "Append value done.");
+}
+
+static int
+_rpc_update_prepend(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, void *arg)
+{
+    return _rpc_update_splice(instance, batch, (rpc_update_t *)arg,
+            RPC_SPLICE_PREPEND, "Prepend value done.");
+}
+
+static int
+_rpc_update_insert(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, void *arg)
+{
+    return _rpc_update_splice(instance, batch, (rpc_update_t *)arg,
+            RPC_SPLICE_INSERT, "Insert value done.");
+}
+
+static int
+_rpc_update_replace(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, void *arg)
+{
+    return _rpc_update_splice(instance, batch, (rpc_update_t *)arg,
+            RPC_SPLICE_REPLACE, "Replace value done.");
+}
+
+/* swaps the value stored at key for value if it is still oval. */
+static int
+_rpc_update_cas(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, void *arg)
+{
+    rpc_update_t *update = (rpc_update_t *)arg;
+    const char *key = update->key;
+    char *err = NULL;
+    char *value = NULL;
+    size_t value_len = 0;
+
+    value = xleveldb_get(instance, instance->roptions,
+            key, strlen(key), &value_len, &err);
+    _rpc_reset_err(&err);
+    if (value == NULL) {
+        _rpc_update_reply_error(update, EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Key not found.");
+        return 0;
+    }
+    if (value_len != strlen(update->oval) ||
+            strncmp(value, update->oval, value_len) != 0) {
+        free(value);
+        _rpc_update_reply_error(update, EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Value not found.");
+        return 0;
+    }
+
+    leveldb_writebatch_put(batch, key, strlen(key),
+            update->value, strlen(update->value));
+    if (update->write.quiet == false) {
+        update->write.response = _rpc_jsonfy_response_on_kv_with_len(
+                key, strlen(key), value, value_len);
+    } else {
+        update->write.response = _rpc_jsonfy_quiet_response_on_kv_with_len(
+                key, strlen(key), value, value_len);
+    }
+    update->write.code = EVHTTPX_RES_OK;
+    free(value);
+    return 1;
+}
+
+/* deletes key, replying with the value it had. */
+static int
+_rpc_update_seize(xleveldb_instance_t *instance,
+        leveldb_writebatch_t *batch, void *arg)
+{
+    rpc_update_t *update = (rpc_update_t *)arg;
+    const char *key = update->key;
+    char *err = NULL;
+    char *value = NULL;
+    size_t value_len = 0;
+
+    value = xleveldb_get(instance, instance->roptions,
+            key, strlen(key), &value_len, &err);
+    _rpc_reset_err(&err);
+    if (value == NULL) {
+        _rpc_update_reply_error(update, EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Key value pair not found.");
+        return 0;
+    }
+
+    leveldb_writebatch_delete(batch, key, strlen(key));
+    if (update->write.quiet == false) {
+        update->write.response = _rpc_jsonfy_msgalt_response_on_kv_with_len(
+                key, strlen(key), value, value_len,
+                "Seize key value pair OK, but note that "
+                "you have just deleted the pair on reveldb server");
+    } else {
+        update->write.response = _rpc_jsonfy_quiet_response_on_kv_with_len(
+                key, strlen(key), value, value_len);
+    }
+    update->write.code = EVHTTPX_RES_OK;
+    free(value);
+    return 1;
+}
+
 static void 
 URI_rpc_void_cb(evhttpx_request_t *req, void *userdata)
 {
@@ -1054,7 +1568,7 @@ URI_rpc_echo_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
-    char *now = NULL;
+    char now[GMTTIME_LEN];
     char *response = NULL;
     cJSON *root = NULL;
     cJSON *request = NULL;
@@ -1069,7 +1583,7 @@ URI_rpc_echo_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    now = gmttime_now();
+    gmttime_now_r(now, sizeof(now));
 
     root = cJSON_CreateObject();
     cJSON_AddNumberToObject(root, "code", EVHTTPX_RES_OK);
@@ -1087,7 +1601,6 @@ URI_rpc_echo_cb(evhttpx_request_t *req, void *userdata)
     response = cJSON_PrintUnformatted(root);
 
     cJSON_Delete(root);
-    free(now);
 
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
     return;
@@ -1119,10 +1632,117 @@ static void
 URI_rpc_report_cb(evhttpx_request_t *req, void *userdata)
 {}
 
-static void
-URI_rpc_status_cb(evhttpx_request_t *req, void *userdata)
-{}
-
+static int
+_rpc_jsonfy_db_status(reveldb_t *db, void *arg)
+{
+    cJSON *databases = (cJSON *)arg;
+    cJSON *status = cJSON_CreateObject();
+    char *memory = NULL;
+    uint64_t reads = 0;
+    uint64_t misses = 0;
+    uint64_t hits = 0;
+    unsigned int k = 0;
+
+    /* lookups are counted by the shard they go to. */
+    for (k = 0; k < db->instance->nshards; k++) {
+        xleveldb_instance_t *shard = db->instance->shards[k];
+        reads += __sync_add_and_fetch(&shard->reads, 0);
+        misses += __sync_add_and_fetch(&shard->misses, 0);
+        hits += __sync_add_and_fetch(&shard->hits, 0);
+    }
+    cJSON_AddNumberToObject(status, "reads", reads);
+    cJSON_AddNumberToObject(status, "misses", misses);
+    cJSON_AddNumberToObject(status, "hits", hits);
+    cJSON_AddNumberToObject(status, "shards", db->instance->nshards);
+    cJSON_AddStringToObject(status, "comparator",
+            xleveldb_comparator_name(db->instance->order));
+    /* memtables plus the shared block cache, older leveldb lacks it. */
+    memory = xleveldb_property_value(db->instance,
+            "leveldb.approximate-memory-usage");
+    if (memory != NULL) {
+        cJSON_AddNumberToObject(status, "memory", strtod(memory, NULL));
+        free(memory);
+    }
+    cJSON_AddItemToObject(databases, db->dbname, status);
+    return 0;
+}
+
+static char *
+_rpc_jsonfy_status_response(reveldb_t *db, bool is_quiet)
+{
+    char *out = NULL;
+    char now[GMTTIME_LEN];
+    vcache_stats_t stats;
+    gmttime_now_r(now, sizeof(now));
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *cache = cJSON_CreateObject();
+    cJSON *databases = cJSON_CreateObject();
+
+    if (is_quiet == false) {
+        cJSON_AddNumberToObject(root, "code", EVHTTPX_RES_OK);
+        cJSON_AddStringToObject(root, "status", "OK");
+        cJSON_AddStringToObject(root, "message", "Reveldb statistics.");
+        cJSON_AddStringToObject(root, "date", now);
+    }
+    cJSON_AddItemToObject(root, "cache", cache);
+    cJSON_AddNumberToObject(cache, "capacity", xleveldb_cache_capacity());
+    if (xleveldb_value_cache_stats(&stats) == 0) {
+        cJSON *values = cJSON_CreateObject();
+        cJSON_AddItemToObject(root, "values", values);
+        cJSON_AddNumberToObject(values, "capacity", stats.capacity);
+        cJSON_AddNumberToObject(values, "usage", stats.usage);
+        cJSON_AddNumberToObject(values, "entries", stats.entries);
+        cJSON_AddNumberToObject(values, "hits", stats.hits);
+        cJSON_AddNumberToObject(values, "misses", stats.misses);
+        cJSON_AddNumberToObject(values, "hit_ratio",
+                (stats.hits + stats.misses > 0) ?
+                (double)stats.hits / (stats.hits + stats.misses) : 0);
+    }
+    cJSON_AddItemToObject(root, "databases", databases);
+    if (db != NULL) _rpc_jsonfy_db_status(db, databases);
+    else reveldb_foreach_db(&reveldb, _rpc_jsonfy_db_status, databases);
+    out = cJSON_PrintUnformatted(root);
+
+    cJSON_Delete(root);
+    return out;
+}
+
+static void
+URI_rpc_status_cb(evhttpx_request_t *req, void *userdata)
+{
+    /* json formatted response. */
+    unsigned int code = 0;
+    bool is_quiet = false;
+    char *response = NULL;
+    const char *dbname = NULL;
+    reveldb_t *db = NULL;
+
+    response = _rpc_proto_and_method_sanity_check(req, &code);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, code);
+        return;
+    }
+
+    is_quiet = _rpc_query_quiet_check(req);
+
+    /* every database unless one is asked for. */
+    _rpc_query_database_check(req, &dbname);
+    if (dbname != NULL) {
+        db = reveldb_request_db(&reveldb, req, dbname);
+        if (db == NULL) {
+            response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                    "Not Found", "Database not found, please check.");
+            _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+            return;
+        }
+    }
+
+    response = _rpc_jsonfy_status_response(db, is_quiet);
+    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    return;
+}
+
 static void
 URI_rpc_property_cb(evhttpx_request_t *req, void *userdata)
 {
@@ -1162,7 +1782,7 @@ URI_rpc_property_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1170,8 +1790,8 @@ URI_rpc_property_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
    
-    content = leveldb_property_value(
-            db->instance->db,
+    content = xleveldb_property_value(
+            db->instance,
             property);
     if (content != NULL) {
         if (is_quiet == false) {
@@ -1205,6 +1825,11 @@ URI_rpc_new_cb(evhttpx_request_t *req, void *userdata)
     unsigned int code = 0;
     bool is_quiet = false;
     const char *dbname = NULL;
+    const char *bloom_bits_per_key = NULL;
+    const char *shards = NULL;
+    const char *comparator = NULL;
+    reveldb_config_t config = *reveldb_config;
+    reveldb_db_config_t db_config = *reveldb_config->db_config;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -1221,9 +1846,49 @@ URI_rpc_new_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
+    /* engine options given along override the configured ones. */
+    bloom_bits_per_key = evhttpx_kv_find(req->uri->query,
+            "bloom_bits_per_key");
+    if ((bloom_bits_per_key != NULL)
+            && !safe_strtoul(bloom_bits_per_key,
+                &db_config.bloom_bits_per_key)) {
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Bloom bits per key should be a non-negative integer.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+    shards = evhttpx_kv_find(req->uri->query, "shards");
+    if ((shards != NULL)
+            && (!safe_strtoul(shards, &db_config.shards)
+                || db_config.shards > XLEVELDB_MAX_SHARDS)) {
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Shards should be an integer between 0 and 256.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+    comparator = evhttpx_kv_find(req->uri->query, "comparator");
+    if (comparator != NULL) {
+        if (xleveldb_comparator_parse(comparator) < 0) {
+            response = _rpc_jsonfy_response_on_error(req,
+                    EVHTTPX_RES_BADREQ, "Bad Request",
+                    "Comparator should be one of bytewise, "
+                    "reverse-bytewise, uint64 and int64.");
+            _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+            return;
+        }
+        db_config.comparator = (char *)comparator;
+    }
+    config.db_config = &db_config;
+
     /* init new leveldb instance and insert it into reveldb. */
-    reveldb_t *db = reveldb_init(dbname, reveldb_config);
-    reveldb_insert_db(&reveldb, db);
+    reveldb_t *db = reveldb_init(dbname, &config);
+    if (db != NULL && reveldb_insert_db(&reveldb, db) == 0) {
+        /* one of that name is open already, which is all that was asked. */
+        reveldb_free_db(db);
+        db = reveldb_request_db(&reveldb, req, dbname);
+    }
 
     if (db != NULL) {
         if (is_quiet == true) {
@@ -1241,15 +1906,43 @@ URI_rpc_new_cb(evhttpx_request_t *req, void *userdata)
     return;
 }
 
+static char *
+_rpc_jsonfy_response_on_compaction(const char *uuid)
+{
+    assert(uuid != NULL);
+    char *out = NULL;
+    char now[GMTTIME_LEN];
+    gmttime_now_r(now, sizeof(now));
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *job = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(root, "code", EVHTTPX_RES_OK);
+    cJSON_AddStringToObject(root, "status", "OK");
+    cJSON_AddStringToObject(root, "message", "Range compaction submitted.");
+    cJSON_AddStringToObject(root, "date", now);
+    cJSON_AddItemToObject(root, "job", job);
+    cJSON_AddStringToObject(job, "id", uuid);
+    /* unformatted json has less data. */
+    out = cJSON_PrintUnformatted(root);
+
+    cJSON_Delete(root);
+    return out;
+}
+
 static void
 URI_rpc_compact_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
     bool is_quiet = false;
+    afsUUID id;
+    char uuid_str[64] = {0};
     char *response = NULL;
     const char *start_key = NULL;
     const char *end_key = NULL;
+    const char *rate_str = NULL;
+    uint64_t rate = 0;
     const char *dbname = NULL;
     evhttpx_query_t *query = req->uri->query;
 
@@ -1263,27 +1956,176 @@ URI_rpc_compact_cb(evhttpx_request_t *req, void *userdata)
 
     start_key = evhttpx_kv_find(query, "start");
     end_key = evhttpx_kv_find(query, "end");
+    rate_str = evhttpx_kv_find(query, "rate");
     dbname = evhttpx_kv_find(query, "db");
 
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
         return;
     }
-   
-    /* do compaction. */
-    leveldb_compact_range(
-            db->instance->db,
-            start_key, (start_key ? strlen(start_key) : 0),
-            end_key, (end_key ? strlen(end_key) : 0));
+
+    /* bytes per second, the configured rate applies if not given. */
+    if (rate_str != NULL && safe_strtoull(rate_str, &rate) == false) {
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Rate should be a number of bytes per second.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
+    /* the compaction goes on in the background, the job id tells how far
+     * it got in /rpc/compact/status. */
+    uuid_create(&id);
+    uuid_to_string(&id, uuid_str, sizeof(uuid_str));
+    if (reveldb_compactor_submit((reveldb_compactor_t *)userdata,
+                uuid_str, db,
+                start_key, (start_key ? strlen(start_key) : 0),
+                end_key, (end_key ? strlen(end_key) : 0), rate) != 0) {
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_SERVERR, "Internal Server Error",
+                "Failed to submit range compaction.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
+
+    if (is_quiet == false) {
+        response = _rpc_jsonfy_response_on_compaction(uuid_str);
+    } else {
+        response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
+    }
+    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    return;
+}
+
+static void
+_rpc_jsonfy_compaction(const reveldb_compaction_t *job, void *arg)
+{
+    static const char *states[] = {
+        "queued", "running", "done", "cancelled"
+    };
+    cJSON *jobs = (cJSON *)arg;
+    cJSON *status = cJSON_CreateObject();
+    double progress = 0;
+
+    if (job->state == REVELDB_COMPACTION_DONE) progress = 1;
+    else if (job->bytes > 0) progress = (double)job->bytes_done / job->bytes;
+    else if (job->ranges > 0) {
+        progress = (double)job->ranges_done / job->ranges;
+    }
+
+    cJSON_AddStringToObject(status, "id", job->id);
+    cJSON_AddStringToObject(status, "db", job->dbname);
+    cJSON_AddStringToObject(status, "state", states[job->state]);
+    cJSON_AddNumberToObject(status, "progress", progress);
+    cJSON_AddNumberToObject(status, "ranges", job->ranges);
+    cJSON_AddNumberToObject(status, "ranges_done", job->ranges_done);
+    cJSON_AddNumberToObject(status, "bytes", job->bytes);
+    cJSON_AddNumberToObject(status, "bytes_done", job->bytes_done);
+    cJSON_AddNumberToObject(status, "rate", job->rate);
+    cJSON_AddNumberToObject(status, "submitted", job->submitted);
+    if (job->started > 0) {
+        cJSON_AddNumberToObject(status, "started", job->started);
+    }
+    if (job->finished > 0) {
+        cJSON_AddNumberToObject(status, "finished", job->finished);
+    }
+    cJSON_AddItemToArray(jobs, status);
+}
+
+static void
+URI_rpc_compact_status_cb(evhttpx_request_t *req, void *userdata)
+{
+    /* json formatted response. */
+    unsigned int code = 0;
+    bool is_quiet = false;
+    char *response = NULL;
+    const char *job_id = NULL;
+    char now[GMTTIME_LEN];
+    cJSON *root = NULL;
+    cJSON *jobs = NULL;
+
+    response = _rpc_proto_and_method_sanity_check(req, &code);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, code);
+        return;
+    }
+
+    is_quiet = _rpc_query_quiet_check(req);
+
+    /* every job kept around unless one is asked for. */
+    job_id = evhttpx_kv_find(req->uri->query, "job");
+
+    root = cJSON_CreateObject();
+    jobs = cJSON_CreateArray();
+    if (reveldb_compactor_foreach((reveldb_compactor_t *)userdata,
+                job_id, _rpc_jsonfy_compaction, jobs) == 0
+            && job_id != NULL) {
+        cJSON_Delete(jobs);
+        cJSON_Delete(root);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Compaction not found, please check.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
+    }
+
+    if (is_quiet == false) {
+        gmttime_now_r(now, sizeof(now));
+        cJSON_AddNumberToObject(root, "code", EVHTTPX_RES_OK);
+        cJSON_AddStringToObject(root, "status", "OK");
+        cJSON_AddStringToObject(root, "message", "Range compaction status.");
+        cJSON_AddStringToObject(root, "date", now);
+    }
+    cJSON_AddItemToObject(root, "jobs", jobs);
+    response = cJSON_PrintUnformatted(root);
+
+    cJSON_Delete(root);
+    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    return;
+}
+
+static void
+URI_rpc_compact_cancel_cb(evhttpx_request_t *req, void *userdata)
+{
+    /* json formatted response. */
+    unsigned int code = 0;
+    bool is_quiet = false;
+    char *response = NULL;
+    const char *job_id = NULL;
+    int ret = 0;
+
+    response = _rpc_proto_and_method_sanity_check(req, &code);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, code);
+        return;
+    }
+
+    is_quiet = _rpc_query_quiet_check(req);
+
+    response = _rpc_query_param_sanity_check(req, &job_id, "job",
+            "Compaction job ID must be specified.");
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
+    ret = reveldb_compactor_cancel((reveldb_compactor_t *)userdata, job_id);
+    if (ret < 0) {
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Compaction not found, please check.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
+    }
 
     if (is_quiet == false) {
-        response = _rpc_jsonfy_general_response(
-                EVHTTPX_RES_OK, "OK", "Range compaction done.");
+        /* a running job stops once its current sub-range is done. */
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK, "OK",
+                (ret == 0) ? "Range compaction cancelled." :
+                "Range compaction already finished.");
     } else {
         response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
@@ -1331,7 +2173,7 @@ URI_rpc_size_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1342,12 +2184,10 @@ URI_rpc_size_cb(evhttpx_request_t *req, void *userdata)
     start_key_len = strlen(start_key);
     limit_key_len = strlen(limit_key);
    
-    leveldb_approximate_sizes(
-            db->instance->db,
-            1,
-            &start_key, &start_key_len,
-            &limit_key, &limit_key_len,
-            &size);
+    size = xleveldb_approximate_size(
+            db->instance,
+            start_key, start_key_len,
+            limit_key, limit_key_len);
     response = _rpc_jsonfy_size_response(
             start_key, limit_key, size, is_quiet);
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
@@ -1355,10 +2195,11 @@ URI_rpc_size_cb(evhttpx_request_t *req, void *userdata)
 }
 
 static void
-URI_rpc_repair_cb(evhttpx_request_t *req, void *userdata)
+_rpc_repair_job(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     bool is_quiet = false;
     char *response = NULL;
     const char *dbname = NULL;
@@ -1372,7 +2213,7 @@ URI_rpc_repair_cb(evhttpx_request_t *req, void *userdata)
     is_quiet = _rpc_query_quiet_check(req);
 
     _rpc_query_database_check(req, &dbname);
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1380,31 +2221,19 @@ URI_rpc_repair_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    char *datadir = reveldb_config->server_config->datadir;
-    tstring_t *fullpath = tstring_new(datadir);
-
-    if (tstring_data(fullpath)[tstring_size(fullpath) - 1] == '/')
-        tstring_append(fullpath, dbname);
-    else {
-        tstring_append(fullpath, "/");
-        tstring_append(fullpath, dbname); 
-    }
-
-    leveldb_repair_db(db->instance->options,
-            tstring_data(fullpath),
-            &(db->instance->err));
-   if (db->instance->err != NULL) {
+    xleveldb_instance_repair(db->instance, &err);
+   if (err != NULL) {
         if (is_quiet == false ) {
         response = _rpc_jsonfy_response_on_error(req,
                 EVHTTPX_RES_SERVERR, 
                 "Internal Server Error",
-                db->instance->err);
+                err);
         } else {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR, 
                 "Internal Server Error",
-                db->instance->err);
+                err);
         }
-        xleveldb_reset_err(db->instance);
+        _rpc_reset_err(&err);
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
@@ -1414,17 +2243,25 @@ URI_rpc_repair_cb(evhttpx_request_t *req, void *userdata)
         }
     }
 
-    tstring_free(fullpath);
-
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    _rpc_reset_err(&err);
     return;
 }
 
+static void
+URI_rpc_repair_cb(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_executor_submit((reveldb_executor_t *)userdata,
+            req, _rpc_repair_job, NULL);
+}
+
 static void
 URI_rpc_destroy_cb(evhttpx_request_t *req, void *userdata)
 {
+    reveldb_rpc_t *rpc = (reveldb_rpc_t *)userdata;
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     bool is_quiet = false;
     char *response = NULL;
     const char *dbname = NULL;
@@ -1452,34 +2289,26 @@ URI_rpc_destroy_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
     
-    char *datadir = reveldb_config->server_config->datadir;
-    tstring_t *fullpath = tstring_new(datadir);
-
-    if (tstring_data(fullpath)[tstring_size(fullpath) - 1] == '/')
-        tstring_append(fullpath, dbname);
-    else {
-        tstring_append(fullpath, "/");
-        tstring_append(fullpath, dbname); 
-    }
-
-    leveldb_close(db->instance->db);
-    leveldb_destroy_db(db->instance->options,
-            tstring_data(fullpath),
-            &(db->instance->err));
-   if (db->instance->err != NULL) {
+    /* queued compactions would keep it open for nothing, a running one
+     * is only told to stop. */
+    reveldb_compactor_forget(rpc->compactor, db);
+    /* the files go right away unless a request, stream, iterator, queued
+     * write or running compaction still holds it, in which case the last
+     * one to let go removes them. */
+    reveldb_destroy_db(&reveldb, db, &err);
+   if (err != NULL) {
         if (is_quiet == false ) {
         response = _rpc_jsonfy_response_on_error(req,
                 EVHTTPX_RES_SERVERR, 
                 "Internal Server Error",
-                db->instance->err);
+                err);
         } else {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR, 
                 "Internal Server Error",
-                db->instance->err);
+                err);
         }
-        xleveldb_reset_err(db->instance);
+        _rpc_reset_err(&err);
     } else {
-        rb_erase(&(db->node), &reveldb);
         // reveldb_free_db(db);
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
@@ -1488,8 +2317,8 @@ URI_rpc_destroy_cb(evhttpx_request_t *req, void *userdata)
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
         }
     }
-    tstring_free(fullpath);
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    _rpc_reset_err(&err);
     return;
 }
 
@@ -1498,6 +2327,8 @@ URI_rpc_add_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    leveldb_writebatch_t *batch = NULL;
+    reveldb_durability_t durability;
     const char *key = NULL;
     const char *value = NULL;
     const char *dbname = NULL;
@@ -1512,6 +2343,12 @@ URI_rpc_add_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "Please specify which key to add.");
     if (response != NULL) {
@@ -1529,7 +2366,7 @@ URI_rpc_add_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1537,31 +2374,17 @@ URI_rpc_add_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    leveldb_put(
-            db->instance->db,
-            db->instance->woptions,
-            key, strlen(key),
-            value, strlen(value),
-            &(db->instance->err));
-    if (db->instance->err != NULL) {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                     "Internal Server Error", db->instance->err);
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
-        xleveldb_reset_err(db->instance);
+    batch = leveldb_writebatch_create();
+    leveldb_writebatch_put(batch, key, strlen(key),
+            value, strlen(value));
+    if (is_quiet == false) {
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
+                "OK", "Set key-value pair done.");
     } else {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                    "OK", "Set key-value pair done.");
-        } else {
-            response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+        response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
+    _rpc_commit(req, (reveldb_committer_t *)userdata, db, batch,
+            durability, is_quiet, response, EVHTTPX_RES_OK);
 
     return;
 }
@@ -1571,6 +2394,8 @@ URI_rpc_set_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    leveldb_writebatch_t *batch = NULL;
+    reveldb_durability_t durability;
     const char *key = NULL;
     const char *value = NULL;
     const char *dbname = NULL;
@@ -1585,6 +2410,12 @@ URI_rpc_set_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "Please specify which key to set.");
     if (response != NULL) {
@@ -1602,7 +2433,7 @@ URI_rpc_set_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1610,31 +2441,17 @@ URI_rpc_set_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    leveldb_put(
-            db->instance->db,
-            db->instance->woptions,
-            key, strlen(key),
-            value, strlen(value),
-            &(db->instance->err));
-    if (db->instance->err != NULL) {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                     "Internal Server Error", db->instance->err);
-        }
-        xleveldb_reset_err(db->instance);
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+    batch = leveldb_writebatch_create();
+    leveldb_writebatch_put(batch, key, strlen(key),
+            value, strlen(value));
+    if (is_quiet == false) {
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
+                "OK", "Set key-value pair done.");
     } else {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                    "OK", "Set key-value pair done.");
-        } else {
-            response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+        response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
+    _rpc_commit(req, (reveldb_committer_t *)userdata, db, batch,
+            durability, is_quiet, response, EVHTTPX_RES_OK);
 
     return;
 }
@@ -1647,6 +2464,8 @@ URI_rpc_mset_cb(evhttpx_request_t *req, void *userdata)
     const char *dbname = NULL;
     bool is_quiet = false;
     char *response = NULL;
+    leveldb_writebatch_t *batch = NULL;
+    reveldb_durability_t durability;
     
     response = _rpc_proto_and_method_sanity_check2nd(req, http_method_POST, &code);
     if (response != NULL) {
@@ -1656,10 +2475,16 @@ URI_rpc_mset_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -1667,7 +2492,12 @@ URI_rpc_mset_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    response = _rpc_do_mset(req, db, is_quiet);
+    response = _rpc_do_mset(req, db, is_quiet, &batch);
+    if (batch != NULL) {
+        _rpc_commit(req, (reveldb_committer_t *)userdata, db, batch,
+                durability, is_quiet, response, EVHTTPX_RES_OK);
+        return;
+    }
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
     return;
 }
@@ -1677,14 +2507,13 @@ URI_rpc_append_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    reveldb_durability_t durability;
     bool is_quiet = false;
-    char *value_old = NULL;
-    tstring_t *value_new = NULL;
+    rpc_update_t update;
     char *response = NULL;
     const char *key = NULL;
     const char *value = NULL;
     const char *dbname = NULL;
-    unsigned int value_old_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -1694,6 +2523,12 @@ URI_rpc_append_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "Please specify which key to append.");
     if (response != NULL) {
@@ -1711,61 +2546,20 @@ URI_rpc_append_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
         return;
     }
-   
-    value_old = leveldb_get(
-            db->instance->db,
-            db->instance->roptions,
-            key, strlen(key),
-            &value_old_len,
-            &(db->instance->err));
-    if (value_old != NULL) {
-        value_new = tstring_new_len(value_old, value_old_len);
-        tstring_append_len(value_new, value, strlen(value));
-        leveldb_put(
-            db->instance->db,
-            db->instance->woptions,
-            key, strlen(key),
-            tstring_data(value_new), tstring_size(value_new),
-            &(db->instance->err));
-        if (db->instance->err != NULL) {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_response_on_error(req,
-                        EVHTTPX_RES_SERVERR, "Internal Server Error",
-                        db->instance->err);
-            } else {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                        "Internal Server Error", db->instance->err);
-            }
-        } else {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                        "OK", "Append value done.");
-            } else {
-                response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
-            }
-        } 
-        leveldb_free(value_old);
-        tstring_free(value_new);
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK);
-    } else {
-
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_NOTFOUND, "Not Found", "Key not found.");
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                     "Not Found", "Key not found.");
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-    }
 
+    memset(&update, 0, sizeof(rpc_update_t));
+    update.write.quiet = is_quiet;
+    update.key = key;
+    update.value = value;
+    _rpc_update(req, (reveldb_committer_t *)userdata, db, durability,
+            _rpc_update_append, &update);
     return;
 }
 
@@ -1774,14 +2568,13 @@ URI_rpc_prepend_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    reveldb_durability_t durability;
     bool is_quiet = false;
-    char *value_old = NULL;
-    tstring_t *value_new = NULL;
+    rpc_update_t update;
     char *response = NULL;
     const char *key = NULL;
     const char *value = NULL;
     const char *dbname = NULL;
-    unsigned int value_old_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -1791,6 +2584,12 @@ URI_rpc_prepend_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "Please specify which key to prepend");
     if (response != NULL) {
@@ -1808,61 +2607,20 @@ URI_rpc_prepend_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
         return;
     }
-   
-    value_old = leveldb_get(
-            db->instance->db,
-            db->instance->roptions,
-            key, strlen(key),
-            &value_old_len,
-            &(db->instance->err));
-    if (value_old != NULL) {
-        value_new = tstring_new_len(value_old, value_old_len);
-        tstring_prepend_len(value_new, value, strlen(value));
-        leveldb_put(
-            db->instance->db,
-            db->instance->woptions,
-            key, strlen(key),
-            tstring_data(value_new), tstring_size(value_new),
-            &(db->instance->err));
-        if (db->instance->err != NULL) {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_response_on_error(req,
-                        EVHTTPX_RES_SERVERR, "Internal Server Error",
-                        db->instance->err);
-            } else {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                        "Internal Server Error", db->instance->err);
-            }
-        } else {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                        "OK", "Prepend value done.");
-            } else {
-                response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
-            }
-        } 
-        leveldb_free(value_old);
-        tstring_free(value_new);
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK);
-    } else {
-
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_NOTFOUND, "Not Found", "Key not found.");
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                     "Not Found", "Key not found.");
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-    }
 
+    memset(&update, 0, sizeof(rpc_update_t));
+    update.write.quiet = is_quiet;
+    update.key = key;
+    update.value = value;
+    _rpc_update(req, (reveldb_committer_t *)userdata, db, durability,
+            _rpc_update_prepend, &update);
     return;
 }
 
@@ -1871,16 +2629,15 @@ URI_rpc_insert_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    reveldb_durability_t durability;
     bool is_quiet = false;
-    char *value_old = NULL;
-    tstring_t *value_new = NULL;
+    rpc_update_t update;
     char *response = NULL;
     const char *key = NULL;
     const char *value = NULL;
     const char *pos = NULL; 
     uint32_t inspos = 0;
     const char *dbname = NULL;
-    unsigned int value_old_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -1890,6 +2647,12 @@ URI_rpc_insert_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "Please specify which key to insert");
     if (response != NULL) {
@@ -1921,62 +2684,21 @@ URI_rpc_insert_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
         return;
     }
-   
-    value_old = leveldb_get(
-            db->instance->db,
-            db->instance->roptions,
-            key, strlen(key),
-            &value_old_len,
-            &(db->instance->err));
-    if (value_old != NULL) {
-        value_new = tstring_new_len(value_old, value_old_len);
-        tstring_insert_len(value_new, inspos,
-                value, strlen(value));
-        leveldb_put(
-            db->instance->db,
-            db->instance->woptions,
-            key, strlen(key),
-            tstring_data(value_new), tstring_size(value_new),
-            &(db->instance->err));
-        if (db->instance->err != NULL) {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_response_on_error(req,
-                        EVHTTPX_RES_SERVERR, "Internal Server Error",
-                        db->instance->err);
-            } else {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                        "Internal Server Error", db->instance->err);
-            }
-        } else {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                        "OK", "Insert value done.");
-            } else {
-                response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
-            }
-        } 
-        leveldb_free(value_old);
-        tstring_free(value_new);
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK);
-    } else {
-
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_NOTFOUND, "Not Found", "Key not found.");
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                     "Not Found", "Key not found.");
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-    }
 
+    memset(&update, 0, sizeof(rpc_update_t));
+    update.write.quiet = is_quiet;
+    update.key = key;
+    update.value = value;
+    update.pos = inspos;
+    _rpc_update(req, (reveldb_committer_t *)userdata, db, durability,
+            _rpc_update_insert, &update);
     return;
 }
 
@@ -1985,7 +2707,9 @@ URI_rpc_get_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     bool is_quiet = false;
+    bool is_raw = false;
     char *value = NULL;
     char *response = NULL;
     const char *key = NULL;
@@ -1993,7 +2717,7 @@ URI_rpc_get_cb(evhttpx_request_t *req, void *userdata)
     const char *snapshot_id = NULL;
     xleveldb_snapshot_t *snapshot = NULL;
     leveldb_readoptions_t *roptions = NULL;
-    unsigned int value_len = 0;
+    size_t value_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -2002,6 +2726,7 @@ URI_rpc_get_cb(evhttpx_request_t *req, void *userdata)
     }
 
     is_quiet = _rpc_query_quiet_check(req);
+    is_raw = _rpc_query_raw_check(req);
 
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "Please specify which key to get.");
@@ -2014,7 +2739,7 @@ URI_rpc_get_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -2024,6 +2749,7 @@ URI_rpc_get_cb(evhttpx_request_t *req, void *userdata)
    
     _rpc_query_snapshot_check(req, &snapshot_id);
     if (snapshot_id != NULL) {
+        pthread_rwlock_rdlock(&dbsnapshot_lock);
         snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
         roptions = leveldb_readoptions_create();
         leveldb_readoptions_set_verify_checksums(roptions,
@@ -2034,13 +2760,15 @@ URI_rpc_get_cb(evhttpx_request_t *req, void *userdata)
                 snapshot->snapshot);
     }
 
-    value = leveldb_get(
-            db->instance->db,
+    value = xleveldb_get(
+            db->instance,
             (snapshot == NULL) ? db->instance->roptions : roptions,
             key, strlen(key),
             &value_len,
-            &(db->instance->err));
-    if (value != NULL) {
+            &err);
+    if (value != NULL && is_raw == true) {
+        _rpc_send_raw_reply(req, value, value_len);
+    } else if (value != NULL) {
         if (is_quiet == false) {
             response = _rpc_jsonfy_response_on_kv_with_len(
                     key, strlen(key), value, value_len);
@@ -2066,6 +2794,8 @@ URI_rpc_get_cb(evhttpx_request_t *req, void *userdata)
         leveldb_readoptions_destroy(roptions);
     }
 
+    _rpc_reset_err(&err);
+    if (snapshot_id != NULL) pthread_rwlock_unlock(&dbsnapshot_lock);
     return;
 }
 
@@ -2089,7 +2819,7 @@ URI_rpc_mget_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -2107,12 +2837,12 @@ URI_rpc_seize_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    reveldb_durability_t durability;
     bool is_quiet = false;
-    char *value = NULL;
+    rpc_update_t update;
     char *response = NULL;
     const char *key = NULL;
     const char *dbname = NULL;
-    unsigned int value_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -2122,6 +2852,12 @@ URI_rpc_seize_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "Please specify which key to seize.");
     if (response != NULL) {
@@ -2132,61 +2868,21 @@ URI_rpc_seize_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
         return;
     }
-   
-    value = leveldb_get(
-            db->instance->db,
-            db->instance->roptions,
-            key, strlen(key),
-            &value_len,
-            &(db->instance->err));
-    if (value != NULL) {
-        leveldb_delete(
-                db->instance->db,
-                db->instance->woptions,
-                key, strlen(key),
-                &(db->instance->err));
-        if (db->instance->err == NULL) {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_msgalt_response_on_kv_with_len(
-                        key, strlen(key), value, value_len,
-                        "Seize key value pair OK, but note that "
-                        "you have just deleted the pair on reveldb server");
-            } else {
-                response = _rpc_jsonfy_quiet_response_on_kv_with_len(
-                        key, strlen(key), value, value_len);
-            }
-        } else {
-             if (is_quiet == false) {
-                response = _rpc_jsonfy_msgalt_response_on_kv_with_len(
-                        key, strlen(key), value, value_len,
-                        "Get kv pair OK, but note that you cannot delete "
-                        "the pair on reveldb server for some reasons");
-            } else {
-                response = _rpc_jsonfy_quiet_response_on_kv_with_len(
-                        key, strlen(key), value, value_len);
-            }
-             xleveldb_reset_err(db->instance);
-        } 
-        free(value);
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK);
-    } else {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_NOTFOUND, "Not Found", "Key value pair not found.");
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                     "Not Found", "Key value pair not found.");
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-    }
 
+    /* the get and the delete go through the committer together, a write
+     * to key queued in between would be lost otherwise. */
+    memset(&update, 0, sizeof(rpc_update_t));
+    update.write.quiet = is_quiet;
+    update.key = key;
+    _rpc_update(req, (reveldb_committer_t *)userdata, db, durability,
+            _rpc_update_seize, &update);
     return;
 }
 
@@ -2198,6 +2894,8 @@ URI_rpc_mseize_cb(evhttpx_request_t *req, void *userdata)
     const char *dbname = NULL;
     bool is_quiet = false;
     char *response = NULL;
+    leveldb_writebatch_t *batch = NULL;
+    reveldb_durability_t durability;
     
     response = _rpc_proto_and_method_sanity_check2nd(req, http_method_POST, &code);
     if (response != NULL) {
@@ -2207,10 +2905,16 @@ URI_rpc_mseize_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -2218,233 +2922,1505 @@ URI_rpc_mseize_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    response = _rpc_do_mseize(req, db, is_quiet);
+    response = _rpc_do_mseize(req, db, is_quiet, &batch);
+    if (batch != NULL) {
+        _rpc_commit(req, (reveldb_committer_t *)userdata, db, batch,
+                durability, is_quiet, response, EVHTTPX_RES_OK);
+        return;
+    }
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
     return;
 }
 
+/* bytes of a streamed scan reply produced per part, and entries visited
+ * at most while producing one. */
+#define RPC_SCAN_PART_SIZE (64 * 1024)
+#define RPC_SCAN_PART_KEYS 4096
+
+/* a partitioned scan is split into that many parts at most, each of them
+ * estimated to hold at least RPC_SCAN_SPLIT_SIZE bytes. */
+#define RPC_SCAN_MAX_PARTITIONS 64
+#define RPC_SCAN_SPLIT_SIZE (1024 * 1024)
+
+/* bytes of matches a part finds ahead of the reply before it pauses. */
+#define RPC_SCAN_PART_BACKLOG (4 * RPC_SCAN_PART_SIZE)
+
+/* range, prefix, regex and similar scans stream their matches back to the
+ * client part by part, every filter that is set must match for a kv to be
+ * sent. */
+typedef struct rpc_scan_s_ {
+    reveldb_t *db; /* referenced while the scan is open. */
+    xleveldb_cursor_t *iter;
+    bool quiet;
+    bool opened; /* head of the reply is out. */
+    size_t count; /* kvs sent so far. */
+    size_t limit; /* kvs sent at most, 0 means no limit. */
+    bool reverse; /* keys are visited in descending order. */
+    char *lower; /* bounds of the scan in key order, NULL if unbounded. */
+    size_t lower_len;
+    bool lower_inclusive;
+    char *upper;
+    size_t upper_len;
+    bool upper_inclusive;
+    char *prefix; /* keys have to start with it, NULL if any key goes. */
+    size_t prefix_len;
+    bool prefix_ordered; /* keys with the prefix are next to each other. */
+    bool keys_only; /* values are neither read nor sent. */
+    reveldb_pattern_cache_t *patterns; /* the patterns go back there. */
+    reveldb_pattern_t *kpattern;
+    reveldb_pattern_t *vpattern;
+    bool dfa; /* patterns matched by their automaton alone. */
+    reveldb_similar_t *ksimilar;
+    reveldb_similar_t *vsimilar;
+    size_t kdistance;
+    size_t vdistance;
+    /* a partitioned scan has no iterator of its own, its parts walk shares
+     * of the range on the scan threads, see _rpc_scan_partition(). */
+    reveldb_executor_t *scanner;
+    struct rpc_scan_part_s_ *parts;
+    unsigned int nparts;
+    unsigned int next_part; /* the one matches are taken from next. */
+    bool ordered; /* matches are sent in key order, part after part. */
+    pthread_mutex_t lock; /* guards the parts. */
+    pthread_cond_t cond; /* signaled when a part finds matches or is over. */
+    unsigned int running; /* parts queued or walking. */
+    bool stopping; /* the scan is being freed, parts stop. */
+    struct evbuffer *pending; /* matches taken from a part, not sent yet. */
+} rpc_scan_t;
+
+typedef enum {
+    RPC_SCAN_PART_IDLE, /* paused, enough of its matches wait. */
+    RPC_SCAN_PART_RUNNING,
+    RPC_SCAN_PART_OVER,
+} rpc_scan_part_state_t;
+
+/* a share of the range of a partitioned scan. */
+typedef struct rpc_scan_part_s_ {
+    rpc_scan_t *whole;
+    rpc_scan_t *scan; /* the filters of the whole, its own bounds. */
+    struct evbuffer *out; /* matches found and not taken yet. */
+    struct evbuffer *found; /* matches of the part thread not handed over. */
+    rpc_scan_part_state_t state;
+    bool seeked;
+} rpc_scan_part_t;
+
+/* appends str as a json string, escaped the way cJSON does. */
 static void
-URI_rpc_range_cb(evhttpx_request_t *req, void *userdata)
+_rpc_evbuffer_add_json_string(struct evbuffer *buf,
+        const char *str, size_t len)
 {
-    /* json formatted response. */
-    unsigned int code = 0;
-    bool is_quiet = false;
-    char *response = NULL;
-    const char *start_key = NULL;
-    const char *end_key = NULL;
-    bool has_end_key = false;
-    const char *dbname = NULL;
-    leveldb_iterator_t* iter = NULL;
-    evhttpx_query_t *query = req->uri->query;
-    evhttpx_kvs_t *kvs = evhttpx_kvs_new();
-
-    response = _rpc_proto_and_method_sanity_check(req, &code);
-    if (response != NULL) {
-        _rpc_send_reply(req, response, code);
-        return;
+    size_t i = 0;
+    size_t start = 0;
+
+    evbuffer_add(buf, "\"", 1);
+    for (i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c > 31 && c != '\"' && c != '\\') continue;
+        evbuffer_add(buf, str + start, i - start);
+        switch (c) {
+            case '\\': evbuffer_add(buf, "\\\\", 2); break;
+            case '\"': evbuffer_add(buf, "\\\"", 2); break;
+            case '\b': evbuffer_add(buf, "\\b", 2); break;
+            case '\f': evbuffer_add(buf, "\\f", 2); break;
+            case '\n': evbuffer_add(buf, "\\n", 2); break;
+            case '\r': evbuffer_add(buf, "\\r", 2); break;
+            case '\t': evbuffer_add(buf, "\\t", 2); break;
+            default: evbuffer_add_printf(buf, "\\u%04x", c); break;
+        }
+        start = i + 1;
     }
+    evbuffer_add(buf, str + start, len - start);
+    evbuffer_add(buf, "\"", 1);
+}
 
-    is_quiet = _rpc_query_quiet_check(req);
+static rpc_scan_t *
+_rpc_scan_new(bool quiet)
+{
+    rpc_scan_t *scan = (rpc_scan_t *)malloc(sizeof(rpc_scan_t));
+    if (scan == NULL) return NULL;
+    memset(scan, 0, sizeof(rpc_scan_t));
+    scan->quiet = quiet;
+    return scan;
+}
 
-    start_key = evhttpx_kv_find(query, "start");
-    end_key = evhttpx_kv_find(query, "end");
-    dbname = evhttpx_kv_find(query, "db");
+/* cursors are the key the next page starts at, hex encoded so that any
+ * key survives the round trip through a query string. */
+static void
+_rpc_evbuffer_add_cursor(struct evbuffer *buf, const char *key, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    size_t i = 0;
+    char hex[2];
 
-    if ((dbname == NULL)) dbname =
-        reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
-    if (db == NULL) {
-        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                "Not Found", "Database not found, please check.");
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-        return;
-    }
-   
-    iter = leveldb_create_iterator(db->instance->db,
-            db->instance->roptions);
-    if (start_key == NULL) {
-        leveldb_iter_seek_to_first(iter);
-        assert(leveldb_iter_valid(iter));
-    } else {
-        leveldb_iter_seek(iter, start_key, strlen(start_key));
-        assert(leveldb_iter_valid(iter));
+    for (i = 0; i < len; i++) {
+        hex[0] = digits[((unsigned char)key[i]) >> 4];
+        hex[1] = digits[((unsigned char)key[i]) & 0x0f];
+        evbuffer_add(buf, hex, 2);
     }
+}
 
-    if (end_key != NULL) has_end_key = true;
+static int
+_rpc_hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-    while(true) {
-        if (!leveldb_iter_valid(iter)) break;
-        size_t key_len = -1;
-        size_t value_len = -1;
-        const char *key = leveldb_iter_key(iter, &key_len);
-        const char *value = NULL; 
-        if ((has_end_key == true)
-                && (strlen(end_key) == key_len)
-                && (strncmp(key, end_key, key_len) == 0)) break;
-        value = leveldb_iter_value(iter, &value_len);
-        if (value != NULL) {
-            evhttpx_kv_t *kv =
-                evhttpx_kvlen_new(key, key_len, value, value_len, 1, 1);
-            evhttpx_kvs_add_kv(kvs, kv);
+/* decodes a cursor, NULL if it is not one of ours. */
+static char *
+_rpc_cursor_decode(const char *cursor, size_t *len)
+{
+    size_t i = 0;
+    size_t cursor_len = strlen(cursor);
+    char *key = NULL;
+
+    if (cursor_len == 0 || (cursor_len % 2) != 0) return NULL;
+    key = (char *)malloc(cursor_len / 2 + 1);
+    if (key == NULL) return NULL;
+
+    for (i = 0; i < cursor_len; i += 2) {
+        int hi = _rpc_hex_digit(cursor[i]);
+        int lo = _rpc_hex_digit(cursor[i + 1]);
+        if (hi < 0 || lo < 0) {
+            free(key);
+            return NULL;
         }
-        leveldb_iter_next(iter);
+        key[i / 2] = (char)((hi << 4) | lo);
     }
-    leveldb_iter_destroy(iter);
+    key[cursor_len / 2] = '\0';
+    *len = cursor_len / 2;
+    return key;
+}
 
-    if (is_quiet == false) {
-        response = _rpc_jsonfy_response_on_kvs(kvs);
-    } else {
-        response = _rpc_jsonfy_quiet_response_on_kvs(kvs);
-    }
+static void _rpc_scan_free(void *arg);
 
-    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
-    return;
+/* frees the first n parts of scan, none of them walking, and leaves the
+ * scan whole. */
+static void
+_rpc_scan_parts_free(rpc_scan_t *scan, unsigned int n)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < n; i++) {
+        if (scan->parts[i].scan != NULL) _rpc_scan_free(scan->parts[i].scan);
+        if (scan->parts[i].out != NULL) evbuffer_free(scan->parts[i].out);
+        if (scan->parts[i].found != NULL) evbuffer_free(scan->parts[i].found);
+    }
+    free(scan->parts);
+    scan->parts = NULL;
+    scan->nparts = 0;
 }
 
 static void
-URI_rpc_regex_cb(evhttpx_request_t *req, void *userdata)
+_rpc_scan_free(void *arg)
 {
-    /* json formatted response. */
-    unsigned int code = 0;
-    bool is_quiet = false;
-    char *response = NULL;
-    char *key_pattern = NULL;
-    char *val_pattern = NULL;
-    struct re_pattern_buffer key_pattern_buf;
-    struct re_pattern_buffer val_pattern_buf;
-    const char *param_key_pattern = NULL;
-    const char *param_val_pattern = NULL;
-    const char *snapshot_id = NULL;
-    xleveldb_snapshot_t *snapshot = NULL;
-    leveldb_readoptions_t *roptions = NULL;
-    const char *dbname = NULL;
-    evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    rpc_scan_t *scan = (rpc_scan_t *)arg;
+
+    if (scan->nparts > 0) {
+        /* queued parts return as soon as they run, walking ones at their
+         * next flush. */
+        pthread_mutex_lock(&scan->lock);
+        scan->stopping = true;
+        while (scan->running > 0) pthread_cond_wait(&scan->cond, &scan->lock);
+        pthread_mutex_unlock(&scan->lock);
+        _rpc_scan_parts_free(scan, scan->nparts);
+        evbuffer_free(scan->pending);
+        pthread_cond_destroy(&scan->cond);
+        pthread_mutex_destroy(&scan->lock);
+    }
+    if (scan->iter != NULL) xleveldb_cursor_destroy(scan->iter);
+    reveldb_release_db(scan->db);
+    reveldb_pattern_release(scan->patterns, scan->kpattern);
+    reveldb_pattern_release(scan->patterns, scan->vpattern);
+    free(scan->lower);
+    free(scan->upper);
+    free(scan->prefix);
+    reveldb_similar_free(scan->ksimilar);
+    reveldb_similar_free(scan->vsimilar);
+    free(scan);
+}
 
-    assert(kvs != NULL);
-    
-    response = _rpc_proto_and_method_sanity_check(req, &code);
-    if (response != NULL) {
-        _rpc_send_reply(req, response, code);
-        return;
+/* compiles an egrep pattern, or takes it out of the cache, NULL if it is
+ * not valid. */
+static reveldb_pattern_t *
+_rpc_scan_compile(rpc_scan_t *scan, const char *pattern)
+{
+    if (pattern == NULL) return NULL;
+    return reveldb_pattern_acquire(scan->patterns, pattern);
+}
+
+/* engine=dfa matches the patterns with their automaton alone, in time
+ * linear in the length of the kv, engine=gnu with re_match() as it has
+ * always been done. patterns with back-references, which only the latter
+ * supports, go to it unless told otherwise. returns the error response,
+ * NULL if the engine suits the patterns. */
+static char *
+_rpc_scan_engine_check(evhttpx_request_t *req, rpc_scan_t *scan)
+{
+    const char *engine = evhttpx_kv_find(req->uri->query, "engine");
+    bool backtracks =
+        (scan->kpattern != NULL && reveldb_pattern_backtracks(scan->kpattern))
+        || (scan->vpattern != NULL && reveldb_pattern_backtracks(scan->vpattern));
+
+    if (engine == NULL) {
+        scan->dfa = !backtracks;
+        return NULL;
+    }
+    if (strcmp(engine, "gnu") == 0) {
+        scan->dfa = false;
+        return NULL;
+    }
+    if (strcmp(engine, "dfa") != 0) {
+        return _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Engine should be either dfa or gnu.");
+    }
+    if (backtracks) {
+        return _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Back-references are only supported by engine gnu.");
     }
+    scan->dfa = true;
+    return NULL;
+}
 
-    is_quiet = _rpc_query_quiet_check(req);
+static bool
+_rpc_scan_regex(rpc_scan_t *scan, reveldb_pattern_t *pattern,
+        const char *str, size_t len)
+{
+    if (scan->dfa) return reveldb_pattern_match(pattern, str, len);
+    return re_match(reveldb_pattern_buffer(pattern), str, len, 0, NULL) >= 0;
+}
 
-    response = _rpc_query_param_sanity_check(req,
-            &param_key_pattern, "kregex",
-            "You have to specify key pattern to match.");
-    if (response != NULL) {
-        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+/* creates the iterator of the scan, or those of its parts which all see
+ * the same entries, the scan walked whole if they can not be had. */
+static void
+_rpc_scan_create_cursors(rpc_scan_t *scan, xleveldb_instance_t *instance,
+        const leveldb_readoptions_t *roptions)
+{
+    xleveldb_cursor_t *cursors[RPC_SCAN_MAX_PARTITIONS];
+    unsigned int i = 0;
+    int r = 0;
+
+    if (scan->nparts == 0) {
+        scan->iter = xleveldb_cursor_create(instance, roptions);
         return;
-    } else {
-        key_pattern = _rpc_pattern_unescape(param_key_pattern);
     }
-    
-    response = _rpc_query_param_sanity_check(req,
-            &param_val_pattern, "vregex",
-            "You have to specify value pattern to match.");
-    if (response != NULL) {
-        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+    r = xleveldb_cursor_create_many(instance, roptions,
+            cursors, scan->nparts);
+    if (r != 0) {
+        LOG_WARN(("failed to create the cursors of a partitioned scan, "
+                    "walking it whole."));
+        _rpc_scan_parts_free(scan, scan->nparts);
+        evbuffer_free(scan->pending);
+        scan->pending = NULL;
+        pthread_cond_destroy(&scan->cond);
+        pthread_mutex_destroy(&scan->lock);
+        scan->iter = xleveldb_cursor_create(instance, roptions);
         return;
-    } else {
-        val_pattern = _rpc_pattern_unescape(param_val_pattern);
     }
+    for (i = 0; i < scan->nparts; i++) scan->parts[i].scan->iter = cursors[i];
+}
 
-    _rpc_query_database_check(req, &dbname);
-    if ((dbname == NULL)) dbname =
-        reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
-    if (db == NULL) {
-        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                "Not Found", "Database not found, please check.");
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-        return;
+/* creates the iterator of the scan, on the snapshot if one is given.
+ * returns the error response if the snapshot is not found. */
+static char *
+_rpc_scan_open(rpc_scan_t *scan, reveldb_t *db, const char *snapshot_id)
+{
+    xleveldb_snapshot_t *snapshot = NULL;
+    leveldb_readoptions_t *roptions = NULL;
+
+    /* the stream may outlive the request. */
+    reveldb_retain_db(db);
+    scan->db = db;
+    if (snapshot_id == NULL) {
+        _rpc_scan_create_cursors(scan, db->instance, db->instance->roptions);
+        return NULL;
     }
 
-     _rpc_query_snapshot_check(req, &snapshot_id);
-    if (snapshot_id != NULL) {
-        snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
-        roptions = leveldb_readoptions_create();
-        leveldb_readoptions_set_verify_checksums(roptions,
-                reveldb_config->db_config->verify_checksums);
-        leveldb_readoptions_set_fill_cache(roptions,
-                reveldb_config->db_config->fill_cache);
-        leveldb_readoptions_set_snapshot(roptions,
-                snapshot->snapshot);
+    pthread_rwlock_rdlock(&dbsnapshot_lock);
+    snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
+    if (snapshot == NULL) {
+        pthread_rwlock_unlock(&dbsnapshot_lock);
+        return _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Snapshot not found, please check.");
     }
+    roptions = leveldb_readoptions_create();
+    leveldb_readoptions_set_verify_checksums(roptions,
+            reveldb_config->db_config->verify_checksums);
+    leveldb_readoptions_set_fill_cache(roptions,
+            reveldb_config->db_config->fill_cache);
+    leveldb_readoptions_set_snapshot(roptions,
+            snapshot->snapshot);
+    /* the iterator pins the sequence and files it reads, so neither the
+     * snapshot nor the read options are needed past this point, and the
+     * lock is not held across the parts of the stream. */
+    _rpc_scan_create_cursors(scan, db->instance, roptions);
+    pthread_rwlock_unlock(&dbsnapshot_lock);
+    leveldb_readoptions_destroy(roptions);
+    return NULL;
+}
 
-    key_pattern_buf.translate = 0; 
-    key_pattern_buf.fastmap = 0;
-    key_pattern_buf.buffer = 0;
-    key_pattern_buf.allocated = 0;
+/* orders keys the way the comparator of the database does. */
+static int
+_rpc_scan_compare(rpc_scan_t *scan,
+        const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    return xleveldb_cursor_compare(scan->iter, a, a_len, b, b_len);
+}
 
-    val_pattern_buf.translate = 0; 
-    val_pattern_buf.fastmap = 0;
-    val_pattern_buf.buffer = 0;
-    val_pattern_buf.allocated = 0;
+static bool
+_rpc_scan_in_bounds(rpc_scan_t *scan, const char *key, size_t key_len)
+{
+    int r = 0;
 
-    re_syntax_options = RE_SYNTAX_EGREP;
-    re_compile_pattern(key_pattern, strlen(key_pattern), &key_pattern_buf);
-    re_compile_pattern(val_pattern, strlen(val_pattern), &val_pattern_buf);
+    if (scan->lower != NULL) {
+        r = _rpc_scan_compare(scan, key, key_len,
+                scan->lower, scan->lower_len);
+        if (r < 0 || (r == 0 && scan->lower_inclusive == false)) return false;
+    }
+    if (scan->upper != NULL) {
+        r = _rpc_scan_compare(scan, key, key_len,
+                scan->upper, scan->upper_len);
+        if (r > 0 || (r == 0 && scan->upper_inclusive == false)) return false;
+    }
+    return true;
+}
 
-    leveldb_iterator_t* iter = leveldb_create_iterator(db->instance->db,
-            (snapshot == NULL) ? db->instance->roptions : roptions);
+static bool
+_rpc_scan_has_prefix(rpc_scan_t *scan, const char *key, size_t key_len)
+{
+    if (scan->prefix == NULL) return true;
+    return (key_len >= scan->prefix_len)
+        && (memcmp(key, scan->prefix, scan->prefix_len) == 0);
+}
 
-    leveldb_iter_seek_to_first(iter);
-    while(true) {
-        if (!leveldb_iter_valid(iter)) break;
-        int matches = -1;
-        size_t key_len = -1;
-        size_t value_len = -1;
-        const char *key = leveldb_iter_key(iter, &key_len);
-        const char *value = NULL; 
-        if ((matches = re_match(&key_pattern_buf, key, key_len, 0, NULL)) >= 0) {
-            matches = -1;
-            value = leveldb_iter_value(iter, &value_len);
-            if ((matches = re_match(&val_pattern_buf, value, value_len, 0, NULL)) >= 0) {
-                evhttpx_kv_t *kv =
-                    evhttpx_kvlen_new(key, key_len, value, value_len, 1, 1);
-                evhttpx_kvs_add_kv(kvs, kv);
+static void _rpc_scan_part_schedule(rpc_scan_t *whole,
+        rpc_scan_part_t *part);
+
+/* positions the iterator on the first key of the scan in its direction.
+ * the parts of a partitioned scan are started instead, they seek on the
+ * scan threads. */
+static void
+_rpc_scan_seek(rpc_scan_t *scan)
+{
+    const char *key = NULL;
+    size_t key_len = 0;
+    unsigned int i = 0;
+
+    if (scan->nparts > 0) {
+        pthread_mutex_lock(&scan->lock);
+        for (i = 0; i < scan->nparts; i++) {
+            _rpc_scan_part_schedule(scan, &scan->parts[i]);
+        }
+        pthread_mutex_unlock(&scan->lock);
+        return;
+    }
+
+    if (scan->reverse == false) {
+        if (scan->lower == NULL) {
+            xleveldb_cursor_seek_to_first(scan->iter);
+            return;
+        }
+        xleveldb_cursor_seek(scan->iter, scan->lower, scan->lower_len);
+        if (scan->lower_inclusive || !xleveldb_cursor_valid(scan->iter)) return;
+        key = xleveldb_cursor_key(scan->iter, &key_len);
+        if (_rpc_scan_compare(scan, key, key_len,
+                    scan->lower, scan->lower_len) == 0) {
+            xleveldb_cursor_next(scan->iter);
+        }
+        return;
+    }
+
+    if (scan->upper == NULL) {
+        xleveldb_cursor_seek_to_last(scan->iter);
+        return;
+    }
+    /* seek lands on the first key at or after the bound, step back if
+     * it is past the range. */
+    xleveldb_cursor_seek(scan->iter, scan->upper, scan->upper_len);
+    if (!xleveldb_cursor_valid(scan->iter)) {
+        xleveldb_cursor_seek_to_last(scan->iter);
+        return;
+    }
+    key = xleveldb_cursor_key(scan->iter, &key_len);
+    if (!_rpc_scan_in_bounds(scan, key, key_len)
+            && _rpc_scan_compare(scan, key, key_len,
+                scan->upper, scan->upper_len) >= 0) {
+        xleveldb_cursor_prev(scan->iter);
+    }
+}
+
+/* returns 1 if the current entry goes into the reply, 0 to skip it and
+ * -1 once the scan is over. */
+static int
+_rpc_scan_match(rpc_scan_t *scan,
+        const char *key, size_t key_len,
+        const char **value, size_t *value_len)
+{
+    if (!_rpc_scan_in_bounds(scan, key, key_len)) return -1;
+    if (!_rpc_scan_has_prefix(scan, key, key_len)) {
+        /* past the keys sharing the prefix, none of them is left. */
+        return scan->prefix_ordered ? -1 : 0;
+    }
+    if ((scan->kpattern != NULL)
+            && !_rpc_scan_regex(scan, scan->kpattern, key, key_len)) return 0;
+    if ((scan->ksimilar != NULL)
+            && (reveldb_similar_distance(scan->ksimilar, key, key_len,
+                    scan->kdistance) > scan->kdistance)) return 0;
+    if (scan->keys_only) return 1;
+
+    *value = xleveldb_cursor_value(scan->iter, value_len);
+    if (*value == NULL) return 0;
+
+    if ((scan->vpattern != NULL)
+            && !_rpc_scan_regex(scan, scan->vpattern,
+                *value, *value_len)) return 0;
+    if ((scan->vsimilar != NULL)
+            && (reveldb_similar_distance(scan->vsimilar, *value, *value_len,
+                    scan->vdistance) > scan->vdistance)) return 0;
+    return 1;
+}
+
+/* appends a match to the reply. */
+static void
+_rpc_scan_add(struct evbuffer *buf, rpc_scan_t *scan,
+        const char *key, size_t key_len, const char *value, size_t value_len)
+{
+    if (scan->count++ > 0) evbuffer_add(buf, ",", 1);
+    if (scan->keys_only) {
+        _rpc_evbuffer_add_json_string(buf, key, key_len);
+        return;
+    }
+    evbuffer_add(buf, "{", 1);
+    _rpc_evbuffer_add_json_string(buf, key, key_len);
+    evbuffer_add(buf, ":", 1);
+    _rpc_evbuffer_add_json_string(buf, value, value_len);
+    evbuffer_add(buf, "}", 1);
+}
+
+/* matches go from the parts to the reply as the lengths of the key and
+ * of the value followed by both. */
+static void
+_rpc_scan_part_add(struct evbuffer *buf,
+        const char *key, size_t key_len, const char *value, size_t value_len)
+{
+    size_t lens[2];
+
+    lens[0] = key_len;
+    lens[1] = value_len;
+    evbuffer_add(buf, lens, sizeof(lens));
+    evbuffer_add(buf, key, key_len);
+    if (value_len > 0) evbuffer_add(buf, value, value_len);
+}
+
+/* walks a part on a scan thread, handing what it finds over every few
+ * keys. the part pauses once enough of its matches wait to be sent, and
+ * is scheduled again when they are taken. */
+static void
+_rpc_scan_part_run(void *arg)
+{
+    rpc_scan_part_t *part = (rpc_scan_part_t *)arg;
+    rpc_scan_t *whole = part->whole;
+    rpc_scan_t *scan = part->scan;
+    struct evbuffer *found = part->found;
+    size_t visited = 0;
+    bool over = false;
+    bool paused = false;
+
+    pthread_mutex_lock(&whole->lock);
+    over = whole->stopping;
+    pthread_mutex_unlock(&whole->lock);
+    if (over == false && part->seeked == false) {
+        part->seeked = true;
+        _rpc_scan_seek(scan);
+    }
+
+    do {
+        int matches = 0;
+        size_t key_len = 0;
+        size_t value_len = 0;
+        const char *key = NULL;
+        const char *value = NULL;
+
+        if (over) {
+            /* the scan was freed before the part got to run. */
+        } else if (!xleveldb_cursor_valid(scan->iter)) {
+            over = true;
+        } else {
+            key = xleveldb_cursor_key(scan->iter, &key_len);
+            matches = _rpc_scan_match(scan, key, key_len, &value, &value_len);
+            if (matches < 0) over = true;
+            if (matches > 0) {
+                _rpc_scan_part_add(found, key, key_len, value, value_len);
+            }
+            if (scan->reverse) xleveldb_cursor_prev(scan->iter);
+            else xleveldb_cursor_next(scan->iter);
+        }
+        if (!over && (++visited % RPC_SCAN_PART_KEYS) != 0
+                && evbuffer_get_length(found) < RPC_SCAN_PART_SIZE) continue;
+
+        pthread_mutex_lock(&whole->lock);
+        evbuffer_add_buffer(part->out, found);
+        if (whole->stopping) over = true;
+        paused = !over
+            && evbuffer_get_length(part->out) >= RPC_SCAN_PART_BACKLOG;
+        if (over || paused) {
+            /* the whole may be freed as soon as the lock is released. */
+            part->state = over ? RPC_SCAN_PART_OVER : RPC_SCAN_PART_IDLE;
+            whole->running--;
+        }
+        pthread_cond_broadcast(&whole->cond);
+        pthread_mutex_unlock(&whole->lock);
+    } while (!over && !paused);
+}
+
+/* gets a part walking, right here if the scan threads can not take it.
+ * called with the lock held. */
+static void
+_rpc_scan_part_schedule(rpc_scan_t *whole, rpc_scan_part_t *part)
+{
+    part->state = RPC_SCAN_PART_RUNNING;
+    whole->running++;
+    if (reveldb_executor_defer(whole->scanner,
+                _rpc_scan_part_run, part) == 0) return;
+    pthread_mutex_unlock(&whole->lock);
+    _rpc_scan_part_run(part);
+    pthread_mutex_lock(&whole->lock);
+}
+
+/* the part an ordered scan sends the k-th, reverse scans go from the last
+ * part down. */
+static rpc_scan_part_t *
+_rpc_scan_part_at(rpc_scan_t *scan, unsigned int k)
+{
+    if (scan->reverse) return &scan->parts[scan->nparts - 1 - k];
+    return &scan->parts[k];
+}
+
+/* moves the matches of the next part into pending, waiting for them if
+ * need be: those of the part in turn if the scan is ordered, of any part
+ * otherwise. returns false once every part is over and sent. */
+static bool
+_rpc_scan_gather(rpc_scan_t *scan)
+{
+    rpc_scan_part_t *part = NULL;
+    bool over = false;
+    unsigned int i = 0;
+
+    pthread_mutex_lock(&scan->lock);
+    while (part == NULL && over == false) {
+        if (scan->ordered) {
+            while (scan->next_part < scan->nparts) {
+                part = _rpc_scan_part_at(scan, scan->next_part);
+                if (evbuffer_get_length(part->out) > 0
+                        || part->state != RPC_SCAN_PART_OVER) break;
+                scan->next_part++;
+            }
+            over = (scan->next_part == scan->nparts);
+            if (over || evbuffer_get_length(part->out) == 0) part = NULL;
+        } else {
+            /* the parts take turns, so that none of them is held up. */
+            over = true;
+            for (i = 0; i < scan->nparts && part == NULL; i++) {
+                rpc_scan_part_t *next =
+                    &scan->parts[(scan->next_part + i) % scan->nparts];
+                if (evbuffer_get_length(next->out) > 0) part = next;
+                else if (next->state != RPC_SCAN_PART_OVER) over = false;
+            }
+            if (part != NULL) {
+                scan->next_part = (scan->next_part + i) % scan->nparts;
+                over = false;
             }
         }
-        leveldb_iter_next(iter);
+        if (part == NULL && over == false) {
+            pthread_cond_wait(&scan->cond, &scan->lock);
+        }
+    }
+    if (part != NULL) {
+        evbuffer_add_buffer(scan->pending, part->out);
+        if (part->state == RPC_SCAN_PART_IDLE) {
+            _rpc_scan_part_schedule(scan, part);
+        }
     }
-    leveldb_iter_destroy(iter);
+    pthread_mutex_unlock(&scan->lock);
+    return part != NULL;
+}
 
-    if (is_quiet == false) {
-        response = _rpc_jsonfy_response_on_kvs(kvs);
+/* the next match of a partitioned scan, left in pending until the caller
+ * drains it. returns false if there is none left. */
+static bool
+_rpc_scan_peek(rpc_scan_t *scan, const char **key, size_t *key_len,
+        const char **value, size_t *value_len)
+{
+    size_t lens[2];
+    const char *item = NULL;
+
+    if (evbuffer_get_length(scan->pending) == 0
+            && !_rpc_scan_gather(scan)) return false;
+    evbuffer_copyout(scan->pending, lens, sizeof(lens));
+    item = (const char *)evbuffer_pullup(scan->pending,
+            sizeof(lens) + lens[0] + lens[1]);
+    *key = item + sizeof(lens);
+    *key_len = lens[0];
+    *value = *key + lens[0];
+    *value_len = lens[1];
+    return true;
+}
+
+/* produces the next part of the reply, the same json
+ * _rpc_jsonfy_response_on_kvs() builds, one fragment at a time. keys only
+ * scans reply with an array of keys instead. */
+static int
+_rpc_scan_next(struct evbuffer *buf, void *arg)
+{
+    rpc_scan_t *scan = (rpc_scan_t *)arg;
+    size_t visited = 0;
+    const char *cursor = NULL;
+    size_t cursor_len = 0;
+
+    if (scan->opened == false) {
+        const char *array = scan->keys_only ? "keys" : "kvs";
+        scan->opened = true;
+        if (scan->quiet == false) {
+            char now[GMTTIME_LEN];
+            gmttime_now_r(now, sizeof(now));
+            evbuffer_add_printf(buf, "{\"code\":%d,\"status\":\"OK\","
+                    "\"message\":\"%s\",\"date\":\"%s\",\"%s\":[",
+                    EVHTTPX_RES_OK, scan->keys_only ? "Get keys done."
+                    : "Get key-value pair done.", now, array);
+        } else {
+            evbuffer_add_printf(buf, "{\"%s\":[", array);
+        }
+    }
+
+    while (scan->nparts > 0) {
+        size_t key_len = 0;
+        size_t value_len = 0;
+        const char *key = NULL;
+        const char *value = NULL;
+
+        if (!_rpc_scan_peek(scan, &key, &key_len, &value, &value_len)) break;
+        if ((scan->limit > 0) && (scan->count >= scan->limit)) {
+            /* the page is full, the client carries on from this match,
+             * unless the matches come in no particular order. */
+            if (scan->ordered) {
+                cursor = key;
+                cursor_len = key_len;
+            }
+            break;
+        }
+        _rpc_scan_add(buf, scan, key, key_len, value, value_len);
+        evbuffer_drain(scan->pending, 2 * sizeof(size_t) + key_len + value_len);
+        if (evbuffer_get_length(buf) >= RPC_SCAN_PART_SIZE) return 1;
+    }
+
+    while (scan->nparts == 0 && xleveldb_cursor_valid(scan->iter)) {
+        int matches = 0;
+        size_t key_len = 0;
+        size_t value_len = 0;
+        const char *key = xleveldb_cursor_key(scan->iter, &key_len);
+        const char *value = NULL;
+
+        if ((scan->limit > 0) && (scan->count >= scan->limit)) {
+            /* the page is full, the client carries on from this key. */
+            if (_rpc_scan_in_bounds(scan, key, key_len)
+                    && (scan->prefix_ordered == false
+                        || _rpc_scan_has_prefix(scan, key, key_len))) {
+                cursor = key;
+                cursor_len = key_len;
+            }
+            break;
+        }
+        matches = _rpc_scan_match(scan, key, key_len, &value, &value_len);
+        if (matches < 0) break;
+        if (matches > 0) {
+            _rpc_scan_add(buf, scan, key, key_len, value, value_len);
+        }
+        if (scan->reverse) xleveldb_cursor_prev(scan->iter);
+        else xleveldb_cursor_next(scan->iter);
+
+        if ((++visited >= RPC_SCAN_PART_KEYS)
+                || (evbuffer_get_length(buf) >= RPC_SCAN_PART_SIZE)) return 1;
+    }
+
+    evbuffer_add(buf, "]", 1);
+    if (cursor != NULL) {
+        evbuffer_add_printf(buf, ",\"cursor\":\"");
+        _rpc_evbuffer_add_cursor(buf, cursor, cursor_len);
+        evbuffer_add(buf, "\"", 1);
+    }
+    evbuffer_add(buf, "}", 1);
+    return 0;
+}
+
+/* hands the scan over to the executor, which streams the reply. */
+static void
+_rpc_scan_start(evhttpx_request_t *req,
+        reveldb_executor_t *executor, rpc_scan_t *scan)
+{
+    char *response = NULL;
+
+    if (reveldb_executor_stream(executor, req,
+                _rpc_scan_next, _rpc_scan_free, scan) == 0) return;
+
+    _rpc_scan_free(scan);
+    response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+            "Internal Server Error", "Failed to stream the response.");
+    _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+}
+
+/* the smallest key greater than every key starting with prefix in
+ * bytewise order, NULL if there is none. */
+static char *
+_rpc_prefix_successor(const char *prefix, size_t prefix_len, size_t *len)
+{
+    char *key = NULL;
+    size_t i = prefix_len;
+
+    while (i > 0 && (unsigned char)prefix[i - 1] == 0xff) i--;
+    if (i == 0) return NULL;
+    key = (char *)malloc(i + 1);
+    if (key == NULL) return NULL;
+    memcpy(key, prefix, i);
+    key[i - 1] = (char)((unsigned char)key[i - 1] + 1);
+    key[i] = '\0';
+    *len = i;
+    return key;
+}
+
+/* a copy of a bound of the scan, NULL if it is unbounded or there is no
+ * memory left. */
+static char *
+_rpc_scan_bound_dup(const char *key, size_t key_len)
+{
+    char *copy = NULL;
+
+    if (key == NULL) return NULL;
+    copy = (char *)malloc(key_len + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, key, key_len);
+    copy[key_len] = '\0';
+    return copy;
+}
+
+/* the 8 bytes of key following its first prefix_len ones as a number,
+ * missing bytes count as 0. */
+static uint64_t
+_rpc_scan_split_point(const char *key, size_t key_len, size_t prefix_len)
+{
+    uint64_t point = 0;
+    size_t i = 0;
+
+    for (i = prefix_len; i < prefix_len + sizeof(point); i++) {
+        point <<= 8;
+        if (i < key_len) point |= (unsigned char)key[i];
+    }
+    return point;
+}
+
+/* writes point after the prefix already in key, trailing zero bytes left
+ * out. returns the length of the key. */
+static size_t
+_rpc_scan_split_key(char *key, size_t prefix_len, uint64_t point)
+{
+    size_t len = prefix_len + sizeof(point);
+    size_t i = 0;
+
+    for (i = 0; i < sizeof(point); i++) {
+        key[len - 1 - i] = (char)(point >> (i * 8));
+    }
+    while (len > prefix_len && key[len - 1] == '\0') len--;
+    return len;
+}
+
+/* picks up to n - 1 keys cutting the range of the scan into n parts the
+ * same size, as leveldb_approximate_sizes() estimates it, in the order of
+ * the database. they are searched for among the keys made of the prefix
+ * both bounds share followed by 8 more bytes. returns how many were found
+ * in order and strictly inside the range. */
+static unsigned int
+_rpc_scan_split(rpc_scan_t *scan, xleveldb_instance_t *instance,
+        unsigned int n, char **keys, size_t *key_lens)
+{
+    bool reversed = (instance->order == XLEVELDB_COMPARATOR_REVERSE_BYTEWISE);
+    char *lo = reversed ? scan->upper : scan->lower; /* in bytewise order. */
+    size_t lo_len = reversed ? scan->upper_len : scan->lower_len;
+    char *hi = reversed ? scan->lower : scan->upper;
+    size_t hi_len = reversed ? scan->lower_len : scan->upper_len;
+    char *successor = NULL;
+    char end[sizeof(uint64_t) + 1];
+    char *first = NULL; /* the bound keys are walked from. */
+    size_t first_len = 0;
+    char *key = NULL;
+    size_t key_len = 0;
+    size_t prefix_len = 0;
+    uint64_t total = 0;
+    uint64_t target = 0;
+    uint64_t size = 0;
+    uint64_t a = 0;
+    uint64_t b = 0;
+    uint64_t m = 0;
+    unsigned int i = 0;
+    unsigned int found = 0;
+
+    /* keys sharing the prefix of a prefix scan lie between it and its
+     * successor, whichever bound the scan leaves open. */
+    if (scan->prefix_ordered && lo == NULL) {
+        lo = scan->prefix;
+        lo_len = scan->prefix_len;
+    }
+    if (scan->prefix_ordered && hi == NULL) {
+        hi = successor = _rpc_prefix_successor(scan->prefix,
+                scan->prefix_len, &hi_len);
+    }
+    if (lo == NULL) {
+        lo = "";
+        lo_len = 0;
+    }
+    if (hi == NULL) {
+        memset(end, 0xff, sizeof(end));
+        hi = end;
+        hi_len = sizeof(end);
+    }
+    while (prefix_len < lo_len && prefix_len < hi_len
+            && lo[prefix_len] == hi[prefix_len]) prefix_len++;
+
+    first = reversed ? hi : lo;
+    first_len = reversed ? hi_len : lo_len;
+    total = reversed
+        ? xleveldb_approximate_size(instance, hi, hi_len, lo, lo_len)
+        : xleveldb_approximate_size(instance, lo, lo_len, hi, hi_len);
+    if (total / RPC_SCAN_SPLIT_SIZE < n) n = total / RPC_SCAN_SPLIT_SIZE;
+    if (n < 2) {
+        free(successor);
+        return 0;
+    }
+
+    key = (char *)malloc(prefix_len + sizeof(uint64_t) + 1);
+    if (key == NULL) {
+        free(successor);
+        return 0;
+    }
+    memcpy(key, lo, prefix_len);
+    for (i = 1; i < n; i++) {
+        /* the point whose key has the i-th share of the range before it
+         * in the order of the database, sizes being monotonic in it. */
+        target = total / n * i;
+        a = _rpc_scan_split_point(lo, lo_len, prefix_len);
+        b = (hi == end) ? UINT64_MAX
+            : _rpc_scan_split_point(hi, hi_len, prefix_len);
+        while (a + 1 < b) {
+            m = a + (b - a) / 2;
+            key_len = _rpc_scan_split_key(key, prefix_len, m);
+            size = xleveldb_approximate_size(instance,
+                    first, first_len, key, key_len);
+            if (reversed ? (size > target) : (size < target)) a = m;
+            else b = m;
+        }
+        key_len = _rpc_scan_split_key(key, prefix_len, reversed ? a : b);
+
+        if (scan->lower != NULL && xleveldb_comparator_compare(
+                    instance->order, key, key_len,
+                    scan->lower, scan->lower_len) <= 0) continue;
+        if (scan->upper != NULL && xleveldb_comparator_compare(
+                    instance->order, key, key_len,
+                    scan->upper, scan->upper_len) >= 0) continue;
+        if (found > 0 && xleveldb_comparator_compare(instance->order,
+                    key, key_len, keys[found - 1], key_lens[found - 1]) <= 0) {
+            continue;
+        }
+        keys[found] = _rpc_scan_bound_dup(key, key_len);
+        if (keys[found] == NULL) break;
+        key_lens[found] = key_len;
+        found++;
+    }
+    free(key);
+    free(successor);
+    return found;
+}
+
+/* a scan with the filters of whole, its bounds left to the caller. */
+static rpc_scan_t *
+_rpc_scan_part_new(rpc_scan_t *whole)
+{
+    rpc_scan_t *scan = _rpc_scan_new(true);
+
+    if (scan == NULL) return NULL;
+    scan->reverse = whole->reverse;
+    scan->prefix = _rpc_scan_bound_dup(whole->prefix, whole->prefix_len);
+    if (whole->prefix != NULL && scan->prefix == NULL) {
+        _rpc_scan_free(scan);
+        return NULL;
+    }
+    scan->prefix_len = whole->prefix_len;
+    scan->prefix_ordered = whole->prefix_ordered;
+    scan->keys_only = whole->keys_only;
+    scan->patterns = whole->patterns;
+    scan->dfa = whole->dfa;
+    /* the similar queries are only read, all parts share those of the
+     * whole. */
+    if (whole->ksimilar != NULL) {
+        scan->ksimilar = reveldb_similar_retain(whole->ksimilar);
+    }
+    if (whole->vsimilar != NULL) {
+        scan->vsimilar = reveldb_similar_retain(whole->vsimilar);
+    }
+    scan->kdistance = whole->kdistance;
+    scan->vdistance = whole->vdistance;
+    /* patterns are used by one scan at a time, parts compile their own. */
+    if (whole->kpattern != NULL) {
+        scan->kpattern = reveldb_pattern_dup(scan->patterns, whole->kpattern);
+    }
+    if (whole->vpattern != NULL) {
+        scan->vpattern = reveldb_pattern_dup(scan->patterns, whole->vpattern);
+    }
+    if ((whole->kpattern != NULL && scan->kpattern == NULL)
+            || (whole->vpattern != NULL && scan->vpattern == NULL)) {
+        _rpc_scan_free(scan);
+        return NULL;
+    }
+    return scan;
+}
+
+/* the i-th of the nkeys + 1 parts of whole, [key i - 1, key i), the bounds
+ * of the whole at both ends. false if there is no memory left. */
+static bool
+_rpc_scan_part_init(rpc_scan_t *whole, unsigned int i, unsigned int nkeys,
+        char **keys, size_t *key_lens)
+{
+    rpc_scan_part_t *part = &whole->parts[i];
+    rpc_scan_t *scan = NULL;
+
+    part->whole = whole;
+    part->scan = scan = _rpc_scan_part_new(whole);
+    part->out = evbuffer_new();
+    part->found = evbuffer_new();
+    if (scan == NULL || part->out == NULL || part->found == NULL) return false;
+    if (i == 0) {
+        scan->lower = _rpc_scan_bound_dup(whole->lower, whole->lower_len);
+        scan->lower_len = whole->lower_len;
+        scan->lower_inclusive = whole->lower_inclusive;
     } else {
-        response = _rpc_jsonfy_quiet_response_on_kvs(kvs);
+        scan->lower = _rpc_scan_bound_dup(keys[i - 1], key_lens[i - 1]);
+        scan->lower_len = key_lens[i - 1];
+        scan->lower_inclusive = true;
+    }
+    if (i == nkeys) {
+        scan->upper = _rpc_scan_bound_dup(whole->upper, whole->upper_len);
+        scan->upper_len = whole->upper_len;
+        scan->upper_inclusive = whole->upper_inclusive;
+    } else {
+        scan->upper = _rpc_scan_bound_dup(keys[i], key_lens[i]);
+        scan->upper_len = key_lens[i];
+        scan->upper_inclusive = false;
     }
+    return (scan->lower != NULL || (i == 0 && whole->lower == NULL))
+        && (scan->upper != NULL || (i == nkeys && whole->upper == NULL));
+}
 
-    if (snapshot != NULL) {
-        leveldb_readoptions_set_snapshot(roptions, NULL);
-        leveldb_readoptions_destroy(roptions);
+/* splits the scan into parts walked side by side by the scan threads:
+ * partitions=k asks for k parts of about the same size, scan_threads of
+ * them by default, ordered=false for the matches to come in whatever
+ * order the parts find them, without a cursor. the scan is left whole if
+ * there are no scan threads, if its database is ordered by numbers, whose
+ * bytes do not follow their order, or if it is too small. called before
+ * _rpc_scan_open(), returns the error response if the arguments are not
+ * valid. */
+static char *
+_rpc_scan_partition(evhttpx_request_t *req, reveldb_rpc_t *rpc,
+        rpc_scan_t *scan, reveldb_t *db)
+{
+    const char *partitions = evhttpx_kv_find(req->uri->query, "partitions");
+    uint32_t nparts = rpc->config->server_config->scan_threads;
+    xleveldb_comparator_type_t order = db->instance->order;
+    char *keys[RPC_SCAN_MAX_PARTITIONS];
+    size_t key_lens[RPC_SCAN_MAX_PARTITIONS];
+    unsigned int nkeys = 0;
+    unsigned int i = 0;
+
+    if ((partitions != NULL) && !safe_strtoul(partitions, &nparts)) {
+        return _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Partitions should be a non-negative integer.");
+    }
+    scan->ordered = _rpc_query_bool_check(req, "ordered", true);
+    if (nparts > RPC_SCAN_MAX_PARTITIONS) nparts = RPC_SCAN_MAX_PARTITIONS;
+    if (nparts < 2 || reveldb_executor_threads(rpc->scanner) == 0) return NULL;
+    if (order != XLEVELDB_COMPARATOR_BYTEWISE
+            && order != XLEVELDB_COMPARATOR_REVERSE_BYTEWISE) return NULL;
+
+    nkeys = _rpc_scan_split(scan, db->instance, nparts, keys, key_lens);
+    if (nkeys == 0) return NULL;
+
+    /* the scan is walked whole if there is no memory left to split it. */
+    scan->parts = (rpc_scan_part_t *)calloc(nkeys + 1, sizeof(rpc_scan_part_t));
+    for (i = 0; scan->parts != NULL && i <= nkeys; i++) {
+        if (!_rpc_scan_part_init(scan, i, nkeys, keys, key_lens)) break;
+    }
+    if (scan->parts != NULL && i > nkeys) scan->pending = evbuffer_new();
+    for (i = 0; i < nkeys; i++) free(keys[i]);
+    if (scan->pending == NULL) {
+        LOG_WARN(("failed to partition a scan, walking it whole."));
+        if (scan->parts != NULL) _rpc_scan_parts_free(scan, nkeys + 1);
+        return NULL;
     }
 
-    evhttpx_kvs_free(kvs);
-    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    scan->nparts = nkeys + 1;
+    scan->scanner = rpc->scanner;
+    pthread_mutex_init(&scan->lock, NULL);
+    pthread_cond_init(&scan->cond, NULL);
+    return NULL;
+}
+
+static void
+_rpc_range_job(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_rpc_t *rpc = (reveldb_rpc_t *)userdata;
+    /* json formatted response. */
+    unsigned int code = 0;
+    bool is_quiet = false;
+    char *response = NULL;
+    const char *start_key = NULL;
+    const char *end_key = NULL;
+    const char *limit = NULL;
+    const char *cursor = NULL;
+    const char *dbname = NULL;
+    char *cursor_key = NULL;
+    size_t cursor_len = 0;
+    uint32_t max_kvs = 0;
+    evhttpx_query_t *query = req->uri->query;
+    rpc_scan_t *scan = NULL;
+
+    response = _rpc_proto_and_method_sanity_check(req, &code);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, code);
+        return;
+    }
+
+    is_quiet = _rpc_query_quiet_check(req);
+
+    start_key = evhttpx_kv_find(query, "start");
+    end_key = evhttpx_kv_find(query, "end");
+    limit = evhttpx_kv_find(query, "limit");
+    cursor = evhttpx_kv_find(query, "cursor");
+    dbname = evhttpx_kv_find(query, "db");
+
+    if ((limit != NULL) && !safe_strtoul(limit, &max_kvs)) {
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Limit should be a non-negative integer.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+    if ((cursor != NULL)
+            && ((cursor_key = _rpc_cursor_decode(cursor, &cursor_len)) == NULL)) {
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Cursor is not valid.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
+    if ((dbname == NULL)) dbname =
+        reveldb_config->db_config->dbname;
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
+    if (db == NULL) {
+        free(cursor_key);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Database not found, please check.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
+    }
+   
+    scan = _rpc_scan_new(is_quiet);
+    if (scan == NULL) {
+        LOG_ERROR(("failed to malloc rpc_scan_t."));
+        free(cursor_key);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
+
+    /* start is included and end is not unless told otherwise, reverse
+     * scans go from end down to start. */
+    scan->limit = max_kvs;
+    scan->reverse = _rpc_query_bool_check(req, "reverse", false);
+    scan->lower_inclusive = _rpc_query_bool_check(req, "start_inclusive", true);
+    scan->upper_inclusive = _rpc_query_bool_check(req, "end_inclusive", false);
+    if (start_key != NULL) {
+        scan->lower_len = strlen(start_key);
+        scan->lower = strdup(start_key);
+    }
+    if (end_key != NULL) {
+        scan->upper_len = strlen(end_key);
+        scan->upper = strdup(end_key);
+    }
+    if ((start_key != NULL && scan->lower == NULL)
+            || (end_key != NULL && scan->upper == NULL)) {
+        LOG_ERROR(("failed to malloc the bounds of a range scan."));
+        free(cursor_key);
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
+
+    /* a cursor replaces the bound the previous page started from. */
+    if (cursor_key != NULL) {
+        if (scan->reverse == false) {
+            free(scan->lower);
+            scan->lower = cursor_key;
+            scan->lower_len = cursor_len;
+            scan->lower_inclusive = true;
+        } else {
+            free(scan->upper);
+            scan->upper = cursor_key;
+            scan->upper_len = cursor_len;
+            scan->upper_inclusive = true;
+        }
+    }
+
+    response = _rpc_scan_partition(req, rpc, scan, db);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
+    response = _rpc_scan_open(scan, db, NULL);
+    assert(response == NULL);
+    _rpc_scan_seek(scan);
+
+    _rpc_scan_start(req, rpc->executor, scan);
     return;
 }
 
 static void
-URI_rpc_kregex_cb(evhttpx_request_t *req, void *userdata)
+URI_rpc_range_cb(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_executor_submit(((reveldb_rpc_t *)userdata)->executor,
+            req, _rpc_range_job, userdata);
+}
+
+/* restricts the scan to the keys starting with prefix, bounded in the
+ * order of the database. returns false if there is no memory left. */
+static bool
+_rpc_scan_prefix(rpc_scan_t *scan, const char *prefix, size_t prefix_len,
+        xleveldb_comparator_type_t order)
 {
+    size_t i = 0;
+
+    scan->prefix = (char *)malloc(prefix_len + 1);
+    if (scan->prefix == NULL) return false;
+    memcpy(scan->prefix, prefix, prefix_len);
+    scan->prefix[prefix_len] = '\0';
+    scan->prefix_len = prefix_len;
+
+    switch (order) {
+        case XLEVELDB_COMPARATOR_BYTEWISE:
+            /* they come right after the prefix itself. */
+            scan->lower = (char *)malloc(scan->prefix_len + 1);
+            if (scan->lower == NULL) return false;
+            memcpy(scan->lower, scan->prefix, scan->prefix_len + 1);
+            scan->lower_len = scan->prefix_len;
+            scan->lower_inclusive = true;
+            scan->prefix_ordered = true;
+            break;
+        case XLEVELDB_COMPARATOR_REVERSE_BYTEWISE:
+            /* they come right after the successor of the prefix. */
+            scan->lower = _rpc_prefix_successor(scan->prefix,
+                    scan->prefix_len, &scan->lower_len);
+            if (scan->lower == NULL) {
+                /* a prefix of 0xff bytes alone has none. */
+                for (i = 0; i < prefix_len; i++) {
+                    if ((unsigned char)prefix[i] != 0xff) return false;
+                }
+            }
+            scan->lower_inclusive = false;
+            scan->prefix_ordered = true;
+            break;
+        default:
+            /* numeric orders scatter them, every key has to be looked at. */
+            scan->prefix_ordered = false;
+            break;
+    }
+    return true;
+}
+
+static void
+_rpc_prefix_job(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_rpc_t *rpc = (reveldb_rpc_t *)userdata;
     /* json formatted response. */
     unsigned int code = 0;
     bool is_quiet = false;
     char *response = NULL;
-    char *pattern = NULL;
-    struct re_pattern_buffer pattern_buf;
+    const char *prefix = NULL;
+    const char *limit = NULL;
+    const char *cursor = NULL;
+    const char *snapshot_id = NULL;
+    const char *dbname = NULL;
+    char *cursor_key = NULL;
+    size_t cursor_len = 0;
+    uint32_t max_kvs = 0;
+    evhttpx_query_t *query = req->uri->query;
+    rpc_scan_t *scan = NULL;
+
+    response = _rpc_proto_and_method_sanity_check(req, &code);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, code);
+        return;
+    }
+
+    is_quiet = _rpc_query_quiet_check(req);
+
+    response = _rpc_query_param_sanity_check(req,
+            &prefix, "prefix",
+            "You have to specify the prefix of the keys.");
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
+    limit = evhttpx_kv_find(query, "limit");
+    cursor = evhttpx_kv_find(query, "cursor");
+
+    if ((limit != NULL) && !safe_strtoul(limit, &max_kvs)) {
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Limit should be a non-negative integer.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+    if ((cursor != NULL)
+            && ((cursor_key = _rpc_cursor_decode(cursor, &cursor_len)) == NULL)) {
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Cursor is not valid.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
+    _rpc_query_database_check(req, &dbname);
+    if ((dbname == NULL)) dbname =
+        reveldb_config->db_config->dbname;
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
+    if (db == NULL) {
+        free(cursor_key);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Database not found, please check.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
+    }
+
+    _rpc_query_snapshot_check(req, &snapshot_id);
+
+    scan = _rpc_scan_new(is_quiet);
+    if (scan == NULL) {
+        LOG_ERROR(("failed to malloc rpc_scan_t."));
+        free(cursor_key);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
+
+    scan->limit = max_kvs;
+    scan->keys_only = _rpc_query_bool_check(req, "keys_only", false);
+    if (!_rpc_scan_prefix(scan, prefix, strlen(prefix), db->instance->order)) {
+        LOG_ERROR(("failed to malloc the prefix of a scan."));
+        free(cursor_key);
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
+
+    /* a cursor replaces the bound the previous page started from. */
+    if (cursor_key != NULL) {
+        free(scan->lower);
+        scan->lower = cursor_key;
+        scan->lower_len = cursor_len;
+        scan->lower_inclusive = true;
+    }
+
+    response = _rpc_scan_partition(req, rpc, scan, db);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
+    response = _rpc_scan_open(scan, db, snapshot_id);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
+    }
+    _rpc_scan_seek(scan);
+
+    _rpc_scan_start(req, rpc->executor, scan);
+    return;
+}
+
+static void
+URI_rpc_prefix_cb(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_executor_submit(((reveldb_rpc_t *)userdata)->executor,
+            req, _rpc_prefix_job, userdata);
+}
+
+static void
+_rpc_regex_job(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_rpc_t *rpc = (reveldb_rpc_t *)userdata;
+    /* json formatted response. */
+    unsigned int code = 0;
+    bool is_quiet = false;
+    char *response = NULL;
+    char *key_pattern = NULL;
+    char *val_pattern = NULL;
     const char *param_key_pattern = NULL;
+    const char *param_val_pattern = NULL;
     const char *snapshot_id = NULL;
-    xleveldb_snapshot_t *snapshot = NULL;
-    leveldb_readoptions_t *roptions = NULL;
+    const char *prefix = NULL;
+    size_t prefix_len = 0;
     const char *dbname = NULL;
-    evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    rpc_scan_t *scan = NULL;
 
-    assert(kvs != NULL);
+    response = _rpc_proto_and_method_sanity_check(req, &code);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, code);
+        return;
+    }
+
+    is_quiet = _rpc_query_quiet_check(req);
+
+    response = _rpc_query_param_sanity_check(req,
+            &param_key_pattern, "kregex",
+            "You have to specify key pattern to match.");
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    } else {
+        key_pattern = _rpc_pattern_unescape(param_key_pattern);
+    }
     
+    response = _rpc_query_param_sanity_check(req,
+            &param_val_pattern, "vregex",
+            "You have to specify value pattern to match.");
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    } else {
+        val_pattern = _rpc_pattern_unescape(param_val_pattern);
+    }
+
+    _rpc_query_database_check(req, &dbname);
+    if ((dbname == NULL)) dbname =
+        reveldb_config->db_config->dbname;
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
+    if (db == NULL) {
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Database not found, please check.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
+    }
+
+    _rpc_query_snapshot_check(req, &snapshot_id);
+
+    scan = _rpc_scan_new(is_quiet);
+    if (scan == NULL) {
+        LOG_ERROR(("failed to malloc rpc_scan_t."));
+        free(key_pattern);
+        free(val_pattern);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
+
+    scan->patterns = rpc->patterns;
+    scan->kpattern = _rpc_scan_compile(scan, key_pattern);
+    scan->vpattern = _rpc_scan_compile(scan, val_pattern);
+    free(key_pattern);
+    free(val_pattern);
+    if (scan->kpattern == NULL || scan->vpattern == NULL) {
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Pattern is not a valid regular expression.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+    response = _rpc_scan_engine_check(req, scan);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
+    /* keys the pattern matches share the literal it begins with, and are
+     * looked for among the keys starting with it alone. */
+    prefix = reveldb_pattern_prefix(scan->kpattern, &prefix_len);
+    if (prefix_len > 0
+            && !_rpc_scan_prefix(scan, prefix, prefix_len, db->instance->order)) {
+        LOG_ERROR(("failed to malloc the prefix of a scan."));
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
+
+    response = _rpc_scan_partition(req, rpc, scan, db);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
+    response = _rpc_scan_open(scan, db, snapshot_id);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
+    }
+    _rpc_scan_seek(scan);
+
+    _rpc_scan_start(req, rpc->executor, scan);
+    return;
+}
+
+static void
+URI_rpc_regex_cb(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_executor_submit(((reveldb_rpc_t *)userdata)->executor,
+            req, _rpc_regex_job, userdata);
+}
+
+static void
+_rpc_kregex_job(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_rpc_t *rpc = (reveldb_rpc_t *)userdata;
+    /* json formatted response. */
+    unsigned int code = 0;
+    bool is_quiet = false;
+    char *response = NULL;
+    char *pattern = NULL;
+    const char *param_key_pattern = NULL;
+    const char *snapshot_id = NULL;
+    const char *prefix = NULL;
+    size_t prefix_len = 0;
+    const char *dbname = NULL;
+    rpc_scan_t *scan = NULL;
+
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
         _rpc_send_reply(req, response, code);
@@ -2466,7 +4442,7 @@ URI_rpc_kregex_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -2474,82 +4450,89 @@ URI_rpc_kregex_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-     _rpc_query_snapshot_check(req, &snapshot_id);
-    if (snapshot_id != NULL) {
-        snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
-        roptions = leveldb_readoptions_create();
-        leveldb_readoptions_set_verify_checksums(roptions,
-                reveldb_config->db_config->verify_checksums);
-        leveldb_readoptions_set_fill_cache(roptions,
-                reveldb_config->db_config->fill_cache);
-        leveldb_readoptions_set_snapshot(roptions,
-                snapshot->snapshot);
+    _rpc_query_snapshot_check(req, &snapshot_id);
+
+    scan = _rpc_scan_new(is_quiet);
+    if (scan == NULL) {
+        LOG_ERROR(("failed to malloc rpc_scan_t."));
+        free(pattern);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
     }
-  
-    pattern_buf.translate = 0; 
-    pattern_buf.fastmap = 0;
-    pattern_buf.buffer = 0;
-    pattern_buf.allocated = 0;
-    re_syntax_options = RE_SYNTAX_EGREP;
-    re_compile_pattern(pattern, strlen(pattern), &pattern_buf);
 
-    leveldb_iterator_t* iter = leveldb_create_iterator(db->instance->db,
-            (snapshot == NULL) ? db->instance->roptions : roptions);
+    scan->patterns = rpc->patterns;
+    scan->kpattern = _rpc_scan_compile(scan, pattern);
+    free(pattern);
+    if (scan->kpattern == NULL) {
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Pattern is not a valid regular expression.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+    response = _rpc_scan_engine_check(req, scan);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
 
-    leveldb_iter_seek_to_first(iter);
-    while(true) {
-        if (!leveldb_iter_valid(iter)) break;
-        int matches = -1;
-        size_t key_len = -1;
-        size_t value_len = -1;
-        const char *key = leveldb_iter_key(iter, &key_len);
-        const char *value = NULL; 
-        if ((matches = re_match(&pattern_buf, key, key_len, 0, NULL)) >= 0) {
-            value = leveldb_iter_value(iter, &value_len);
-            if (value != NULL) {                    
-                evhttpx_kv_t *kv =
-                    evhttpx_kvlen_new(key, key_len, value, value_len, 1, 1);
-                evhttpx_kvs_add_kv(kvs, kv);
-            }
-        }
-        leveldb_iter_next(iter);
+    /* keys the pattern matches share the literal it begins with, and are
+     * looked for among the keys starting with it alone. */
+    prefix = reveldb_pattern_prefix(scan->kpattern, &prefix_len);
+    if (prefix_len > 0
+            && !_rpc_scan_prefix(scan, prefix, prefix_len, db->instance->order)) {
+        LOG_ERROR(("failed to malloc the prefix of a scan."));
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
     }
-    leveldb_iter_destroy(iter);
 
-    if (is_quiet == false) {
-        response = _rpc_jsonfy_response_on_kvs(kvs);
-    } else {
-        response = _rpc_jsonfy_quiet_response_on_kvs(kvs);
+    response = _rpc_scan_partition(req, rpc, scan, db);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
     }
 
-    if (snapshot != NULL) {
-        leveldb_readoptions_set_snapshot(roptions, NULL);
-        leveldb_readoptions_destroy(roptions);
+    response = _rpc_scan_open(scan, db, snapshot_id);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
     }
+    _rpc_scan_seek(scan);
 
-    evhttpx_kvs_free(kvs);
-    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    _rpc_scan_start(req, rpc->executor, scan);
     return;
 }
 
 static void
-URI_rpc_vregex_cb(evhttpx_request_t *req, void *userdata)
+URI_rpc_kregex_cb(evhttpx_request_t *req, void *userdata)
 {
+    reveldb_executor_submit(((reveldb_rpc_t *)userdata)->executor,
+            req, _rpc_kregex_job, userdata);
+}
+
+static void
+_rpc_vregex_job(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_rpc_t *rpc = (reveldb_rpc_t *)userdata;
     /* json formatted response. */
     unsigned int code = 0;
     bool is_quiet = false;
     char *response = NULL;
     char *pattern = NULL;
-    struct re_pattern_buffer pattern_buf;
     const char *param_key_pattern = NULL;
     const char *snapshot_id = NULL;
-    xleveldb_snapshot_t *snapshot = NULL;
-    leveldb_readoptions_t *roptions = NULL;
     const char *dbname = NULL;
-    evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    rpc_scan_t *scan = NULL;
 
-    assert(kvs != NULL);
-    
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
         _rpc_send_reply(req, response, code);
@@ -2571,7 +4554,7 @@ URI_rpc_vregex_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -2579,64 +4562,65 @@ URI_rpc_vregex_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
     _rpc_query_snapshot_check(req, &snapshot_id);
-    if (snapshot_id != NULL) {
-        snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
-        roptions = leveldb_readoptions_create();
-        leveldb_readoptions_set_verify_checksums(roptions,
-                reveldb_config->db_config->verify_checksums);
-        leveldb_readoptions_set_fill_cache(roptions,
-                reveldb_config->db_config->fill_cache);
-        leveldb_readoptions_set_snapshot(roptions,
-                snapshot->snapshot);
-    }
 
-    pattern_buf.translate = 0; 
-    pattern_buf.fastmap = 0;
-    pattern_buf.buffer = 0;
-    pattern_buf.allocated = 0;
-    re_syntax_options = RE_SYNTAX_EGREP;
-    re_compile_pattern(pattern, strlen(pattern), &pattern_buf);
-
-    leveldb_iterator_t* iter = leveldb_create_iterator(db->instance->db,
-            (snapshot == NULL) ? db->instance->roptions : roptions);
+    scan = _rpc_scan_new(is_quiet);
+    if (scan == NULL) {
+        LOG_ERROR(("failed to malloc rpc_scan_t."));
+        free(pattern);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
 
-    leveldb_iter_seek_to_first(iter);
-    while(true) {
-        if (!leveldb_iter_valid(iter)) break;
-        int matches = -1;
-        size_t key_len = -1;
-        size_t value_len = -1;
-        const char *key = NULL; 
-        const char *value = leveldb_iter_value(iter, &value_len);
-        if ((matches = re_match(&pattern_buf, value, value_len, 0, NULL)) >= 0) {
-            key = leveldb_iter_key(iter, &key_len);
-            evhttpx_kv_t *kv =
-                evhttpx_kvlen_new(key, key_len, value, value_len, 1, 1);
-            evhttpx_kvs_add_kv(kvs, kv);
-        }
-        leveldb_iter_next(iter);
+    scan->patterns = rpc->patterns;
+    scan->vpattern = _rpc_scan_compile(scan, pattern);
+    free(pattern);
+    if (scan->vpattern == NULL) {
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Pattern is not a valid regular expression.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+    response = _rpc_scan_engine_check(req, scan);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
     }
-    leveldb_iter_destroy(iter);
 
-    if (is_quiet == false) {
-        response = _rpc_jsonfy_response_on_kvs(kvs);
-    } else {
-        response = _rpc_jsonfy_quiet_response_on_kvs(kvs);
+    response = _rpc_scan_partition(req, rpc, scan, db);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
     }
 
-    if (snapshot != NULL) {
-        leveldb_readoptions_set_snapshot(roptions, NULL);
-        leveldb_readoptions_destroy(roptions);
+    response = _rpc_scan_open(scan, db, snapshot_id);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
     }
+    _rpc_scan_seek(scan);
 
-    evhttpx_kvs_free(kvs);
-    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    _rpc_scan_start(req, rpc->executor, scan);
     return;
 }
 
 static void
-URI_rpc_similar_cb(evhttpx_request_t *req, void *userdata)
+URI_rpc_vregex_cb(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_executor_submit(((reveldb_rpc_t *)userdata)->executor,
+            req, _rpc_vregex_job, userdata);
+}
+
+static void
+_rpc_similar_job(evhttpx_request_t *req, void *userdata)
 {
+    reveldb_rpc_t *rpc = (reveldb_rpc_t *)userdata;
     /* json formatted response. */
     unsigned int code = 0;
     bool is_quiet = false;
@@ -2648,13 +4632,9 @@ URI_rpc_similar_cb(evhttpx_request_t *req, void *userdata)
     size_t klimit = 0;
     size_t vlimit = 0;
     const char *snapshot_id = NULL;
-    xleveldb_snapshot_t *snapshot = NULL;
-    leveldb_readoptions_t *roptions = NULL;
     const char *dbname = NULL;
-    evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    rpc_scan_t *scan = NULL;
 
-    assert(kvs != NULL);
-    
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
         _rpc_send_reply(req, response, code);
@@ -2714,7 +4694,7 @@ URI_rpc_similar_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -2723,60 +4703,59 @@ URI_rpc_similar_cb(evhttpx_request_t *req, void *userdata)
     }
     
     _rpc_query_snapshot_check(req, &snapshot_id);
-    if (snapshot_id != NULL) {
-        snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
-        roptions = leveldb_readoptions_create();
-        leveldb_readoptions_set_verify_checksums(roptions,
-                reveldb_config->db_config->verify_checksums);
-        leveldb_readoptions_set_fill_cache(roptions,
-                reveldb_config->db_config->fill_cache);
-        leveldb_readoptions_set_snapshot(roptions,
-                snapshot->snapshot);
-    }
 
-    leveldb_iterator_t* iter = leveldb_create_iterator(db->instance->db,
-            (snapshot == NULL) ? db->instance->roptions : roptions);
+    scan = _rpc_scan_new(is_quiet);
+    if (scan == NULL) {
+        LOG_ERROR(("failed to malloc rpc_scan_t."));
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
 
-    leveldb_iter_seek_to_first(iter);
-    while(true) {
-        if (!leveldb_iter_valid(iter)) break;
-        size_t key_len = -1;
-        size_t value_len = -1;
-        const char *key = leveldb_iter_key(iter, &key_len);
-        const char *value = NULL; 
-        if (_rpc_levenshtein(key, key_len,
-                        ksimilar, strlen(ksimilar)) <= klimit) {
-            value = leveldb_iter_key(iter, &value_len);
-            if (_rpc_levenshtein(value, value_len,
-                            vsimilar, strlen(vsimilar)) <= vlimit) {
-                evhttpx_kv_t *kv =
-                    evhttpx_kvlen_new(key, key_len, value, value_len, 1, 1);
-                evhttpx_kvs_add_kv(kvs, kv);
-            }
-        }
-        leveldb_iter_next(iter);
+    scan->ksimilar = reveldb_similar_new(ksimilar, strlen(ksimilar));
+    scan->vsimilar = reveldb_similar_new(vsimilar, strlen(vsimilar));
+    if (scan->ksimilar == NULL || scan->vsimilar == NULL) {
+        LOG_ERROR(("failed to malloc reveldb_similar_t."));
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
     }
-    leveldb_iter_destroy(iter);
+    scan->kdistance = klimit;
+    scan->vdistance = vlimit;
 
-    if (is_quiet == false) {
-        response = _rpc_jsonfy_response_on_kvs(kvs);
-    } else {
-        response = _rpc_jsonfy_quiet_response_on_kvs(kvs);
+    response = _rpc_scan_partition(req, rpc, scan, db);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
     }
 
-    if (snapshot != NULL) {
-        leveldb_readoptions_set_snapshot(roptions, NULL);
-        leveldb_readoptions_destroy(roptions);
+    response = _rpc_scan_open(scan, db, snapshot_id);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
     }
+    _rpc_scan_seek(scan);
 
-    evhttpx_kvs_free(kvs);
-    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    _rpc_scan_start(req, rpc->executor, scan);
     return;
 }
 
 static void
-URI_rpc_ksimilar_cb(evhttpx_request_t *req, void *userdata)
+URI_rpc_similar_cb(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_executor_submit(((reveldb_rpc_t *)userdata)->executor,
+            req, _rpc_similar_job, userdata);
+}
+
+static void
+_rpc_ksimilar_job(evhttpx_request_t *req, void *userdata)
 {
+    reveldb_rpc_t *rpc = (reveldb_rpc_t *)userdata;
     /* json formatted response. */
     unsigned int code = 0;
     bool is_quiet = false;
@@ -2784,15 +4763,11 @@ URI_rpc_ksimilar_cb(evhttpx_request_t *req, void *userdata)
     const char *similar = NULL;
     const char *distance = NULL;
     const char *snapshot_id = NULL;
-    xleveldb_snapshot_t *snapshot = NULL;
-    leveldb_readoptions_t *roptions = NULL;
     size_t limit = 0;
     const char *dbname = NULL;
  
-    evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    rpc_scan_t *scan = NULL;
 
-    assert(kvs != NULL);
-    
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
         _rpc_send_reply(req, response, code);
@@ -2828,7 +4803,7 @@ URI_rpc_ksimilar_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -2837,57 +4812,57 @@ URI_rpc_ksimilar_cb(evhttpx_request_t *req, void *userdata)
     }
     
     _rpc_query_snapshot_check(req, &snapshot_id);
-    if (snapshot_id != NULL) {
-        snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
-        roptions = leveldb_readoptions_create();
-        leveldb_readoptions_set_verify_checksums(roptions,
-                reveldb_config->db_config->verify_checksums);
-        leveldb_readoptions_set_fill_cache(roptions,
-                reveldb_config->db_config->fill_cache);
-        leveldb_readoptions_set_snapshot(roptions,
-                snapshot->snapshot);
-    }
 
-    leveldb_iterator_t* iter = leveldb_create_iterator(db->instance->db,
-            (snapshot == NULL) ? db->instance->roptions : roptions);
+    scan = _rpc_scan_new(is_quiet);
+    if (scan == NULL) {
+        LOG_ERROR(("failed to malloc rpc_scan_t."));
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
 
-    leveldb_iter_seek_to_first(iter);
-    while(true) {
-        if (!leveldb_iter_valid(iter)) break;
-        size_t key_len = -1;
-        size_t value_len = -1;
-        const char *key = leveldb_iter_key(iter, &key_len);
-        const char *value = NULL; 
-        if (_rpc_levenshtein(key, key_len,
-                        similar, strlen(similar)) <= limit) {
-            value = leveldb_iter_value(iter, &value_len);
-            evhttpx_kv_t *kv =
-                evhttpx_kvlen_new(key, key_len, value, value_len, 1, 1);
-            evhttpx_kvs_add_kv(kvs, kv);
-        }
-        leveldb_iter_next(iter);
+    scan->ksimilar = reveldb_similar_new(similar, strlen(similar));
+    if (scan->ksimilar == NULL) {
+        LOG_ERROR(("failed to malloc reveldb_similar_t."));
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
     }
-    leveldb_iter_destroy(iter);
+    scan->kdistance = limit;
 
-    if (is_quiet == false) {
-        response = _rpc_jsonfy_response_on_kvs(kvs);
-    } else {
-        response = _rpc_jsonfy_quiet_response_on_kvs(kvs);
+    response = _rpc_scan_partition(req, rpc, scan, db);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
     }
 
-    if (snapshot != NULL) {
-        leveldb_readoptions_set_snapshot(roptions, NULL);
-        leveldb_readoptions_destroy(roptions);
+    response = _rpc_scan_open(scan, db, snapshot_id);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
     }
+    _rpc_scan_seek(scan);
 
-    evhttpx_kvs_free(kvs);
-    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    _rpc_scan_start(req, rpc->executor, scan);
     return;
 }
 
 static void
-URI_rpc_vsimilar_cb(evhttpx_request_t *req, void *userdata)
+URI_rpc_ksimilar_cb(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_executor_submit(((reveldb_rpc_t *)userdata)->executor,
+            req, _rpc_ksimilar_job, userdata);
+}
+
+static void
+_rpc_vsimilar_job(evhttpx_request_t *req, void *userdata)
 {
+    reveldb_rpc_t *rpc = (reveldb_rpc_t *)userdata;
     /* json formatted response. */
     unsigned int code = 0;
     bool is_quiet = false;
@@ -2895,14 +4870,10 @@ URI_rpc_vsimilar_cb(evhttpx_request_t *req, void *userdata)
     const char *similar = NULL;
     const char *distance = NULL;
     const char *snapshot_id = NULL;
-    xleveldb_snapshot_t *snapshot = NULL;
-    leveldb_readoptions_t *roptions = NULL;
     size_t limit = 0;
     const char *dbname = NULL;
-    evhttpx_kvs_t *kvs = evhttpx_kvs_new();
+    rpc_scan_t *scan = NULL;
 
-    assert(kvs != NULL);
-    
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
         _rpc_send_reply(req, response, code);
@@ -2938,7 +4909,7 @@ URI_rpc_vsimilar_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -2947,67 +4918,66 @@ URI_rpc_vsimilar_cb(evhttpx_request_t *req, void *userdata)
     }
     
     _rpc_query_snapshot_check(req, &snapshot_id);
-    if (snapshot_id != NULL) {
-        snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
-        roptions = leveldb_readoptions_create();
-        leveldb_readoptions_set_verify_checksums(roptions,
-                reveldb_config->db_config->verify_checksums);
-        leveldb_readoptions_set_fill_cache(roptions,
-                reveldb_config->db_config->fill_cache);
-        leveldb_readoptions_set_snapshot(roptions,
-                snapshot->snapshot);
-    }
 
-    leveldb_iterator_t* iter = leveldb_create_iterator(db->instance->db,
-            (snapshot == NULL) ? db->instance->roptions : roptions);
+    scan = _rpc_scan_new(is_quiet);
+    if (scan == NULL) {
+        LOG_ERROR(("failed to malloc rpc_scan_t."));
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
+    }
 
-    leveldb_iter_seek_to_first(iter);
-    while(true) {
-        if (!leveldb_iter_valid(iter)) break;
-        size_t key_len = -1;
-        size_t value_len = -1;
-        const char *key = NULL; 
-        const char *value = leveldb_iter_value(iter, &value_len);
-        if (_rpc_levenshtein(value, value_len,
-                        similar, strlen(similar)) <= limit) {
-            key = leveldb_iter_key(iter, &key_len);
-            evhttpx_kv_t *kv =
-                evhttpx_kvlen_new(key, key_len, value, value_len, 1, 1);
-            evhttpx_kvs_add_kv(kvs, kv);
-        }
-        leveldb_iter_next(iter);
+    scan->vsimilar = reveldb_similar_new(similar, strlen(similar));
+    if (scan->vsimilar == NULL) {
+        LOG_ERROR(("failed to malloc reveldb_similar_t."));
+        _rpc_scan_free(scan);
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                "Internal Server Error", "Out of memory.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
     }
-    leveldb_iter_destroy(iter);
+    scan->vdistance = limit;
 
-    if (is_quiet == false) {
-        response = _rpc_jsonfy_response_on_kvs(kvs);
-    } else {
-        response = _rpc_jsonfy_quiet_response_on_kvs(kvs);
+    response = _rpc_scan_partition(req, rpc, scan, db);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
     }
 
-    if (snapshot != NULL) {
-        leveldb_readoptions_set_snapshot(roptions, NULL);
-        leveldb_readoptions_destroy(roptions);
+    response = _rpc_scan_open(scan, db, snapshot_id);
+    if (response != NULL) {
+        _rpc_scan_free(scan);
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
     }
+    _rpc_scan_seek(scan);
 
-    evhttpx_kvs_free(kvs);
-    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+    _rpc_scan_start(req, rpc->executor, scan);
     return;
 }
 
+static void
+URI_rpc_vsimilar_cb(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_executor_submit(((reveldb_rpc_t *)userdata)->executor,
+            req, _rpc_vsimilar_job, userdata);
+}
+
 static void
 URI_rpc_incr_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    reveldb_durability_t durability;
     bool is_quiet = false;
-    char *value = NULL;
+    rpc_update_t update;
     char *response = NULL;
     const char *key = NULL;
     const char *step = NULL;
     long long llstep = -1;
     const char *dbname = NULL;
-    unsigned int value_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -3017,6 +4987,12 @@ URI_rpc_incr_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "You have to specify which key to incr.");
     if (response != NULL) {
@@ -3041,75 +5017,20 @@ URI_rpc_incr_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
         return;
     }
-   
-    value = leveldb_get(
-            db->instance->db,
-            db->instance->roptions,
-            key, strlen(key),
-            &value_len,
-            &(db->instance->err));
-    if (value != NULL) {
-        long long llvalue = -1;
-        if (safe_strntoll(value, value_len, &llvalue)) {
-            char valuebuf[64] = {0};
-            llvalue += llstep;
-            sprintf(valuebuf, "%lld", llvalue);
-            leveldb_put(
-                    db->instance->db,
-                    db->instance->woptions,
-                    key, strlen(key),
-                    valuebuf, strlen(valuebuf),
-                    &(db->instance->err));
-            if (db->instance->err != NULL) {
-                if (is_quiet == false) {
-                    response = _rpc_jsonfy_response_on_error(req,
-                            EVHTTPX_RES_SERVERR, "Internal Server Error",
-                            db->instance->err);
-                } else {
-                    response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                            "Internal Server Error", db->instance->err);
-                }
-                _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
-            } else {
-                if (is_quiet == false) {
-                    response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                            "OK", "Incr value done.");
-                } else {
-                    response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
-                }
-                _rpc_send_reply(req, response, EVHTTPX_RES_OK);
-            }
-        } else {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_response_on_error(req,
-                        EVHTTPX_RES_BADREQ, "Bad Request",
-                        "Value is not numerical, incr is not allowed.");
-            } else {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_BADREQ,
-                        "Bad Request", "Value is not numerical, incr is not allowed.");
-            }
-            _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
-        } 
-
-        free(value);
-    } else {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_NOTFOUND, "Not Found", "Key value pair not found.");
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                     "Not Found", "Key value pair not found.");
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-    }
 
+    memset(&update, 0, sizeof(rpc_update_t));
+    update.write.quiet = is_quiet;
+    update.key = key;
+    update.step = llstep;
+    _rpc_update(req, (reveldb_committer_t *)userdata, db, durability,
+            _rpc_update_incr, &update);
     return;
 }
 
@@ -3118,14 +5039,14 @@ URI_rpc_decr_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    reveldb_durability_t durability;
     bool is_quiet = false;
-    char *value = NULL;
+    rpc_update_t update;
     char *response = NULL;
     const char *key = NULL;
     const char *step = NULL;
     long long llstep = -1;
     const char *dbname = NULL;
-    unsigned int value_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -3135,6 +5056,12 @@ URI_rpc_decr_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "You have to specify which key to decr.");
     if (response != NULL) {
@@ -3159,75 +5086,20 @@ URI_rpc_decr_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
         return;
     }
-   
-    value = leveldb_get(
-            db->instance->db,
-            db->instance->roptions,
-            key, strlen(key),
-            &value_len,
-            &(db->instance->err));
-    if (value != NULL) {
-        long long llvalue = -1;
-        if (safe_strntoll(value, value_len, &llvalue)) {
-            char valuebuf[64] = {0};
-            llvalue -= llstep;
-            sprintf(valuebuf, "%lld", llvalue);
-            leveldb_put(
-                    db->instance->db,
-                    db->instance->woptions,
-                    key, strlen(key),
-                    valuebuf, strlen(valuebuf),
-                    &(db->instance->err));
-            if (db->instance->err != NULL) {
-                if (is_quiet == false) {
-                    response = _rpc_jsonfy_response_on_error(req,
-                            EVHTTPX_RES_SERVERR, "Internal Server Error",
-                            db->instance->err);
-                } else {
-                    response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                            "Internal Server Error", db->instance->err);
-                }
-                _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
-            } else {
-                if (is_quiet == false) {
-                    response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                            "OK", "Decr value done.");
-                } else {
-                    response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
-                }
-                _rpc_send_reply(req, response, EVHTTPX_RES_OK);
-            }
-        } else {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_response_on_error(req,
-                        EVHTTPX_RES_BADREQ, "Bad Request",
-                        "Value is not numerical, incr is not allowed.");
-            } else {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_BADREQ,
-                        "Bad Request", "Value is not numerical, incr is not allowed.");
-            }
-            _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
-        } 
-
-        free(value);
-    } else {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_NOTFOUND, "Not Found", "Key value pair not found.");
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                     "Not Found", "Key value pair not found.");
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-    }
 
+    memset(&update, 0, sizeof(rpc_update_t));
+    update.write.quiet = is_quiet;
+    update.key = key;
+    update.step = llstep;
+    _rpc_update(req, (reveldb_committer_t *)userdata, db, durability,
+            _rpc_update_decr, &update);
     return;
 }
 
@@ -3236,14 +5108,14 @@ URI_rpc_cas_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    reveldb_durability_t durability;
     bool is_quiet = false;
-    char *value = NULL;
+    rpc_update_t update;
     char *response = NULL;
     const char *key = NULL;
     const char *oval = NULL;
     const char *nval = NULL;
     const char *dbname = NULL;
-    unsigned int value_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -3253,6 +5125,12 @@ URI_rpc_cas_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "Please specify which key to get.");
     if (response != NULL) {
@@ -3277,83 +5155,21 @@ URI_rpc_cas_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
         return;
     }
-   
-    value = leveldb_get(
-            db->instance->db,
-            db->instance->roptions,
-            key, strlen(key),
-            &value_len,
-            &(db->instance->err));
-    if (value != NULL) {
-        if (value_len != strlen(oval)) {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_response_on_error(req,
-                        EVHTTPX_RES_NOTFOUND, "Not Found", "Value not found.");
-            } else {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                        "Not Found", "Value not found.");
-            }
-            _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-            return;
-        } else {
-            if (strncmp(value, oval, value_len) == 0) {
-                leveldb_put(
-                        db->instance->db,
-                        db->instance->woptions,
-                        key, strlen(key),
-                        nval, strlen(nval),
-                        &(db->instance->err));
-                if (db->instance->err != NULL) {
-                    if (is_quiet == false) {
-                        response = _rpc_jsonfy_response_on_error(req,
-                                EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
-                    } else {
-                        response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                                "Internal Server Error", db->instance->err);
-                    }
-                    xleveldb_reset_err(db->instance);
-                    _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
-                } else {
-                    if (is_quiet == false) {
-                        response = _rpc_jsonfy_response_on_kv_with_len(
-                                key, strlen(key), value, value_len);
-                    } else {
-                        response = _rpc_jsonfy_quiet_response_on_kv_with_len(
-                                key, strlen(key), value, value_len);
-                    }
-                    free(value);
-                    _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
-                }
-                return;
-            } else {
-                if (is_quiet == false) {
-                    response = _rpc_jsonfy_response_on_error(req,
-                            EVHTTPX_RES_NOTFOUND, "Not Found", "Value not found.");
-                } else {
-                    response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                            "Not Found", "Value not found.");
-                }
-                _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-                return;
-            }
-        }
-    } else {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_NOTFOUND, "Not Found", "Key not found.");
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                     "Not Found", "Key not found.");
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-    }
+
+    memset(&update, 0, sizeof(rpc_update_t));
+    update.write.quiet = is_quiet;
+    update.key = key;
+    update.oval = oval;
+    update.value = nval;
+    _rpc_update(req, (reveldb_committer_t *)userdata, db, durability,
+            _rpc_update_cas, &update);
     return;
 }
 
@@ -3362,14 +5178,13 @@ URI_rpc_replace_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    reveldb_durability_t durability;
     bool is_quiet = false;
-    char *value_old = NULL;
-    tstring_t *value_new = NULL;
+    rpc_update_t update;
     char *response = NULL;
     const char *key = NULL;
     const char *value = NULL;
     const char *dbname = NULL;
-    unsigned int value_old_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -3379,6 +5194,12 @@ URI_rpc_replace_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "You have to specify which key to replace.");
     if (response != NULL) {
@@ -3396,61 +5217,20 @@ URI_rpc_replace_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
-        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                "Not Found", "Database not found, please check.");
-        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
-        return;
-    }
-   
-    value_old = leveldb_get(
-            db->instance->db,
-            db->instance->roptions,
-            key, strlen(key),
-            &value_old_len,
-            &(db->instance->err));
-    if (value_old != NULL) {
-        value_new = tstring_new_len(value, strlen(value));
-        leveldb_put(
-            db->instance->db,
-            db->instance->woptions,
-            key, strlen(key),
-            tstring_data(value_new), tstring_size(value_new),
-            &(db->instance->err));
-        if (db->instance->err != NULL) {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_response_on_error(req,
-                        EVHTTPX_RES_SERVERR, "Internal Server Error",
-                        db->instance->err);
-            } else {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                        "Internal Server Error", db->instance->err);
-            }
-        } else {
-            if (is_quiet == false) {
-                response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                        "OK", "Replace value done.");
-            } else {
-                response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
-            }
-        } 
-        leveldb_free(value_old);
-        tstring_free(value_new);
-
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK);
-    } else {
-
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_NOTFOUND, "Not Found", "Key value pair not found.");
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
-                     "Not Found", "Key value pair not found.");
-        }
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
     }
 
+    memset(&update, 0, sizeof(rpc_update_t));
+    update.write.quiet = is_quiet;
+    update.key = key;
+    update.value = value;
+    _rpc_update(req, (reveldb_committer_t *)userdata, db, durability,
+            _rpc_update_replace, &update);
     return;
 }
 
@@ -3459,6 +5239,8 @@ URI_rpc_del_cb(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    leveldb_writebatch_t *batch = NULL;
+    reveldb_durability_t durability;
     char *response = NULL;
     const char *key = NULL;
     const char *dbname = NULL;
@@ -3472,6 +5254,12 @@ URI_rpc_del_cb(evhttpx_request_t *req, void *userdata)
     
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     response = _rpc_query_param_sanity_check(req,
             &key, "key", "You have to specify which key to delete.");
     if (response != NULL) {
@@ -3482,7 +5270,7 @@ URI_rpc_del_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -3490,33 +5278,16 @@ URI_rpc_del_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    leveldb_delete(
-            db->instance->db,
-            db->instance->woptions,
-            key, strlen(key),
-            &(db->instance->err));
-    if (db->instance->err != NULL) {
-        if (is_quiet == false ) {
-        response = _rpc_jsonfy_response_on_error(req,
-                EVHTTPX_RES_SERVERR, 
-                "Internal Server Error",
-                db->instance->err);
-        } else {
-            response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR, 
-                "Internal Server Error",
-                db->instance->err);
-        }
-        xleveldb_reset_err(db->instance);
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+    batch = leveldb_writebatch_create();
+    leveldb_writebatch_delete(batch, key, strlen(key));
+    if (is_quiet == false) {
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOCONTENT,
+                "No Content", "Delete key done.");
     } else {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOCONTENT,
-                    "No Content", "Delete key done.");
-        } else {
-            response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_NOCONTENT);
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+        response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_NOCONTENT);
     }
+    _rpc_commit(req, (reveldb_committer_t *)userdata, db, batch,
+            durability, is_quiet, response, EVHTTPX_RES_OK);
 
     return;
 }
@@ -3529,6 +5300,8 @@ URI_rpc_mdel_cb(evhttpx_request_t *req, void *userdata)
     const char *dbname = NULL;
     bool is_quiet = false;
     char *response = NULL;
+    leveldb_writebatch_t *batch = NULL;
+    reveldb_durability_t durability;
     
     response = _rpc_proto_and_method_sanity_check2nd(req, http_method_POST, &code);
     if (response != NULL) {
@@ -3538,10 +5311,16 @@ URI_rpc_mdel_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -3549,23 +5328,36 @@ URI_rpc_mdel_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    response = _rpc_do_mdel(req, db, is_quiet);
+    response = _rpc_do_mdel(req, db, is_quiet, &batch);
+    if (batch != NULL) {
+        _rpc_commit(req, (reveldb_committer_t *)userdata, db, batch,
+                durability, is_quiet, response, EVHTTPX_RES_OK);
+        return;
+    }
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
     return;
 }
 
+/* deletes of a range remove written at once, the range may be too large
+ * for a single batch. */
+#define RPC_REMOVE_BATCH_KEYS 4096
+
 static void
-URI_rpc_remove_cb(evhttpx_request_t *req, void *userdata)
+_rpc_remove_job(evhttpx_request_t *req, void *userdata)
 {
     /* json formatted response. */
     unsigned int code = 0;
+    char *err = NULL;
     bool is_quiet = false;
     char *response = NULL;
     const char *start_key = NULL;
     const char *end_key = NULL;
     bool has_end_key = false;
     const char *dbname = NULL;
-    leveldb_iterator_t* iter = NULL;
+    xleveldb_cursor_t *iter = NULL;
+    leveldb_writebatch_t *batch = NULL;
+    size_t nkeys = 0;
+    reveldb_durability_t durability;
     evhttpx_query_t *query = req->uri->query;
 
     response = _rpc_proto_and_method_sanity_check(req, &code);
@@ -3576,13 +5368,19 @@ URI_rpc_remove_cb(evhttpx_request_t *req, void *userdata)
 
     is_quiet = _rpc_query_quiet_check(req);
 
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
+
     start_key = evhttpx_kv_find(query, "start");
     end_key = evhttpx_kv_find(query, "end");
     dbname = evhttpx_kv_find(query, "db");
 
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -3590,36 +5388,58 @@ URI_rpc_remove_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
    
-    iter = leveldb_create_iterator(db->instance->db,
+    iter = xleveldb_cursor_create(db->instance,
             db->instance->roptions);
     if (start_key == NULL) {
-        leveldb_iter_seek_to_first(iter);
-        assert(leveldb_iter_valid(iter));
+        xleveldb_cursor_seek_to_first(iter);
+        assert(xleveldb_cursor_valid(iter));
     } else {
-        leveldb_iter_seek(iter, start_key, strlen(start_key));
-        assert(leveldb_iter_valid(iter));
+        xleveldb_cursor_seek(iter, start_key, strlen(start_key));
+        assert(xleveldb_cursor_valid(iter));
     }
 
     if (end_key != NULL) has_end_key = true;
 
-    while(true) {
-        if (!leveldb_iter_valid(iter)) break;
+    /* the deletes go through the committer, like any other write, so that
+     * none of them comes in between what an update reads and writes. */
+    batch = leveldb_writebatch_create();
+    while(err == NULL) {
+        if (!xleveldb_cursor_valid(iter)) break;
         size_t key_len = -1;
-        const char *key = leveldb_iter_key(iter, &key_len);
+        const char *key = xleveldb_cursor_key(iter, &key_len);
+        /* end is excluded, in the order of the database. */
         if ((has_end_key == true)
-                && (strlen(end_key) == key_len)
-                && (strncmp(key, end_key, key_len) == 0)) break;
-        leveldb_delete(
-                db->instance->db,
-                db->instance->woptions,
-                key, key_len,
-                &(db->instance->err));
-        if (db->instance->err != NULL) {
-            xleveldb_reset_err(db->instance);
+                && (xleveldb_compare(db->instance, key, key_len,
+                        end_key, strlen(end_key)) >= 0)) break;
+        leveldb_writebatch_delete(batch, key, key_len);
+        if (++nkeys == RPC_REMOVE_BATCH_KEYS) {
+            reveldb_committer_write_wait((reveldb_committer_t *)userdata,
+                    db, batch, durability, &err);
+            batch = leveldb_writebatch_create();
+            nkeys = 0;
+        }
+        xleveldb_cursor_next(iter);
+    }
+    xleveldb_cursor_destroy(iter);
+    if (err == NULL && nkeys > 0) {
+        reveldb_committer_write_wait((reveldb_committer_t *)userdata,
+                db, batch, durability, &err);
+    } else {
+        leveldb_writebatch_destroy(batch);
+    }
+
+    if (err != NULL) {
+        if (is_quiet == false) {
+            response = _rpc_jsonfy_response_on_error(req,
+                    EVHTTPX_RES_SERVERR, "Internal Server Error", err);
+        } else {
+            response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
+                    "Internal Server Error", err);
         }
-        leveldb_iter_next(iter);
+        _rpc_reset_err(&err);
+        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+        return;
     }
-    leveldb_iter_destroy(iter);
 
     if (is_quiet == false) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOCONTENT,
@@ -3632,6 +5452,78 @@ URI_rpc_remove_cb(evhttpx_request_t *req, void *userdata)
     return;
 }
 
+static void
+URI_rpc_remove_cb(evhttpx_request_t *req, void *userdata)
+{
+    reveldb_executor_submit(((reveldb_rpc_t *)userdata)->executor,
+            req, _rpc_remove_job, ((reveldb_rpc_t *)userdata)->committer);
+}
+
+/* iterators and write batches are looked up under the lock of their
+ * registry only, a reference keeps them around and their own lock keeps
+ * other requests off them until the request is done. */
+static void
+_rpc_iter_unref(xleveldb_iter_t *iter)
+{
+    unsigned int refs = 0;
+
+    pthread_mutex_lock(&dbiter_lock);
+    refs = --iter->refs;
+    pthread_mutex_unlock(&dbiter_lock);
+    if (refs == 0) xleveldb_free_iter(iter);
+}
+
+static xleveldb_iter_t *
+_rpc_iter_checkout(const char *iter_id)
+{
+    xleveldb_iter_t *iter = NULL;
+
+    pthread_mutex_lock(&dbiter_lock);
+    iter = xleveldb_search_iter(&dbiter, iter_id);
+    if (iter != NULL) iter->refs++;
+    pthread_mutex_unlock(&dbiter_lock);
+    if (iter != NULL) pthread_mutex_lock(&iter->lock);
+    return iter;
+}
+
+static void
+_rpc_iter_checkin(xleveldb_iter_t *iter)
+{
+    pthread_mutex_unlock(&iter->lock);
+    _rpc_iter_unref(iter);
+}
+
+static void
+_rpc_writebatch_unref(xleveldb_writebatch_t *batch)
+{
+    unsigned int refs = 0;
+
+    pthread_mutex_lock(&dbwritebatch_lock);
+    refs = --batch->refs;
+    pthread_mutex_unlock(&dbwritebatch_lock);
+    if (refs == 0) xleveldb_free_writebatch(batch);
+}
+
+static xleveldb_writebatch_t *
+_rpc_writebatch_checkout(const char *batch_id)
+{
+    xleveldb_writebatch_t *batch = NULL;
+
+    pthread_mutex_lock(&dbwritebatch_lock);
+    batch = xleveldb_search_writebatch(&dbwritebatch, batch_id);
+    if (batch != NULL) batch->refs++;
+    pthread_mutex_unlock(&dbwritebatch_lock);
+    if (batch != NULL) pthread_mutex_lock(&batch->lock);
+    return batch;
+}
+
+static void
+_rpc_writebatch_checkin(xleveldb_writebatch_t *batch)
+{
+    pthread_mutex_unlock(&batch->lock);
+    _rpc_writebatch_unref(batch);
+}
+
 static void
 URI_rpc_iter_new_cb(evhttpx_request_t *req, void *userdata)
 {
@@ -3658,7 +5550,7 @@ URI_rpc_iter_new_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -3667,7 +5559,15 @@ URI_rpc_iter_new_cb(evhttpx_request_t *req, void *userdata)
     }
     _rpc_query_snapshot_check(req, &snapshot_id);
     if (snapshot_id != NULL) {
+        pthread_rwlock_rdlock(&dbsnapshot_lock);
         snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
+        if (snapshot == NULL) {
+            pthread_rwlock_unlock(&dbsnapshot_lock);
+            response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                    "Not Found", "Snapshot not found, please check.");
+            _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+            return;
+        }
         roptions = leveldb_readoptions_create();
         leveldb_readoptions_set_verify_checksums(roptions,
                 reveldb_config->db_config->verify_checksums);
@@ -3682,7 +5582,11 @@ URI_rpc_iter_new_cb(evhttpx_request_t *req, void *userdata)
     /* init new leveldb iterator and insert it into dbiter. */
     xleveldb_iter_t *iter = xleveldb_init_iter(uuid_str, db, roptions,
             (snapshot == NULL) ? false : true);
+    /* the iterator pins the snapshot from now on. */
+    if (snapshot_id != NULL) pthread_rwlock_unlock(&dbsnapshot_lock);
+    pthread_mutex_lock(&dbiter_lock);
     xleveldb_insert_iter(&dbiter, iter);
+    pthread_mutex_unlock(&dbiter_lock);
 
     if (is_quiet == false) {
         response = _rpc_jsonfy_response_on_iter(uuid_str);
@@ -3690,7 +5594,6 @@ URI_rpc_iter_new_cb(evhttpx_request_t *req, void *userdata)
         response = _rpc_jsonfy_quiet_response_on_iter(uuid_str);
     }
     _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
-
     return;
 }
 
@@ -3719,7 +5622,7 @@ URI_rpc_iter_first_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -3736,7 +5639,7 @@ URI_rpc_iter_first_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -3744,9 +5647,11 @@ URI_rpc_iter_first_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -3775,7 +5680,7 @@ URI_rpc_iter_last_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -3792,7 +5697,7 @@ URI_rpc_iter_last_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -3800,9 +5705,11 @@ URI_rpc_iter_last_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -3831,7 +5738,7 @@ URI_rpc_iter_next_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -3847,7 +5754,7 @@ URI_rpc_iter_next_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -3855,9 +5762,11 @@ URI_rpc_iter_next_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -3886,7 +5795,7 @@ URI_rpc_iter_prev_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -3902,7 +5811,7 @@ URI_rpc_iter_prev_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -3910,9 +5819,11 @@ URI_rpc_iter_prev_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -3958,7 +5869,7 @@ URI_rpc_iter_forward_cb(evhttpx_request_t *req, void *userdata)
         }
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -3974,7 +5885,7 @@ URI_rpc_iter_forward_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -3982,9 +5893,11 @@ URI_rpc_iter_forward_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -4030,7 +5943,7 @@ URI_rpc_iter_backward_cb(evhttpx_request_t *req, void *userdata)
         }
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -4046,7 +5959,7 @@ URI_rpc_iter_backward_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -4054,9 +5967,11 @@ URI_rpc_iter_backward_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -4093,7 +6008,7 @@ URI_rpc_iter_seek_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -4109,7 +6024,7 @@ URI_rpc_iter_seek_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -4117,9 +6032,11 @@ URI_rpc_iter_seek_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -4132,7 +6049,7 @@ URI_rpc_iter_key_cb(evhttpx_request_t *req, void *userdata)
     char *response = NULL;
     const char *iter_id = NULL;
     const char *key = NULL;
-    unsigned int key_len = 0;
+    size_t key_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -4150,7 +6067,7 @@ URI_rpc_iter_key_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -4167,7 +6084,7 @@ URI_rpc_iter_key_cb(evhttpx_request_t *req, void *userdata)
             response = _rpc_jsonfy_quiet_response_on_kv_with_len(
                     "key", 3, key, key_len);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -4175,9 +6092,11 @@ URI_rpc_iter_key_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -4190,7 +6109,7 @@ URI_rpc_iter_value_cb(evhttpx_request_t *req, void *userdata)
     char *response = NULL;
     const char *iter_id = NULL;
     const char *value = NULL;
-    unsigned int value_len = 0;
+    size_t value_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -4208,7 +6127,7 @@ URI_rpc_iter_value_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -4225,7 +6144,7 @@ URI_rpc_iter_value_cb(evhttpx_request_t *req, void *userdata)
             response = _rpc_jsonfy_quiet_response_on_kv_with_len(
                     "value", 5, value, value_len);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -4233,9 +6152,11 @@ URI_rpc_iter_value_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -4248,9 +6169,9 @@ URI_rpc_iter_kv_cb(evhttpx_request_t *req, void *userdata)
     char *response = NULL;
     const char *iter_id = NULL;
     const char *key = NULL;
-    unsigned int key_len = 0;
+    size_t key_len = 0;
     const char *value = NULL;
-    unsigned int value_len = 0;
+    size_t value_len = 0;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -4268,7 +6189,7 @@ URI_rpc_iter_kv_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    xleveldb_iter_t *iter = _rpc_iter_checkout(iter_id);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -4285,7 +6206,7 @@ URI_rpc_iter_kv_cb(evhttpx_request_t *req, void *userdata)
             response = _rpc_jsonfy_quiet_response_on_kv_with_len(
                     key, key_len, value, value_len);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+        code = EVHTTPX_RES_OK;
     } else {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
@@ -4293,9 +6214,11 @@ URI_rpc_iter_kv_cb(evhttpx_request_t *req, void *userdata)
         } else {
             response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_SERVERR);
         }
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR); 
+        code = EVHTTPX_RES_SERVERR;
     }
 
+    _rpc_iter_checkin(iter);
+    _rpc_send_reply(req, response, code);
     return;
 }
 
@@ -4324,7 +6247,10 @@ URI_rpc_iter_destroy_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
+    pthread_mutex_lock(&dbiter_lock);
     xleveldb_iter_t *iter = xleveldb_search_iter(&dbiter, iter_id);
+    if (iter != NULL) rb_erase(&(iter->node), &dbiter);
+    pthread_mutex_unlock(&dbiter_lock);
     if (iter == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Iterator not found, please check.");
@@ -4332,8 +6258,8 @@ URI_rpc_iter_destroy_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_free_iter(iter);
-    rb_erase(&(iter->node), &dbiter);
+    /* requests still using it free it once they are done. */
+    _rpc_iter_unref(iter);
     if (is_quiet == false) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK, "OK",
                 "Iterator destroyed");
@@ -4341,7 +6267,6 @@ URI_rpc_iter_destroy_cb(evhttpx_request_t *req, void *userdata)
         response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
     _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
-    
     return;
 }
 
@@ -4367,19 +6292,28 @@ URI_rpc_snapshot_new_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
         return;
     }
+    if (db->instance->nshards > 1) {
+        response = _rpc_jsonfy_response_on_error(req,
+                EVHTTPX_RES_BADREQ, "Bad Request",
+                "Snapshots are not supported on sharded databases.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
 
     uuid_create(&id);
     uuid_to_string(&id, uuid_str, sizeof(uuid_str));
     /* init new leveldb iterator and insert it into dbiter. */
     xleveldb_snapshot_t *snapshot = xleveldb_init_snapshot(uuid_str, db);
+    pthread_rwlock_wrlock(&dbsnapshot_lock);
     xleveldb_insert_snapshot(&dbsnapshot, snapshot);
+    pthread_rwlock_unlock(&dbsnapshot_lock);
 
     if (is_quiet == false) {
         response = _rpc_jsonfy_response_on_iter(uuid_str);
@@ -4416,17 +6350,19 @@ URI_rpc_snapshot_release_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
+    pthread_rwlock_wrlock(&dbsnapshot_lock);
     xleveldb_snapshot_t *snapshot =
         xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
     if (snapshot == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Snapshot not found, please check.");
         _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        pthread_rwlock_unlock(&dbsnapshot_lock);
         return;
     }
 
-    xleveldb_free_snapshot(snapshot);
     rb_erase(&(snapshot->node), &dbsnapshot);
+    xleveldb_free_snapshot(snapshot);
     if (is_quiet == false) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK, "OK",
                 "Snapshot released.");
@@ -4435,6 +6371,7 @@ URI_rpc_snapshot_release_cb(evhttpx_request_t *req, void *userdata)
     }
 
     _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
+    pthread_rwlock_unlock(&dbsnapshot_lock);
     return;
 }
 
@@ -4460,7 +6397,7 @@ URI_rpc_writebatch_new_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -4472,7 +6409,9 @@ URI_rpc_writebatch_new_cb(evhttpx_request_t *req, void *userdata)
     uuid_to_string(&id, uuid_str, sizeof(uuid_str));
     /* init new leveldb iterator and insert it into dbiter. */
     xleveldb_writebatch_t *writebatch= xleveldb_init_writebatch(uuid_str, db);
+    pthread_mutex_lock(&dbwritebatch_lock);
     xleveldb_insert_writebatch(&dbwritebatch, writebatch);
+    pthread_mutex_unlock(&dbwritebatch_lock);
 
     if (is_quiet == false) {
         response = _rpc_jsonfy_response_on_iter(uuid_str);
@@ -4525,8 +6464,7 @@ URI_rpc_writebatch_put_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_writebatch_t *batch =
-        xleveldb_search_writebatch(&dbwritebatch, batch_id);
+    xleveldb_writebatch_t *batch = _rpc_writebatch_checkout(batch_id);
     if (batch == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Batch not found, please check.");
@@ -4547,6 +6485,7 @@ URI_rpc_writebatch_put_cb(evhttpx_request_t *req, void *userdata)
         response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
 
+    _rpc_writebatch_checkin(batch);
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
     return;
 }
@@ -4584,8 +6523,7 @@ URI_rpc_writebatch_del_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_writebatch_t *batch =
-        xleveldb_search_writebatch(&dbwritebatch, batch_id);
+    xleveldb_writebatch_t *batch = _rpc_writebatch_checkout(batch_id);
     if (batch == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Batch not found, please check.");
@@ -4604,6 +6542,7 @@ URI_rpc_writebatch_del_cb(evhttpx_request_t *req, void *userdata)
         response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
 
+    _rpc_writebatch_checkin(batch);
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
     return;
 }
@@ -4633,8 +6572,7 @@ URI_rpc_writebatch_clear_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_writebatch_t *batch =
-        xleveldb_search_writebatch(&dbwritebatch, batch_id);
+    xleveldb_writebatch_t *batch = _rpc_writebatch_checkout(batch_id);
     if (batch == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Batch not found, please check.");
@@ -4651,10 +6589,25 @@ URI_rpc_writebatch_clear_cb(evhttpx_request_t *req, void *userdata)
         response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
     
+    _rpc_writebatch_checkin(batch);
     _rpc_send_reply(req, response, EVHTTPX_RES_OK);
     return;
 }
 
+static void
+_rpc_writebatch_copy_put(void *state,
+        const char *key, size_t klen,
+        const char *val, size_t vlen)
+{
+    leveldb_writebatch_put((leveldb_writebatch_t *)state, key, klen, val, vlen);
+}
+
+static void
+_rpc_writebatch_copy_delete(void *state, const char *key, size_t klen)
+{
+    leveldb_writebatch_delete((leveldb_writebatch_t *)state, key, klen);
+}
+
 static void
 URI_rpc_writebatch_commit_cb(evhttpx_request_t *req, void *userdata)
 {
@@ -4664,6 +6617,8 @@ URI_rpc_writebatch_commit_cb(evhttpx_request_t *req, void *userdata)
     const char *batch_id = NULL;
     bool is_quiet = false;
     char *response = NULL;
+    leveldb_writebatch_t *copy = NULL;
+    reveldb_durability_t durability;
     
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
@@ -4672,11 +6627,17 @@ URI_rpc_writebatch_commit_cb(evhttpx_request_t *req, void *userdata)
     }
 
     is_quiet = _rpc_query_quiet_check(req);
+
+    response = _rpc_query_durability_check(req, &durability);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, EVHTTPX_RES_BADREQ);
+        return;
+    }
     
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -4692,8 +6653,7 @@ URI_rpc_writebatch_commit_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_writebatch_t *batch =
-        xleveldb_search_writebatch(&dbwritebatch, batch_id);
+    xleveldb_writebatch_t *batch = _rpc_writebatch_checkout(batch_id);
     if (batch == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Batch not found, please check.");
@@ -4701,31 +6661,23 @@ URI_rpc_writebatch_commit_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    leveldb_write(
-            db->instance->db,
-            db->instance->woptions,
-            batch->writebatch,
-            &(db->instance->err));
-    if (db->instance->err != NULL) {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_response_on_error(req,
-                    EVHTTPX_RES_SERVERR, "Internal Server Error", db->instance->err);
-        } else {
-             response = _rpc_jsonfy_general_response(EVHTTPX_RES_SERVERR,
-                     "Internal Server Error", db->instance->err);
-        }
-        xleveldb_reset_err(db->instance);
-        _rpc_send_reply(req, response, EVHTTPX_RES_SERVERR);
+    /* the committer writes a copy, the batch stays registered and may be
+     * changed and committed again meanwhile. going through the committer
+     * keeps the batch from coming in between what an update reads and
+     * writes. */
+    copy = leveldb_writebatch_create();
+    leveldb_writebatch_iterate(batch->writebatch, copy,
+            _rpc_writebatch_copy_put, _rpc_writebatch_copy_delete);
+    _rpc_writebatch_checkin(batch);
+
+    if (is_quiet == false) {
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
+                "OK", "Writebatch done.");
     } else {
-        if (is_quiet == false) {
-            response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
-                    "OK", "Writebatch done.");
-        } else {
-            response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
-        }
-        _rpc_send_reply(req, response, EVHTTPX_RES_OK);
+        response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
-
+    _rpc_commit(req, (reveldb_committer_t *)userdata, db, copy,
+            durability, is_quiet, response, EVHTTPX_RES_OK);
     return;
 }
 
@@ -4754,8 +6706,11 @@ URI_rpc_writebatch_destroy_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
+    pthread_mutex_lock(&dbwritebatch_lock);
     xleveldb_writebatch_t *batch=
         xleveldb_search_writebatch(&dbwritebatch, batch_id);
+    if (batch != NULL) rb_erase(&(batch->node), &dbwritebatch);
+    pthread_mutex_unlock(&dbwritebatch_lock);
     if (batch == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Writebatch not found, please check.");
@@ -4763,8 +6718,8 @@ URI_rpc_writebatch_destroy_cb(evhttpx_request_t *req, void *userdata)
         return;
     }
 
-    xleveldb_free_writebatch(batch);
-    rb_erase(&(batch->node), &dbwritebatch);
+    /* requests still using it free it once they are done. */
+    _rpc_writebatch_unref(batch);
     if (is_quiet == false) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK, "OK",
                 "Writebatch destroyed");
@@ -4772,7 +6727,6 @@ URI_rpc_writebatch_destroy_cb(evhttpx_request_t *req, void *userdata)
         response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_OK);
     }
     _rpc_send_reply(req, response, EVHTTPX_RES_OK); 
-    
     return;
 }
 
@@ -4790,7 +6744,6 @@ URI_rpc_check_cb(evhttpx_request_t *req, void *userdata)
     /* json formatted response. */
     unsigned int code = 0;
     bool is_quiet = false;
-    char *value = NULL;
     char *response = NULL;
     const char *key = NULL;
     const char *dbname = NULL;
@@ -4798,8 +6751,6 @@ URI_rpc_check_cb(evhttpx_request_t *req, void *userdata)
     xleveldb_snapshot_t *snapshot = NULL;
     leveldb_readoptions_t *roptions = NULL;
 
-    unsigned int value_len = 0;
-
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
         _rpc_send_reply(req, response, code);
@@ -4818,7 +6769,7 @@ URI_rpc_check_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -4828,7 +6779,15 @@ URI_rpc_check_cb(evhttpx_request_t *req, void *userdata)
 
     _rpc_query_snapshot_check(req, &snapshot_id);
     if (snapshot_id != NULL) {
+        pthread_rwlock_rdlock(&dbsnapshot_lock);
         snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
+        if (snapshot == NULL) {
+            pthread_rwlock_unlock(&dbsnapshot_lock);
+            response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                    "Not Found", "Snapshot not found, please check.");
+            _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+            return;
+        }
         roptions = leveldb_readoptions_create();
         leveldb_readoptions_set_verify_checksums(roptions,
                 reveldb_config->db_config->verify_checksums);
@@ -4838,13 +6797,10 @@ URI_rpc_check_cb(evhttpx_request_t *req, void *userdata)
                 snapshot->snapshot);
     }
 
-    value = leveldb_get(
-            db->instance->db,
+    if (xleveldb_exists(
+            db->instance,
             (snapshot == NULL) ? db->instance->roptions : roptions,
-            key, strlen(key),
-            &value_len,
-            &(db->instance->err));
-    if (value != NULL) {
+            key, strlen(key))) {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
                     "OK", "Key exists.");
@@ -4869,6 +6825,7 @@ URI_rpc_check_cb(evhttpx_request_t *req, void *userdata)
         leveldb_readoptions_destroy(roptions);
     }
 
+    if (snapshot_id != NULL) pthread_rwlock_unlock(&dbsnapshot_lock);
     return;
 }
 
@@ -4878,7 +6835,6 @@ URI_rpc_exists_cb(evhttpx_request_t *req, void *userdata)
     /* json formatted response. */
     unsigned int code = 0;
     bool is_quiet = false;
-    char *value = NULL;
     char *response = NULL;
     const char *key = NULL;
     const char *dbname = NULL;
@@ -4886,8 +6842,6 @@ URI_rpc_exists_cb(evhttpx_request_t *req, void *userdata)
     xleveldb_snapshot_t *snapshot = NULL;
     leveldb_readoptions_t *roptions = NULL;
 
-    unsigned int value_len = 0;
-
     response = _rpc_proto_and_method_sanity_check(req, &code);
     if (response != NULL) {
         _rpc_send_reply(req, response, code);
@@ -4906,7 +6860,7 @@ URI_rpc_exists_cb(evhttpx_request_t *req, void *userdata)
     _rpc_query_database_check(req, &dbname);
     if ((dbname == NULL)) dbname =
         reveldb_config->db_config->dbname;
-    reveldb_t *db = reveldb_search_db(&reveldb, dbname);
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
     if (db == NULL) {
         response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
                 "Not Found", "Database not found, please check.");
@@ -4916,7 +6870,15 @@ URI_rpc_exists_cb(evhttpx_request_t *req, void *userdata)
 
     _rpc_query_snapshot_check(req, &snapshot_id);
     if (snapshot_id != NULL) {
+        pthread_rwlock_rdlock(&dbsnapshot_lock);
         snapshot = xleveldb_search_snapshot(&dbsnapshot, snapshot_id);
+        if (snapshot == NULL) {
+            pthread_rwlock_unlock(&dbsnapshot_lock);
+            response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                    "Not Found", "Snapshot not found, please check.");
+            _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+            return;
+        }
         roptions = leveldb_readoptions_create();
         leveldb_readoptions_set_verify_checksums(roptions,
                 reveldb_config->db_config->verify_checksums);
@@ -4926,13 +6888,10 @@ URI_rpc_exists_cb(evhttpx_request_t *req, void *userdata)
                 snapshot->snapshot);
     }
 
-    value = leveldb_get(
-            db->instance->db,
-            (snapshot == NULL) ? db->instance->roptions :roptions ,
-            key, strlen(key),
-            &value_len,
-            &(db->instance->err));
-    if (value != NULL) {
+    if (xleveldb_exists(
+            db->instance,
+            (snapshot == NULL) ? db->instance->roptions : roptions,
+            key, strlen(key))) {
         if (is_quiet == false) {
             response = _rpc_jsonfy_general_response(EVHTTPX_RES_OK,
                     "OK", "Key exists.");
@@ -4955,6 +6914,117 @@ URI_rpc_exists_cb(evhttpx_request_t *req, void *userdata)
         leveldb_readoptions_set_snapshot(roptions, NULL);
         leveldb_readoptions_destroy(roptions);
     }
+    if (snapshot_id != NULL) pthread_rwlock_unlock(&dbsnapshot_lock);
+    return;
+}
+
+static char *
+_rpc_do_mexists(evhttpx_request_t *req, reveldb_t *db, bool quiet)
+{
+    assert(req != NULL);
+    cJSON *root = NULL;
+    cJSON *keys = NULL;
+    cJSON *result = NULL;
+    char *response = NULL;
+    int items = 0;
+    int arridx = -1;
+    cJSON *item = NULL;
+    const char **key_array = NULL;
+    size_t *key_lens = NULL;
+    bool *exists = NULL;
+    char now[GMTTIME_LEN];
+
+    /* buffer containing data from client */
+    evbuf_t *buffer_in = req->buffer_in;
+    size_t buffer_in_size = -1;
+    char *inbuffer =
+        evbuffer_readln(buffer_in, &buffer_in_size, EVBUFFER_EOL_CRLF);
+
+    root = (inbuffer != NULL) ? cJSON_Parse(inbuffer) : NULL;
+    free(inbuffer);
+    keys = (root != NULL) ? cJSON_GetObjectItem(root, "keys") : NULL;
+    if (keys == NULL) {
+        if (root != NULL) cJSON_Delete(root);
+        if (quiet == false) {
+            response = _rpc_jsonfy_response_on_error(req, EVHTTPX_RES_BADREQ,
+                    "Bad Request", "Invalid post filed format.");
+        } else {
+            response = _rpc_jsonfy_quiet_response(EVHTTPX_RES_BADREQ);
+        }
+        return response;
+    }
+
+    items = cJSON_GetArraySize(keys);
+    key_array = (const char **)malloc(sizeof(char *) * (items + 1));
+    key_lens = (size_t *)malloc(sizeof(size_t) * (items + 1));
+    exists = (bool *)malloc(sizeof(bool) * (items + 1));
+    assert(key_array != NULL && key_lens != NULL && exists != NULL);
+
+    for (arridx = 0, item = keys->child;
+            arridx < items; arridx++, item = item->next) {
+        const char *key = item->valuestring;
+        key_array[arridx] = (key != NULL) ? key : "";
+        key_lens[arridx] = strlen(key_array[arridx]);
+    }
+    xleveldb_mexists(db->instance, db->instance->roptions,
+            items, key_array, key_lens, exists);
+
+    result = cJSON_CreateObject();
+    for (arridx = 0; arridx < items; arridx++) {
+        cJSON_AddItemToObject(result, key_array[arridx],
+                exists[arridx] ? cJSON_CreateTrue() : cJSON_CreateFalse());
+    }
+    free(key_array);
+    free(key_lens);
+    free(exists);
+    cJSON_Delete(root);
+
+    root = cJSON_CreateObject();
+    if (quiet == false) {
+        gmttime_now_r(now, sizeof(now));
+        cJSON_AddNumberToObject(root, "code", EVHTTPX_RES_OK);
+        cJSON_AddStringToObject(root, "status", "OK");
+        cJSON_AddStringToObject(root, "message", "Check keys done.");
+        cJSON_AddStringToObject(root, "date", now);
+    }
+    cJSON_AddItemToObject(root, "exists", result);
+    /* unformatted json has less data. */
+    response = cJSON_PrintUnformatted(root);
+
+    cJSON_Delete(root);
+    return response;
+}
+
+static void
+URI_rpc_mexists_cb(evhttpx_request_t *req, void *userdata)
+{
+    /* json formatted response. */
+    unsigned int code = 0;
+    const char *dbname = NULL;
+    bool is_quiet = false;
+    char *response = NULL;
+    
+    response = _rpc_proto_and_method_sanity_check2nd(req, http_method_POST, &code);
+    if (response != NULL) {
+        _rpc_send_reply(req, response, code);
+        return;
+    }
+
+    is_quiet = _rpc_query_quiet_check(req);
+
+    _rpc_query_database_check(req, &dbname);
+    if ((dbname == NULL)) dbname =
+        reveldb_config->db_config->dbname;
+    reveldb_t *db = reveldb_request_db(&reveldb, req, dbname);
+    if (db == NULL) {
+        response = _rpc_jsonfy_general_response(EVHTTPX_RES_NOTFOUND,
+                "Not Found", "Database not found, please check.");
+        _rpc_send_reply(req, response, EVHTTPX_RES_NOTFOUND);
+        return;
+    }
+
+    response = _rpc_do_mexists(req, db, is_quiet);
+    _rpc_send_reply(req, response, EVHTTPX_RES_OK);
     return;
 }
 
@@ -4991,8 +7061,47 @@ reveldb_rpc_init(reveldb_config_t *config)
         return NULL;
     }
 
+#ifndef EVHTTPX_DISABLE_EVTHR
+    /* must be set up before any event base is created, the commit threads
+     * acknowledge writes on the loops whatever the other settings. */
+    evthread_use_pthreads();
+#endif
+
+    /* every regex handler compiles egrep patterns, set the syntax once here
+     * instead of writing the global from concurrent requests. */
+    re_syntax_options = RE_SYNTAX_EGREP;
+
+    /* json documents built by the handlers are allocated out of the request
+     * arena and released in one go with the request. */
+    cJSON_Hooks json_hooks;
+    json_hooks.malloc_fn = evhttpx_arena_current_malloc;
+    json_hooks.free_fn = evhttpx_arena_current_free;
+    cJSON_InitHooks(&json_hooks);
+
     rpc->evbase = event_base_new();
     rpc->httpx = evhttpx_new(rpc->evbase, NULL);
+    evhttpx_set_max_pipelined_requests(rpc->httpx,
+            config->server_config->max_pipelined_requests);
+    rpc->executor = reveldb_executor_init(
+            config->server_config->storage_threads,
+            config->server_config->stream_high_watermark);
+    rpc->scanner = reveldb_executor_init(
+            config->server_config->scan_threads, 0);
+#ifndef EVHTTPX_DISABLE_EVTHR
+    rpc->committer = reveldb_committer_init(
+            config->server_config->group_commit_max_batch,
+            config->server_config->group_commit_max_wait,
+            config->server_config->commit_threads);
+#else
+    /* the loops can not be woken up from other threads, writes are done
+     * right on them. */
+    rpc->committer = NULL;
+#endif
+    rpc->compactor = reveldb_compactor_init(
+            config->server_config->compaction_rate,
+            config->server_config->compaction_range_size);
+    rpc->patterns = reveldb_pattern_cache_init(
+            config->server_config->pattern_cache_size);
 
     reveldb_rpc_callbacks_t *callbacks = (reveldb_rpc_callbacks_t *)
         malloc(sizeof(reveldb_rpc_callbacks_t));
@@ -5023,44 +7132,47 @@ reveldb_rpc_init(reveldb_config_t *config)
 
     /* admin operations. */
     callbacks->rpc_new_cb     = evhttpx_set_cb(rpc->httpx, "/rpc/new", URI_rpc_new_cb, NULL);
-    callbacks->rpc_compact_cb = evhttpx_set_cb(rpc->httpx, "/rpc/compact", URI_rpc_compact_cb, NULL);
+    callbacks->rpc_compact_cb = evhttpx_set_cb(rpc->httpx, "/rpc/compact", URI_rpc_compact_cb, rpc->compactor);
+    callbacks->rpc_compact_status_cb = evhttpx_set_cb(rpc->httpx, "/rpc/compact/status", URI_rpc_compact_status_cb, rpc->compactor);
+    callbacks->rpc_compact_cancel_cb = evhttpx_set_cb(rpc->httpx, "/rpc/compact/cancel", URI_rpc_compact_cancel_cb, rpc->compactor);
     callbacks->rpc_size_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/size", URI_rpc_size_cb, NULL);
-    callbacks->rpc_repair_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/repair", URI_rpc_repair_cb, NULL);
-    callbacks->rpc_destroy_cb = evhttpx_set_cb(rpc->httpx, "/rpc/destroy", URI_rpc_destroy_cb, NULL);
+    callbacks->rpc_repair_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/repair", URI_rpc_repair_cb, rpc->executor);
+    callbacks->rpc_destroy_cb = evhttpx_set_cb(rpc->httpx, "/rpc/destroy", URI_rpc_destroy_cb, rpc);
 
     /* set(C), get(R), update(U), delete(D) (CRUD)operations. */
 
     /* set related operations. */
-    callbacks->rpc_add_cb     = evhttpx_set_cb(rpc->httpx, "/rpc/add", URI_rpc_add_cb, NULL);
-    callbacks->rpc_set_cb     = evhttpx_set_cb(rpc->httpx, "/rpc/set", URI_rpc_set_cb, NULL);
-    callbacks->rpc_mset_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/mset", URI_rpc_mset_cb, NULL);
-    callbacks->rpc_append_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/append", URI_rpc_append_cb, NULL);
-    callbacks->rpc_prepend_cb = evhttpx_set_cb(rpc->httpx, "/rpc/prepend", URI_rpc_prepend_cb, NULL);
-    callbacks->rpc_insert_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/insert", URI_rpc_insert_cb, NULL);
+    callbacks->rpc_add_cb     = evhttpx_set_cb(rpc->httpx, "/rpc/add", URI_rpc_add_cb, rpc->committer);
+    callbacks->rpc_set_cb     = evhttpx_set_cb(rpc->httpx, "/rpc/set", URI_rpc_set_cb, rpc->committer);
+    callbacks->rpc_mset_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/mset", URI_rpc_mset_cb, rpc->committer);
+    callbacks->rpc_append_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/append", URI_rpc_append_cb, rpc->committer);
+    callbacks->rpc_prepend_cb = evhttpx_set_cb(rpc->httpx, "/rpc/prepend", URI_rpc_prepend_cb, rpc->committer);
+    callbacks->rpc_insert_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/insert", URI_rpc_insert_cb, rpc->committer);
 
     /* get related operations. */
     callbacks->rpc_get_cb     = evhttpx_set_cb(rpc->httpx, "/rpc/get", URI_rpc_get_cb, NULL);
     callbacks->rpc_mget_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/mget", URI_rpc_mget_cb, NULL);
-    callbacks->rpc_seize_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/seize", URI_rpc_seize_cb, NULL);
-    callbacks->rpc_mseize_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/mseize", URI_rpc_mseize_cb, NULL);
-    callbacks->rpc_range_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/range", URI_rpc_range_cb, NULL);
-    callbacks->rpc_regex_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/regex", URI_rpc_regex_cb, NULL);
-    callbacks->rpc_kregex_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/kregex", URI_rpc_kregex_cb, NULL);
-    callbacks->rpc_vregex_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/vregex", URI_rpc_vregex_cb, NULL);
-    callbacks->rpc_similar_cb = evhttpx_set_cb(rpc->httpx, "/rpc/similar", URI_rpc_similar_cb, NULL);
-    callbacks->rpc_similar_cb = evhttpx_set_cb(rpc->httpx, "/rpc/ksimilar", URI_rpc_ksimilar_cb, NULL);
-    callbacks->rpc_similar_cb = evhttpx_set_cb(rpc->httpx, "/rpc/vsimilar", URI_rpc_vsimilar_cb, NULL);
+    callbacks->rpc_seize_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/seize", URI_rpc_seize_cb, rpc->committer);
+    callbacks->rpc_mseize_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/mseize", URI_rpc_mseize_cb, rpc->committer);
+    callbacks->rpc_range_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/range", URI_rpc_range_cb, rpc);
+    callbacks->rpc_prefix_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/prefix", URI_rpc_prefix_cb, rpc);
+    callbacks->rpc_regex_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/regex", URI_rpc_regex_cb, rpc);
+    callbacks->rpc_kregex_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/kregex", URI_rpc_kregex_cb, rpc);
+    callbacks->rpc_vregex_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/vregex", URI_rpc_vregex_cb, rpc);
+    callbacks->rpc_similar_cb = evhttpx_set_cb(rpc->httpx, "/rpc/similar", URI_rpc_similar_cb, rpc);
+    callbacks->rpc_similar_cb = evhttpx_set_cb(rpc->httpx, "/rpc/ksimilar", URI_rpc_ksimilar_cb, rpc);
+    callbacks->rpc_similar_cb = evhttpx_set_cb(rpc->httpx, "/rpc/vsimilar", URI_rpc_vsimilar_cb, rpc);
 
     /* update related operations. */
-    callbacks->rpc_incr_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/incr", URI_rpc_incr_cb, NULL);
-    callbacks->rpc_decr_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/decr", URI_rpc_decr_cb, NULL);
-    callbacks->rpc_cas_cb     = evhttpx_set_cb(rpc->httpx, "/rpc/cas", URI_rpc_cas_cb, NULL);
-    callbacks->rpc_replace_cb = evhttpx_set_cb(rpc->httpx, "/rpc/replace", URI_rpc_replace_cb, NULL);
+    callbacks->rpc_incr_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/incr", URI_rpc_incr_cb, rpc->committer);
+    callbacks->rpc_decr_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/decr", URI_rpc_decr_cb, rpc->committer);
+    callbacks->rpc_cas_cb     = evhttpx_set_cb(rpc->httpx, "/rpc/cas", URI_rpc_cas_cb, rpc->committer);
+    callbacks->rpc_replace_cb = evhttpx_set_cb(rpc->httpx, "/rpc/replace", URI_rpc_replace_cb, rpc->committer);
 
     /* delete related operations. */
-    callbacks->rpc_del_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/del", URI_rpc_del_cb, NULL);
-    callbacks->rpc_mdel_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/mdel", URI_rpc_mdel_cb, NULL);
-    callbacks->rpc_remove_cb = evhttpx_set_cb(rpc->httpx, "/rpc/remove", URI_rpc_remove_cb, NULL);
+    callbacks->rpc_del_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/del", URI_rpc_del_cb, rpc->committer);
+    callbacks->rpc_mdel_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/mdel", URI_rpc_mdel_cb, rpc->committer);
+    callbacks->rpc_remove_cb = evhttpx_set_cb(rpc->httpx, "/rpc/remove", URI_rpc_remove_cb, rpc);
     callbacks->rpc_clear_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/clear", URI_rpc_clear_cb, NULL);
 
     /* iterator related operations. */
@@ -5086,13 +7198,14 @@ reveldb_rpc_init(reveldb_config_t *config)
     callbacks->rpc_writebatch_put_cb     = evhttpx_set_cb(rpc->httpx, "/rpc/batch/put", URI_rpc_writebatch_put_cb, NULL);
     callbacks->rpc_writebatch_delete_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/batch/del", URI_rpc_writebatch_del_cb, NULL);
     callbacks->rpc_writebatch_clear_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/batch/clear", URI_rpc_writebatch_clear_cb, NULL);
-    callbacks->rpc_writebatch_commit_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/batch/commit", URI_rpc_writebatch_commit_cb, NULL);
+    callbacks->rpc_writebatch_commit_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/batch/commit", URI_rpc_writebatch_commit_cb, rpc->committer);
     callbacks->rpc_writebatch_destroy_cb = evhttpx_set_cb(rpc->httpx, "/rpc/batch/destroy", URI_rpc_writebatch_destroy_cb, NULL);
 
     /* miscs operations. */
     callbacks->rpc_sync_cb    = evhttpx_set_cb(rpc->httpx, "/rpc/sync", URI_rpc_sync_cb, NULL);
     callbacks->rpc_check_cb   = evhttpx_set_cb(rpc->httpx, "/rpc/check", URI_rpc_check_cb, NULL);
     callbacks->rpc_exists_cb  = evhttpx_set_cb(rpc->httpx, "/rpc/exists", URI_rpc_exists_cb, NULL);
+    callbacks->rpc_mexists_cb = evhttpx_set_cb(rpc->httpx, "/rpc/mexists", URI_rpc_mexists_cb, NULL);
     callbacks->rpc_version_cb = evhttpx_set_cb(rpc->httpx, "/rpc/version", URI_rpc_version_cb, NULL);
 
     sslcfg->pemfile            = config->ssl_config->key;
@@ -5126,13 +7239,57 @@ reveldb_rpc_run(reveldb_rpc_t *rpc)
 {
     assert(rpc != NULL);
     int i;
+    int rc = 0;
+    bool reuseport = false;
     reveldb_config_t *config = rpc->config;
 
     if (rpc->config->server_config->https == true) {
         evhttpx_ssl_init(rpc->httpx, rpc->sslcfg);
     }
-    // evhttpx_use_threads(rpc->httpx, NULL, 4, NULL);
-    for (i = 0; i < rpc->num_ports; i++) {
+#ifndef EVHTTPX_DISABLE_EVTHR
+    if (config->server_config->threads > 1) {
+        /* evhttpx_use_threads() binds a listener per worker on every
+         * registered port, so the ports go in before the threads do. */
+        if (config->server_config->reuseport == true) {
+            reuseport = true;
+            for (i = 0; i < rpc->num_ports; i++) {
+                if (evhttpx_bind_socket_reuseport(rpc->httpx,
+                            config->server_config->host,
+                            rpc->ports[i],
+                            config->server_config->backlog) < 0) {
+                    LOG_WARN(("SO_REUSEPORT is not usable on %s:%u, "
+                                "falling back to a single listener.",
+                                config->server_config->host, rpc->ports[i]));
+                    reuseport = false;
+                    break;
+                }
+            }
+        }
+        if (reuseport == false) {
+            /* the ports registered before the failing one would keep
+             * the single listener from binding them. */
+            evhttpx_unbind_socket_reuseport(rpc->httpx);
+        }
+        LOG_DEBUG(("serving rpc requests on %u worker threads.",
+                    config->server_config->threads));
+        rc = evhttpx_use_threads(rpc->httpx, NULL,
+                config->server_config->threads, NULL);
+        if (rc < 0 && reuseport == true) {
+            LOG_WARN(("binding the SO_REUSEPORT listeners failed, "
+                        "falling back to a single listener."));
+            evhttpx_unbind_socket_reuseport(rpc->httpx);
+            reuseport = false;
+            rc = evhttpx_use_threads(rpc->httpx, NULL,
+                    config->server_config->threads, NULL);
+        }
+        if (rc < 0) {
+            LOG_ERROR(("starting %u worker threads failed, serving rpc "
+                        "requests on the main loop.",
+                        config->server_config->threads));
+        }
+    }
+#endif
+    for (i = 0; i < rpc->num_ports && reuseport == false; i++) {
         evhttpx_bind_socket(rpc->httpx,
                 config->server_config->host,
                 rpc->ports[i],
@@ -5159,6 +7316,8 @@ reveldb_rpc_stop(reveldb_rpc_t *rpc)
 
     evhttpx_callback_free(rpc->callbacks->rpc_new_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_compact_cb);
+    evhttpx_callback_free(rpc->callbacks->rpc_compact_status_cb);
+    evhttpx_callback_free(rpc->callbacks->rpc_compact_cancel_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_size_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_repair_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_destroy_cb);
@@ -5175,6 +7334,7 @@ reveldb_rpc_stop(reveldb_rpc_t *rpc)
     evhttpx_callback_free(rpc->callbacks->rpc_seize_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_mseize_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_range_cb);
+    evhttpx_callback_free(rpc->callbacks->rpc_prefix_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_regex_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_kregex_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_vregex_cb);
@@ -5218,9 +7378,19 @@ reveldb_rpc_stop(reveldb_rpc_t *rpc)
     evhttpx_callback_free(rpc->callbacks->rpc_sync_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_check_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_exists_cb);
+    evhttpx_callback_free(rpc->callbacks->rpc_mexists_cb);
     evhttpx_callback_free(rpc->callbacks->rpc_version_cb);
 
+    /* queued writes go out and compactions stop before the databases
+     * get closed. */
+    reveldb_compactor_free(rpc->compactor);
+    reveldb_committer_free(rpc->committer);
     evhttpx_free(rpc->httpx);
+    reveldb_executor_free(rpc->executor);
+    /* scans wait for their parts when they are freed. */
+    reveldb_executor_free(rpc->scanner);
+    /* scans that were still streaming gave their patterns back. */
+    reveldb_pattern_cache_free(rpc->patterns);
     event_base_free(rpc->evbase);
     free(rpc->sslcfg);
     free(rpc->callbacks);
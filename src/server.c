@@ -21,6 +21,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include <leveldb/c.h>
 
@@ -34,6 +35,10 @@ struct rb_root dbiter       = RB_ROOT;
 struct rb_root dbsnapshot   = RB_ROOT;
 struct rb_root dbwritebatch = RB_ROOT;
 
+pthread_mutex_t dbiter_lock       = PTHREAD_MUTEX_INITIALIZER;
+pthread_rwlock_t dbsnapshot_lock  = PTHREAD_RWLOCK_INITIALIZER;
+pthread_mutex_t dbwritebatch_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct rb_root reveldb = RB_ROOT;
 
 reveldb_log_t *reveldb_log       = NULL;
@@ -15,12 +15,19 @@
 #ifndef _REVELDB_SERVER_H_
 #define _REVELDB_SERVER_H_
 
+#include <pthread.h>
+
 #include <reveldb/rpc.h>
 
 extern struct rb_root dbiter;
 extern struct rb_root dbsnapshot;
 extern struct rb_root dbwritebatch;
 
+/* locks guarding the trees above when requests run on worker threads. */
+extern pthread_mutex_t dbiter_lock;
+extern pthread_rwlock_t dbsnapshot_lock;
+extern pthread_mutex_t dbwritebatch_lock;
+
 extern struct rb_root reveldb;
 extern reveldb_config_t *reveldb_config;
 
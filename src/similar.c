@@ -0,0 +1,165 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  similar.c
+ *
+ *    Description:  bounded edit distance for the similar scans, computed
+ *                  64 cells of a column at a time after Myers and Hyyro.
+ *
+ * =============================================================================
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "similar.h"
+
+/* strings of up to 64 times that many bytes are measured with their
+ * working vectors on the stack. */
+#define SIMILAR_STACK_WORDS 16
+
+struct reveldb_similar_s_ {
+    int refs; /* the scans measuring with it. */
+    size_t len;
+    size_t nwords; /* 64 bit words a column of the matrix takes. */
+    uint64_t *peq; /* the positions of each byte in the string, whatever
+                      its case, nwords per byte. */
+};
+
+reveldb_similar_t *
+reveldb_similar_new(const char *str, size_t len)
+{
+    reveldb_similar_t *similar = (reveldb_similar_t *)
+        malloc(sizeof(reveldb_similar_t));
+    size_t i = 0;
+
+    if (similar == NULL) return NULL;
+    similar->refs = 1;
+    similar->len = len;
+    similar->nwords = (len + 63) / 64;
+    similar->peq = NULL;
+    if (len == 0) return similar;
+
+    similar->peq = (uint64_t *)calloc(256 * similar->nwords, sizeof(uint64_t));
+    if (similar->peq == NULL) {
+        free(similar);
+        return NULL;
+    }
+    for (i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        uint64_t bit = 1ULL << (i % 64);
+        similar->peq[tolower(c) * similar->nwords + i / 64] |= bit;
+        similar->peq[toupper(c) * similar->nwords + i / 64] |= bit;
+    }
+    return similar;
+}
+
+reveldb_similar_t *
+reveldb_similar_retain(reveldb_similar_t *similar)
+{
+    __sync_add_and_fetch(&similar->refs, 1);
+    return similar;
+}
+
+/* the column of the matrix is kept as the signs of its vertical deltas,
+ * pv and mv, and text goes through it a byte at a time, the words of the
+ * column added and shifted as one integer. a bit of d0 is set where the
+ * diagonal delta is 0, a transposition making it so when the byte and
+ * the previous one match the other way round. */
+size_t
+reveldb_similar_distance(const reveldb_similar_t *similar,
+        const char *text, size_t len, size_t max)
+{
+    uint64_t stack[4 * SIMILAR_STACK_WORDS];
+    uint64_t *vectors = stack;
+    uint64_t *pv = NULL;
+    uint64_t *mv = NULL;
+    uint64_t *d0 = NULL;
+    uint64_t *eqs = NULL; /* the bytes matching the previous one of text. */
+    uint64_t last = 0;
+    size_t nwords = similar->nwords;
+    size_t score = similar->len;
+    size_t i = 0;
+    size_t w = 0;
+
+    /* as many edits at least as the lengths differ. */
+    if (((len > similar->len) ? len - similar->len : similar->len - len) > max) {
+        return max + 1;
+    }
+    if (similar->len == 0) return len;
+    if (len == 0) return similar->len;
+
+    if (nwords > SIMILAR_STACK_WORDS) {
+        vectors = (uint64_t *)malloc(4 * nwords * sizeof(uint64_t));
+        if (vectors == NULL) return max + 1;
+    }
+    pv = vectors;
+    mv = pv + nwords;
+    d0 = mv + nwords;
+    eqs = d0 + nwords;
+    for (w = 0; w < nwords; w++) {
+        pv[w] = ~0ULL;
+        mv[w] = 0;
+        d0[w] = 0;
+        eqs[w] = 0;
+    }
+    last = 1ULL << ((similar->len - 1) % 64);
+
+    for (i = 0; i < len; i++) {
+        const uint64_t *peq = similar->peq + (unsigned char)text[i] * nwords;
+        uint64_t carry = 0;
+        uint64_t hp_in = 1; /* the first row goes up by one per byte. */
+        uint64_t hn_in = 0;
+        uint64_t tr_in = 0;
+
+        for (w = 0; w < nwords; w++) {
+            uint64_t eq = peq[w];
+            uint64_t swap = ~d0[w] & eq;
+            uint64_t tr = ((swap << 1) | tr_in) & eqs[w];
+            uint64_t sum = (eq & pv[w]) + carry;
+            uint64_t d = 0;
+            uint64_t hp = 0;
+            uint64_t hn = 0;
+
+            carry = (sum < carry);
+            sum += pv[w];
+            carry |= (sum < pv[w]);
+            d = (sum ^ pv[w]) | eq | mv[w] | tr;
+            hp = mv[w] | ~(d | pv[w]);
+            hn = d & pv[w];
+            if (w == nwords - 1) {
+                if (hp & last) score++;
+                else if (hn & last) score--;
+            }
+
+            tr_in = swap >> 63;
+            d0[w] = d;
+            eqs[w] = eq;
+            swap = hp >> 63;
+            hp = (hp << 1) | hp_in;
+            hp_in = swap;
+            swap = hn >> 63;
+            hn = (hn << 1) | hn_in;
+            hn_in = swap;
+            pv[w] = hn | ~(d | hp);
+            mv[w] = hp & d;
+        }
+
+        /* each byte left changes the distance by one at most. */
+        if (score > max + (len - i - 1)) break;
+    }
+
+    if (vectors != stack) free(vectors);
+    return (score > max) ? max + 1 : score;
+}
+
+void
+reveldb_similar_free(reveldb_similar_t *similar)
+{
+    if (similar == NULL) return;
+    if (__sync_sub_and_fetch(&similar->refs, 1) > 0) return;
+    free(similar->peq);
+    free(similar);
+}
@@ -0,0 +1,36 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  similar.h
+ *
+ *    Description:  bounded edit distance for the similar scans.
+ *
+ * =============================================================================
+ */
+#ifndef _REVELDB_SIMILAR_H_
+#define _REVELDB_SIMILAR_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct reveldb_similar_s_ reveldb_similar_t;
+
+/* prepares str to be measured against many strings. NULL if there is no
+ * memory left. */
+extern reveldb_similar_t * reveldb_similar_new(const char *str, size_t len);
+
+/* shares similar with a scan walking alongside the one using it, each
+ * of them freeing it once done. */
+extern reveldb_similar_t * reveldb_similar_retain(reveldb_similar_t *similar);
+
+/* the number of edits turning text into the string of similar: letters
+ * inserted, deleted or replaced, or two adjacent ones swapped, their case
+ * left aside. max + 1 as soon as it is known to be past max. similar is
+ * only read, any number of threads can measure with it at once. */
+extern size_t reveldb_similar_distance(const reveldb_similar_t *similar,
+        const char *text, size_t len, size_t max);
+
+/* frees similar once the last scan sharing it is done with it. */
+extern void reveldb_similar_free(reveldb_similar_t *similar);
+
+#endif /* _REVELDB_SIMILAR_H_ */
@@ -32,6 +32,7 @@ xleveldb_init_snapshot(const char *uuid, reveldb_t *reveldb)
     memset(snapshot, 0, (sizeof(xleveldb_snapshot_t) + uuid_len + 1));
     snapshot->uuid = (char *)snapshot + sizeof(xleveldb_snapshot_t);
     memcpy(snapshot->uuid, uuid, uuid_len);
+    reveldb_retain_db(reveldb);
     snapshot->reveldb = reveldb;
     snapshot->snapshot = leveldb_create_snapshot(reveldb->instance->db);
     return snapshot;
@@ -97,6 +98,7 @@ xleveldb_free_snapshot(xleveldb_snapshot_t *snapshot)
                     snapshot->snapshot);
             snapshot->snapshot = NULL;
         }
+        reveldb_release_db(snapshot->reveldb);
         free(snapshot);
     }
 }
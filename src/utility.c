@@ -207,18 +207,24 @@ safe_urldecode(const char *url)
 }
 
 char *
-gmttime_now()
+gmttime_now_r(char *buf, size_t len)
 {
 	time_t now;
-	struct tm *gmt;
-	char *time_val;
+	struct tm gmt;
 
 	time(&now);
-	gmt = gmtime(&now);
+	gmtime_r(&now, &gmt);
+
+	memset(buf, '\0', len);
+	strftime(buf, len, "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+	return buf;
+}
 
-	time_val = (char *)malloc(sizeof(char) * 64);
-	memset(time_val, '\0', 64);
+char *
+gmttime_now()
+{
+	char *time_val;
 
-	strftime(time_val, 64, "%a, %d %b %Y %H:%M:%S GMT", gmt);
-	return time_val;
+	time_val = (char *)malloc(sizeof(char) * GMTTIME_LEN);
+	return gmttime_now_r(time_val, GMTTIME_LEN);
 }
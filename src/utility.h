@@ -18,6 +18,7 @@
 #define _REVELDB_UTILITY_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /*
  * Wrappers around strtoull/strtoll that are safer and easier to
@@ -36,8 +37,11 @@ bool safe_strtol(const char *str, int32_t * out);
 char * safe_urldecode(const char *url);
 
 /*
- * Get GMT formatted time.
+ * Get GMT formatted time, gmttime_now_r() formats into buf which should
+ * hold GMTTIME_LEN bytes.
  */
+#define GMTTIME_LEN 64
 char * gmttime_now(void);
+char * gmttime_now_r(char *buf, size_t len);
 
 #endif // _REVELDB_UTILITY_H_
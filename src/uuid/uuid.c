@@ -61,6 +61,7 @@
 
 #include <fcntl.h>
 #include <ifaddrs.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -73,6 +74,7 @@ static uint32_t seq_num;
 static struct timeval last_time;
 static int32_t counter;
 static char nodeaddr[6];
+static pthread_mutex_t uuid_lock = PTHREAD_MUTEX_INITIALIZER;
 
 enum { UUID_NODE_MULTICAST = 0x80 };
 
@@ -156,6 +158,9 @@ uuid_create(afsUUID * uuid)
     int ret, got_time;
     uint64_t dce_time;
 
+    /* generator state is shared by all request threads. */
+    pthread_mutex_lock(&uuid_lock);
+
     if (uuid_inited == 0) {
         gettimeofday(&last_time, NULL);
         seq_num = arc4random();
@@ -216,6 +221,8 @@ uuid_create(afsUUID * uuid)
     uuid->clock_seq_hi_and_reserved |= 0x80;    /* dce variant */
 
     memcpy(uuid->node, nodeaddr, 6);
+
+    pthread_mutex_unlock(&uuid_lock);
 }
 
 /*
@@ -31,8 +31,11 @@ xleveldb_init_writebatch(const char *uuid, reveldb_t *reveldb)
     memset(writebatch, 0, (sizeof(xleveldb_writebatch_t) + uuid_len + 1));
     writebatch->uuid = (char *)writebatch + sizeof(xleveldb_writebatch_t);
     memcpy(writebatch->uuid, uuid, uuid_len);
+    reveldb_retain_db(reveldb);
     writebatch->reveldb = reveldb;
     writebatch->writebatch = leveldb_writebatch_create();
+    pthread_mutex_init(&writebatch->lock, NULL);
+    writebatch->refs = 1;
     return writebatch;
 }
 
@@ -97,6 +100,8 @@ xleveldb_free_writebatch(xleveldb_writebatch_t *writebatch)
             leveldb_writebatch_destroy(writebatch->writebatch);
             writebatch->writebatch = NULL;
         }
+        reveldb_release_db(writebatch->reveldb);
+        pthread_mutex_destroy(&writebatch->lock);
         free(writebatch);
     }
 }
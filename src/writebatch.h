@@ -14,6 +14,8 @@
  */
 #ifndef _XLEVELDB_WRITEBATCH_H_
 #define _XLEVELDB_WRITEBATCH_H_
+#include <pthread.h>
+
 #include <reveldb/reveldb.h>
 
 struct rb_node;
@@ -24,6 +26,10 @@ struct xleveldb_writebatch_s_ {
     char *uuid;
     leveldb_writebatch_t *writebatch;
     reveldb_t *reveldb;
+    /* held while a request fills or commits the batch. */
+    pthread_mutex_t lock;
+    /* the registry and every request using it, under the registry lock. */
+    unsigned int refs;
     struct rb_node node;
 };
 
@@ -236,6 +236,68 @@ _xconfig_init_internal_config(const char *config)
         iter = cJSON_GetObjectItem(server, "backlog");
         server_config->backlog = iter->valueint;
 
+        /* optional, requests are served on the main loop by default. */
+        iter = cJSON_GetObjectItem(server, "threads");
+        server_config->threads = (iter != NULL && iter->valueint > 0) ?
+            iter->valueint : 1;
+
+        /* optional, a single listener hands connections to the workers by default. */
+        iter = cJSON_GetObjectItem(server, "reuseport");
+        server_config->reuseport =
+            (iter != NULL && iter->valueint == 1) ? true : false;
+
+        /* optional, storage jobs run on the event loops by default. */
+        iter = cJSON_GetObjectItem(server, "storage_threads");
+        server_config->storage_threads = (iter != NULL && iter->valueint > 0) ?
+            iter->valueint : 0;
+
+        /* optional, pipelined requests are not limited by default. */
+        iter = cJSON_GetObjectItem(server, "max_pipelined_requests");
+        server_config->max_pipelined_requests =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
+        /* optional, 0 lets the executor pick its default. */
+        iter = cJSON_GetObjectItem(server, "stream_high_watermark");
+        server_config->stream_high_watermark =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
+        /* optional, 0 lets the committer pick its default. */
+        iter = cJSON_GetObjectItem(server, "group_commit_max_batch");
+        server_config->group_commit_max_batch =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
+        /* optional, batches do not wait for more writes by default. */
+        iter = cJSON_GetObjectItem(server, "group_commit_max_wait");
+        server_config->group_commit_max_wait =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
+        /* optional, 0 lets the committer pick its default. */
+        iter = cJSON_GetObjectItem(server, "commit_threads");
+        server_config->commit_threads =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
+        /* optional, compactions are not throttled by default. */
+        iter = cJSON_GetObjectItem(server, "compaction_rate");
+        server_config->compaction_rate =
+            (iter != NULL && iter->valuedouble > 0) ?
+            (uint64_t)iter->valuedouble : 0;
+
+        /* optional, 0 lets the compactor pick its default. */
+        iter = cJSON_GetObjectItem(server, "compaction_range_size");
+        server_config->compaction_range_size =
+            (iter != NULL && iter->valuedouble > 0) ?
+            (uint64_t)iter->valuedouble : 0;
+
+        /* optional, 0 lets the pattern cache pick its default. */
+        iter = cJSON_GetObjectItem(server, "pattern_cache_size");
+        server_config->pattern_cache_size =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
+        /* optional, 0 means scans are not partitioned. */
+        iter = cJSON_GetObjectItem(server, "scan_threads");
+        server_config->scan_threads =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
         iter = cJSON_GetObjectItem(server, "username");
         config_vlen = strlen(iter->valuestring);
         server_config->username =
@@ -278,8 +340,15 @@ _xconfig_init_internal_config(const char *config)
         strncpy(db_config->dbname, iter->valuestring, config_vlen);
         config_vlen = -1;
 
+        /* valueint is an int, take the double for budgets past 2GB. */
         iter = cJSON_GetObjectItem(db, "lru_cache_size");
-        db_config->lru_cache_size = iter->valueint;
+        db_config->lru_cache_size = (iter->valuedouble > 0) ?
+            (uint64_t)iter->valuedouble : 0;
+
+        /* optional, the value cache is off by default. */
+        iter = cJSON_GetObjectItem(db, "value_cache_size");
+        db_config->value_cache_size = (iter != NULL && iter->valuedouble > 0) ?
+            (uint64_t)iter->valuedouble : 0;
 
         iter = cJSON_GetObjectItem(db, "create_if_missing");
         db_config->create_if_missing =
@@ -303,6 +372,26 @@ _xconfig_init_internal_config(const char *config)
         iter = cJSON_GetObjectItem(db, "block_restart_interval");
         db_config->block_restart_interval = iter->valueint;
 
+        /* optional, filters are off by default. */
+        iter = cJSON_GetObjectItem(db, "bloom_bits_per_key");
+        db_config->bloom_bits_per_key =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
+        /* optional, mget does point lookups only by default. */
+        iter = cJSON_GetObjectItem(db, "sorted_mget_threshold");
+        db_config->sorted_mget_threshold =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
+        /* optional, databases are not sharded by default. */
+        iter = cJSON_GetObjectItem(db, "shards");
+        db_config->shards =
+            (iter != NULL && iter->valueint > 0) ? iter->valueint : 0;
+
+        /* optional, keys are ordered bytewise by default. */
+        iter = cJSON_GetObjectItem(db, "comparator");
+        db_config->comparator = (iter != NULL && iter->valuestring != NULL) ?
+            strdup(iter->valuestring) : NULL;
+
         iter = cJSON_GetObjectItem(db, "compression");
         db_config->compression = (iter->valueint == 1) ? true : false;
 
@@ -441,6 +530,10 @@ reveldb_config_fini(reveldb_config_t * config)
             free(config->db_config->dbname);
             config->db_config->dbname = NULL;
         }
+        if (config->db_config->comparator != NULL) {
+            free(config->db_config->comparator);
+            config->db_config->comparator = NULL;
+        }
         free(config->db_config);
     }
 